@@ -1,10 +1,13 @@
 /*
 Author: Ricky Da Silva Marques
 Date: 8/04/2024
-Description: BMI088 driver for ESP32-S3 using BMI08X library from Bosch Sensortec
+Description: BMI088 driver for ESP32-S3 using BMI08X library from Bosch Sensortec, on bean_hal so it also runs on the
+host against the simulated BMI088 (tools/sensor_bench)
 */
 
 #include "bean_imu.h"
+#include "bean_hal.h"
+#include "bean_metrics.h"
 
 static float lsb_to_mps2(int16_t val, float g_range, uint8_t bit_width);
 static float lsb_to_dps(int16_t val, float dps, uint8_t bit_width);
@@ -27,6 +30,8 @@ uint8_t gyr_dev_addr = BMI088_GYR_I2C_ADDR;
 uint8_t accel_range = 0;
 uint16_t gyro_range = 0;
 
+static bool feature_engine_loaded = false;
+
 static BMI08_INTF_RET_TYPE i2c_write_registers(uint8_t reg_addr, const uint8_t *reg_data, uint32_t len, void *intf_ptr)
 {
     uint8_t *buf = (uint8_t *)malloc(len + 1);
@@ -34,12 +39,13 @@ static BMI08_INTF_RET_TYPE i2c_write_registers(uint8_t reg_addr, const uint8_t *
     memcpy(buf + 1, reg_data, len);
     uint8_t dev_addr = *(uint8_t *)intf_ptr;
 
-    esp_err_t ret = i2c_master_write_to_device(I2C_NUM_0, dev_addr, buf, len + 1, pdMS_TO_TICKS(1000));
+    esp_err_t ret = bean_hal_i2c_write(dev_addr, buf, len + 1, 1000);
     free(buf);
 
     if (ret != ESP_OK)
     {
-        ESP_LOGE(TAG, "I2C write error");
+        BEAN_LOGE(TAG, "I2C write error");
+        bean_metrics_add(BEAN_METRIC_I2C_ERRORS, 1);
         return BMI08_E_COM_FAIL;
     }
     return BMI08_INTF_RET_SUCCESS;
@@ -49,11 +55,12 @@ static BMI08_INTF_RET_TYPE i2c_read_registers(uint8_t reg_addr, uint8_t *reg_dat
 {
     uint8_t dev_addr = *(uint8_t *)intf_ptr;
 
-    esp_err_t ret = i2c_master_write_read_device(I2C_NUM_0, dev_addr, &reg_addr, 1, reg_data, len, pdMS_TO_TICKS(1000));
+    esp_err_t ret = bean_hal_i2c_write_read(dev_addr, &reg_addr, 1, reg_data, len, 1000);
 
     if (ret != ESP_OK)
     {
-        ESP_LOGE(TAG, "I2C write error");
+        BEAN_LOGE(TAG, "I2C write error");
+        bean_metrics_add(BEAN_METRIC_I2C_ERRORS, 1);
         return BMI08_E_COM_FAIL;
     }
     return BMI08_INTF_RET_SUCCESS;
@@ -61,7 +68,7 @@ static BMI08_INTF_RET_TYPE i2c_read_registers(uint8_t reg_addr, uint8_t *reg_dat
 
 static void delay_us(uint32_t period, void *intf_ptr)
 {
-    ets_delay_us(period);
+    bean_hal_delay_us(period);
 }
 
 esp_err_t bean_imu_init()
@@ -92,14 +99,14 @@ esp_err_t bean_imu_init()
     int8_t rslt = bmi088_mma_init(sensor); //accel init
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 accel init error");
+        BEAN_LOGE(TAG, "BMI088 accel init error");
         return ESP_FAIL;
     }
 
     rslt = bmi08g_init(sensor); //gyro init
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 gyro init error");
+        BEAN_LOGE(TAG, "BMI088 gyro init error");
         return ESP_FAIL;
     }
     for (int i = 0; i < 10; i++)
@@ -109,11 +116,11 @@ esp_err_t bean_imu_init()
         {
             break;
         }
-        vTaskDelay(pdMS_TO_TICKS(100));
+        bean_hal_delay_ms(100);
     }
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 accel soft reset error");
+        BEAN_LOGE(TAG, "BMI088 accel soft reset error");
         return ESP_FAIL;
     }
 
@@ -121,14 +128,14 @@ esp_err_t bean_imu_init()
     rslt                    = bmi08a_set_power_mode(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 accel set power mode error");
+        BEAN_LOGE(TAG, "BMI088 accel set power mode error");
         return ESP_FAIL;
     }
     sensor->gyro_cfg.power = BMI08_GYRO_PM_NORMAL;
     rslt                   = bmi08g_set_power_mode(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 gyro set power mode error");
+        BEAN_LOGE(TAG, "BMI088 gyro set power mode error");
         return ESP_FAIL;
     }
 
@@ -141,14 +148,14 @@ esp_err_t bean_imu_init()
     rslt = bmi08a_set_power_mode(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 accel set power mode error");
+        BEAN_LOGE(TAG, "BMI088 accel set power mode error");
         return ESP_FAIL;
     }
 
     rslt = bmi088_mma_set_meas_conf(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 accel set meas conf error");
+        BEAN_LOGE(TAG, "BMI088 accel set meas conf error");
         return ESP_FAIL;
     }
 
@@ -161,18 +168,18 @@ esp_err_t bean_imu_init()
     rslt = bmi08g_set_power_mode(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 gyro set power mode error");
+        BEAN_LOGE(TAG, "BMI088 gyro set power mode error");
         return ESP_FAIL;
     }
 
     rslt = bmi08g_set_meas_conf(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 gyro set power mode error");
+        BEAN_LOGE(TAG, "BMI088 gyro set power mode error");
         return ESP_FAIL;
     }
 
-    ESP_LOGI(TAG, "BMI088 init success!");
+    BEAN_LOGI(TAG, "BMI088 init success!");
     return ESP_OK;
 }
 
@@ -182,7 +189,7 @@ esp_err_t set_accel_odr(uint8_t odr)
     int8_t rslt           = bmi088_mma_set_meas_conf(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 accel set odr error");
+        BEAN_LOGE(TAG, "BMI088 accel set odr error");
         return ESP_FAIL;
     }
     return ESP_OK;
@@ -209,14 +216,14 @@ esp_err_t set_accel_range(uint8_t range)
     }
     else
     {
-        ESP_LOGE(TAG, "BMI088 accel range not valid");
+        BEAN_LOGE(TAG, "BMI088 accel range not valid");
         return ESP_FAIL;
     }
 
     int8_t rslt = bmi088_mma_set_meas_conf(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 accel set range error");
+        BEAN_LOGE(TAG, "BMI088 accel set range error");
         return ESP_FAIL;
     }
     return ESP_OK;
@@ -228,7 +235,7 @@ esp_err_t set_accel_bw(uint8_t bw)
     int8_t rslt          = bmi088_mma_set_meas_conf(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 accel set bw error");
+        BEAN_LOGE(TAG, "BMI088 accel set bw error");
         return ESP_FAIL;
     }
     return ESP_OK;
@@ -240,7 +247,7 @@ esp_err_t set_accel_power_mode(uint8_t power_mode)
     int8_t rslt             = bmi08a_set_power_mode(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 accel set power mode error");
+        BEAN_LOGE(TAG, "BMI088 accel set power mode error");
         return ESP_FAIL;
     }
     return ESP_OK;
@@ -252,7 +259,7 @@ esp_err_t set_gyro_odr(uint8_t odr)
     int8_t rslt          = bmi08g_set_meas_conf(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 gyro set odr error");
+        BEAN_LOGE(TAG, "BMI088 gyro set odr error");
         return ESP_FAIL;
     }
     return ESP_OK;
@@ -279,13 +286,13 @@ esp_err_t set_gyro_range(uint8_t range)
     }
     else
     {
-        ESP_LOGE(TAG, "BMI088 gyro range not valid");
+        BEAN_LOGE(TAG, "BMI088 gyro range not valid");
         return ESP_FAIL;
     }
     int8_t rslt = bmi08g_set_meas_conf(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 gyro set range error");
+        BEAN_LOGE(TAG, "BMI088 gyro set range error");
         return ESP_FAIL;
     }
     return ESP_OK;
@@ -297,7 +304,7 @@ esp_err_t set_gyro_bw(uint8_t bw)
     int8_t rslt         = bmi08g_set_meas_conf(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 gyro set bw error");
+        BEAN_LOGE(TAG, "BMI088 gyro set bw error");
         return ESP_FAIL;
     }
     return ESP_OK;
@@ -309,7 +316,166 @@ esp_err_t set_gyro_power_mode(uint8_t power_mode)
     int8_t rslt            = bmi08g_set_power_mode(sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 gyro set power mode error");
+        BEAN_LOGE(TAG, "BMI088 gyro set power mode error");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+/*!
+ * @brief Uploads the feature engine config stream, needed once before any of the motion features can be used.
+ * Takes a few hundred ms on the I2C bus, so it is only done when a feature is requested.
+ */
+static esp_err_t load_feature_engine(void)
+{
+    if (feature_engine_loaded)
+        return ESP_OK;
+
+    int8_t rslt = bmi08a_load_config_file(sensor);
+    if (rslt != BMI08_OK)
+    {
+        BEAN_LOGE(TAG, "BMI088 feature engine load error %d", rslt);
+        return ESP_FAIL;
+    }
+    feature_engine_loaded = true;
+    return ESP_OK;
+}
+
+esp_err_t bean_imu_enable_no_motion(float threshold_ms2, uint32_t duration_ms)
+{
+    if (load_feature_engine() != ESP_OK)
+        return ESP_FAIL;
+
+    // Threshold is in 5.11 format g, the duration counts 20 ms steps of the feature engine
+    uint32_t threshold = (uint32_t)(threshold_ms2 / GRAVITY_EARTH * 2048.0f);
+    uint32_t duration  = duration_ms / 20;
+
+    struct bmi088_mm_no_motion_cfg no_motion_cfg = {
+        .threshold = threshold > 0x7FF ? 0x7FF : threshold,
+        .duration  = duration > 0x1FFF ? 0x1FFF : duration,
+        .select_x  = BMI08_ENABLE,
+        .select_y  = BMI08_ENABLE,
+        .select_z  = BMI08_ENABLE,
+        .enable    = BMI08_ENABLE,
+    };
+    int8_t rslt = bmi088_mma_set_no_motion_config(&no_motion_cfg, sensor);
+    if (rslt != BMI08_OK)
+    {
+        BEAN_LOGE(TAG, "BMI088 set no-motion config error");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t bean_imu_enable_high_g(float threshold_ms2, float hysteresis_ms2, uint32_t duration_ms)
+{
+    if (load_feature_engine() != ESP_OK)
+        return ESP_FAIL;
+
+    // Threshold and hysteresis are in 5.11 format g, the duration counts 2.5 ms steps of the feature engine
+    uint32_t threshold  = (uint32_t)(threshold_ms2 / GRAVITY_EARTH * 2048.0f);
+    uint32_t hysteresis = (uint32_t)(hysteresis_ms2 / GRAVITY_EARTH * 2048.0f);
+    uint32_t duration   = duration_ms * 2 / 5;
+
+    struct bmi088_mm_high_g_cfg high_g_cfg = {
+        .threshold  = threshold > 0x7FFF ? 0x7FFF : threshold,
+        .hysteresis = hysteresis > 0xFFF ? 0xFFF : hysteresis,
+        .select_x   = BMI08_ENABLE,
+        .select_y   = BMI08_ENABLE,
+        .select_z   = BMI08_ENABLE,
+        .enable     = BMI08_ENABLE,
+        .duration   = duration > 0xFFF ? 0xFFF : duration,
+    };
+    int8_t rslt = bmi088_mma_set_high_g_config(&high_g_cfg, sensor);
+    if (rslt != BMI08_OK)
+    {
+        BEAN_LOGE(TAG, "BMI088 set high-g config error");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t bean_imu_enable_any_motion(float threshold_ms2, uint32_t duration_ms)
+{
+    if (load_feature_engine() != ESP_OK)
+        return ESP_FAIL;
+
+    // Same formats as the no-motion feature: 5.11 format g, 20 ms steps
+    uint32_t threshold = (uint32_t)(threshold_ms2 / GRAVITY_EARTH * 2048.0f);
+    uint32_t duration  = duration_ms / 20;
+
+    struct bmi088_mm_anymotion_cfg anymotion_cfg = {
+        .threshold = threshold > 0x7FF ? 0x7FF : threshold,
+        .enable    = BMI08_ENABLE,
+        .duration  = duration > 0x1FFF ? 0x1FFF : duration,
+        .x_en      = BMI08_ENABLE,
+        .y_en      = BMI08_ENABLE,
+        .z_en      = BMI08_ENABLE,
+    };
+    int8_t rslt = bmi088_mma_configure_anymotion(anymotion_cfg, sensor);
+    if (rslt != BMI08_OK)
+    {
+        BEAN_LOGE(TAG, "BMI088 set any-motion config error");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t route_feature_int(enum bmi088_mm_accel_int_types feature, uint8_t int_pin)
+{
+    struct bmi08_accel_int_channel_cfg int_cfg = {
+        .int_channel = int_pin == 2 ? BMI08_INT_CHANNEL_2 : BMI08_INT_CHANNEL_1,
+        .int_pin_cfg = { .lvl            = BMI08_INT_ACTIVE_HIGH,
+                         .output_mode    = BMI08_INT_MODE_PUSH_PULL,
+                         .enable_int_pin = BMI08_ENABLE },
+    };
+    int8_t rslt = bmi088_mma_set_int_config(&int_cfg, feature, sensor);
+    if (rslt != BMI08_OK)
+    {
+        BEAN_LOGE(TAG, "BMI088 set interrupt %d error", feature);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t bean_imu_route_high_g_int(uint8_t int_pin)
+{
+    return route_feature_int(BMI088_MM_HIGH_G_INT, int_pin);
+}
+
+esp_err_t bean_imu_route_any_motion_int(uint8_t int_pin)
+{
+    if (route_feature_int(BMI088_MM_ANYMOTION_INT, int_pin) != ESP_OK)
+        return ESP_FAIL;
+
+    // Held until the status is read, a deep sleeping ESP only sees the level
+    uint8_t latch = BMI08_ENABLE;
+    int8_t rslt   = bmi08a_set_regs(BMI08_REG_ACCEL_INT_LATCH_CONF, &latch, 1, sensor);
+    if (rslt != BMI08_OK)
+    {
+        BEAN_LOGE(TAG, "BMI088 set interrupt latch error");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t bean_imu_get_high_g_output(struct bmi088_mm_high_g_out *output)
+{
+    int8_t rslt = bmi088_mma_get_high_g_output(output, sensor);
+    if (rslt != BMI08_OK)
+    {
+        BEAN_LOGE(TAG, "BMI088 get high-g output error");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t bean_imu_get_feature_status(uint8_t *status)
+{
+    int8_t rslt = bmi088_mma_get_feat_int_status(status, sensor);
+    if (rslt != BMI08_OK)
+    {
+        BEAN_LOGE(TAG, "BMI088 get feature status error");
         return ESP_FAIL;
     }
     return ESP_OK;
@@ -348,14 +514,14 @@ esp_err_t bean_imu_update_accel()
     //set_accel_power_mode(BMI08_ACCEL_PM_ACTIVE);
     if (accel_range == 0)
     {
-        ESP_LOGE(TAG, "BMI088 accel range not set, cant measure yet");
+        BEAN_LOGE(TAG, "BMI088 accel range not set, cant measure yet");
         return ESP_FAIL;
     }
 
     int8_t rslt = bmi088_mma_get_data(accel_data, sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 accel update accel data error");
+        BEAN_LOGE(TAG, "BMI088 accel update accel data error");
         return ESP_FAIL;
     }
 
@@ -373,7 +539,7 @@ esp_err_t bean_imu_update_gyro()
     int8_t rslt = bmi08g_get_data(gyro_data, sensor);
     if (rslt != BMI08_OK)
     {
-        ESP_LOGE(TAG, "BMI088 gyro get data error");
+        BEAN_LOGE(TAG, "BMI088 gyro get data error");
         return ESP_FAIL;
     }
 
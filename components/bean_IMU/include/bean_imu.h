@@ -1,12 +1,11 @@
 #pragma once
-#include "esp_types.h"
-#include "driver/i2c.h"
-#include "esp_log.h"
-#include "bmi08x.h"
-#include "rom/ets_sys.h"
 #include <math.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include "esp_err.h"
+#include "bmi08x.h"
 #include "bmi088_mm.h"
 
 #define BMI088_ACC_I2C_ADDR BMI08_ACCEL_I2C_ADDR_PRIMARY
@@ -83,6 +82,75 @@ esp_err_t set_gyro_bw(uint8_t bw);
  */
 esp_err_t set_gyro_power_mode(uint8_t power_mode);
 
+/**
+ * @brief Enables the no-motion feature of the accelerometer.
+ *
+ * Loads the feature engine on first use.
+ *
+ * @param threshold_ms2 Max change of acceleration per axis that still counts as no motion.
+ * @param duration_ms Time without motion before the feature fires, in 20 ms steps.
+ * @return esp_err_t Returns ESP_OK if the setting is successful, otherwise an error code.
+ */
+esp_err_t bean_imu_enable_no_motion(float threshold_ms2, uint32_t duration_ms);
+
+/**
+ * @brief Enables the high-g feature of the accelerometer on all axes.
+ *
+ * Loads the feature engine on first use. The threshold is limited to 16 g by the feature engine.
+ *
+ * @param threshold_ms2 Acceleration on any axis above which the feature fires.
+ * @param hysteresis_ms2 Drop below the threshold needed before it can fire again.
+ * @param duration_ms Time the threshold has to be exceeded, in 2.5 ms steps.
+ * @return esp_err_t Returns ESP_OK if the setting is successful, otherwise an error code.
+ */
+esp_err_t bean_imu_enable_high_g(float threshold_ms2, float hysteresis_ms2, uint32_t duration_ms);
+
+/**
+ * @brief Routes the high-g feature to an accelerometer interrupt pin (push-pull, active high).
+ *
+ * @param int_pin 1 for INT1, 2 for INT2.
+ * @return esp_err_t Returns ESP_OK if the setting is successful, otherwise an error code.
+ */
+esp_err_t bean_imu_route_high_g_int(uint8_t int_pin);
+
+/**
+ * @brief Enables the any-motion feature of the accelerometer on all axes.
+ *
+ * Loads the feature engine on first use.
+ *
+ * @param threshold_ms2 Change of acceleration on any axis that counts as motion, at most about 1 g.
+ * @param duration_ms Time the motion has to last, in 20 ms steps.
+ * @return esp_err_t Returns ESP_OK if the setting is successful, otherwise an error code.
+ */
+esp_err_t bean_imu_enable_any_motion(float threshold_ms2, uint32_t duration_ms);
+
+/**
+ * @brief Routes the any-motion feature to an accelerometer interrupt pin (push-pull, active high, latched).
+ *
+ * The interrupt stays high until the feature status is read, so it can wake an ESP in deep sleep. The latch holds
+ * for every interrupt of the accelerometer until the next soft reset.
+ *
+ * @param int_pin 1 for INT1, 2 for INT2.
+ * @return esp_err_t Returns ESP_OK if the setting is successful, otherwise an error code.
+ */
+esp_err_t bean_imu_route_any_motion_int(uint8_t int_pin);
+
+/**
+ * @brief Reads the axis and direction of the last high-g event.
+ *
+ * @param output Gets the high-g output.
+ * @return esp_err_t Returns ESP_OK if the read is successful, otherwise an error code.
+ */
+esp_err_t bean_imu_get_high_g_output(struct bmi088_mm_high_g_out *output);
+
+/**
+ * @brief Reads the feature interrupt status (BMI088_MM_ACCEL_*_INT bits).
+ *
+ * @param status Gets the status register.
+ * @return esp_err_t Returns ESP_OK if the read is successful, otherwise an error code.
+ */
+esp_err_t bean_imu_get_feature_status(uint8_t *status);
+
 /**
  * @brief Updates the accelerometer data.
  *
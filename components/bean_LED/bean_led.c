@@ -1,9 +1,16 @@
 #include "bean_led.h"
+#include <string.h>
 #include "esp_check.h"
 #include "driver/gpio.h"
 #include "driver/ledc.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
 #include "gamma.h"
+#include "bean_bits.h"
 #include "bean_context.h"
+#include "bean_flight.h"
+#include "bean_power.h"
 
 static char tag[] = "leds";
 
@@ -21,6 +28,46 @@ const ledc_channel_t LEDC_CHANNEL_RED2   = LEDC_CHANNEL_3;
 const ledc_channel_t LEDC_CHANNEL_GREEN2 = LEDC_CHANNEL_4;
 const ledc_channel_t LEDC_CHANNEL_BLUE2  = LEDC_CHANNEL_5;
 
+// Red, green and blue of L1 and L2
+static const ledc_channel_t led_channels[2][3] = {
+    { LEDC_CHANNEL_0, LEDC_CHANNEL_1, LEDC_CHANNEL_2 },
+    { LEDC_CHANNEL_3, LEDC_CHANNEL_4, LEDC_CHANNEL_5 },
+};
+
+typedef struct led_look
+{
+    led_color_rgb_t color;
+    led_pattern_kind_t pattern;
+} led_look_t;
+
+typedef struct led_command
+{
+    led_select_t led;
+    bool release;
+    led_look_t look;
+    uint32_t duration_ms;
+} led_command_t;
+
+// What one LED is playing
+typedef struct led_track
+{
+    bool playing;
+    led_look_t look;
+    led_step_t steps[LED_PATTERN_MAX_STEPS];
+    uint8_t count;
+    uint8_t index;
+    TickType_t step_start;
+    TickType_t step_ticks; // 0 holds the step forever
+
+    bool overridden; // Set by bean_led_show(), the LED function is ignored until it ends
+    led_look_t override;
+    TickType_t override_start;
+    TickType_t override_ticks; // 0 until released
+} led_track_t;
+
+static bean_context_t *led_ctx = NULL;
+static QueueHandle_t led_queue = NULL;
+
 esp_err_t bean_led_init()
 {
     esp_err_t ret = ESP_OK;
@@ -116,4 +163,244 @@ esp_err_t bean_led_set_color(led_select_t led, led_color_rgb_t color)
     ret = ledc_update_duty(LEDC_LOW_SPEED_MODE, b_channel);
     ESP_RETURN_ON_ERROR(ret, tag, "Error updating LEDC duty for blue channel: %s", esp_err_to_name(ret));
     return ret;
-}
\ No newline at end of file
+}
+
+static uint32_t channel_duty(const uint16_t *gamma, uint8_t value, uint8_t level)
+{
+    return gamma[(uint16_t)value * level / 255] >> 3;
+}
+
+static void start_step(led_track_t *track, uint8_t led, TickType_t now)
+{
+    const led_step_t *step       = &track->steps[track->index];
+    const led_color_rgb_t *color = &track->look.color;
+    const uint16_t *gamma[3]     = { led_gamma_r, led_gamma_g, led_gamma_b };
+    const uint8_t value[3]       = { color->r, color->g, color->b };
+
+    for (int c = 0; c < 3; c++)
+    {
+        ledc_channel_t channel = led_channels[led][c];
+        uint32_t duty          = channel_duty(gamma[c], value[c], step->level);
+        // The fade runs in hardware, the task only wakes up again for the next step
+        if (step->fade_ms > 0 && ledc_set_fade_with_time(LEDC_LOW_SPEED_MODE, channel, duty, step->fade_ms) == ESP_OK)
+        {
+            ledc_fade_start(LEDC_LOW_SPEED_MODE, channel, LEDC_FADE_NO_WAIT);
+        }
+        else
+        {
+            ledc_set_duty(LEDC_LOW_SPEED_MODE, channel, duty);
+            ledc_update_duty(LEDC_LOW_SPEED_MODE, channel);
+        }
+    }
+
+    track->step_start = now;
+    track->step_ticks = 0;
+    if (track->count > 1)
+    {
+        track->step_ticks = pdMS_TO_TICKS(step->fade_ms + step->hold_ms);
+        if (track->step_ticks == 0)
+            track->step_ticks = 1;
+    }
+}
+
+static void play(led_track_t *track, uint8_t led, const led_look_t *look, TickType_t now)
+{
+    const bean_config_bean_leds_functions_patterns_t *patterns = &bean_config_get()->bean_leds.functions.patterns;
+    led_pattern_timing_t timing                                = {
+        .slow_blink_hz     = patterns->slow_blink_rate,
+        .fast_blink_hz     = patterns->fast_blink_rate,
+        .pulse_ms          = (uint32_t)patterns->pulse.duration_ms,
+        .pulse_interval_ms = (uint32_t)patterns->pulse.interval_ms,
+    };
+
+    // A fade of the previous pattern may still run, it would fight the new one
+    for (int c = 0; c < 3; c++)
+        ledc_fade_stop(LEDC_LOW_SPEED_MODE, led_channels[led][c]);
+
+    track->playing = true;
+    track->look    = *look;
+    track->count   = led_pattern_build(look->pattern, &timing, track->steps);
+    track->index   = 0;
+    start_step(track, led, now);
+}
+
+static led_look_t config_look(const int32_t *color, uint8_t color_count, const char *pattern)
+{
+    led_look_t look = { .color = { 0, 0, 0 }, .pattern = led_pattern_from_name(pattern) };
+    if (color_count == 3)
+        look.color = (led_color_rgb_t){ (uint8_t)color[0], (uint8_t)color[1], (uint8_t)color[2] };
+    return look;
+}
+
+#define CONFIG_LOOK(entry) config_look((entry).color, (entry).color_count, (entry).pattern)
+
+static led_look_t flight_state_look(const bean_config_bean_leds_functions_flight_state_t *looks)
+{
+    switch (bean_flight_get_state())
+    {
+    case FLIGHT_STATE_PRE_LAUNCH:
+        return CONFIG_LOOK(looks->pre_launch);
+    case FLIGHT_STATE_ARMED:
+        return CONFIG_LOOK(looks->armed);
+    case FLIGHT_STATE_ASCENDING:
+        return CONFIG_LOOK(looks->ascending);
+    case FLIGHT_STATE_DROGUE_DEPLOYED:
+        return CONFIG_LOOK(looks->drogue_deployed);
+    case FLIGHT_STATE_MAIN_DEPLOYED:
+        return CONFIG_LOOK(looks->main_deployed);
+    default:
+        return CONFIG_LOOK(looks->landed);
+    }
+}
+
+// The battery monitor keeps the system event bits up to date
+static led_look_t battery_look(const bean_config_bean_leds_functions_battery_t *looks)
+{
+    EventBits_t bits = xEventGroupGetBits(led_ctx->system_event_group);
+    if (bits & BEAN_SYSTEM_BATTERY_CHARGING)
+        return CONFIG_LOOK(looks->charging);
+    if (bits & BEAN_SYSTEM_BATTERY_CRITICAL)
+        return CONFIG_LOOK(looks->critical);
+    if (bits & BEAN_SYSTEM_BATTERY_LOW)
+        return CONFIG_LOOK(looks->low);
+    return CONFIG_LOOK(looks->full);
+}
+
+static led_look_t function_look(const char *function)
+{
+    const bean_config_bean_leds_functions_t *functions = &bean_config_get()->bean_leds.functions;
+    if (strcmp(function, "flight_state") == 0)
+        return flight_state_look(&functions->flight_state);
+    if (strcmp(function, "battery") == 0)
+        return battery_look(&functions->battery);
+    return (led_look_t){ .pattern = LED_PATTERN_OFF };
+}
+
+static bool same_look(const led_look_t *a, const led_look_t *b)
+{
+    return a->pattern == b->pattern && a->color.r == b->color.r && a->color.g == b->color.g && a->color.b == b->color.b;
+}
+
+static void apply_command(led_track_t *tracks, const led_command_t *command, TickType_t now)
+{
+    for (uint8_t i = 0; i < 2; i++)
+    {
+        if (command->led != LED_BOTH && command->led != i)
+            continue;
+        tracks[i].overridden     = !command->release;
+        tracks[i].override       = command->look;
+        tracks[i].override_start = now;
+        tracks[i].override_ticks = pdMS_TO_TICKS(command->duration_ms);
+    }
+}
+
+static TickType_t ticks_left(TickType_t start, TickType_t length, TickType_t now)
+{
+    TickType_t elapsed = now - start;
+    return elapsed >= length ? 0 : length - elapsed;
+}
+
+// The LEDC only keeps its duty with the APB clock running, so the clock stays up while an LED shows something
+static bool track_lit(const led_track_t *track)
+{
+    const led_step_t *step       = &track->steps[track->index];
+    const led_color_rgb_t *color = &track->look.color;
+    return track->playing && (color->r || color->g || color->b) && (step->level > 0 || step->fade_ms > 0);
+}
+
+// Sleeps until the next step, the end of an override, a command or the next look at the states
+static void vtask_led_engine(void *pvParameter)
+{
+    led_track_t tracks[2] = { 0 };
+    bool power_locked     = false;
+
+    while (1)
+    {
+        const bean_config_bean_leds_t *config = &bean_config_get()->bean_leds;
+        const char *functions[2]              = { config->LED1_function, config->LED2_function };
+        TickType_t wait                       = pdMS_TO_TICKS(BEAN_LED_POLL_MS);
+
+        for (uint8_t i = 0; i < 2; i++)
+        {
+            led_track_t *track = &tracks[i];
+            TickType_t now     = xTaskGetTickCount();
+            if (track->overridden && track->override_ticks > 0 &&
+                ticks_left(track->override_start, track->override_ticks, now) == 0)
+                track->overridden = false;
+
+            led_look_t look = track->overridden ? track->override : function_look(functions[i]);
+            if (!track->playing || !same_look(&look, &track->look))
+            {
+                play(track, i, &look, now);
+            }
+            else if (track->step_ticks > 0 && ticks_left(track->step_start, track->step_ticks, now) == 0)
+            {
+                track->index = (track->index + 1) % track->count;
+                start_step(track, i, now);
+            }
+
+            if (track->step_ticks > 0 && ticks_left(track->step_start, track->step_ticks, now) < wait)
+                wait = ticks_left(track->step_start, track->step_ticks, now);
+            if (track->overridden && track->override_ticks > 0 &&
+                ticks_left(track->override_start, track->override_ticks, now) < wait)
+                wait = ticks_left(track->override_start, track->override_ticks, now);
+        }
+
+        bool lit = track_lit(&tracks[0]) || track_lit(&tracks[1]);
+        if (lit && !power_locked)
+            bean_power_acquire(BEAN_POWER_LOCK_LED);
+        else if (!lit && power_locked)
+            bean_power_release(BEAN_POWER_LOCK_LED);
+        power_locked = lit;
+
+        led_command_t command;
+        if (xQueueReceive(led_queue, &command, wait) == pdTRUE)
+            apply_command(tracks, &command, xTaskGetTickCount());
+    }
+}
+
+esp_err_t bean_led_start(bean_context_t *ctx)
+{
+    led_ctx = ctx;
+
+    esp_err_t ret = ledc_fade_func_install(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) // Already installed is fine
+    {
+        ESP_LOGE(tag, "Error installing LEDC fade: %s", esp_err_to_name(ret));
+        return ret;
+    }
+
+    led_queue = xQueueCreate(BEAN_LED_QUEUE_LENGTH, sizeof(led_command_t));
+    ESP_RETURN_ON_FALSE(led_queue != NULL, ESP_ERR_NO_MEM, tag, "Failed to create LED queue");
+
+    TaskHandle_t handle = NULL;
+    xTaskCreate(&vtask_led_engine, "led_engine", BEAN_LED_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY, &handle);
+    ESP_RETURN_ON_FALSE(handle != NULL, ESP_FAIL, tag, "Failed to create LED task");
+    return ESP_OK;
+}
+
+static esp_err_t send_command(const led_command_t *command)
+{
+    if (led_queue == NULL)
+        return ESP_ERR_INVALID_STATE;
+    if (command->led > LED_BOTH)
+        return ESP_ERR_INVALID_ARG;
+    // Never wait, a caller on the sensor or logging path must not block on the LEDs
+    return xQueueSend(led_queue, command, 0) == pdPASS ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t bean_led_show(led_select_t led, led_color_rgb_t color, led_pattern_kind_t pattern, uint32_t duration_ms)
+{
+    led_command_t command = {
+        .led         = led,
+        .look        = { .color = color, .pattern = pattern },
+        .duration_ms = duration_ms,
+    };
+    return send_command(&command);
+}
+
+esp_err_t bean_led_release(led_select_t led)
+{
+    led_command_t command = { .led = led, .release = true };
+    return send_command(&command);
+}
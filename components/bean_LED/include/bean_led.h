@@ -1,6 +1,12 @@
 #pragma once
 
 #include "esp_err.h"
+#include "bean_context.h"
+#include "led_pattern.h"
+
+#define BEAN_LED_TASK_STACK_SIZE 3072
+#define BEAN_LED_QUEUE_LENGTH    4
+#define BEAN_LED_POLL_MS         100 // Longest time before a flight or battery state change shows
 
 typedef enum
 {
@@ -24,4 +30,28 @@ typedef struct led_color_hsv_t
 } led_color_hsv_t;
 
 esp_err_t bean_led_init();
+
+/**
+ * @brief Writes a color right away. Meant for before bean_led_start(), the LED task overwrites it on its next step.
+ */
 esp_err_t bean_led_set_color(led_select_t led, led_color_rgb_t color);
+
+/**
+ * @brief Starts the LED task: each LED shows what its function (LED1_function, LED2_function) says, the flight state
+ * or the battery state, with the colors and patterns of the config.
+ */
+esp_err_t bean_led_start(bean_context_t *ctx);
+
+/**
+ * @brief Shows a color and pattern instead of the LED function. Fire and forget: it never blocks, the command is
+ * dropped when the queue is full.
+ *
+ * @param duration_ms Time before the LED goes back to its function, 0 keeps it until bean_led_release()
+ * @return ESP_ERR_INVALID_STATE when the LED task is not running, ESP_FAIL when the command was dropped
+ */
+esp_err_t bean_led_show(led_select_t led, led_color_rgb_t color, led_pattern_kind_t pattern, uint32_t duration_ms);
+
+/**
+ * @brief Gives the LED back to its function.
+ */
+esp_err_t bean_led_release(led_select_t led);
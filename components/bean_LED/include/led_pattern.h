@@ -0,0 +1,52 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * LED patterns as a short loop of steps: fade to a brightness level, then hold it. The LED task plays the steps with
+ * the LEDC hardware fades, so a pattern costs one wake-up per step and nothing in between.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+#define LED_PATTERN_MAX_STEPS 2
+
+typedef enum led_pattern_kind
+{
+    LED_PATTERN_OFF,
+    LED_PATTERN_FIXED,
+    LED_PATTERN_SLOW_BLINK,
+    LED_PATTERN_FAST_BLINK,
+    LED_PATTERN_PULSE, // Fades up and down, then stays off until the next pulse
+    LED_PATTERN_COUNT
+} led_pattern_kind_t;
+
+typedef struct led_pattern_timing
+{
+    float slow_blink_hz;
+    float fast_blink_hz;
+    uint32_t pulse_ms; // Fade up and down
+    uint32_t pulse_interval_ms; // Start to start
+} led_pattern_timing_t;
+
+typedef struct led_step
+{
+    uint8_t level; // Brightness the step fades to, 255 is the full color
+    uint32_t fade_ms;
+    uint32_t hold_ms;
+} led_step_t;
+
+/**
+ * @brief Builds the steps of a pattern.
+ *
+ * @return Number of steps, a single step is held forever
+ */
+uint8_t led_pattern_build(led_pattern_kind_t kind,
+                          const led_pattern_timing_t *timing,
+                          led_step_t steps[LED_PATTERN_MAX_STEPS]);
+
+/**
+ * @brief Parses a pattern name from the config, an unknown name gives the fixed pattern.
+ */
+led_pattern_kind_t led_pattern_from_name(const char *name);
+
+const char *led_pattern_name(led_pattern_kind_t kind);
@@ -0,0 +1,64 @@
+#include "led_pattern.h"
+#include <string.h>
+
+#define MIN_BLINK_HZ 0.05f // Slower than this is not a blink anymore
+
+static const char *pattern_names[LED_PATTERN_COUNT] = {
+    "off", "fixed", "slow_blink", "fast_blink", "pulse",
+};
+
+const char *led_pattern_name(led_pattern_kind_t kind)
+{
+    if (kind >= LED_PATTERN_COUNT)
+        return "unknown";
+    return pattern_names[kind];
+}
+
+led_pattern_kind_t led_pattern_from_name(const char *name)
+{
+    for (int kind = 0; kind < LED_PATTERN_COUNT; kind++)
+    {
+        if (strcmp(name, pattern_names[kind]) == 0)
+            return (led_pattern_kind_t)kind;
+    }
+    return LED_PATTERN_FIXED;
+}
+
+static uint8_t build_blink(float rate_hz, led_step_t steps[LED_PATTERN_MAX_STEPS])
+{
+    if (rate_hz < MIN_BLINK_HZ)
+        rate_hz = MIN_BLINK_HZ;
+    uint32_t half_period_ms = (uint32_t)(500.0f / rate_hz);
+    steps[0]                = (led_step_t){ .level = 255, .fade_ms = 0, .hold_ms = half_period_ms };
+    steps[1]                = (led_step_t){ .level = 0, .fade_ms = 0, .hold_ms = half_period_ms };
+    return 2;
+}
+
+uint8_t led_pattern_build(led_pattern_kind_t kind,
+                          const led_pattern_timing_t *timing,
+                          led_step_t steps[LED_PATTERN_MAX_STEPS])
+{
+    switch (kind)
+    {
+    case LED_PATTERN_FIXED:
+        steps[0] = (led_step_t){ .level = 255 };
+        return 1;
+    case LED_PATTERN_SLOW_BLINK:
+        return build_blink(timing->slow_blink_hz, steps);
+    case LED_PATTERN_FAST_BLINK:
+        return build_blink(timing->fast_blink_hz, steps);
+    case LED_PATTERN_PULSE:
+    {
+        uint32_t fade_ms     = timing->pulse_ms / 2;
+        uint32_t interval_ms = timing->pulse_interval_ms;
+        if (interval_ms < timing->pulse_ms)
+            interval_ms = timing->pulse_ms;
+        steps[0] = (led_step_t){ .level = 255, .fade_ms = fade_ms, .hold_ms = 0 };
+        steps[1] = (led_step_t){ .level = 0, .fade_ms = fade_ms, .hold_ms = interval_ms - 2 * fade_ms };
+        return 2;
+    }
+    default:
+        steps[0] = (led_step_t){ .level = 0 };
+        return 1;
+    }
+}
@@ -1,7 +1,10 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include "bean_altimeter.h"
 #include "bmp3_defs.h"
 #include "esp_err.h"
+#include "bean_hal.h"
+#include "bean_metrics.h"
 
 bool _filterEnabled, _tempOSEnabled, _presOSEnabled, _ODREnabled;
 uint8_t _i2caddr;
@@ -30,31 +33,32 @@ static int8_t i2c_write(uint8_t reg_addr, const uint8_t *reg_data, uint32_t len,
     uint8_t *buf = (uint8_t *)malloc(len + 1);
     buf[0]       = reg_addr;
     memcpy(buf + 1, reg_data, len);
-    esp_err_t ret = i2c_master_write_to_device(I2C_NUM_0, bmp390_address, buf, len + 1, pdMS_TO_TICKS(1000));
+    esp_err_t ret = bean_hal_i2c_write(bmp390_address, buf, len + 1, 1000);
     free(buf);
     if (ret == ESP_OK)
     {
         return BMP3_OK;
     }
-    ESP_LOGE(TAG, "I2C write failed with error %d", ret);
+    BEAN_LOGE(TAG, "I2C write failed with error %d", ret);
+    bean_metrics_add(BEAN_METRIC_I2C_ERRORS, 1);
     return BMP3_E_COMM_FAIL;
 }
 
 static int8_t i2c_read(uint8_t reg_addr, uint8_t *reg_data, uint32_t len, void *intf_ptr)
 {
-    esp_err_t ret =
-      i2c_master_write_read_device(I2C_NUM_0, bmp390_address, &reg_addr, 1, reg_data, len, pdMS_TO_TICKS(1000));
+    esp_err_t ret = bean_hal_i2c_write_read(bmp390_address, &reg_addr, 1, reg_data, len, 1000);
     if (ret == ESP_OK)
     {
         return BMP3_OK;
     }
-    ESP_LOGE(TAG, "I2C read failed with error %d", ret);
+    BEAN_LOGE(TAG, "I2C read failed with error %d", ret);
+    bean_metrics_add(BEAN_METRIC_I2C_ERRORS, 1);
     return BMP3_E_COMM_FAIL;
 }
 
 static void delay_usec(uint32_t us, void *intf_ptr)
 {
-    ets_delay_us(us);
+    bean_hal_delay_us(us);
 }
 
 static int8_t cal_crc(uint8_t seed, uint8_t data)
@@ -115,7 +119,7 @@ esp_err_t bean_altimeter_sleep(void)
     int8_t rslt       = bmp3_set_op_mode(settings, sensor);
     if (rslt != BMP3_OK)
     {
-        ESP_LOGE(TAG, "Failed to set sleep mode");
+        BEAN_LOGE(TAG, "Failed to set sleep mode");
         return ESP_FAIL;
     }
     altimeter_state = ALTIMETER_STATE_SLEEPING;
@@ -124,18 +128,38 @@ esp_err_t bean_altimeter_sleep(void)
 
 esp_err_t bean_altimeter_wake(void)
 {
-    ESP_LOGI(TAG, "Activating altimeter");
+    BEAN_LOGI(TAG, "Activating altimeter");
     settings->op_mode = BMP3_MODE_NORMAL;
     int8_t rslt       = bmp3_set_op_mode(settings, sensor);
     if (rslt != BMP3_OK)
     {
-        ESP_LOGE(TAG, "Failed to wake sensor");
+        BEAN_LOGE(TAG, "Failed to wake sensor");
         return ESP_FAIL;
     }
     altimeter_state = ALTIMETER_STATE_ACTIVE;
     return ESP_OK;
 }
 
+esp_err_t bean_altimeter_set_odr(uint8_t odr)
+{
+    if (setOutputDataRate(odr) != ESP_OK)
+        return ESP_FAIL;
+
+    int8_t rslt = bmp3_set_sensor_settings(BMP3_SEL_ODR, settings, sensor);
+    if (rslt != BMP3_OK)
+    {
+        BEAN_LOGE(TAG, "Failed to set the output data rate");
+        return ESP_FAIL;
+    }
+    // The ODR is only taken over on the way into the normal mode, which goes through the sleep mode
+    if (altimeter_state == ALTIMETER_STATE_ACTIVE && bmp3_set_op_mode(settings, sensor) != BMP3_OK)
+    {
+        BEAN_LOGE(TAG, "Failed to restart with the new output data rate");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
 esp_err_t bean_altimeter_init()
 {
     sensor             = (struct bmp3_dev *)malloc(sizeof(struct bmp3_dev));
@@ -153,14 +177,14 @@ esp_err_t bean_altimeter_init()
     rslt = bmp3_init(sensor);
     if (rslt != BMP3_OK)
     {
-        ESP_LOGE(TAG, "BMP3 initialization failed with code %hhi", rslt);
+        BEAN_LOGE(TAG, "BMP3 initialization failed with code %hhi", rslt);
         return ESP_FAIL;
     }
 
     rslt = validate_trimming_param(sensor);
     if (rslt != BMP3_OK)
     {
-        ESP_LOGE(TAG, "BMP3 trimming parameters validation failed");
+        BEAN_LOGE(TAG, "BMP3 trimming parameters validation failed");
         return ESP_FAIL;
     }
 
@@ -192,7 +216,7 @@ esp_err_t bean_altimeter_init()
     rslt = bmp3_set_sensor_settings(settings_sel, settings, sensor);
     if (rslt != BMP3_OK)
     {
-        ESP_LOGE(TAG, "BMP3 set sensor settings failed");
+        BEAN_LOGE(TAG, "BMP3 set sensor settings failed");
         return ESP_FAIL;
     }
 
@@ -202,7 +226,7 @@ esp_err_t bean_altimeter_init()
     rslt = bmp3_set_op_mode(settings, sensor);
     if (rslt != BMP3_OK)
     {
-        ESP_LOGE(TAG, "BMP3 set operation mode failed");
+        BEAN_LOGE(TAG, "BMP3 set operation mode failed");
         return ESP_FAIL;
     }
 
@@ -236,7 +260,7 @@ esp_err_t bean_altimeter_update()
     rslt = bmp3_get_sensor_data(sensor_comp, &data, sensor);
     if (rslt != BMP3_OK)
     {
-        ESP_LOGE(TAG, "BMP3 get sensor data failed");
+        BEAN_LOGE(TAG, "BMP3 get sensor data failed");
         return ESP_FAIL;
     }
 
@@ -1,11 +1,8 @@
 #pragma once
 #include <stdio.h>
-#include "driver/i2c.h"
+#include <string.h>
 #include "esp_err.h"
-#include "string.h"
-#include "rom/ets_sys.h"
 #include "bmp3.h"
-#include <esp_log.h>
 
 #define BMP3_DOUBLE_PRECISION_COMPENSATION
 
@@ -20,6 +17,10 @@ typedef enum
 altimeter_state_t bean_altimeter_get_state(void);
 esp_err_t bean_altimeter_init(void);
 esp_err_t bean_altimeter_update(void);
+esp_err_t bean_altimeter_sleep(void);
+esp_err_t bean_altimeter_wake(void);
+// Changes the output data rate of the running sensor, one of the BMP3_ODR_* values
+esp_err_t bean_altimeter_set_odr(uint8_t odr);
 double bean_altimeter_get_pressure(void);
 double bean_altimeter_get_temperature(void);
 esp_err_t setTemperatureOversampling(uint8_t oversample);
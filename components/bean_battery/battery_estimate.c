@@ -0,0 +1,87 @@
+#include "battery_estimate.h"
+#include <stddef.h>
+
+// Resting voltage of a LiPo cell every 5 % from 0 to 100 %, in mV
+static const uint16_t discharge_curve_mv[] = {
+    3270, 3610, 3690, 3710, 3730, 3750, 3770, 3790, 3800, 3820, 3840,
+    3850, 3870, 3910, 3950, 3980, 4020, 4080, 4110, 4150, 4200,
+};
+
+#define CURVE_POINTS (sizeof(discharge_curve_mv) / sizeof(discharge_curve_mv[0]))
+#define CURVE_STEP   (100 / (CURVE_POINTS - 1))
+
+static const char *level_names[] = { "critical", "low", "normal", "full" };
+
+void battery_filter_reset(battery_filter_t *filter)
+{
+    filter->initialized = false;
+    filter->voltage_v   = 0.0f;
+}
+
+float battery_filter_update(battery_filter_t *filter, float voltage_v, uint32_t dt_ms)
+{
+    if (!filter->initialized)
+    {
+        filter->initialized = true;
+        filter->voltage_v   = voltage_v;
+        return voltage_v;
+    }
+
+    // Discretized RC filter, alpha = dt / (tau + dt)
+    float alpha = (float)dt_ms / (float)(BATTERY_FILTER_TAU_MS + dt_ms);
+    filter->voltage_v += alpha * (voltage_v - filter->voltage_v);
+    return filter->voltage_v;
+}
+
+uint8_t battery_soc_percent(const battery_thresholds_t *thresholds, float voltage_v)
+{
+    float span_v = thresholds->full_v - thresholds->shutdown_v;
+    if (span_v <= 0.0f)
+        return voltage_v >= thresholds->full_v ? 100 : 0;
+
+    // Maps the configured range onto the range of the curve
+    float first_mv = discharge_curve_mv[0];
+    float last_mv  = discharge_curve_mv[CURVE_POINTS - 1];
+    float curve_mv = first_mv + (voltage_v - thresholds->shutdown_v) / span_v * (last_mv - first_mv);
+    if (curve_mv <= first_mv)
+        return 0;
+    if (curve_mv >= last_mv)
+        return 100;
+
+    size_t i = 1;
+    while (curve_mv > discharge_curve_mv[i])
+        i++;
+    float low_mv  = discharge_curve_mv[i - 1];
+    float high_mv = discharge_curve_mv[i];
+    float soc     = (float)((i - 1) * CURVE_STEP) + (curve_mv - low_mv) / (high_mv - low_mv) * (float)CURVE_STEP;
+    return (uint8_t)(soc + 0.5f);
+}
+
+static battery_level_t level_of(const battery_thresholds_t *thresholds, float voltage_v)
+{
+    if (voltage_v < thresholds->critical_v)
+        return BATTERY_LEVEL_CRITICAL;
+    if (voltage_v < thresholds->low_v)
+        return BATTERY_LEVEL_LOW;
+    if (voltage_v >= thresholds->full_v - BATTERY_FULL_MARGIN_V)
+        return BATTERY_LEVEL_FULL;
+    return BATTERY_LEVEL_NORMAL;
+}
+
+battery_level_t battery_level_update(const battery_thresholds_t *thresholds, battery_level_t previous, float voltage_v)
+{
+    battery_level_t level = level_of(thresholds, voltage_v);
+    if (level <= previous)
+        return level;
+
+    // A warning is raised right away but only cleared once the voltage is past the hysteresis band
+    battery_level_t recovered = level_of(thresholds, voltage_v - BATTERY_HYSTERESIS_V);
+    return recovered > previous ? recovered : previous;
+}
+
+const char *battery_level_name(battery_level_t level)
+{
+    if (level > BATTERY_LEVEL_FULL)
+        return "unknown";
+    return level_names[level];
+}
@@ -0,0 +1,80 @@
+#include "battery_sag.h"
+#include <string.h>
+
+#define SAMPLE_US      (1000000 / BATTERY_SAG_RATE_HZ)
+#define PRE_SAMPLES    (BATTERY_SAG_PRE_MS * BATTERY_SAG_RATE_HZ / 1000)
+#define SAMPLES_PER_MS (BATTERY_SAG_RATE_HZ / 1000)
+
+void battery_sag_history_reset(battery_sag_history_t *history)
+{
+    memset(history, 0, sizeof(*history));
+}
+
+void battery_sag_history_push(battery_sag_history_t *history, uint16_t sample, int64_t time_us)
+{
+    history->samples[history->head] = sample;
+    history->head                   = (history->head + 1) % BATTERY_SAG_HISTORY_SAMPLES;
+    if (history->count < BATTERY_SAG_HISTORY_SAMPLES)
+        history->count++;
+    history->last_us = time_us;
+}
+
+battery_sag_window_t battery_sag_history_window(const battery_sag_history_t *history,
+                                                int64_t trigger_us,
+                                                uint16_t window[BATTERY_SAG_WINDOW_SAMPLES])
+{
+    int64_t start_us = trigger_us - (int64_t)BATTERY_SAG_PRE_MS * 1000;
+    int64_t end_us   = start_us + (int64_t)(BATTERY_SAG_WINDOW_SAMPLES - 1) * SAMPLE_US;
+    if (history->count == 0 || history->last_us < end_us)
+        return BATTERY_SAG_PENDING;
+
+    // Samples back from the newest one to the start of the window
+    int64_t back = (history->last_us - start_us + SAMPLE_US / 2) / SAMPLE_US;
+    if (back >= history->count)
+        return BATTERY_SAG_MISSED;
+
+    uint32_t index = (history->head + BATTERY_SAG_HISTORY_SAMPLES - 1 - (uint32_t)back) % BATTERY_SAG_HISTORY_SAMPLES;
+    for (uint32_t i = 0; i < BATTERY_SAG_WINDOW_SAMPLES; i++)
+    {
+        window[i] = history->samples[index];
+        index     = (index + 1) % BATTERY_SAG_HISTORY_SAMPLES;
+    }
+    return BATTERY_SAG_READY;
+}
+
+void battery_sag_analyze(const uint16_t window_mv[BATTERY_SAG_WINDOW_SAMPLES], battery_sag_result_t *result)
+{
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < PRE_SAMPLES; i++)
+        sum += window_mv[i];
+    uint16_t baseline_mv = (uint16_t)((sum + PRE_SAMPLES / 2) / PRE_SAMPLES);
+
+    uint32_t min_index = PRE_SAMPLES;
+    int32_t onset      = -1;
+    for (uint32_t i = PRE_SAMPLES; i < BATTERY_SAG_WINDOW_SAMPLES; i++)
+    {
+        if (window_mv[i] < window_mv[min_index])
+            min_index = i;
+        if (onset < 0 && window_mv[i] + BATTERY_SAG_ONSET_MV < baseline_mv)
+            onset = (int32_t)i;
+    }
+
+    int32_t recovered = -1;
+    if (onset >= 0)
+    {
+        for (uint32_t i = min_index; i < BATTERY_SAG_WINDOW_SAMPLES; i++)
+        {
+            if (window_mv[i] + BATTERY_SAG_RECOVERED_MV >= baseline_mv)
+            {
+                recovered = (int32_t)i;
+                break;
+            }
+        }
+    }
+
+    result->baseline_mv = baseline_mv;
+    result->min_mv      = window_mv[min_index];
+    result->min_ms      = (int32_t)(min_index - PRE_SAMPLES) / SAMPLES_PER_MS;
+    result->onset_ms    = onset < 0 ? -1 : (onset - PRE_SAMPLES) / SAMPLES_PER_MS;
+    result->recovery_ms = recovered < 0 ? -1 : (recovered - onset) / SAMPLES_PER_MS;
+}
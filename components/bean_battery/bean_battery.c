@@ -2,107 +2,169 @@
 #include <stdio.h>
 #include "bean_bits.h"
 #include "bean_context.h"
-#include "driver/adc_types_legacy.h"
 #include "esp_log.h"
 #include "esp_check.h"
 #include "bean_battery.h"
+#include "battery_estimate.h"
+#include "battery_sag.h"
+#include "bean_power.h"
+#include "bean_metrics.h"
+#include "bean_trace.h"
+#include "esp_timer.h"
 #include "driver/gpio.h"
 #include "freertos/queue.h"
 #include "freertos/event_groups.h"
 #include "freertos/task.h"
+#include "soc/soc_caps.h"
 
-#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
 #include "esp_adc/adc_cali.h"
 #include "esp_adc/adc_cali_scheme.h"
+#if SOC_ADC_DIG_IIR_FILTER_SUPPORTED
+#include "esp_adc/adc_filter.h"
+#endif
 
 const char TAG[] = "bean_battery";
 
 const float resistor_voltage_divider = 2.0f; // Could later be part of the configuration.
 
+// The DMA fills a whole frame before the driver interrupts the CPU, one frame is 0.5 s of samples. Two samples make
+// one of the 1 kHz sag history.
+#define VBAT_SAMPLE_FREQ_HZ   (2 * BATTERY_SAG_RATE_HZ)
+#define VBAT_FRAME_SAMPLES    1000
+#define VBAT_FRAME_BYTES      (VBAT_FRAME_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES)
+#define VBAT_FRAME_MS         (VBAT_FRAME_SAMPLES * 1000 / VBAT_SAMPLE_FREQ_HZ)
+#define VBAT_FRAME_TIMEOUT_MS 2000
+#define SAG_LOG_PER_ENTRY     6 // "4012,4010,..." fits the 32 characters of a log entry
+
 void vtask_battery_monitor(void *pvParameter);
 
 static adc_channel_t vbat_adc_channel;
 static adc_unit_t vbat_adc_unit;
-static adc_oneshot_unit_handle_t vbat_adc_handle;
+static adc_continuous_handle_t vbat_adc_handle;
 static adc_cali_handle_t vbat_adc_cali_handle;
+static uint8_t vbat_frame[VBAT_FRAME_BYTES];
+static uint16_t vbat_raw[VBAT_FRAME_SAMPLES];
+
+// Sag capture, the history is only touched by the monitor task
+static battery_sag_history_t sag_history;
+static uint16_t sag_window[BATTERY_SAG_WINDOW_SAMPLES];
+static portMUX_TYPE sag_lock     = portMUX_INITIALIZER_UNLOCKED;
+static int64_t sag_trigger_us    = 0;
+static const char *sag_source    = NULL; // Pending capture, NULL when there is none
+static uint8_t sag_trigger_count = 0; // Actuations in the window of the pending capture
 
 // Configuration settings
 static bool vbat_logging_enabled       = true;
+static bool sag_capture_enabled        = true;
 static uint16_t vbat_check_interval_ms = 5000;
+static battery_thresholds_t thresholds = { .full_v = 4.2f, .low_v = 3.5f, .critical_v = 3.3f, .shutdown_v = 3.2f };
+
+// Written by the monitor task only
+static volatile float battery_voltage_v = 0.0f;
+static volatile uint8_t battery_soc     = 0;
 
 TaskHandle_t battery_monitor_task_handle;
 
+static void apply_config(const bean_config_bean_battery_t *config)
+{
+    vbat_check_interval_ms = (uint16_t)config->check_interval_ms;
+    vbat_logging_enabled   = config->logging;
+    sag_capture_enabled    = config->sag_capture;
+    thresholds.full_v      = config->full_voltage;
+    thresholds.low_v       = config->low_voltage;
+    thresholds.critical_v  = config->critical_voltage;
+    thresholds.shutdown_v  = config->shutdown_voltage;
+}
+
+// Live config patches take effect on the next frame
+static void config_listener(const bean_config_t *previous, const bean_config_t *current, void *arg)
+{
+    apply_config(&current->bean_battery);
+}
+
+static esp_err_t start_continuous_adc(void)
+{
+    adc_continuous_handle_cfg_t handle_config = {
+        .max_store_buf_size = 2 * VBAT_FRAME_BYTES,
+        .conv_frame_size    = VBAT_FRAME_BYTES,
+    };
+    ESP_RETURN_ON_ERROR(
+      adc_continuous_new_handle(&handle_config, &vbat_adc_handle), TAG, "Failed to create VBAT ADC handle");
+
+    adc_digi_pattern_config_t pattern = {
+        .atten     = ADC_ATTEN_DB_12,
+        .channel   = vbat_adc_channel,
+        .unit      = vbat_adc_unit,
+        .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+    };
+    adc_continuous_config_t adc_config = {
+        .pattern_num    = 1,
+        .adc_pattern    = &pattern,
+        .sample_freq_hz = VBAT_SAMPLE_FREQ_HZ,
+        .conv_mode      = vbat_adc_unit == ADC_UNIT_1 ? ADC_CONV_SINGLE_UNIT_1 : ADC_CONV_SINGLE_UNIT_2,
+        .format         = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
+    };
+    ESP_RETURN_ON_ERROR(adc_continuous_config(vbat_adc_handle, &adc_config), TAG, "Failed to configure VBAT ADC");
+
+#if SOC_ADC_DIG_IIR_FILTER_SUPPORTED
+    // Smooths the samples in the ADC itself, the frame average and the software filter do the rest
+    adc_continuous_iir_filter_config_t filter_config = {
+        .unit    = vbat_adc_unit,
+        .channel = vbat_adc_channel,
+        .coeff   = ADC_DIGI_IIR_FILTER_COEFF_4, // About 2 ms, it must not smooth the sag away
+    };
+    adc_iir_filter_handle_t filter_handle;
+    ESP_RETURN_ON_ERROR(adc_new_continuous_iir_filter(vbat_adc_handle, &filter_config, &filter_handle),
+                        TAG,
+                        "Failed to create VBAT ADC filter");
+    ESP_RETURN_ON_ERROR(adc_continuous_iir_filter_enable(filter_handle), TAG, "Failed to enable VBAT ADC filter");
+#endif
+
+    return adc_continuous_start(vbat_adc_handle);
+}
+
 esp_err_t bean_battery_init(bean_context_t *ctx)
 {
-    // Read configuration from JSON
-    const cJSON *config = config_store_get();
-    if (config)
-    {
-        const cJSON *battery_config = cJSON_GetObjectItem(config, "bean_battery");
-        if (battery_config)
-        {
-            // Read check interval
-            const cJSON *check_interval = cJSON_GetObjectItem(battery_config, "check_interval_ms");
-            if (cJSON_IsNumber(check_interval))
-            {
-                vbat_check_interval_ms = (uint16_t)cJSON_GetNumberValue(check_interval);
-                ESP_LOGI(TAG, "Battery check interval set to %d ms", vbat_check_interval_ms);
-            }
-
-            // Read logging enabled flag
-            const cJSON *logging = cJSON_GetObjectItem(battery_config, "logging");
-            if (cJSON_IsBool(logging))
-            {
-                vbat_logging_enabled = cJSON_IsTrue(logging);
-                ESP_LOGI(TAG, "Battery logging %s", vbat_logging_enabled ? "enabled" : "disabled");
-            }
-        }
-        else
-        {
-            ESP_LOGW(TAG, "No bean_battery config found, using defaults");
-        }
-    }
-    else
-    {
-        ESP_LOGW(TAG, "No config available, using defaults");
-    }
+    apply_config(&bean_config_get()->bean_battery);
+    ESP_LOGI(TAG,
+             "Battery check interval %d ms, logging %s",
+             vbat_check_interval_ms,
+             vbat_logging_enabled ? "enabled" : "disabled");
 
     ESP_RETURN_ON_ERROR(gpio_set_direction(PIN_USB_DET, GPIO_MODE_INPUT), TAG, "Set USB DET pin direction failed");
     ESP_RETURN_ON_ERROR(gpio_set_direction(PIN_CHRG_STAT, GPIO_MODE_INPUT), TAG, "Set CHRG STAT pin direction failed");
     ESP_RETURN_ON_ERROR(gpio_set_direction(PIN_VBAT_ADC, GPIO_MODE_INPUT), TAG, "Set VBAT ADC pin direction failed");
 
-    ESP_RETURN_ON_ERROR(adc_oneshot_io_to_channel(PIN_VBAT_ADC, &vbat_adc_unit, &vbat_adc_channel),
+    ESP_RETURN_ON_ERROR(adc_continuous_io_to_channel(PIN_VBAT_ADC, &vbat_adc_unit, &vbat_adc_channel),
                         TAG,
                         "VBAT I/O pin is not a valid ADC channel");
 
-    adc_oneshot_unit_init_cfg_t init_config1 = {
-        .unit_id  = vbat_adc_unit,
-        .ulp_mode = ADC_ULP_MODE_DISABLE,
-    };
-    ESP_RETURN_ON_ERROR(adc_oneshot_new_unit(&init_config1, &vbat_adc_handle), TAG, "Failed to create VBAT ADC unit");
-
-    adc_oneshot_chan_cfg_t chan_config = { .bitwidth = ADC_WIDTH_BIT_12, .atten = ADC_ATTEN_DB_12 };
-    ESP_RETURN_ON_ERROR(adc_oneshot_config_channel(vbat_adc_handle, vbat_adc_channel, &chan_config),
-                        TAG,
-                        "Failed to configure VBAT ADC channel");
-
     adc_cali_curve_fitting_config_t cali_config = {
         .unit_id  = vbat_adc_unit,
         .chan     = vbat_adc_channel,
         .atten    = ADC_ATTEN_DB_12,
-        .bitwidth = ADC_WIDTH_BIT_12,
+        .bitwidth = SOC_ADC_DIGI_MAX_BITWIDTH,
     };
     ESP_RETURN_ON_ERROR(adc_cali_create_scheme_curve_fitting(&cali_config, &vbat_adc_cali_handle),
                         TAG,
                         "Failed to create VBAT ADC calibration handle");
 
-    xTaskCreate(
-      &vtask_battery_monitor, "battery_monitor", 2560, (void *)ctx, tskIDLE_PRIORITY, &battery_monitor_task_handle);
+    ESP_RETURN_ON_ERROR(start_continuous_adc(), TAG, "Failed to start VBAT ADC");
+
+    xTaskCreate(&vtask_battery_monitor,
+                "battery_monitor",
+                BEAN_BATTERY_TASK_STACK_SIZE,
+                (void *)ctx,
+                BEAN_BATTERY_TASK_PRIORITY,
+                &battery_monitor_task_handle);
     if (battery_monitor_task_handle == NULL)
     {
         ESP_LOGE(TAG, "Failed to create battery monitor task");
         return ESP_FAIL;
     }
+    bean_metrics_watch_task(battery_monitor_task_handle);
+    bean_context_config_subscribe(config_listener, NULL);
     return ESP_OK;
 }
 
@@ -118,16 +180,170 @@ esp_err_t enqueue_battery_voltage(bean_context_t *ctx, int voltage_mv)
     if (xQueueSend(ctx->data_log_queue, &log_data, pdMS_TO_TICKS(100)) != pdPASS)
     {
         ESP_LOGW(TAG, "Failed to enqueue battery voltage");
+        bean_metrics_add(BEAN_METRIC_SAMPLES_DROPPED, 1);
         return ESP_FAIL;
     }
 
     return ESP_OK;
 }
 
+// Read by the LED task and anything else that wants to warn about the battery
+static void set_level_bits(bean_context_t *ctx, battery_level_t level)
+{
+    const EventBits_t level_bits = BEAN_SYSTEM_BATTERY_CRITICAL | BEAN_SYSTEM_BATTERY_LOW | BEAN_SYSTEM_BATTERY_FULL;
+    EventBits_t bits             = 0;
+    if (level == BATTERY_LEVEL_CRITICAL)
+        bits = BEAN_SYSTEM_BATTERY_CRITICAL | BEAN_SYSTEM_BATTERY_LOW;
+    else if (level == BATTERY_LEVEL_LOW)
+        bits = BEAN_SYSTEM_BATTERY_LOW;
+    else if (level == BATTERY_LEVEL_FULL)
+        bits = BEAN_SYSTEM_BATTERY_FULL;
+    xEventGroupClearBits(ctx->system_event_group, level_bits & ~bits);
+    xEventGroupSetBits(ctx->system_event_group, bits);
+}
+
+static int raw_to_mv(int raw)
+{
+    int voltage_mv = 0;
+    adc_cali_raw_to_voltage(vbat_adc_cali_handle, raw, &voltage_mv);
+    return (int)(voltage_mv * resistor_voltage_divider);
+}
+
+// Raw VBAT samples of a frame
+static uint32_t frame_samples(const uint8_t *frame, uint32_t length, uint16_t *raw)
+{
+    uint32_t count = 0;
+    for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length && count < VBAT_FRAME_SAMPLES;
+         i += SOC_ADC_DIGI_RESULT_BYTES)
+    {
+        const adc_digi_output_data_t *sample = (const adc_digi_output_data_t *)&frame[i];
+        if (sample->type2.unit != vbat_adc_unit || sample->type2.channel != vbat_adc_channel)
+            continue;
+        raw[count++] = (uint16_t)sample->type2.data;
+    }
+    return count;
+}
+
+// Average of the frame, in mV at the battery
+static int frame_voltage_mv(const uint16_t *raw, uint32_t count)
+{
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < count; i++)
+        sum += raw[i];
+    return raw_to_mv((int)((sum + count / 2) / count));
+}
+
+esp_err_t bean_battery_capture_sag(const char *source)
+{
+    if (!sag_capture_enabled || vbat_adc_handle == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    // A second actuation inside the window of the first one lands in the same capture
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&sag_lock);
+    if (sag_source == NULL)
+    {
+        sag_source        = source;
+        sag_trigger_us    = now_us;
+        sag_trigger_count = 0;
+    }
+    sag_trigger_count++;
+    portEXIT_CRITICAL(&sag_lock);
+
+    // Cuts the pause of the pad mode short
+    if (battery_monitor_task_handle != NULL)
+        xTaskNotifyGive(battery_monitor_task_handle);
+    return ESP_OK;
+}
+
+// Pairs of samples go into the 1 kHz history, the newest pair is the end of the frame
+static void push_sag_history(const uint16_t *raw, uint32_t count, int64_t frame_end_us)
+{
+    uint32_t pairs = count / 2;
+    for (uint32_t i = 0; i < pairs; i++)
+    {
+        int64_t time_us = frame_end_us - (int64_t)(pairs - 1 - i) * (1000000 / BATTERY_SAG_RATE_HZ);
+        battery_sag_history_push(&sag_history, (uint16_t)((raw[2 * i] + raw[2 * i + 1] + 1) / 2), time_us);
+    }
+}
+
+// Spread over ticks when the queue fills up, the flight samples go first
+static void log_sag_waveform(bean_context_t *ctx, uint32_t start_ms)
+{
+    for (uint32_t i = 0; i < BATTERY_SAG_WINDOW_SAMPLES; i += SAG_LOG_PER_ENTRY)
+    {
+        log_data_t log_data = { .measurement_type = MEASUREMENT_TYPE_BATTERY_SAG,
+                                .timestamp        = start_ms + i * 1000 / BATTERY_SAG_RATE_HZ };
+        int length          = 0;
+        for (uint32_t j = i; j < i + SAG_LOG_PER_ENTRY && j < BATTERY_SAG_WINDOW_SAMPLES; j++)
+        {
+            length += snprintf(&log_data.measurement_value[length],
+                               sizeof(log_data.measurement_value) - length,
+                               j == i ? "%u" : ",%u",
+                               sag_window[j]);
+        }
+
+        while (uxQueueSpacesAvailable(ctx->data_log_queue) < BEAN_CONTEXT_DATA_QUEUE_LENGTH / 2)
+            vTaskDelay(1);
+        xQueueSend(ctx->data_log_queue, &log_data, 0);
+    }
+}
+
+static void finish_sag_capture(bean_context_t *ctx)
+{
+    portENTER_CRITICAL(&sag_lock);
+    const char *source = sag_source;
+    int64_t trigger_us = sag_trigger_us;
+    uint8_t triggers   = sag_trigger_count;
+    portEXIT_CRITICAL(&sag_lock);
+    if (source == NULL)
+        return;
+
+    battery_sag_window_t window = battery_sag_history_window(&sag_history, trigger_us, sag_window);
+    if (window == BATTERY_SAG_PENDING)
+        return;
+
+    portENTER_CRITICAL(&sag_lock);
+    sag_source = NULL;
+    portEXIT_CRITICAL(&sag_lock);
+    if (window == BATTERY_SAG_MISSED)
+    {
+        ESP_LOGW(TAG, "Battery sag capture for %s missed", source);
+        return;
+    }
+
+    for (uint32_t i = 0; i < BATTERY_SAG_WINDOW_SAMPLES; i++)
+        sag_window[i] = (uint16_t)raw_to_mv(sag_window[i]);
+    battery_sag_result_t result;
+    battery_sag_analyze(sag_window, &result);
+
+    // On the esp_timer clock, like the flight samples
+    uint32_t trigger_ms = (uint32_t)(trigger_us / 1000);
+    ESP_LOGI(TAG,
+             "Battery sag after %s: %u mV to %u mV, recovered after %ld ms",
+             source,
+             result.baseline_mv,
+             result.min_mv,
+             result.recovery_ms);
+    bean_context_log_event(ctx,
+                           EVENT_ID_BATTERY_SAG,
+                           "source=%s;triggers=%u;trigger_ms=%lu;baseline_mv=%u;min_mv=%u;min_ms=%ld;onset_ms=%ld;"
+                           "recovery_ms=%ld",
+                           source,
+                           triggers,
+                           trigger_ms,
+                           result.baseline_mv,
+                           result.min_mv,
+                           result.min_ms,
+                           result.onset_ms,
+                           result.recovery_ms);
+    if (vbat_logging_enabled)
+        log_sag_waveform(ctx, trigger_ms - BATTERY_SAG_PRE_MS);
+}
+
 void vtask_battery_monitor(void *pvParameter)
 {
     ESP_LOGI(TAG, "Battery monitor task started");
-    int voltage_raw, voltage_mv = 0;
     bean_context_t *ctx = (bean_context_t *)pvParameter;
     if (ctx == NULL)
     {
@@ -135,34 +351,70 @@ void vtask_battery_monitor(void *pvParameter)
         vTaskDelete(NULL);
         return;
     }
+
+    battery_filter_t filter;
+    battery_filter_reset(&filter);
+    battery_sag_history_reset(&sag_history);
+    battery_level_t level   = BATTERY_LEVEL_NORMAL;
+    uint32_t last_frame_ms  = esp_log_timestamp();
+    uint32_t last_report_ms = 0;
+    bool reported           = false;
     while (1)
     {
-        esp_err_t ret = adc_oneshot_read(vbat_adc_handle, vbat_adc_channel, &voltage_raw);
-        if (ret == ESP_OK)
-        {
-            adc_cali_raw_to_voltage(vbat_adc_cali_handle, voltage_raw, &voltage_mv);
-            voltage_mv *= resistor_voltage_divider;
-            enqueue_battery_voltage(ctx, voltage_mv);
-        }
-        else
+        // Blocks until the DMA has a frame, the task sleeps in between
+        uint32_t length = 0;
+        esp_err_t ret   = adc_continuous_read(
+          vbat_adc_handle, vbat_frame, sizeof(vbat_frame), &length, pdMS_TO_TICKS(VBAT_FRAME_TIMEOUT_MS));
+        int64_t now_us  = esp_timer_get_time();
+        uint32_t now_ms = esp_log_timestamp();
+        uint32_t count  = ret == ESP_OK ? frame_samples(vbat_frame, length, vbat_raw) : 0;
+        if (count == 0)
         {
             ESP_LOGE(TAG, "Failed to read battery voltage!");
+            continue;
         }
+        BEAN_TRACE(BEAN_TRACE_ADC_FRAME, length);
+        push_sag_history(vbat_raw, count, now_us);
+        finish_sag_capture(ctx);
+
+        int voltage_mv    = frame_voltage_mv(vbat_raw, count);
+        float voltage_v   = battery_filter_update(&filter, voltage_mv / 1000.0f, now_ms - last_frame_ms);
+        last_frame_ms     = now_ms;
+        level             = battery_level_update(&thresholds, level, voltage_v);
+        battery_voltage_v = voltage_v;
+        battery_soc       = battery_soc_percent(&thresholds, voltage_v);
+        set_level_bits(ctx, level);
 
         if (bean_battery_is_usb_powered())
         {
-            xEventGroupSetBits(ctx->system_event_group, BEAN_SYSTEM_USB_POWERED);
+            // The charger runs whenever USB is plugged in, CHRG_STAT can not tell a missing battery apart (see below)
+            xEventGroupSetBits(ctx->system_event_group, BEAN_SYSTEM_USB_POWERED | BEAN_SYSTEM_BATTERY_CHARGING);
         }
         else
         {
-            xEventGroupClearBits(ctx->system_event_group, BEAN_SYSTEM_USB_POWERED);
+            xEventGroupClearBits(ctx->system_event_group, BEAN_SYSTEM_USB_POWERED | BEAN_SYSTEM_BATTERY_CHARGING);
         }
         // there needs to be more logic for the charging. Because the skybean can start-up without battery and then the CHRG_STAT is LOW.
         //int chrg_stat = gpio_get_level(PIN_CHRG_STAT);
         //ESP_LOGI(TAG, "Charge status: %d", chrg_stat);
 
-        // Delay before the next reading
-        vTaskDelay(pdMS_TO_TICKS(5000));
+        // The log gets the filtered voltage once per check interval
+        if (!reported || now_ms - last_report_ms >= vbat_check_interval_ms)
+        {
+            reported       = true;
+            last_report_ms = now_ms;
+            enqueue_battery_voltage(ctx, (int)(voltage_v * 1000.0f + 0.5f));
+            ESP_LOGD(TAG, "Battery %.2f V, %u %%, %s", voltage_v, battery_soc, battery_level_name(level));
+        }
+
+        // The running ADC holds the APB clock up, on the pad it only samples one frame per check interval
+        if (bean_power_in_pad_mode() && vbat_check_interval_ms > VBAT_FRAME_MS)
+        {
+            adc_continuous_stop(vbat_adc_handle);
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(vbat_check_interval_ms - VBAT_FRAME_MS));
+            adc_continuous_start(vbat_adc_handle);
+            battery_sag_history_reset(&sag_history); // The gap would break the timeline of the history
+        }
     }
 }
 
@@ -171,3 +423,13 @@ bool bean_battery_is_usb_powered(void)
     // Read the USB detection pin
     return gpio_get_level(PIN_USB_DET) == 1;
 }
+
+float bean_battery_get_voltage(void)
+{
+    return battery_voltage_v;
+}
+
+uint8_t bean_battery_get_soc(void)
+{
+    return battery_soc;
+}
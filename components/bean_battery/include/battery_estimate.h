@@ -0,0 +1,61 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Battery voltage filtering, state of charge and level with hysteresis, from the averaged ADC frames.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+#define BATTERY_FILTER_TAU_MS 4000 // Time constant of the IIR filter, long enough to ride over a servo move
+#define BATTERY_HYSTERESIS_V  0.05f // Recovery to a better level needs this much above the threshold
+#define BATTERY_FULL_MARGIN_V 0.05f // Full from this close to full_voltage
+
+typedef enum battery_level
+{
+    BATTERY_LEVEL_CRITICAL,
+    BATTERY_LEVEL_LOW,
+    BATTERY_LEVEL_NORMAL,
+    BATTERY_LEVEL_FULL,
+} battery_level_t;
+
+typedef struct battery_thresholds
+{
+    float full_v;
+    float low_v;
+    float critical_v;
+    float shutdown_v; // 0 % state of charge
+} battery_thresholds_t;
+
+typedef struct battery_filter
+{
+    bool initialized;
+    float voltage_v;
+} battery_filter_t;
+
+void battery_filter_reset(battery_filter_t *filter);
+
+/**
+ * @brief First order IIR low pass, the first sample initializes the filter.
+ *
+ * @param dt_ms Time since the previous sample, the weight of the sample grows with it
+ * @return Filtered voltage
+ */
+float battery_filter_update(battery_filter_t *filter, float voltage_v, uint32_t dt_ms);
+
+/**
+ * @brief State of charge from the resting voltage of a single LiPo cell, 0 to 100.
+ *
+ * The discharge curve is stretched so that shutdown_v reads 0 % and full_v 100 %. It is an open circuit curve: under
+ * load the estimate reads low, while charging it reads high.
+ */
+uint8_t battery_soc_percent(const battery_thresholds_t *thresholds, float voltage_v);
+
+/**
+ * @brief Level of the battery. It drops as soon as the voltage crosses a threshold, but only goes back up once the
+ * voltage is BATTERY_HYSTERESIS_V past it.
+ */
+battery_level_t battery_level_update(const battery_thresholds_t *thresholds, battery_level_t previous, float voltage_v);
+
+const char *battery_level_name(battery_level_t level);
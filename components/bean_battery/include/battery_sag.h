@@ -0,0 +1,63 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Battery sag capture around an actuation: a history of 1 kHz samples, the window around a trigger and the sag
+ * measured in it.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+#define BATTERY_SAG_RATE_HZ         1000
+#define BATTERY_SAG_PRE_MS          100 // Baseline before the trigger
+#define BATTERY_SAG_POST_MS         1000 // Longer than the pyro hold time
+#define BATTERY_SAG_WINDOW_SAMPLES  ((BATTERY_SAG_PRE_MS + BATTERY_SAG_POST_MS) * BATTERY_SAG_RATE_HZ / 1000)
+#define BATTERY_SAG_HISTORY_SAMPLES 2048 // The window and the ADC frame that completes it
+#define BATTERY_SAG_ONSET_MV        50 // Below the baseline, the sag starts
+#define BATTERY_SAG_RECOVERED_MV    20 // Back within this of the baseline, the sag is over
+
+typedef enum battery_sag_window
+{
+    BATTERY_SAG_PENDING, // The samples after the trigger are not all in yet
+    BATTERY_SAG_READY,
+    BATTERY_SAG_MISSED, // The samples before the trigger are gone already
+} battery_sag_window_t;
+
+typedef struct battery_sag_history
+{
+    uint16_t samples[BATTERY_SAG_HISTORY_SAMPLES];
+    uint32_t head; // Next write
+    uint32_t count;
+    int64_t last_us; // Time of the newest sample
+} battery_sag_history_t;
+
+typedef struct battery_sag_result
+{
+    uint16_t baseline_mv; // Average before the trigger
+    uint16_t min_mv;
+    int32_t min_ms; // From the trigger
+    int32_t onset_ms; // From the trigger, -1 without a sag
+    int32_t recovery_ms; // From the onset back to the baseline, -1 when it did not recover in the window
+} battery_sag_result_t;
+
+void battery_sag_history_reset(battery_sag_history_t *history);
+
+/**
+ * @brief Appends the next sample, taken 1 ms after the previous one.
+ *
+ * @param time_us Time of the sample, only kept for the newest one
+ */
+void battery_sag_history_push(battery_sag_history_t *history, uint16_t sample, int64_t time_us);
+
+/**
+ * @brief Copies the BATTERY_SAG_WINDOW_SAMPLES from BATTERY_SAG_PRE_MS before the trigger.
+ */
+battery_sag_window_t battery_sag_history_window(const battery_sag_history_t *history,
+                                                int64_t trigger_us,
+                                                uint16_t window[BATTERY_SAG_WINDOW_SAMPLES]);
+
+/**
+ * @brief Measures the sag in a window of voltages in mV.
+ */
+void battery_sag_analyze(const uint16_t window_mv[BATTERY_SAG_WINDOW_SAMPLES], battery_sag_result_t *result);
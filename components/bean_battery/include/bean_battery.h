@@ -2,5 +2,30 @@
 #include "esp_err.h"
 #include "bean_context.h"
 
+#define BEAN_BATTERY_TASK_STACK_SIZE 3072
+#define BEAN_BATTERY_TASK_PRIORITY   (tskIDLE_PRIORITY + 2) // A frame is timestamped when the task wakes up for it
+
 esp_err_t bean_battery_init(bean_context_t *ctx);
 bool bean_battery_is_usb_powered(void);
+
+/**
+ * @brief Filtered battery voltage, 0 until the first ADC frame.
+ */
+float bean_battery_get_voltage(void);
+
+/**
+ * @brief State of charge estimated from the filtered voltage, 0 to 100 (see battery_estimate.h).
+ */
+uint8_t bean_battery_get_soc(void);
+
+/**
+ * @brief Captures the battery voltage at 1 kHz around an actuation, call it right after switching the load on.
+ *
+ * Once the window is complete the monitor logs an EVENT_ID_BATTERY_SAG line with the sag and the recovery time, and
+ * the waveform as MEASUREMENT_TYPE_BATTERY_SAG entries. An actuation in the window of a pending capture is counted in
+ * it instead of starting another one. Does not block.
+ *
+ * @param source Name of the actuation, a string literal
+ * @return ESP_ERR_INVALID_STATE when `sag_capture` is off or the monitor is not running
+ */
+esp_err_t bean_battery_capture_sag(const char *source);
@@ -2,12 +2,146 @@
 #include "bean_beep.h"
 #include "driver/mcpwm.h"
 #include "bean_context.h"
+#include "bean_power.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
 #include "freertos/task.h"
 
 #define BEEP_MCPWM_UNIT  MCPWM_UNIT_0
 #define BEEP_MCPWM_TIMER MCPWM_TIMER_0
 
+typedef struct beep_command
+{
+    bool stop;
+    beep_sequence_t sequence; // Only the priority counts for a stop
+} beep_command_t;
+
+// One-shot sequences play in the foreground, over the repeating one in the background
+typedef struct beep_player
+{
+    bool active;
+    beep_sequence_t sequence;
+    uint8_t index; // Next note
+    TickType_t start; // Of the current repetition
+    TickType_t note_start;
+    TickType_t note_ticks;
+} beep_player_t;
+
+static bool initialized         = false; // The buzzer is optional, the boot goes on when its init fails
+static QueueHandle_t beep_queue = NULL;
+static beep_player_t foreground;
+static beep_player_t background;
+static bool sounding = false; // Light sleep would stop the tone halfway
+
+static void tone(uint32_t frequency)
+{
+    if (frequency == 0)
+    {
+        // Set duty to 0 to silence
+        mcpwm_set_duty(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_A, 0.0);
+        mcpwm_set_duty(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_B, 0.0);
+        if (sounding)
+            bean_power_release(BEAN_POWER_LOCK_BEEP);
+        sounding = false;
+        return;
+    }
+
+    if (!sounding)
+        bean_power_acquire(BEAN_POWER_LOCK_BEEP);
+    sounding = true;
+
+    // Set frequency and 50% duty
+    mcpwm_set_frequency(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, frequency);
+    mcpwm_set_duty(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_A, 50.0);
+    mcpwm_set_duty(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_B, 50.0);
+    mcpwm_set_duty_type(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_B, MCPWM_DUTY_MODE_1); // Inverted
+}
+
+static void start_player(beep_player_t *player, const beep_sequence_t *sequence, TickType_t now)
+{
+    player->active     = true;
+    player->sequence   = *sequence;
+    player->index      = 0;
+    player->start      = now;
+    player->note_start = now;
+    player->note_ticks = 0;
+}
+
+// Plays the note that is due, returns the ticks until something has to happen again
+static TickType_t step(beep_player_t *player, TickType_t now)
+{
+    TickType_t elapsed = now - player->note_start;
+    if (elapsed < player->note_ticks)
+        return player->note_ticks - elapsed;
+
+    if (player->index >= player->sequence.count)
+    {
+        tone(0);
+        if (player->sequence.repeat_ms == 0)
+        {
+            player->active = false;
+            // The background starts over once the foreground is done
+            if (player == &foreground && background.active)
+                start_player(&background, &background.sequence, now);
+            return 0;
+        }
+
+        TickType_t period = pdMS_TO_TICKS(player->sequence.repeat_ms);
+        if (now - player->start < period)
+            return period - (now - player->start);
+        player->start = now;
+        player->index = 0;
+        if (player->sequence.count == 0)
+            return period;
+    }
+
+    const beep_note_t *note = &player->sequence.notes[player->index++];
+    tone(note->frequency_hz);
+    player->note_start = now;
+    player->note_ticks = pdMS_TO_TICKS(note->duration_ms);
+    if (player->note_ticks == 0)
+        player->note_ticks = 1;
+    return player->note_ticks;
+}
+
+static void handle_command(const beep_command_t *command, TickType_t now)
+{
+    beep_priority_t priority = command->sequence.priority;
+    if (command->stop)
+    {
+        if (background.active && background.sequence.priority <= priority)
+        {
+            background.active = false;
+            if (!foreground.active)
+                tone(0);
+        }
+        return;
+    }
+
+    // A lower priority never cuts in, for example the armed chirp after the landed locator
+    beep_player_t *player = command->sequence.repeat_ms > 0 ? &background : &foreground;
+    if (player->active && priority < player->sequence.priority)
+        return;
+    start_player(player, &command->sequence, now);
+}
+
+static void vtask_beeper(void *pvParameter)
+{
+    beep_command_t command;
+    while (1)
+    {
+        TickType_t wait = portMAX_DELAY;
+        if (foreground.active)
+            wait = step(&foreground, xTaskGetTickCount());
+        else if (background.active)
+            wait = step(&background, xTaskGetTickCount());
+
+        // A new command cuts the wait short, so it can preempt the note that is playing
+        if (xQueueReceive(beep_queue, &command, wait) == pdTRUE)
+            handle_command(&command, xTaskGetTickCount());
+    }
+}
+
 esp_err_t bean_beep_init()
 {
     // Initialize MCPWM GPIOs
@@ -29,22 +163,44 @@ esp_err_t bean_beep_init()
     // Set complementary output: A = PWM, B = inverted PWM
     mcpwm_set_duty_type(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_A, MCPWM_DUTY_MODE_0);
     mcpwm_set_duty_type(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_B, MCPWM_DUTY_MODE_1); // Inverted
+
+    beep_queue = xQueueCreate(BEAN_BEEP_QUEUE_LENGTH, sizeof(beep_command_t));
+    if (beep_queue == NULL)
+        return ESP_ERR_NO_MEM;
+    TaskHandle_t handle = NULL;
+    xTaskCreate(&vtask_beeper, "beeper", BEAN_BEEP_TASK_STACK_SIZE, NULL, tskIDLE_PRIORITY + 1, &handle);
+    if (handle == NULL)
+        return ESP_FAIL;
+
+    initialized = true;
     return ESP_OK;
 }
 
-esp_err_t bean_beep_sound(uint32_t frequency, uint32_t duration)
+static esp_err_t send_command(const beep_command_t *command)
 {
-    // Set frequency and 50% duty
-    mcpwm_set_frequency(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, frequency); // Not available in ESP-IDF, so:
-    mcpwm_set_duty(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_A, 50.0);
-    mcpwm_set_duty(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_B, 50.0);
-    mcpwm_set_duty_type(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_B, MCPWM_DUTY_MODE_1); // Inverted
+    if (!initialized)
+        return ESP_ERR_INVALID_STATE;
+    // Never wait, the caller returns right away
+    return xQueueSend(beep_queue, command, 0) == pdPASS ? ESP_OK : ESP_FAIL;
+}
 
-    // Wait for duration
-    vTaskDelay(duration / portTICK_PERIOD_MS);
+esp_err_t bean_beep_play(const beep_sequence_t *sequence)
+{
+    beep_command_t command = { .sequence = *sequence };
+    return send_command(&command);
+}
 
-    // Set duty to 0 to silence
-    mcpwm_set_duty(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_A, 0.0);
-    mcpwm_set_duty(BEEP_MCPWM_UNIT, BEEP_MCPWM_TIMER, MCPWM_OPR_B, 0.0);
-    return ESP_OK;
+esp_err_t bean_beep_sound(uint32_t frequency, uint32_t duration)
+{
+    beep_command_t command;
+    beep_sequence_init(&command.sequence, BEEP_PRIORITY_FEEDBACK, 0);
+    beep_sequence_add(&command.sequence, frequency, duration);
+    command.stop = false;
+    return send_command(&command);
+}
+
+esp_err_t bean_beep_stop(beep_priority_t priority)
+{
+    beep_command_t command = { .stop = true, .sequence = { .priority = priority } };
+    return send_command(&command);
 }
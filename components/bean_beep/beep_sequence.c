@@ -0,0 +1,67 @@
+#include "beep_sequence.h"
+#include <string.h>
+
+void beep_sequence_init(beep_sequence_t *seq, beep_priority_t priority, uint32_t repeat_ms)
+{
+    memset(seq, 0, sizeof(*seq));
+    seq->priority  = priority;
+    seq->repeat_ms = repeat_ms;
+}
+
+bool beep_sequence_add(beep_sequence_t *seq, uint32_t frequency_hz, uint32_t duration_ms)
+{
+    if (seq->count >= BEEP_SEQUENCE_MAX_NOTES)
+        return false;
+    if (duration_ms > UINT16_MAX)
+        duration_ms = UINT16_MAX;
+    seq->notes[seq->count].frequency_hz = (uint16_t)frequency_hz;
+    seq->notes[seq->count].duration_ms  = (uint16_t)duration_ms;
+    seq->count++;
+    return true;
+}
+
+bool beep_sequence_add_notes(beep_sequence_t *seq, const int32_t *notes, uint8_t count, uint32_t duration_ms)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (!beep_sequence_add(seq, notes[i] > 0 ? (uint32_t)notes[i] : 0, duration_ms))
+            return false;
+    }
+    return true;
+}
+
+bool beep_sequence_add_altitude(beep_sequence_t *seq, float altitude_m)
+{
+    uint32_t altitude = altitude_m > 0.0f ? (uint32_t)(altitude_m + 0.5f) : 0;
+    if (altitude > BEEP_ALTITUDE_MAX_M)
+        altitude = BEEP_ALTITUDE_MAX_M;
+
+    // Most significant digit first
+    uint32_t divisor = 1;
+    while (divisor * 10 <= altitude)
+        divisor *= 10;
+
+    for (; divisor > 0; divisor /= 10)
+    {
+        uint32_t digit = altitude / divisor % 10;
+        if (digit == 0 && !beep_sequence_add(seq, BEEP_DIGIT_FREQUENCY_HZ, BEEP_ZERO_NOTE_MS))
+            return false;
+        for (uint32_t i = 0; i < digit; i++)
+        {
+            if (!beep_sequence_add(seq, BEEP_DIGIT_FREQUENCY_HZ, BEEP_DIGIT_NOTE_MS) ||
+                (i + 1 < digit && !beep_sequence_add(seq, 0, BEEP_DIGIT_REST_MS)))
+                return false;
+        }
+        if (!beep_sequence_add(seq, 0, BEEP_DIGIT_GAP_MS))
+            return false;
+    }
+    return true;
+}
+
+uint32_t beep_sequence_duration_ms(const beep_sequence_t *seq)
+{
+    uint32_t duration_ms = 0;
+    for (uint8_t i = 0; i < seq->count; i++)
+        duration_ms += seq->notes[i].duration_ms;
+    return duration_ms;
+}
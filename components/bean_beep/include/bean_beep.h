@@ -1,9 +1,36 @@
 #pragma once
 #include "esp_err.h"
+#include "beep_sequence.h"
 
+#define BEAN_BEEP_TASK_STACK_SIZE 2560
+#define BEAN_BEEP_QUEUE_LENGTH    4
+
+/**
+ * @brief Sets up the buzzer and starts the beeper task.
+ */
 esp_err_t bean_beep_init();
+
+/**
+ * @brief Plays a sequence, the call returns right away.
+ *
+ * A one-shot sequence (repeat_ms 0) plays over the repeating one, which starts over once it is done. A repeating
+ * sequence replaces the repeating one. Either way a sequence only cuts in when its priority is at least as high as
+ * the one it replaces, the latest wins between equals.
+ *
+ * @return ESP_ERR_INVALID_STATE without a buzzer, ESP_FAIL when the queue is full and the sequence was dropped
+ */
+esp_err_t bean_beep_play(const beep_sequence_t *sequence);
+
+/**
+ * @brief Plays one note as a one-shot feedback sequence, the call returns right away.
+ */
 esp_err_t bean_beep_sound(uint32_t frequency, uint32_t duration_ms);
 
+/**
+ * @brief Stops the repeating sequence unless its priority is higher, a one-shot sequence plays to its end.
+ */
+esp_err_t bean_beep_stop(beep_priority_t priority);
+
 enum notes
 {
     NOTE_C4 = 261,
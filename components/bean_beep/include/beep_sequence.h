@@ -0,0 +1,64 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Note sequences for the beeper task: tunes, the per-state patterns of the config and the altitude beep-out.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+#define BEEP_SEQUENCE_MAX_NOTES   80
+#define BEEP_ALTITUDE_MAX_M       9999 // Four digits are read out at most
+#define BEEP_DIGIT_FREQUENCY_HZ   2093 // NOTE_C7
+#define BEEP_DIGIT_NOTE_MS        150
+#define BEEP_DIGIT_REST_MS        250 // Between the beeps of one digit
+#define BEEP_DIGIT_GAP_MS         1000 // Between two digits
+#define BEEP_ZERO_NOTE_MS         600 // A zero is one long beep
+
+typedef enum beep_priority
+{
+    BEEP_PRIORITY_FEEDBACK, // Startup tune, console
+    BEEP_PRIORITY_STATE, // Pad patterns like the armed chirp
+    BEEP_PRIORITY_LOCATOR, // Recovery after landing
+} beep_priority_t;
+
+typedef struct beep_note
+{
+    uint16_t frequency_hz; // 0 is a rest
+    uint16_t duration_ms;
+} beep_note_t;
+
+typedef struct beep_sequence
+{
+    beep_note_t notes[BEEP_SEQUENCE_MAX_NOTES];
+    uint8_t count;
+    beep_priority_t priority;
+    uint32_t repeat_ms; // Start to start when it repeats, 0 plays it once
+} beep_sequence_t;
+
+void beep_sequence_init(beep_sequence_t *seq, beep_priority_t priority, uint32_t repeat_ms);
+
+/**
+ * @brief Appends a note, or a rest with frequency 0.
+ *
+ * @return false when the sequence is full
+ */
+bool beep_sequence_add(beep_sequence_t *seq, uint32_t frequency_hz, uint32_t duration_ms);
+
+/**
+ * @brief Appends notes of the same duration, as they are given in the config.
+ */
+bool beep_sequence_add_notes(beep_sequence_t *seq, const int32_t *notes, uint8_t count, uint32_t duration_ms);
+
+/**
+ * @brief Appends the altitude read out digit by digit: n short beeps for the digit n, one long beep for a zero.
+ *
+ * Meters, rounded and clamped to BEEP_ALTITUDE_MAX_M, negative altitudes read as 0.
+ */
+bool beep_sequence_add_altitude(beep_sequence_t *seq, float altitude_m);
+
+/**
+ * @brief Total duration of the notes.
+ */
+uint32_t beep_sequence_duration_ms(const beep_sequence_t *seq);
@@ -0,0 +1,483 @@
+#include "bean_console.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_console.h"
+#include "cmd_system.h"
+#include "cJSON.h"
+#include "bean_context.h"
+#include "bean_metrics.h"
+#include "bean_trace.h"
+#include "bean_storage.h"
+#include "bean_storage_bench.h"
+#include "bean_power.h"
+#include "bean_flight.h"
+
+#define CONFIG_ERROR_LENGTH 128
+#define HOLD_WAIT_MS        1000 // For the acquisition task to take the hold, a few samples
+
+static const char *TAG = "BEAN_CONSOLE";
+
+static const char *config_usage = "config get [path]\n"
+                                  "config set [--save] <path>=<value> ...\n"
+                                  "config set [--save] {\\\"bean_battery\\\":{\\\"check_interval_ms\\\":1000}}\n"
+                                  "config save\n";
+
+// Walks a dotted path like bean_core.airbrake.kp, an empty path is the root
+static const cJSON *find_path(const cJSON *json, const char *path)
+{
+    char key[BEAN_CONFIG_PATH_LENGTH];
+    while (json && *path)
+    {
+        const char *dot = strchr(path, '.');
+        size_t length   = dot ? (size_t)(dot - path) : strlen(path);
+        if (length >= sizeof(key))
+            return NULL;
+        memcpy(key, path, length);
+        key[length] = '\0';
+        json        = cJSON_GetObjectItemCaseSensitive(json, key);
+        path += dot ? length + 1 : length;
+    }
+    return json;
+}
+
+static int config_get(const char *path)
+{
+    bean_context_config_begin();
+    cJSON *config      = bean_config_encode(bean_config_get());
+    const cJSON *value = find_path(config, path);
+    char *text         = value ? cJSON_Print(value) : NULL;
+    if (text)
+        printf("%s\n", text);
+    else
+        printf("Unknown setting '%s'\n", path);
+    cJSON_free(text);
+    cJSON_Delete(config);
+    bean_context_config_end();
+    return text ? 0 : 1;
+}
+
+// A value that is no JSON literal (a number, true, [1,2]) is taken as a string, so quotes are not needed
+static cJSON *parse_value(const char *value)
+{
+    cJSON *json = cJSON_Parse(value);
+    return json ? json : cJSON_CreateString(value);
+}
+
+// Adds path=value to the patch, creating the objects along the path
+static bool add_setting(cJSON *patch, char *assignment)
+{
+    char *value = strchr(assignment, '=');
+    if (!value || value == assignment)
+        return false;
+    *value++ = '\0';
+
+    cJSON *node = patch;
+    char *save  = NULL;
+    char *key   = strtok_r(assignment, ".", &save);
+    while (key)
+    {
+        char *next = strtok_r(NULL, ".", &save);
+        if (!next)
+        {
+            cJSON_DeleteItemFromObjectCaseSensitive(node, key);
+            cJSON_AddItemToObject(node, key, parse_value(value));
+            return true;
+        }
+
+        cJSON *child = cJSON_GetObjectItemCaseSensitive(node, key);
+        if (!child)
+            child = cJSON_AddObjectToObject(node, key);
+        if (!cJSON_IsObject(child))
+            return false;
+        node = child;
+        key  = next;
+    }
+    return false;
+}
+
+// The console strips unescaped quotes and splits at spaces, a raw JSON patch is glued back together
+static char *build_patch(int argc, char **argv)
+{
+    if (argv[0][0] == '{')
+    {
+        size_t length = 1;
+        for (int i = 0; i < argc; i++)
+            length += strlen(argv[i]) + 1;
+        char *patch = malloc(length);
+        if (!patch)
+            return NULL;
+        patch[0] = '\0';
+        for (int i = 0; i < argc; i++)
+        {
+            strcat(patch, argv[i]);
+            if (i + 1 < argc)
+                strcat(patch, " ");
+        }
+        return patch;
+    }
+
+    cJSON *patch = cJSON_CreateObject();
+    for (int i = 0; patch && i < argc; i++)
+    {
+        if (!add_setting(patch, argv[i]))
+        {
+            printf("Expected <path>=<value>, got '%s'\n", argv[i]);
+            cJSON_Delete(patch);
+            return NULL;
+        }
+    }
+    char *text = cJSON_PrintUnformatted(patch);
+    cJSON_Delete(patch);
+    if (!text)
+        return NULL;
+
+    // Handed out as a plain malloc'd string like the raw patch above
+    char *copy = strdup(text);
+    cJSON_free(text);
+    return copy;
+}
+
+static int config_save(void)
+{
+    esp_err_t ret = bean_storage_save_config();
+    if (ret != ESP_OK)
+    {
+        printf("Saving failed: %s\n", esp_err_to_name(ret));
+        return 1;
+    }
+    printf("Saved\n");
+    return 0;
+}
+
+static int config_set(int argc, char **argv)
+{
+    bool save = argc > 0 && strcmp(argv[0], "--save") == 0;
+    if (save)
+    {
+        argc--;
+        argv++;
+    }
+    if (argc < 1)
+    {
+        printf("%s", config_usage);
+        return 1;
+    }
+
+    char *patch = build_patch(argc, argv);
+    if (!patch)
+        return 1;
+
+    char error[CONFIG_ERROR_LENGTH] = "";
+    esp_err_t ret                   = bean_context_apply_config_patch(patch, error, sizeof(error));
+    free(patch);
+    if (ret != ESP_OK)
+    {
+        printf("Rejected: %s\n", error[0] ? error : esp_err_to_name(ret));
+        return 1;
+    }
+    printf("Applied\n");
+    return save ? config_save() : 0;
+}
+
+static int cmd_config(int argc, char **argv)
+{
+    if (argc >= 2 && strcmp(argv[1], "get") == 0)
+        return config_get(argc > 2 ? argv[2] : "");
+    if (argc >= 2 && strcmp(argv[1], "set") == 0)
+        return config_set(argc - 2, argv + 2);
+    if (argc == 2 && strcmp(argv[1], "save") == 0)
+        return config_save();
+
+    printf("%s", config_usage);
+    return 1;
+}
+
+static esp_err_t register_config_command(void)
+{
+    const esp_console_cmd_t command = {
+        .command = "config",
+        .help    = "Shows or changes the running configuration, without a reboot. "
+                   "Changes are lost at the next boot unless saved to conf.json.",
+        .hint    = "get [path] | set [--save] <path>=<value> ... | save",
+        .func    = &cmd_config,
+    };
+    return esp_console_cmd_register(&command);
+}
+
+static int cmd_power(int argc, char **argv)
+{
+    bean_power_print_report();
+    return 0;
+}
+
+static esp_err_t register_power_command(void)
+{
+    const esp_console_cmd_t command = {
+        .command = "power",
+        .help    = "Shows the power mode, the light sleep wakeups and residency since the mode was entered, "
+                   "and the time spent in each clock mode and lock.",
+        .func    = &cmd_power,
+    };
+    return esp_console_cmd_register(&command);
+}
+
+static int cmd_metrics(int argc, char **argv)
+{
+    bean_metrics_print();
+    return 0;
+}
+
+static esp_err_t register_metrics_command(void)
+{
+    const esp_console_cmd_t command = {
+        .command = "metrics",
+        .help    = "Shows the CPU share and free stack of the watched tasks, the queues, the heap and the error and "
+                   "drop counters.",
+        .func    = &cmd_metrics,
+    };
+    return esp_console_cmd_register(&command);
+}
+
+static const char *trace_usage = "Usage: trace [status | dump | mark [arg]]\n";
+
+static int cmd_trace(int argc, char **argv)
+{
+    if (argc == 1 || (argc == 2 && strcmp(argv[1], "status") == 0))
+    {
+        bean_trace_print_status();
+        return 0;
+    }
+    if (argc == 2 && strcmp(argv[1], "dump") == 0)
+    {
+        esp_err_t ret = bean_trace_dump(STORAGE_BASE_PATH "/trace.bin");
+        if (ret != ESP_OK)
+        {
+            printf("Dump failed: %s\n", esp_err_to_name(ret));
+            return 1;
+        }
+        printf("Written to %s\n", STORAGE_BASE_PATH "/trace.bin");
+        return 0;
+    }
+    if ((argc == 2 || argc == 3) && strcmp(argv[1], "mark") == 0)
+    {
+        BEAN_TRACE(BEAN_TRACE_MARK, argc == 3 ? atoi(argv[2]) : 0);
+        return 0;
+    }
+
+    printf("%s", trace_usage);
+    return 1;
+}
+
+static esp_err_t register_trace_command(void)
+{
+    const esp_console_cmd_t command = {
+        .command = "trace",
+        .help    = "Shows the trace recorder, writes its rings to trace.bin or records a mark. "
+                   "tools/trace_convert turns the file into a Perfetto timeline.",
+        .hint    = "[status | dump | mark [arg]]",
+        .func    = &cmd_trace,
+    };
+    return esp_console_cmd_register(&command);
+}
+
+static int cmd_standby(int argc, char **argv)
+{
+    esp_err_t ret = bean_flight_request_standby();
+    if (ret != ESP_OK)
+    {
+        printf("Standby not possible: %s\n", esp_err_to_name(ret));
+        return 1;
+    }
+    printf("Going to standby, moving the board wakes it up\n");
+    return 0;
+}
+
+static esp_err_t register_standby_command(void)
+{
+    const esp_console_cmd_t command = {
+        .command = "standby",
+        .help    = "Closes the logs and puts the board into deep sleep until it is moved. Only on the pad, and only "
+                   "with the accelerometer interrupt wired to an RTC GPIO.",
+        .func    = &cmd_standby,
+    };
+    return esp_console_cmd_register(&command);
+}
+
+static int cmd_hold(int argc, char **argv)
+{
+    bool hold     = strcmp(argv[0], "disarm") == 0;
+    esp_err_t ret = bean_flight_hold(hold);
+    for (int waited_ms = 0; ret == ESP_OK && bean_flight_is_held() != hold; waited_ms += 10)
+    {
+        if (waited_ms >= HOLD_WAIT_MS || bean_flight_get_state() > FLIGHT_STATE_ARMED)
+            ret = ESP_ERR_TIMEOUT;
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    if (ret != ESP_OK)
+    {
+        printf("Not possible: %s\n", esp_err_to_name(ret));
+        return 1;
+    }
+    printf(hold ? "Held on the pad, `arm` releases it\n" : "Released, the launch detection arms after the pad wait\n");
+    return 0;
+}
+
+static esp_err_t register_hold_commands(void)
+{
+    const esp_console_cmd_t disarm = {
+        .command = "disarm",
+        .help    = "Holds the flight in pre_launch: the launch detection is disarmed until `arm`, config patches "
+                   "included. Only on the pad, needed by `bench`.",
+        .func    = &cmd_hold,
+    };
+    const esp_console_cmd_t arm = {
+        .command = "arm",
+        .help    = "Releases the hold of `disarm`, the launch detection arms after the pre_launch wait.",
+        .func    = &cmd_hold,
+    };
+    ESP_RETURN_ON_ERROR(esp_console_cmd_register(&disarm), TAG, "Failed to register disarm");
+    return esp_console_cmd_register(&arm);
+}
+
+static const char *bench_usage = "Usage: bench [--record <bytes>,..] [--buffer <bytes>,..] "
+                                 "[--sync close|periodic|record,..] [--kb <per run>] [--stall-ms <ms>]\n";
+
+static bool parse_number(const char *text, uint32_t *value)
+{
+    char *end;
+    long number = strtol(text, &end, 10);
+    *value      = (uint32_t)number;
+    return end != text && *end == '\0' && number >= 0;
+}
+
+// A comma separated list of numbers, at most BEAN_STORAGE_BENCH_MAX_VALUES
+static bool parse_sizes(char *list, uint32_t *values, uint8_t *count)
+{
+    *count = 0;
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        if (*count >= BEAN_STORAGE_BENCH_MAX_VALUES || !parse_number(item, &values[*count]))
+            return false;
+        (*count)++;
+    }
+    return *count > 0;
+}
+
+static bool parse_syncs(char *list, bean_storage_bench_sync_t *syncs, uint8_t *count)
+{
+    *count = 0;
+    for (char *item = strtok(list, ","); item; item = strtok(NULL, ","))
+    {
+        bean_storage_bench_sync_t sync = 0;
+        while (sync < BEAN_STORAGE_BENCH_SYNC_COUNT && strcmp(item, bean_storage_bench_sync_name(sync)) != 0)
+            sync++;
+        if (sync == BEAN_STORAGE_BENCH_SYNC_COUNT || *count >= BEAN_STORAGE_BENCH_MAX_VALUES)
+            return false;
+        syncs[(*count)++] = sync;
+    }
+    return *count > 0;
+}
+
+static int cmd_bench(int argc, char **argv)
+{
+    bean_storage_bench_plan_t plan;
+    bean_storage_bench_default_plan(&plan);
+
+    bool ok = argc % 2 == 1;
+    for (int i = 1; ok && i + 1 < argc; i += 2)
+    {
+        uint32_t value = 0;
+        if (strcmp(argv[i], "--record") == 0)
+            ok = parse_sizes(argv[i + 1], plan.record_sizes, &plan.record_size_count);
+        else if (strcmp(argv[i], "--buffer") == 0)
+            ok = parse_sizes(argv[i + 1], plan.buffer_sizes, &plan.buffer_size_count);
+        else if (strcmp(argv[i], "--sync") == 0)
+            ok = parse_syncs(argv[i + 1], plan.syncs, &plan.sync_count);
+        else if (strcmp(argv[i], "--kb") == 0)
+        {
+            ok             = parse_number(argv[i + 1], &value);
+            plan.run_bytes = value * 1024;
+        }
+        else if (strcmp(argv[i], "--stall-ms") == 0)
+        {
+            ok            = parse_number(argv[i + 1], &value);
+            plan.stall_us = value * 1000;
+        }
+        else
+            ok = false;
+    }
+    if (!ok)
+    {
+        printf("%s", bench_usage);
+        return 1;
+    }
+
+    // The runs take the flash from the loggers for minutes, the hold keeps the launch detection off all along: only
+    // `arm` releases it and the console runs one command at a time
+    if (!bean_flight_is_held())
+    {
+        printf("Only while held on the pad, run `disarm` first\n");
+        return 1;
+    }
+
+    esp_err_t ret = bean_storage_bench(&plan, STORAGE_BASE_PATH "/" BEAN_STORAGE_BENCH_JSON_NAME);
+    if (!bean_flight_is_held())
+        ESP_LOGW(TAG, "Hold lost during the benchmark");
+    if (ret != ESP_OK)
+    {
+        printf("Benchmark failed: %s\n", esp_err_to_name(ret));
+        return 1;
+    }
+    printf("Written to %s\n", STORAGE_BASE_PATH "/" BEAN_STORAGE_BENCH_JSON_NAME);
+    return 0;
+}
+
+static esp_err_t register_bench_command(void)
+{
+    const esp_console_cmd_t command = {
+        .command = "bench",
+        .help    = "Benchmarks the storage: writes synthetic logs for every combination of record size, stdio buffer "
+                   "and sync policy, prints the throughput and latencies and writes them to bench.json. Only while "
+                   "held with `disarm`, the loggers keep writing next to it. Without options it runs the default plan of 27 runs.",
+        .hint    = "[--record <bytes>,..] [--buffer <bytes>,..] [--sync close|periodic|record,..] [--kb <n>] "
+                   "[--stall-ms <ms>]",
+        .func    = &cmd_bench,
+    };
+    return esp_console_cmd_register(&command);
+}
+
+esp_err_t bean_console_init(void)
+{
+    esp_console_repl_t *repl              = NULL;
+    esp_console_repl_config_t repl_config = ESP_CONSOLE_REPL_CONFIG_DEFAULT();
+    repl_config.prompt                    = BEAN_CONSOLE_PROMPT;
+    repl_config.task_stack_size           = BEAN_CONSOLE_TASK_STACK_SIZE;
+    repl_config.max_cmdline_length        = 512;
+
+#if defined(CONFIG_ESP_CONSOLE_USB_SERIAL_JTAG) || defined(CONFIG_ESP_CONSOLE_SECONDARY_USB_SERIAL_JTAG)
+    esp_console_dev_usb_serial_jtag_config_t hw_config = ESP_CONSOLE_DEV_USB_SERIAL_JTAG_CONFIG_DEFAULT();
+    ESP_RETURN_ON_ERROR(
+      esp_console_new_repl_usb_serial_jtag(&hw_config, &repl_config, &repl), TAG, "Failed to create the REPL");
+#else
+    esp_console_dev_uart_config_t hw_config = ESP_CONSOLE_DEV_UART_CONFIG_DEFAULT();
+    ESP_RETURN_ON_ERROR(esp_console_new_repl_uart(&hw_config, &repl_config, &repl), TAG, "Failed to create the REPL");
+#endif
+
+    ESP_RETURN_ON_ERROR(esp_console_register_help_command(), TAG, "Failed to register help");
+    register_system_common();
+    ESP_RETURN_ON_ERROR(register_config_command(), TAG, "Failed to register config");
+    ESP_RETURN_ON_ERROR(register_power_command(), TAG, "Failed to register power");
+    ESP_RETURN_ON_ERROR(register_standby_command(), TAG, "Failed to register standby");
+    ESP_RETURN_ON_ERROR(register_metrics_command(), TAG, "Failed to register metrics");
+    ESP_RETURN_ON_ERROR(register_trace_command(), TAG, "Failed to register trace");
+    ESP_RETURN_ON_ERROR(register_hold_commands(), TAG, "Failed to register disarm and arm");
+    ESP_RETURN_ON_ERROR(register_bench_command(), TAG, "Failed to register bench");
+    ESP_RETURN_ON_ERROR(esp_console_start_repl(repl), TAG, "Failed to start the REPL");
+    ESP_LOGI(TAG, "Console started");
+    return ESP_OK;
+}
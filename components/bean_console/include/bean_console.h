@@ -0,0 +1,14 @@
+#pragma once
+#include "esp_err.h"
+
+#define BEAN_CONSOLE_TASK_STACK_SIZE 6144
+#define BEAN_CONSOLE_PROMPT          "bean>"
+
+/**
+ * @brief Starts the console REPL with the system commands and `config`.
+ *
+ * The REPL runs on the USB Serial/JTAG port when it is a console (primary or secondary), on the UART otherwise.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t bean_console_init(void);
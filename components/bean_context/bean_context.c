@@ -1,5 +1,13 @@
 #include "bean_context.h"
-#include <esp_log.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bean_hal.h"
+#include "config_arena.h"
+#include "bean_context_internal.h"
+#include "bean_metrics.h"
 
 /* Linker symbols from EMBED_FILES */
 extern const uint8_t _binary_default_json_start[]; // start of bytes
@@ -7,13 +15,176 @@ extern const uint8_t _binary_default_json_end[]; // one past last byte
 
 static const char *TAG = "BEAN_CONTEXT";
 // Gets loaded with default at first & is overwritten with the stored conf.json
+// Only parsed when needed inside a config session, a boot that loads the snapshot never builds it
 static cJSON *config = NULL;
+// Decoded from the tree above, outlives it. A patch is decoded into the inactive buffer and swapped in, so a reader
+// never sees a half applied patch
+static bean_config_t config_buffers[2];
+static bean_config_t *typed_config   = &config_buffers[0];
+static bean_hal_mutex_t config_mutex = NULL;
+
+typedef struct config_subscriber
+{
+    bean_config_listener_t listener;
+    void *arg;
+} config_subscriber_t;
+
+static config_subscriber_t config_subscribers[BEAN_CONTEXT_CONFIG_LISTENERS];
+static uint8_t config_subscriber_count = 0;
+
+// Every cJSON allocation of a config session comes from this arena and is released in one go at the end
+static config_arena_t config_arena;
+static void *config_arena_buffer  = NULL;
+static bool config_session        = false;
+static size_t heap_free_before    = 0;
+static size_t heap_largest_before = 0;
+
+static void *arena_malloc(size_t size)
+{
+    void *ptr = config_arena_alloc(&config_arena, size);
+    return ptr ? ptr : malloc(size);
+}
+
+static void arena_free(void *ptr)
+{
+    if (ptr && !config_arena_owns(&config_arena, ptr))
+        free(ptr);
+}
+
+esp_err_t bean_context_config_begin(void)
+{
+    heap_free_before    = bean_hal_heap_free();
+    heap_largest_before = bean_hal_heap_largest_block();
+    config_session      = true;
+
+    config_arena_buffer = malloc(BEAN_CONTEXT_CONFIG_ARENA_SIZE);
+    if (!config_arena_buffer)
+    {
+        BEAN_LOGW(TAG, "No room for the config arena, parsing on the heap");
+        return ESP_ERR_NO_MEM;
+    }
+    config_arena_init(&config_arena, config_arena_buffer, BEAN_CONTEXT_CONFIG_ARENA_SIZE);
+    cJSON_Hooks hooks = { .malloc_fn = arena_malloc, .free_fn = arena_free };
+    cJSON_InitHooks(&hooks);
+    return ESP_OK;
+}
+
+void bean_context_config_end(void)
+{
+    // Only the nodes that did not fit in the arena are really freed here
+    cJSON_Delete(config);
+    config         = NULL;
+    config_session = false;
+    if (!config_arena_buffer)
+        return;
+
+    cJSON_InitHooks(NULL);
+    free(config_arena_buffer);
+    config_arena_buffer = NULL;
+    BEAN_LOGI(TAG,
+              "Config arena: peak %u of %u bytes, %" PRIu32 " allocations, %" PRIu32
+              " overflowed to the heap (%u bytes)",
+              (unsigned)config_arena.peak,
+              (unsigned)config_arena.size,
+              config_arena.allocations,
+              config_arena.overflows,
+              (unsigned)config_arena.overflow_bytes);
+    BEAN_LOGI(TAG,
+              "Heap: free %u -> %u bytes, largest block %u -> %u bytes, low water mark %u bytes",
+              (unsigned)heap_free_before,
+              (unsigned)bean_hal_heap_free(),
+              (unsigned)heap_largest_before,
+              (unsigned)bean_hal_heap_largest_block(),
+              (unsigned)bean_hal_heap_min_free());
+    config_arena_init(&config_arena, NULL, 0);
+}
+
+static void parse_default_config(void)
+{
+    if (config || !config_session)
+        return;
+
+    // Load the default.json in to the config
+    size_t len = (size_t)(_binary_default_json_end - _binary_default_json_start);
+    /* Parse directly from embedded bytes (may not be NUL-terminated) */
+    config = cJSON_ParseWithLength((const char *)_binary_default_json_start, len);
+    if (!config)
+    {
+        const char *err = cJSON_GetErrorPtr();
+        BEAN_LOGE(TAG, "Failed to parse embedded default.json: %s", err ? err : "(unknown)");
+        return;
+    }
+    BEAN_LOGI(TAG, "default.json parsed (%u bytes)", (unsigned)len);
+}
 
 const cJSON *config_store_get(void)
 {
+    parse_default_config();
     return config;
 }
 
+const bean_config_t *bean_config_get(void)
+{
+    return typed_config;
+}
+
+bean_config_t *bean_context_active_config(void)
+{
+    return typed_config;
+}
+
+esp_err_t bean_context_config_subscribe(bean_config_listener_t listener, void *arg)
+{
+    if (!listener)
+        return ESP_ERR_INVALID_ARG;
+    if (config_subscriber_count >= BEAN_CONTEXT_CONFIG_LISTENERS)
+        return ESP_ERR_NO_MEM;
+
+    bean_hal_mutex_lock(config_mutex);
+    config_subscribers[config_subscriber_count++] = (config_subscriber_t){ .listener = listener, .arg = arg };
+    bean_hal_mutex_unlock(config_mutex);
+    return ESP_OK;
+}
+
+esp_err_t bean_context_apply_config_patch(const char *patch_json, char *error, size_t error_length)
+{
+    if (!patch_json)
+        return ESP_ERR_INVALID_ARG;
+
+    bean_hal_mutex_lock(config_mutex);
+    bean_context_config_begin();
+
+    esp_err_t ret = ESP_OK;
+    cJSON *patch  = cJSON_Parse(patch_json);
+    if (!patch)
+    {
+        snprintf(error, error_length, "not valid JSON near '%.16s'", cJSON_GetErrorPtr() ? cJSON_GetErrorPtr() : "");
+        ret = ESP_ERR_INVALID_ARG;
+    }
+    else if (!bean_config_validate(patch, error, error_length))
+    {
+        ret = ESP_ERR_INVALID_ARG;
+    }
+    else
+    {
+        // Nothing is written to the active buffer, the swap is the only thing a reader can observe
+        bean_config_t *previous = typed_config;
+        bean_config_t *next     = previous == &config_buffers[0] ? &config_buffers[1] : &config_buffers[0];
+        *next                   = *previous;
+        bean_config_decode(next, patch);
+        typed_config = next;
+
+        for (uint8_t i = 0; i < config_subscriber_count; i++)
+            config_subscribers[i].listener(previous, next, config_subscribers[i].arg);
+        BEAN_LOGI(TAG, "Config patch applied, %u listeners notified", config_subscriber_count);
+    }
+
+    cJSON_Delete(patch);
+    bean_context_config_end();
+    bean_hal_mutex_unlock(config_mutex);
+    return ret;
+}
+
 static config_merge_result_t merge_array_config(cJSON *default_obj, const cJSON *stored_item, const char *current_path)
 {
     config_merge_result_t result = { 0 };
@@ -21,7 +192,7 @@ static config_merge_result_t merge_array_config(cJSON *default_obj, const cJSON
     cJSON *default_item = cJSON_GetObjectItem(default_obj, stored_item->string);
     if (!default_item || !cJSON_IsArray(default_item))
     {
-        ESP_LOGW(TAG, "Default config doesn't have array '%s' - ignoring", current_path);
+        BEAN_LOGW(TAG, "Default config doesn't have array '%s' - ignoring", current_path);
         result.items_ignored++;
         return result;
     }
@@ -58,7 +229,7 @@ static config_merge_result_t merge_array_config(cJSON *default_obj, const cJSON
 
     if (!type_consistent)
     {
-        ESP_LOGW(TAG, "Array '%s' has inconsistent types - keeping default", current_path);
+        BEAN_LOGW(TAG, "Array '%s' has inconsistent types - keeping default", current_path);
         result.type_mismatches++;
         return result;
     }
@@ -110,12 +281,12 @@ static config_merge_result_t merge_array_config(cJSON *default_obj, const cJSON
             cJSON_ReplaceItemInObject(default_obj, stored_item->string, array_copy);
             result.config_changed = true;
             result.items_updated++;
-            ESP_LOGI(TAG,
-                     "Updated %s array config '%s' (size: %d -> %d)",
-                     is_number_array ? "number" : (is_string_array ? "string" : "boolean"),
-                     current_path,
-                     default_size,
-                     stored_size);
+            BEAN_LOGI(TAG,
+                      "Updated %s array config '%s' (size: %d -> %d)",
+                      is_number_array ? "number" : (is_string_array ? "string" : "boolean"),
+                      current_path,
+                      default_size,
+                      stored_size);
         }
     }
 
@@ -146,7 +317,7 @@ static config_merge_result_t merge_json_recursive(cJSON *default_obj, const cJSO
 
         if (!default_item)
         {
-            ESP_LOGW(TAG, "Unknown config key '%s' - ignoring", current_path);
+            BEAN_LOGW(TAG, "Unknown config key '%s' - ignoring", current_path);
             result.items_ignored++;
             continue;
         }
@@ -179,7 +350,7 @@ static config_merge_result_t merge_json_recursive(cJSON *default_obj, const cJSO
                 cJSON_SetValuestring(default_item, cJSON_GetStringValue(stored_item));
                 result.config_changed = true;
                 result.items_updated++;
-                ESP_LOGI(TAG, "Updated string config '%s'", current_path);
+                BEAN_LOGI(TAG, "Updated string config '%s'", current_path);
             }
         }
         else if (cJSON_IsNumber(stored_item) && cJSON_IsNumber(default_item))
@@ -189,7 +360,7 @@ static config_merge_result_t merge_json_recursive(cJSON *default_obj, const cJSO
                 cJSON_SetNumberValue(default_item, cJSON_GetNumberValue(stored_item));
                 result.config_changed = true;
                 result.items_updated++;
-                ESP_LOGI(TAG, "Updated number config '%s'", current_path);
+                BEAN_LOGI(TAG, "Updated number config '%s'", current_path);
             }
         }
         else if (cJSON_IsBool(stored_item) && cJSON_IsBool(default_item))
@@ -200,12 +371,12 @@ static config_merge_result_t merge_json_recursive(cJSON *default_obj, const cJSO
                 cJSON_ReplaceItemInObject(default_obj, stored_item->string, new_bool);
                 result.config_changed = true;
                 result.items_updated++;
-                ESP_LOGI(TAG, "Updated boolean config '%s'", current_path);
+                BEAN_LOGI(TAG, "Updated boolean config '%s'", current_path);
             }
         }
         else
         {
-            ESP_LOGW(TAG, "Type mismatch for config key '%s' - keeping default", current_path);
+            BEAN_LOGW(TAG, "Type mismatch for config key '%s' - keeping default", current_path);
             result.type_mismatches++;
         }
     }
@@ -218,26 +389,28 @@ config_merge_result_t bean_context_initialize_config(cJSON *stored_config)
 
     config_merge_result_t result = { 0 };
 
+    parse_default_config();
     if (!config || !stored_config)
     {
-        ESP_LOGW(TAG, "Cannot initialize config - missing default or stored config");
+        BEAN_LOGW(TAG, "Cannot initialize config - missing default or stored config");
         return result;
     }
 
     result = merge_json_recursive(config, stored_config, NULL);
+    bean_config_decode(typed_config, config);
 
     if (result.config_changed || result.type_mismatches || result.items_ignored)
     {
         result.needs_storage_update = true;
-        ESP_LOGI(TAG,
-                 "Configuration merge complete: %d updated, %d ignored, %d type mismatches",
-                 result.items_updated,
-                 result.items_ignored,
-                 result.type_mismatches);
+        BEAN_LOGI(TAG,
+                  "Configuration merge complete: %d updated, %d ignored, %d type mismatches",
+                  result.items_updated,
+                  result.items_ignored,
+                  result.type_mismatches);
     }
     else
     {
-        ESP_LOGI(TAG, "No configuration changes needed");
+        BEAN_LOGI(TAG, "No configuration changes needed");
     }
 
     return result;
@@ -250,37 +423,58 @@ config_merge_result_t bean_context_initialize_config(cJSON *stored_config)
 esp_err_t bean_context_init(bean_context_t **ctx)
 {
 
-    *ctx = (bean_context_t *)malloc(sizeof(bean_context_t));
-
-    // Load the default.json in to the config
-    size_t len = (size_t)(_binary_default_json_end - _binary_default_json_start);
-    /* Parse directly from embedded bytes (may not be NUL-terminated) */
-    config = cJSON_ParseWithLength((const char *)_binary_default_json_start, len);
-    if (!config)
-    {
-        const char *err = cJSON_GetErrorPtr();
-
-        ESP_LOGE(TAG, "Failed to parse embedded default.json: %s", err ? err : "(unknown)");
-        return false;
-    }
-    ESP_LOGI(TAG, "default.json parsed (%u bytes)", (unsigned)len);
+    *ctx          = (bean_context_t *)malloc(sizeof(bean_context_t));
+    *typed_config = bean_config_defaults;
+    config_mutex  = bean_hal_mutex_create();
+    if (!config_mutex)
+        return ESP_ERR_NO_MEM;
 
     (*ctx)->is_not_usb_msc = false;
 
     if (!*ctx)
         return ESP_ERR_NO_MEM;
 
-    (*ctx)->system_event_group = xEventGroupCreate();
+    (*ctx)->system_event_group = bean_hal_event_group_create();
     if (!(*ctx)->system_event_group)
         return ESP_ERR_NO_MEM;
 
-    (*ctx)->event_queue = xQueueCreate(10, sizeof(event_data_t));
+    (*ctx)->event_queue = bean_hal_queue_create(BEAN_CONTEXT_EVENT_QUEUE_LENGTH, sizeof(event_data_t));
     if (!(*ctx)->event_queue)
         return ESP_ERR_NO_MEM;
 
-    (*ctx)->data_log_queue = xQueueCreate(10, sizeof(log_data_t));
+    (*ctx)->data_log_queue = bean_hal_queue_create(BEAN_CONTEXT_DATA_QUEUE_LENGTH, sizeof(log_data_t));
     if (!(*ctx)->data_log_queue)
         return ESP_ERR_NO_MEM;
 
     return ESP_OK;
 }
+
+esp_err_t bean_context_log_event(bean_context_t *ctx, event_id_t event_id, const char *fmt, ...)
+{
+    event_data_t event = { .event_id = event_id, .timestamp = bean_hal_time_ms(), .event_data = NULL };
+
+    va_list args;
+    va_start(args, fmt);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    event.event_data = malloc(len + 1);
+    if (!event.event_data)
+    {
+        bean_metrics_add(BEAN_METRIC_EVENTS_DROPPED, 1);
+        return ESP_ERR_NO_MEM;
+    }
+
+    va_start(args, fmt);
+    vsnprintf(event.event_data, len + 1, fmt, args);
+    va_end(args);
+
+    if (!bean_hal_queue_send(ctx->event_queue, &event, 0))
+    {
+        BEAN_LOGW(TAG, "Event queue full, dropping event %d", event_id);
+        bean_metrics_add(BEAN_METRIC_EVENTS_DROPPED, 1);
+        free(event.event_data);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,9 @@
+#pragma once
+#include "bean_context.h"
+
+// Shared between the files of bean_context only
+
+/**
+ * @brief Gets the active typed configuration for writing, for a load at boot while no patch can be applied.
+ */
+bean_config_t *bean_context_active_config(void);
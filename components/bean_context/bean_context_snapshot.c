@@ -0,0 +1,71 @@
+/*
+Description: The snapshot of the typed configuration in NVS, see bean_context_load_config_snapshot(). Only on the
+target, the host build has no NVS.
+*/
+
+#include <stdlib.h>
+#include "nvs.h"
+#include "bean_context.h"
+#include "bean_context_internal.h"
+
+#define SNAPSHOT_NAMESPACE "bean_config"
+#define SNAPSHOT_KEY_HASH  "file_hash"
+#define SNAPSHOT_KEY_DATA  "config"
+
+// The hash covers conf.json and, through the schema hash, the default.json the firmware was built with
+static uint64_t snapshot_hash(uint32_t file_hash)
+{
+    return ((uint64_t)BEAN_CONFIG_SCHEMA_HASH << 32) | file_hash;
+}
+
+esp_err_t bean_context_load_config_snapshot(uint32_t file_hash)
+{
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(SNAPSHOT_NAMESPACE, NVS_READONLY, &handle);
+    if (ret != ESP_OK)
+        return ret;
+
+    uint64_t stored_hash = 0;
+    ret                  = nvs_get_u64(handle, SNAPSHOT_KEY_HASH, &stored_hash);
+    if (ret == ESP_OK && stored_hash != snapshot_hash(file_hash))
+        ret = ESP_ERR_INVALID_VERSION;
+
+    // Read into a copy, a failed read must not leave a half written config behind
+    bean_config_t *snapshot = NULL;
+    size_t length           = sizeof(bean_config_t);
+    if (ret == ESP_OK)
+    {
+        snapshot = malloc(sizeof(bean_config_t));
+        ret      = snapshot ? nvs_get_blob(handle, SNAPSHOT_KEY_DATA, snapshot, &length) : ESP_ERR_NO_MEM;
+    }
+    if (ret == ESP_OK && length != sizeof(bean_config_t))
+        ret = ESP_ERR_INVALID_SIZE;
+    if (ret == ESP_OK)
+        *bean_context_active_config() = *snapshot;
+
+    free(snapshot);
+    nvs_close(handle);
+    return ret;
+}
+
+esp_err_t bean_context_store_config_snapshot(uint32_t file_hash)
+{
+    nvs_handle_t handle;
+    esp_err_t ret = nvs_open(SNAPSHOT_NAMESPACE, NVS_READWRITE, &handle);
+    if (ret != ESP_OK)
+        return ret;
+
+    // Hash last, a snapshot interrupted half way is never taken for valid
+    ret = nvs_erase_key(handle, SNAPSHOT_KEY_HASH);
+    if (ret == ESP_OK || ret == ESP_ERR_NVS_NOT_FOUND)
+        ret = nvs_set_blob(handle, SNAPSHOT_KEY_DATA, bean_config_get(), sizeof(bean_config_t));
+    if (ret == ESP_OK)
+        ret = nvs_commit(handle);
+    if (ret == ESP_OK)
+        ret = nvs_set_u64(handle, SNAPSHOT_KEY_HASH, snapshot_hash(file_hash));
+    if (ret == ESP_OK)
+        ret = nvs_commit(handle);
+
+    nvs_close(handle);
+    return ret;
+}
@@ -0,0 +1,61 @@
+#include "bean_metrics.h"
+#include <stdatomic.h>
+
+typedef struct metric_info
+{
+    const char *name;
+    bool peak; // Reset by every report, a counter only grows
+} metric_info_t;
+
+static const metric_info_t metric_info[BEAN_METRIC_COUNT] = {
+    [BEAN_METRIC_I2C_ERRORS]       = { "i2c_errors", false },
+    [BEAN_METRIC_SAMPLES_DROPPED]  = { "samples_dropped", false },
+    [BEAN_METRIC_EVENTS_DROPPED]   = { "events_dropped", false },
+    [BEAN_METRIC_DATA_QUEUE_PEAK]  = { "data_queue_peak", true },
+    [BEAN_METRIC_EVENT_QUEUE_PEAK] = { "event_queue_peak", true },
+    [BEAN_METRIC_FSYNCS]           = { "fsyncs", false },
+    [BEAN_METRIC_FSYNC_MAX_US]     = { "fsync_max_us", true },
+};
+
+static _Atomic uint32_t metric_values[BEAN_METRIC_COUNT];
+
+void bean_metrics_add(bean_metric_t metric, uint32_t amount)
+{
+    if (metric < BEAN_METRIC_COUNT)
+        atomic_fetch_add_explicit(&metric_values[metric], amount, memory_order_relaxed);
+}
+
+void bean_metrics_peak(bean_metric_t metric, uint32_t value)
+{
+    if (metric >= BEAN_METRIC_COUNT)
+        return;
+    uint32_t current = atomic_load_explicit(&metric_values[metric], memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(
+             &metric_values[metric], &current, value, memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+uint32_t bean_metrics_get(bean_metric_t metric)
+{
+    return metric < BEAN_METRIC_COUNT ? atomic_load_explicit(&metric_values[metric], memory_order_relaxed) : 0;
+}
+
+uint32_t bean_metrics_take(bean_metric_t metric)
+{
+    if (metric >= BEAN_METRIC_COUNT)
+        return 0;
+    if (metric_info[metric].peak)
+        return atomic_exchange_explicit(&metric_values[metric], 0, memory_order_relaxed);
+    return atomic_load_explicit(&metric_values[metric], memory_order_relaxed);
+}
+
+const char *bean_metrics_name(bean_metric_t metric)
+{
+    return metric < BEAN_METRIC_COUNT ? metric_info[metric].name : "unknown";
+}
+
+bool bean_metrics_is_peak(bean_metric_t metric)
+{
+    return metric < BEAN_METRIC_COUNT && metric_info[metric].peak;
+}
@@ -0,0 +1,236 @@
+#include "bean_metrics.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_heap_caps.h"
+
+/*
+ * The sampler task and the report, target-only: the counters themselves are in bean_metrics.c.
+ */
+
+#define METRICS_IDLE_POLL_MS  1000 // With the reports off, how often the sampler looks whether they were switched on
+#define METRICS_REPORT_LENGTH 640
+
+static const char *TAG = "BEAN_METRICS";
+
+typedef struct watched_task
+{
+    TaskHandle_t handle;
+    uint32_t runtime_base; // Run time counter at the last report
+} watched_task_t;
+
+static watched_task_t watched_tasks[BEAN_METRICS_MAX_TASKS];
+static volatile uint8_t watched_task_count = 0;
+static portMUX_TYPE watch_lock             = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t idle_runtime_base[portNUM_PROCESSORS];
+static int64_t report_base_us           = 0;
+static bean_context_t *metrics_ctx      = NULL;
+static TaskHandle_t metrics_task_handle = NULL;
+
+typedef struct task_figures
+{
+    const char *name;
+    uint32_t stack_free; // Bytes, the high-water mark
+    uint16_t cpu_permille; // Of one core, 0 without the run time stats
+} task_figures_t;
+
+typedef struct metrics_snapshot
+{
+    uint32_t values[BEAN_METRIC_COUNT];
+    uint32_t elapsed_ms; // Since the last report
+    uint32_t heap_free;
+    uint32_t heap_min_free;
+    uint32_t data_queue;
+    uint32_t event_queue;
+    uint16_t load_permille[portNUM_PROCESSORS]; // What the idle task of each core did not get
+    task_figures_t tasks[BEAN_METRICS_MAX_TASKS];
+    uint8_t task_count;
+} metrics_snapshot_t;
+
+esp_err_t bean_metrics_watch_task(bean_hal_task_t task)
+{
+    if (task == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    esp_err_t ret = ESP_OK;
+    portENTER_CRITICAL(&watch_lock);
+    if (watched_task_count < BEAN_METRICS_MAX_TASKS)
+        watched_tasks[watched_task_count++] = (watched_task_t){ .handle = task };
+    else
+        ret = ESP_ERR_NO_MEM;
+    portEXIT_CRITICAL(&watch_lock);
+    return ret;
+}
+
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+// The run time counter runs on the esp_timer (CONFIG_FREERTOS_RUN_TIME_STATS_USING_ESP_TIMER), so it is in us
+static uint16_t runtime_permille(TaskHandle_t task, uint32_t *base, uint32_t elapsed_us, bool report)
+{
+    uint32_t runtime = (uint32_t)ulTaskGetRunTimeCounter(task);
+    uint32_t used_us = runtime - *base;
+    if (report)
+        *base = runtime;
+    if (elapsed_us == 0)
+        return 0;
+    uint64_t permille = (uint64_t)used_us * 1000 / elapsed_us;
+    return permille > 1000 ? 1000 : (uint16_t)permille;
+}
+#endif
+
+// A report takes the peaks and moves the base of the CPU shares, a look from the console leaves them
+static void take_snapshot(metrics_snapshot_t *snapshot, bool report)
+{
+    int64_t now_us      = esp_timer_get_time();
+    uint32_t elapsed_us = (uint32_t)(now_us - report_base_us);
+    if (report)
+        report_base_us = now_us;
+
+    for (int i = 0; i < BEAN_METRIC_COUNT; i++)
+    {
+        snapshot->values[i] = report ? bean_metrics_take(i) : bean_metrics_get(i);
+    }
+    snapshot->elapsed_ms    = elapsed_us / 1000;
+    snapshot->heap_free     = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+    snapshot->heap_min_free = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+    snapshot->data_queue    = metrics_ctx ? uxQueueMessagesWaiting(metrics_ctx->data_log_queue) : 0;
+    snapshot->event_queue   = metrics_ctx ? uxQueueMessagesWaiting(metrics_ctx->event_queue) : 0;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        snapshot->load_permille[core] = 0;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        snapshot->load_permille[core] =
+          1000 - runtime_permille(xTaskGetIdleTaskHandleForCore(core), &idle_runtime_base[core], elapsed_us, report);
+#endif
+    }
+
+    snapshot->task_count = watched_task_count;
+    for (uint8_t i = 0; i < snapshot->task_count; i++)
+    {
+        watched_task_t *task    = &watched_tasks[i];
+        task_figures_t *figures = &snapshot->tasks[i];
+        figures->name           = pcTaskGetName(task->handle);
+        figures->stack_free     = uxTaskGetStackHighWaterMark(task->handle);
+        figures->cpu_permille   = 0;
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+        figures->cpu_permille = runtime_permille(task->handle, &task->runtime_base, elapsed_us, report);
+#endif
+    }
+}
+
+static void append(char *buffer, size_t size, size_t *length, const char *fmt, ...)
+  __attribute__((format(printf, 4, 5)));
+
+static void append(char *buffer, size_t size, size_t *length, const char *fmt, ...)
+{
+    if (*length >= size)
+        return;
+    va_list args;
+    va_start(args, fmt);
+    int written = vsnprintf(&buffer[*length], size - *length, fmt, args);
+    va_end(args);
+    if (written > 0)
+        *length += (size_t)written;
+}
+
+// period_ms=..;heap_free=..;heap_min=..;data_queue=..;event_queue=..;cpu0=..;cpu1=..;<metric>=..;<task>=<cpu>/<stack>
+static void format_report(const metrics_snapshot_t *snapshot, char *buffer, size_t size)
+{
+    size_t length = 0;
+    buffer[0]     = '\0';
+    append(buffer,
+           size,
+           &length,
+           "period_ms=%lu;heap_free=%lu;heap_min=%lu;data_queue=%lu;event_queue=%lu",
+           snapshot->elapsed_ms,
+           snapshot->heap_free,
+           snapshot->heap_min_free,
+           snapshot->data_queue,
+           snapshot->event_queue);
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+        append(buffer, size, &length, ";cpu%d=%.1f", core, snapshot->load_permille[core] / 10.0f);
+    for (int i = 0; i < BEAN_METRIC_COUNT; i++)
+        append(buffer, size, &length, ";%s=%lu", bean_metrics_name(i), snapshot->values[i]);
+    for (uint8_t i = 0; i < snapshot->task_count; i++)
+    {
+        append(buffer,
+               size,
+               &length,
+               ";%s=%.1f/%lu",
+               snapshot->tasks[i].name,
+               snapshot->tasks[i].cpu_permille / 10.0f,
+               snapshot->tasks[i].stack_free);
+    }
+}
+
+static void vtask_metrics(void *pvParameter)
+{
+    static metrics_snapshot_t snapshot;
+    static char report[METRICS_REPORT_LENGTH];
+
+    while (1)
+    {
+        uint32_t interval_ms = (uint32_t)bean_config_get()->bean_metrics.interval_ms;
+        vTaskDelay(pdMS_TO_TICKS(interval_ms > 0 ? interval_ms : METRICS_IDLE_POLL_MS));
+        if (interval_ms == 0)
+            continue;
+
+        take_snapshot(&snapshot, true);
+        format_report(&snapshot, report, sizeof(report));
+        bean_context_log_event(metrics_ctx, EVENT_ID_METRICS, "%s", report);
+    }
+}
+
+esp_err_t bean_metrics_start(bean_context_t *ctx)
+{
+    if (ctx == NULL)
+        return ESP_ERR_INVALID_ARG;
+
+    metrics_ctx    = ctx;
+    report_base_us = esp_timer_get_time();
+    xTaskCreate(&vtask_metrics,
+                "metrics",
+                BEAN_METRICS_TASK_STACK_SIZE,
+                NULL,
+                BEAN_METRICS_TASK_PRIORITY,
+                &metrics_task_handle);
+    if (metrics_task_handle == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create metrics task");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void bean_metrics_print(void)
+{
+    static metrics_snapshot_t snapshot;
+    take_snapshot(&snapshot, false);
+
+    printf("Since the last report (%lu ms):\n", snapshot.elapsed_ms);
+    printf("  heap free %lu bytes, lowest %lu bytes\n", snapshot.heap_free, snapshot.heap_min_free);
+    printf("  data log queue %lu of %d, event queue %lu of %d\n",
+           snapshot.data_queue,
+           BEAN_CONTEXT_DATA_QUEUE_LENGTH,
+           snapshot.event_queue,
+           BEAN_CONTEXT_EVENT_QUEUE_LENGTH);
+#if CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+        printf("  cpu%d load %.1f %%\n", core, snapshot.load_permille[core] / 10.0f);
+#endif
+    for (int i = 0; i < BEAN_METRIC_COUNT; i++)
+        printf("  %-18s %lu%s\n",
+               bean_metrics_name(i),
+               snapshot.values[i],
+               bean_metrics_is_peak(i) ? "" : " since boot");
+
+    printf("%-20s %8s %12s\n", "task", "cpu", "stack free");
+    for (uint8_t i = 0; i < snapshot.task_count; i++)
+    {
+        printf("%-20s %6.1f %% %6lu bytes\n",
+               snapshot.tasks[i].name,
+               snapshot.tasks[i].cpu_permille / 10.0f,
+               snapshot.tasks[i].stack_free);
+    }
+}
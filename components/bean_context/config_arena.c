@@ -0,0 +1,44 @@
+#include "config_arena.h"
+#include <string.h>
+
+void config_arena_init(config_arena_t *arena, void *buffer, size_t size)
+{
+    memset(arena, 0, sizeof(*arena));
+    // Start on an aligned address, the buffer may come from anywhere
+    uintptr_t start = ((uintptr_t)buffer + CONFIG_ARENA_ALIGNMENT - 1) & ~(uintptr_t)(CONFIG_ARENA_ALIGNMENT - 1);
+    size_t skipped  = (size_t)(start - (uintptr_t)buffer);
+    arena->buffer   = (uint8_t *)start;
+    arena->size     = size > skipped ? size - skipped : 0;
+}
+
+void *config_arena_alloc(config_arena_t *arena, size_t size)
+{
+    if (size == 0)
+        return NULL;
+
+    size_t rounded = (size + CONFIG_ARENA_ALIGNMENT - 1) & ~(size_t)(CONFIG_ARENA_ALIGNMENT - 1);
+    if (rounded < size || rounded > arena->size - arena->used)
+    {
+        arena->overflows++;
+        arena->overflow_bytes += size;
+        return NULL;
+    }
+
+    void *ptr = arena->buffer + arena->used;
+    arena->used += rounded;
+    arena->allocations++;
+    if (arena->used > arena->peak)
+        arena->peak = arena->used;
+    return ptr;
+}
+
+int config_arena_owns(const config_arena_t *arena, const void *ptr)
+{
+    const uint8_t *p = (const uint8_t *)ptr;
+    return p >= arena->buffer && p < arena->buffer + arena->size;
+}
+
+void config_arena_reset(config_arena_t *arena)
+{
+    arena->used = 0;
+}
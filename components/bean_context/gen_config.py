@@ -0,0 +1,420 @@
+#!/usr/bin/env python3
+"""Generates the typed configuration (bean_config.h / bean_config.c) from default.json.
+
+Every JSON object becomes a struct, every value a plain field:
+ - numbers written with a decimal point -> float, other numbers -> int32_t
+ - booleans -> bool
+ - strings -> char[BEAN_CONFIG_STRING_LENGTH]
+ - arrays -> a fixed array of BEAN_CONFIG_ARRAY_LENGTH elements plus a <name>_count field
+
+bean_config_defaults holds the values of default.json, bean_config_decode() overwrites the fields that are set in a
+cJSON tree, bean_config_validate() checks a patch against the schema (known keys, matching types, fitting lengths)
+and bean_config_encode() turns the struct back into a tree. BEAN_CONFIG_SCHEMA_HASH changes with default.json and
+this generator, so anything stored in the struct layout can tell it was made by another firmware.
+
+Run at build time by CMakeLists.txt: gen_config.py <default.json> <output dir>
+"""
+
+import json
+import os
+import re
+import sys
+import zlib
+
+STRING_LENGTH = 32
+ARRAY_LENGTH = 8
+
+HEADER = "// Generated from default.json by gen_config.py, do not edit\n"
+
+
+def identifier(key):
+    name = re.sub(r"[^0-9a-zA-Z_]", "_", key)
+    return "_" + name if name[0].isdigit() else name
+
+
+def type_name(path):
+    return "bean_config_" + "_".join(identifier(p).lower() for p in path) + "_t" if path else "bean_config_t"
+
+
+def struct_tag(path):
+    return type_name(path)[:-2]
+
+
+def array_type(values):
+    return "float" if any(isinstance(v, float) for v in values) else "int32_t"
+
+
+def c_number(value, ctype):
+    if ctype == "float":
+        text = repr(float(value))
+        return (text if ("." in text or "e" in text) else text + ".0") + "f"
+    return str(int(value))
+
+
+def c_string(value):
+    return '"' + value.replace("\\", "\\\\").replace('"', '\\"') + '"'
+
+
+def field_kind(value):
+    if isinstance(value, bool):
+        return "bool"
+    if isinstance(value, float):
+        return "float"
+    if isinstance(value, int):
+        return "int32_t"
+    if isinstance(value, str):
+        return "string"
+    if isinstance(value, list):
+        if len(value) > ARRAY_LENGTH:
+            sys.exit(f"gen_config: array longer than {ARRAY_LENGTH} elements")
+        if not all(isinstance(v, (int, float)) and not isinstance(v, bool) for v in value):
+            sys.exit("gen_config: only number arrays are supported")
+        return "array"
+    if isinstance(value, dict):
+        return "object"
+    sys.exit(f"gen_config: unsupported value {value!r}")
+
+
+def emit_structs(obj, path, out):
+    """Children first, C needs the nested types declared before they are used."""
+    for key, value in obj.items():
+        if isinstance(value, dict):
+            emit_structs(value, path + [key], out)
+
+    lines = [f"typedef struct {struct_tag(path)}", "{"]
+    for key, value in obj.items():
+        name = identifier(key)
+        kind = field_kind(value)
+        if kind == "object":
+            lines.append(f"    {type_name(path + [key])} {name};")
+        elif kind == "string":
+            lines.append(f"    char {name}[BEAN_CONFIG_STRING_LENGTH];")
+        elif kind == "array":
+            lines.append(f"    {array_type(value)} {name}[BEAN_CONFIG_ARRAY_LENGTH];")
+            lines.append(f"    uint8_t {name}_count;")
+        else:
+            lines.append(f"    {kind} {name};")
+    lines.append(f"}} {type_name(path)};")
+    out.append("\n".join(lines) + "\n")
+
+
+def emit_defaults(obj, indent):
+    pad = " " * indent
+    lines = []
+    for key, value in obj.items():
+        name = identifier(key)
+        kind = field_kind(value)
+        if kind == "object":
+            lines.append(f"{pad}.{name} =")
+            lines.append(f"{pad}  {{")
+            lines.extend(emit_defaults(value, indent + 4))
+            lines.append(f"{pad}  }},")
+        elif kind == "string":
+            lines.append(f"{pad}.{name} = {c_string(value)},")
+        elif kind == "array":
+            ctype = array_type(value)
+            elements = ", ".join(c_number(v, ctype) for v in value) if value else "0"
+            lines.append(f"{pad}.{name} = {{ {elements} }},")
+            lines.append(f"{pad}.{name}_count = {len(value)},")
+        elif kind == "bool":
+            lines.append(f"{pad}.{name} = {'true' if value else 'false'},")
+        else:
+            lines.append(f"{pad}.{name} = {c_number(value, kind)},")
+    return lines
+
+
+def emit_decoders(obj, path, out, array_types):
+    for key, value in obj.items():
+        if isinstance(value, dict):
+            emit_decoders(value, path + [key], out, array_types)
+
+    lines = [f"static void decode_{struct_tag(path)}({type_name(path)} *config, const cJSON *json)", "{"]
+    for key, value in obj.items():
+        name = identifier(key)
+        kind = field_kind(value)
+        item = f'cJSON_GetObjectItem(json, "{key}")'
+        if kind == "object":
+            lines.append(f"    decode_{struct_tag(path + [key])}(&config->{name}, {item});")
+        elif kind == "string":
+            lines.append(f"    decode_string(config->{name}, {item});")
+        elif kind == "array":
+            array_types.add(array_type(value))
+            ctype = "float" if array_type(value) == "float" else "int"
+            lines.append(f"    decode_{ctype}_array(config->{name}, &config->{name}_count, {item});")
+        elif kind == "bool":
+            lines.append(f"    decode_bool(&config->{name}, {item});")
+        elif kind == "float":
+            lines.append(f"    decode_float(&config->{name}, {item});")
+        else:
+            lines.append(f"    decode_int(&config->{name}, {item});")
+    lines.append("}")
+    out.append("\n".join(lines) + "\n")
+
+
+def emit_validators(obj, path, out):
+    for key, value in obj.items():
+        if isinstance(value, dict):
+            emit_validators(value, path + [key], out)
+
+    lines = [
+        f"static bool validate_{struct_tag(path)}(const cJSON *json, const char *path, char *error, size_t length)",
+        "{",
+        "    if (!cJSON_IsObject(json))",
+        '        return fail(error, length, path, NULL, "is not an object");',
+        "    const cJSON *item;",
+        "    cJSON_ArrayForEach(item, json)",
+        "    {",
+    ]
+    first = True
+    for key, value in obj.items():
+        kind = field_kind(value)
+        keyword = "if" if first else "else if"
+        first = False
+        lines.append(f'        {keyword} (strcmp(item->string, "{key}") == 0)')
+        lines.append("        {")
+        if kind == "object":
+            lines.append("            char child[BEAN_CONFIG_PATH_LENGTH];")
+            lines.append('            snprintf(child, sizeof(child), "%s%s%s", path, *path ? "." : "", item->string);')
+            lines.append(f"            if (!validate_{struct_tag(path + [key])}(item, child, error, length))")
+            lines.append("                return false;")
+        else:
+            check = {
+                "bool": "check_bool",
+                "float": "check_number",
+                "int32_t": "check_number",
+                "string": "check_string",
+                "array": "check_array",
+            }[kind]
+            lines.append(f"            if (!{check}(item, path, error, length))")
+            lines.append("                return false;")
+        lines.append("        }")
+    lines.append("        else")
+    lines.append("        {")
+    lines.append('            return fail(error, length, path, item->string, "is not a known setting");')
+    lines.append("        }")
+    lines.append("    }")
+    lines.append("    return true;")
+    lines.append("}")
+    out.append("\n".join(lines) + "\n")
+
+
+def emit_encoders(obj, path, out):
+    for key, value in obj.items():
+        if isinstance(value, dict):
+            emit_encoders(value, path + [key], out)
+
+    lines = [f"static cJSON *encode_{struct_tag(path)}(const {type_name(path)} *config)", "{"]
+    lines.append("    cJSON *json = cJSON_CreateObject();")
+    for key, value in obj.items():
+        name = identifier(key)
+        kind = field_kind(value)
+        if kind == "object":
+            encoder = f"encode_{struct_tag(path + [key])}"
+            lines.append(f'    cJSON_AddItemToObject(json, "{key}", {encoder}(&config->{name}));')
+        elif kind == "string":
+            lines.append(f'    cJSON_AddStringToObject(json, "{key}", config->{name});')
+        elif kind == "array":
+            lines.append(f'    cJSON *{name} = cJSON_AddArrayToObject(json, "{key}");')
+            element = f"float_value(config->{name}[i])" if array_type(value) == "float" else f"config->{name}[i]"
+            lines.append(f"    for (uint8_t i = 0; {name} && i < config->{name}_count; i++)")
+            lines.append(f"        cJSON_AddItemToArray({name}, cJSON_CreateNumber({element}));")
+        elif kind == "bool":
+            lines.append(f'    cJSON_AddBoolToObject(json, "{key}", config->{name});')
+        elif kind == "float":
+            lines.append(f'    cJSON_AddNumberToObject(json, "{key}", float_value(config->{name}));')
+        else:
+            lines.append(f'    cJSON_AddNumberToObject(json, "{key}", config->{name});')
+    lines.append("    return json;")
+    lines.append("}")
+    out.append("\n".join(lines) + "\n")
+
+
+ENCODE_HELPERS = """
+// The double nearest to the shortest decimal of a float, so 0.02f is written as 0.02 and not 0.0199999995
+static double float_value(float value)
+{
+    char text[16];
+    snprintf(text, sizeof(text), "%.7g", value);
+    return strtod(text, NULL);
+}
+"""
+
+
+VALIDATE_HELPERS = """
+static bool fail(char *error, size_t length, const char *path, const char *key, const char *message)
+{
+    if (error && length)
+        snprintf(error, length, "%s%s%s %s", path, *path && key ? "." : "", key ? key : "", message);
+    return false;
+}
+
+static bool check_bool(const cJSON *item, const char *path, char *error, size_t length)
+{
+    return cJSON_IsBool(item) || fail(error, length, path, item->string, "must be true or false");
+}
+
+static bool check_number(const cJSON *item, const char *path, char *error, size_t length)
+{
+    return cJSON_IsNumber(item) || fail(error, length, path, item->string, "must be a number");
+}
+
+static bool check_string(const cJSON *item, const char *path, char *error, size_t length)
+{
+    if (!cJSON_IsString(item))
+        return fail(error, length, path, item->string, "must be a string");
+    if (strlen(cJSON_GetStringValue(item)) >= BEAN_CONFIG_STRING_LENGTH)
+        return fail(error, length, path, item->string, "is too long");
+    return true;
+}
+
+static bool check_array(const cJSON *item, const char *path, char *error, size_t length)
+{
+    if (!cJSON_IsArray(item))
+        return fail(error, length, path, item->string, "must be an array");
+    if (cJSON_GetArraySize(item) > BEAN_CONFIG_ARRAY_LENGTH)
+        return fail(error, length, path, item->string, "has too many elements");
+    const cJSON *element;
+    cJSON_ArrayForEach(element, item)
+    {
+        if (!cJSON_IsNumber(element))
+            return fail(error, length, path, item->string, "must only hold numbers");
+    }
+    return true;
+}
+"""
+
+
+DECODE_HELPERS = """
+// A missing item or an item of another type leaves the field at its current value
+static void decode_int(int32_t *field, const cJSON *item)
+{
+    if (cJSON_IsNumber(item))
+        *field = (int32_t)cJSON_GetNumberValue(item);
+}
+
+static void decode_float(float *field, const cJSON *item)
+{
+    if (cJSON_IsNumber(item))
+        *field = (float)cJSON_GetNumberValue(item);
+}
+
+static void decode_bool(bool *field, const cJSON *item)
+{
+    if (cJSON_IsBool(item))
+        *field = cJSON_IsTrue(item);
+}
+
+static void decode_string(char *field, const cJSON *item)
+{
+    if (cJSON_IsString(item))
+        snprintf(field, BEAN_CONFIG_STRING_LENGTH, "%s", cJSON_GetStringValue(item));
+}
+
+"""
+
+# Only emitted when default.json has an array of that type, unused static functions would warn
+ARRAY_DECODER = """static void decode_{name}_array({ctype} *field, uint8_t *count, const cJSON *item)
+{{
+    if (!cJSON_IsArray(item))
+        return;
+    const cJSON *element;
+    *count = 0;
+    cJSON_ArrayForEach(element, item)
+    {{
+        if (*count < BEAN_CONFIG_ARRAY_LENGTH && cJSON_IsNumber(element))
+            field[(*count)++] = ({ctype})cJSON_GetNumberValue(element);
+    }}
+}}
+
+"""
+
+
+def main():
+    if len(sys.argv) != 3:
+        sys.exit("usage: gen_config.py <default.json> <output dir>")
+    with open(sys.argv[1], "rb") as f:
+        raw = f.read()
+    config = json.loads(raw)
+    with open(__file__, "rb") as f:
+        schema_hash = zlib.crc32(f.read(), zlib.crc32(raw))
+    os.makedirs(sys.argv[2], exist_ok=True)
+
+    structs = []
+    emit_structs(config, [], structs)
+    header = [
+        HEADER,
+        "#pragma once",
+        "#include <stdbool.h>",
+        "#include <stddef.h>",
+        "#include <stdint.h>",
+        '#include "cJSON.h"',
+        "",
+        f"#define BEAN_CONFIG_STRING_LENGTH {STRING_LENGTH}",
+        f"#define BEAN_CONFIG_ARRAY_LENGTH  {ARRAY_LENGTH}",
+        "#define BEAN_CONFIG_PATH_LENGTH   96",
+        f"#define BEAN_CONFIG_SCHEMA_HASH   0x{schema_hash:08x}u // Of default.json and gen_config.py",
+        "",
+        "\n".join(structs),
+        "// The values of default.json",
+        "extern const bean_config_t bean_config_defaults;",
+        "",
+        "// Overwrites the fields that are set in json with a matching type, the others are left untouched",
+        "void bean_config_decode(bean_config_t *config, const cJSON *json);",
+        "",
+        "// Checks that every key of json is a known setting with the right type, error gets the first problem",
+        "bool bean_config_validate(const cJSON *json, char *error, size_t error_length);",
+        "",
+        "// Builds the tree of a config, with the layout of default.json",
+        "cJSON *bean_config_encode(const bean_config_t *config);",
+        "",
+    ]
+
+    decoders = []
+    array_types = set()
+    emit_decoders(config, [], decoders, array_types)
+    validators = []
+    emit_validators(config, [], validators)
+    encoders = []
+    emit_encoders(config, [], encoders)
+    source = [
+        HEADER,
+        '#include "bean_config.h"',
+        "#include <stdio.h>",
+        "#include <stdlib.h>",
+        "#include <string.h>",
+        "",
+        "const bean_config_t bean_config_defaults = {",
+        "\n".join(emit_defaults(config, 4)),
+        "};",
+        DECODE_HELPERS.rstrip("\n") + "\n",
+        "".join(ARRAY_DECODER.format(name=t.replace("32_t", ""), ctype=t) for t in sorted(array_types)),
+        "\n".join(decoders),
+        "void bean_config_decode(bean_config_t *config, const cJSON *json)",
+        "{",
+        "    if (json)",
+        "        decode_bean_config(config, json);",
+        "}",
+        VALIDATE_HELPERS,
+        "\n".join(validators),
+        "bool bean_config_validate(const cJSON *json, char *error, size_t error_length)",
+        "{",
+        '    return validate_bean_config(json, "", error, error_length);',
+        "}",
+        "",
+        ENCODE_HELPERS,
+        "\n".join(encoders),
+        "cJSON *bean_config_encode(const bean_config_t *config)",
+        "{",
+        "    return encode_bean_config(config);",
+        "}",
+        "",
+    ]
+
+    with open(os.path.join(sys.argv[2], "bean_config.h"), "w") as f:
+        f.write("\n".join(header))
+    with open(os.path.join(sys.argv[2], "bean_config.c"), "w") as f:
+        f.write("\n".join(source))
+
+
+if __name__ == "__main__":
+    main()
@@ -2,19 +2,23 @@
 
 #include "esp_err.h"
 
-#include "freertos/FreeRTOS.h"
-#include "freertos/queue.h"
-#include "freertos/event_groups.h"
+#include "bean_hal.h"
 
 #include "pins.h"
 #include <stdbool.h>
 #include "cJSON.h"
+#include "bean_config.h" // Generated from default.json at build time
+
+#define BEAN_CONTEXT_EVENT_QUEUE_LENGTH 10
+#define BEAN_CONTEXT_DATA_QUEUE_LENGTH  64 // Holds a few acquisition ticks worth of samples
+#define BEAN_CONTEXT_CONFIG_ARENA_SIZE  (64 * 1024) // Both config trees (~10 kB each) and the printed conf.json
+#define BEAN_CONTEXT_CONFIG_LISTENERS   8
 
 typedef struct bean_context
 {
-    EventGroupHandle_t system_event_group;
-    QueueHandle_t event_queue;
-    QueueHandle_t data_log_queue;
+    bean_hal_event_group_t system_event_group;
+    bean_hal_queue_t event_queue;
+    bean_hal_queue_t data_log_queue;
     bool is_not_usb_msc;
 } bean_context_t;
 
@@ -25,9 +29,30 @@ typedef enum measurement_type
     MEASUREMENT_TYPE_ALTITUDE,
     MEASUREMENT_TYPE_ACCELERATION,
     MEASUREMENT_TYPE_GYROSCOPE,
-    MEASUREMENT_TYPE_BATTERY_VOLTAGE
+    MEASUREMENT_TYPE_BATTERY_VOLTAGE,
+    MEASUREMENT_TYPE_BATTERY_SAG, // Comma separated mV at 1 kHz, the timestamp is the one of the first
 } measurement_type_t;
 
+typedef enum event_id
+{
+    EVENT_ID_BOOT,
+    EVENT_ID_STATE_CHANGE,
+    EVENT_ID_LAUNCH,
+    EVENT_ID_LANDED,
+    EVENT_ID_FLIGHT_SUMMARY,
+    EVENT_ID_LOG_CLOSE,
+    EVENT_ID_LAUNCH_CROSSCHECK,
+    EVENT_ID_APOGEE,
+    EVENT_ID_BARO_LOCKOUT,
+    EVENT_ID_PYRO_FIRE,
+    EVENT_ID_RESUME, // Flight resumed from a checkpoint after a warm reset
+    EVENT_ID_BATTERY_SAG, // Battery sag measured after an actuation
+    EVENT_ID_PAD_POWER, // Wakeups and light sleep residency of the pad mode, logged when it ends
+    EVENT_ID_STANDBY, // Going to deep sleep until the board is moved
+    EVENT_ID_STANDBY_WAKE, // Woken up from the standby, with the boot time against its budget
+    EVENT_ID_METRICS, // Periodic report of bean_metrics
+} event_id_t;
+
 typedef struct event_data
 {
     int event_id;
@@ -39,7 +64,7 @@ typedef struct log_data
 {
     measurement_type_t measurement_type;
     uint32_t timestamp;
-    char measurement_value[20];
+    char measurement_value[32];
 } log_data_t;
 
 typedef struct config_merge_result
@@ -51,8 +76,88 @@ typedef struct config_merge_result
     int type_mismatches;
 } config_merge_result_t;
 
+/**
+ * @brief Gets the merged configuration tree, NULL outside of a config session.
+ *
+ * Only meant for the code that loads and stores conf.json, everything else reads bean_config_get().
+ */
 const cJSON *config_store_get(void);
 
+/**
+ * @brief Gets the typed configuration: the defaults of default.json, overwritten by conf.json once it is merged.
+ *
+ * The fields are plain values, so this is safe to use on the hot paths. Valid from bean_context_init() on. A live patch
+ * swaps in another struct, so code that should follow patches calls this again instead of keeping the pointer.
+ */
+const bean_config_t *bean_config_get(void);
+
+/**
+ * @brief Called after a config patch was applied, from the task that applied it.
+ *
+ * Both configs stay valid for the duration of the call only, a listener copies what it needs and must not block.
+ */
+typedef void (*bean_config_listener_t)(const bean_config_t *previous, const bean_config_t *current, void *arg);
+
+/**
+ * @brief Registers a listener for config patches, up to BEAN_CONTEXT_CONFIG_LISTENERS.
+ */
+esp_err_t bean_context_config_subscribe(bean_config_listener_t listener, void *arg);
+
+/**
+ * @brief Applies a JSON patch to the running configuration without a reboot.
+ *
+ * The patch has the layout of default.json and only holds the settings to change. It is validated against the schema
+ * first and either applied completely or not at all: it is decoded into a copy of the config, which then replaces the
+ * active one in a single pointer swap. The listeners are notified afterwards. Nothing is written to the storage, see
+ * bean_storage_save_config().
+ *
+ * @param error Gets the reason when the patch is rejected
+ * @return ESP_OK, or ESP_ERR_INVALID_ARG when the patch is not valid JSON or does not match the schema
+ */
+esp_err_t bean_context_apply_config_patch(const char *patch_json, char *error, size_t error_length);
+
 config_merge_result_t bean_context_initialize_config(cJSON *config);
 
+/**
+ * @brief Loads the typed configuration from the snapshot in NVS, skipping the JSON parsing and merging.
+ *
+ * @param file_hash Hash of the conf.json the snapshot has to be made from
+ * @return ESP_OK when loaded, an error when there is no snapshot or it was made from another conf.json or firmware
+ */
+esp_err_t bean_context_load_config_snapshot(uint32_t file_hash);
+
+/**
+ * @brief Stores the typed configuration in NVS for the next boots.
+ *
+ * @param file_hash Hash of the conf.json the configuration was merged from, as it is on the storage now
+ */
+esp_err_t bean_context_store_config_snapshot(uint32_t file_hash);
+
+/**
+ * @brief Starts a config session: cJSON allocates from a temporary arena until bean_context_config_end().
+ *
+ * Everything allocated by cJSON in the session (the trees, printed strings) is released at once by
+ * bean_context_config_end(), so nothing of it may be kept. Strings printed by cJSON have to be freed with cJSON_free().
+ *
+ * @return ESP_OK, or ESP_ERR_NO_MEM when the arena could not be allocated (cJSON then uses the heap as before)
+ */
+esp_err_t bean_context_config_begin(void);
+
+/**
+ * @brief Ends the config session: frees the configuration tree and the arena and logs the arena and heap usage.
+ *
+ * Only the typed config is kept.
+ */
+void bean_context_config_end(void);
+
+/**
+ * @brief Formats an event and puts it on the event log queue without blocking.
+ *
+ * The formatted string is heap allocated and freed by the event logger task.
+ *
+ * @return ESP_OK when queued, ESP_ERR_NO_MEM or ESP_FAIL when the event was dropped.
+ */
+esp_err_t bean_context_log_event(bean_context_t *ctx, event_id_t event_id, const char *fmt, ...)
+  __attribute__((format(printf, 3, 4)));
+
 esp_err_t bean_context_init(bean_context_t **ctx);
@@ -0,0 +1,68 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+#include "bean_context.h"
+#include "bean_hal.h"
+
+/*
+ * Runtime metrics: counters and peaks that the components update on their hot paths with one atomic operation, and a
+ * sampler task that adds the task, queue and heap figures and writes all of it to the event log as EVENT_ID_METRICS.
+ * The counters (bean_metrics.c) are portable, the sampler (bean_metrics_report.c) is target-only.
+ */
+
+#define BEAN_METRICS_MAX_TASKS       8
+#define BEAN_METRICS_TASK_STACK_SIZE 3072
+#define BEAN_METRICS_TASK_PRIORITY   tskIDLE_PRIORITY
+
+typedef enum bean_metric
+{
+    BEAN_METRIC_I2C_ERRORS, // Failed transfers to the altimeter and the IMU
+    BEAN_METRIC_SAMPLES_DROPPED, // Measurements lost to a full data log queue
+    BEAN_METRIC_EVENTS_DROPPED, // Events lost to a full event queue or to the heap
+    BEAN_METRIC_DATA_QUEUE_PEAK, // Most samples waiting in the data log queue, peak since the last report
+    BEAN_METRIC_EVENT_QUEUE_PEAK, // Same for the event queue
+    BEAN_METRIC_FSYNCS, // Flushes and syncs of the log files
+    BEAN_METRIC_FSYNC_MAX_US, // Longest flush and sync, peak since the last report
+    BEAN_METRIC_COUNT
+} bean_metric_t;
+
+/**
+ * @brief Adds to a counter, from any task or an ISR.
+ */
+void bean_metrics_add(bean_metric_t metric, uint32_t amount);
+
+/**
+ * @brief Raises a peak metric to the value if it is higher, from any task or an ISR.
+ */
+void bean_metrics_peak(bean_metric_t metric, uint32_t value);
+
+uint32_t bean_metrics_get(bean_metric_t metric);
+
+/**
+ * @brief Gets a metric for a report: a peak is reset with it, a counter keeps counting.
+ */
+uint32_t bean_metrics_take(bean_metric_t metric);
+
+const char *bean_metrics_name(bean_metric_t metric);
+
+/**
+ * @brief Tells whether a metric is a peak since the last report rather than a counter since boot.
+ */
+bool bean_metrics_is_peak(bean_metric_t metric);
+
+/**
+ * @brief Adds a task to the report: its share of the CPU and its free stack. The task must never be deleted.
+ *
+ * @return ESP_ERR_NO_MEM when BEAN_METRICS_MAX_TASKS are watched already
+ */
+esp_err_t bean_metrics_watch_task(bean_hal_task_t task);
+
+/**
+ * @brief Starts the sampler task, which reports every `bean_metrics.interval_ms` (followed live, 0 stops the reports).
+ */
+esp_err_t bean_metrics_start(bean_context_t *ctx);
+
+/**
+ * @brief Prints the metrics since the last report, the counters since boot. Changes nothing, for the console.
+ */
+void bean_metrics_print(void);
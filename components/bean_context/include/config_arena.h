@@ -0,0 +1,43 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Bump allocator for the short lived cJSON trees of the config load.
+ *
+ * Allocations are carved from one buffer and never freed one by one, the whole arena is released at once. When the
+ * buffer is exhausted config_arena_alloc() returns NULL and the caller falls back to the heap, the overflow is counted
+ * so the arena size can be tuned from the report.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+#define CONFIG_ARENA_ALIGNMENT 8
+
+typedef struct config_arena
+{
+    uint8_t *buffer;
+    size_t size;
+    size_t used;
+    size_t peak; // Highest used since the last reset
+    uint32_t allocations;
+    uint32_t overflows; // Requests that did not fit
+    size_t overflow_bytes;
+} config_arena_t;
+
+void config_arena_init(config_arena_t *arena, void *buffer, size_t size);
+
+/**
+ * @brief Allocates from the arena, NULL when it does not fit.
+ */
+void *config_arena_alloc(config_arena_t *arena, size_t size);
+
+/**
+ * @brief Tells if a pointer was handed out by the arena.
+ */
+int config_arena_owns(const config_arena_t *arena, const void *ptr);
+
+/**
+ * @brief Releases every allocation at once, the statistics are kept.
+ */
+void config_arena_reset(config_arena_t *arena);
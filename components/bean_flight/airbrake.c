@@ -0,0 +1,73 @@
+#include "airbrake.h"
+#include <math.h>
+#include <string.h>
+
+#define GRAVITY_EARTH (9.80665f)
+#define MIN_DRAG_K    1e-6f // Below this the drag is neglected, the prediction is ballistic
+
+void airbrake_init(airbrake_t *brake, const airbrake_config_t *config)
+{
+    memset(brake, 0, sizeof(*brake));
+    brake->config = *config;
+}
+
+float airbrake_predict_apogee(float altitude_m, float velocity_ms, float drag_k)
+{
+    if (velocity_ms <= 0.0f)
+        return altitude_m;
+    if (drag_k < MIN_DRAG_K)
+        return altitude_m + velocity_ms * velocity_ms / (2.0f * GRAVITY_EARTH);
+
+    // dv/dt = -g - k v^2 integrated over the height: h = ln(1 + k v^2 / g) / (2 k)
+    return altitude_m + logf(1.0f + drag_k * velocity_ms * velocity_ms / GRAVITY_EARTH) / (2.0f * drag_k);
+}
+
+static void retract(airbrake_t *brake)
+{
+    brake->active     = false;
+    brake->deflection = 0.0f;
+    brake->integral   = 0.0f;
+}
+
+float airbrake_update(airbrake_t *brake,
+                      float altitude_m,
+                      float velocity_ms,
+                      float accel_ms2,
+                      float dt_s,
+                      bool coasting)
+{
+    if (!coasting || velocity_ms < brake->config.min_velocity_ms)
+    {
+        retract(brake);
+        return brake->deflection;
+    }
+
+    // In the coast the deceleration beyond gravity is the drag
+    float measured_k = (-accel_ms2 - GRAVITY_EARTH) / (velocity_ms * velocity_ms);
+    if (measured_k < 0.0f)
+        measured_k = 0.0f;
+    if (!brake->has_drag)
+    {
+        brake->drag_k   = measured_k;
+        brake->has_drag = true;
+    }
+    else
+    {
+        brake->drag_k += brake->config.drag_filter_alpha * (measured_k - brake->drag_k);
+    }
+
+    brake->active             = true;
+    brake->predicted_apogee_m = airbrake_predict_apogee(altitude_m, velocity_ms, brake->drag_k);
+    float error               = brake->predicted_apogee_m - brake->config.target_apogee_m;
+
+    float output = brake->config.kp * error + brake->config.ki * (brake->integral + error * dt_s);
+    if (output > 1.0f)
+        output = 1.0f;
+    else if (output < 0.0f)
+        output = 0.0f;
+    else
+        brake->integral += error * dt_s; // Only integrate when not saturated, so the integral can not wind up
+
+    brake->deflection = output;
+    return brake->deflection;
+}
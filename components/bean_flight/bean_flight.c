@@ -0,0 +1,735 @@
+#include "bean_flight.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_app_desc.h"
+#include "bean_imu.h"
+#include "bean_altimeter.h"
+#include "bean_storage.h"
+#include "bean_storage_logger.h"
+#include "bean_pyro.h"
+#include "bean_servo.h"
+#include "bean_battery.h"
+#include "bean_power.h"
+#include "bean_metrics.h"
+#include "bean_trace.h"
+#include "airbrake.h"
+#include "flight_actions.h"
+#include "flight_config.h"
+
+static const char *TAG = "BEAN_FLIGHT";
+
+#define PAD_BARO_ODR        BMP3_ODR_25_HZ
+#define FLIGHT_BARO_ODR     BMP3_ODR_200_HZ
+#define GYRO_STARTUP_US     30000 // From suspend to the first valid rate
+#define STANDBY_LOG_WAIT_MS 3000 // For the loggers to close, the data log needs one idle sync interval
+
+static bean_context_t *flight_ctx = NULL;
+static flight_sm_t flight_sm;
+static volatile flight_state_t flight_state = FLIGHT_STATE_PRE_LAUNCH;
+static volatile bool flight_held            = false;
+
+// Configuration settings
+static uint32_t loop_delay_ms        = 10;
+static uint32_t landed_loop_delay_ms = 1000;
+static bool log_baro                 = true;
+static bool log_imu                  = true;
+static bool hw_no_motion_enabled     = false;
+static bool hw_high_g_enabled        = false;
+static int high_g_int_gpio           = -1; // -1 when the interrupt is not wired, the status is polled instead
+static uint32_t pad_loop_delay_ms    = 0; // Armed loop delay when the interrupt is wired, 0 keeps the full rate
+static int64_t sample_time_us        = 0; // Start of the sample being processed, for the pyro latency
+static flight_actions_t actions; // Deployments and events on the transitions, with the dropped samples
+
+// Pad mode, the long armed wait behind the high-g interrupt: the gyro is suspended, the baro slowed down and the CPU
+// clock may drop between two samples
+static bool pad_power_save         = false;
+static bool pad_mode               = false;
+static int64_t gyro_ready_us       = 0; // The gyro is only read after its startup time
+static bool pad_woken              = false; // A high-g interrupt ended the slow wait until pad_woken_until_ms
+static uint32_t pad_woken_until_ms = 0;
+
+// Standby, a deep sleep on the pad until the any-motion interrupt on the high-g wire wakes the board
+static int standby_gpio                    = -1;
+static uint8_t standby_int_pin             = 1;
+static uint32_t standby_idle_ms            = 0; // 0 only goes to standby on request
+static float standby_threshold_ms2         = 0.5f;
+static uint32_t last_motion_ms             = 0;
+static float last_accel[3]                 = { 0 };
+static const char *volatile standby_reason = NULL; // Handled between two samples
+
+// Airbrakes, only driven in the ascent
+static airbrake_t airbrake;
+
+// Set from the high-g interrupt
+static volatile bool high_g_pending            = false;
+static volatile uint32_t high_g_timestamp_ms   = 0;
+static struct bmi088_mm_high_g_out high_g_axis = { 0 };
+
+// Set when a config patch was applied, handled between two samples
+static volatile bool config_pending = false;
+
+// Set from bean_flight_hold, handled between two samples
+static volatile bool hold_pending = false;
+static volatile bool hold_wanted  = false;
+
+// Left in RTC memory on every sample in flight, a warm reset resumes from it
+RTC_NOINIT_ATTR static flight_checkpoint_t checkpoint;
+static uint32_t firmware = 0;
+
+TaskHandle_t flight_acquisition_task_handle;
+
+// First bytes of the ELF hash, a checkpoint written by another build is never resumed
+static uint32_t firmware_id(void)
+{
+    const uint8_t *sha = esp_app_get_description()->app_elf_sha256;
+    return (uint32_t)sha[0] | (uint32_t)sha[1] << 8 | (uint32_t)sha[2] << 16 | (uint32_t)sha[3] << 24;
+}
+
+static void set_servo(int channel, float position_deg)
+{
+    if (channel >= 0 && bean_servo_set((uint8_t)channel, position_deg) != ESP_OK)
+        ESP_LOGW(TAG, "Failed to move servo %d", channel);
+}
+
+// Drops the sensors to their lowest rates, only the recovery beacon is left running after this
+static void enter_low_power(void)
+{
+    if (set_accel_odr(BMI08_ACCEL_ODR_12_5_HZ) != ESP_OK)
+        ESP_LOGW(TAG, "Failed to lower accel ODR");
+    if (set_gyro_odr(BMI08_GYRO_BW_12_ODR_100_HZ) != ESP_OK || set_gyro_power_mode(BMI08_GYRO_PM_SUSPEND) != ESP_OK)
+        ESP_LOGW(TAG, "Failed to suspend gyro");
+    if (bean_altimeter_sleep() != ESP_OK)
+        ESP_LOGW(TAG, "Failed to put altimeter to sleep");
+}
+
+// The outputs of flight_actions, called from the acquisition task
+static bool actions_arm_pyro(void *ctx, uint8_t channel)
+{
+    return bean_pyro_arm(channel) == ESP_OK;
+}
+
+static const char *actions_fire_pyro(void *ctx, uint8_t channel, pyro_fire_record_t *record)
+{
+    esp_err_t ret = bean_pyro_fire(channel, sample_time_us, record);
+    return ret == ESP_OK ? NULL : esp_err_to_name(ret);
+}
+
+static void actions_set_servo(void *ctx, uint8_t channel, float position_deg)
+{
+    set_servo(channel, position_deg);
+}
+
+static void actions_capture_sag(void *ctx, const char *reason)
+{
+    bean_battery_capture_sag(reason);
+}
+
+static void actions_log_event(void *ctx, event_id_t id, const char *data)
+{
+    bean_context_log_event(flight_ctx, id, "%s", data);
+}
+
+static void actions_landed(void *ctx)
+{
+    bean_pyro_disarm_all();
+    bean_storage_logger_close(flight_ctx);
+    enter_low_power();
+}
+
+static const flight_actions_io_t actions_io = {
+    .arm_pyro    = actions_arm_pyro,
+    .fire_pyro   = actions_fire_pyro,
+    .set_servo   = actions_set_servo,
+    .capture_sag = actions_capture_sag,
+    .log_event   = actions_log_event,
+    .landed      = actions_landed,
+};
+
+// The axis of the last high-g interrupt, for the launch event
+static const char *high_g_axis_name(void)
+{
+    static const char *names[2][3] = { { "+x", "+y", "+z" }, { "-x", "-y", "-z" } };
+    return names[high_g_axis.direction ? 1 : 0][high_g_axis.x ? 0 : (high_g_axis.y ? 1 : 2)];
+}
+
+static void IRAM_ATTR high_g_isr(void *arg)
+{
+    BEAN_TRACE(BEAN_TRACE_HIGH_G_ISR, 0);
+    if (!high_g_pending)
+    {
+        high_g_timestamp_ms = (uint32_t)(esp_timer_get_time() / 1000);
+        high_g_pending      = true;
+    }
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    if (flight_acquisition_task_handle)
+        vTaskNotifyGiveFromISR(flight_acquisition_task_handle, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+static esp_err_t setup_high_g(float threshold_ms2, float hysteresis_ms2, uint32_t duration_ms, uint8_t int_pin)
+{
+    ESP_RETURN_ON_ERROR(
+      bean_imu_enable_high_g(threshold_ms2, hysteresis_ms2, duration_ms), TAG, "High-g feature not available");
+    if (high_g_int_gpio < 0)
+        return ESP_OK;
+
+    ESP_RETURN_ON_ERROR(bean_imu_route_high_g_int(int_pin), TAG, "Failed to route high-g interrupt");
+    gpio_config_t io_conf = {
+        .pin_bit_mask = 1ULL << high_g_int_gpio,
+        .mode         = GPIO_MODE_INPUT,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE,
+        .intr_type    = GPIO_INTR_POSEDGE,
+    };
+    ESP_RETURN_ON_ERROR(gpio_config(&io_conf), TAG, "Failed to configure high-g GPIO");
+
+    esp_err_t ret = gpio_install_isr_service(0);
+    if (ret != ESP_OK && ret != ESP_ERR_INVALID_STATE) // Already installed is fine
+        return ret;
+    return gpio_isr_handler_add(high_g_int_gpio, high_g_isr, NULL);
+}
+
+// Reads everything that can change without a reboot, the sensor features are only set up once by bean_flight_init()
+static void load_config(const bean_config_t *config, flight_sm_config_t *sm_config, airbrake_config_t *brake_config)
+{
+    const bean_config_bean_core_t *core                                    = &config->bean_core;
+    const bean_config_bean_core_flight_states_t *states                    = &core->flight_states;
+    const bean_config_bean_core_flight_states_armed_hw_high_g_t *hw_high_g = &states->armed.hw_high_g;
+
+    flight_config_load(config, sm_config, brake_config);
+    sm_config->hw_launch_trigger = sm_config->hw_launch_trigger && hw_high_g_enabled;
+
+    loop_delay_ms         = flight_config_loop_delay_ms(config);
+    landed_loop_delay_ms  = (uint32_t)states->landed.loop_delay;
+    log_baro              = core->logging.baro;
+    log_imu               = core->logging.imu;
+    pad_loop_delay_ms     = (uint32_t)hw_high_g->pad_loop_delay;
+    pad_power_save        = config->bean_power.pad_power_save;
+    standby_idle_ms       = (uint32_t)config->bean_power.standby.idle_timeout_s * 1000;
+    standby_threshold_ms2 = config->bean_power.standby.wake_threshold_ms2;
+
+    flight_actions_load(&actions, config);
+}
+
+// (Re)starts the state machine and the airbrake controller with the current settings
+static void start_state_machine(void)
+{
+    flight_sm_config_t sm_config;
+    airbrake_config_t brake_config;
+    load_config(bean_config_get(), &sm_config, &brake_config);
+
+    ESP_LOGI(TAG,
+             "Loop delay %lu ms, launch at %.1f m/s^2 for %lu ms",
+             loop_delay_ms,
+             sm_config.launch.threshold_ms2,
+             sm_config.launch.window_ms);
+
+    airbrake_init(&airbrake, &brake_config);
+    if (actions.airbrake_enabled)
+    {
+        ESP_LOGI(TAG,
+                 "Airbrakes on servo %d, target apogee %.0f m",
+                 actions.airbrake_servo_channel,
+                 brake_config.target_apogee_m);
+        set_servo(actions.airbrake_servo_channel, actions.airbrake_retracted_deg);
+    }
+
+    // A hold outlives a config patch, it is only ended by the release
+    bool held = flight_sm.held;
+    flight_sm_init(&flight_sm, &sm_config);
+    if (held)
+        flight_sm_hold(&flight_sm, true, esp_log_timestamp());
+    flight_state   = flight_sm.state;
+    flight_held    = flight_sm.held;
+    last_motion_ms = esp_log_timestamp();
+}
+
+// Runs in the caller of bean_context_apply_config_patch(), the acquisition task picks the new config up
+static void config_listener(const bean_config_t *previous, const bean_config_t *current, void *arg)
+{
+    config_pending = true;
+}
+
+esp_err_t bean_flight_init(bean_context_t *ctx)
+{
+    flight_ctx = ctx;
+    flight_actions_init(&actions, &actions_io);
+
+    const bean_config_bean_core_t *core                                    = &bean_config_get()->bean_core;
+    const bean_config_bean_core_flight_states_t *states                    = &core->flight_states;
+    const bean_config_bean_core_flight_states_armed_hw_high_g_t *hw_high_g = &states->armed.hw_high_g;
+    high_g_int_gpio                                                        = hw_high_g->int_gpio;
+    standby_gpio                                                           = hw_high_g->int_gpio;
+    standby_int_pin                                                        = (uint8_t)hw_high_g->int_pin;
+
+    // Loading the feature engine is slow, do it now and not in the middle of a flight
+    if (states->landed.hw_no_motion)
+    {
+        hw_no_motion_enabled = bean_imu_enable_no_motion(states->landed.accel_tolerance_ms2,
+                                                         (uint32_t)states->landed.quiet_duration_ms) == ESP_OK;
+        if (!hw_no_motion_enabled)
+            ESP_LOGW(TAG, "Hardware no-motion not available, landing detection uses the samples only");
+    }
+    if (hw_high_g->enabled)
+    {
+        hw_high_g_enabled = setup_high_g(hw_high_g->threshold_ms2,
+                                         hw_high_g->hysteresis_ms2,
+                                         (uint32_t)hw_high_g->duration_ms,
+                                         (uint8_t)hw_high_g->int_pin) == ESP_OK;
+        if (!hw_high_g_enabled)
+            ESP_LOGW(TAG, "Hardware high-g not available, launch detection uses the samples only");
+    }
+    if (!hw_high_g_enabled)
+        high_g_int_gpio = -1;
+
+    start_state_machine();
+    bean_context_config_subscribe(config_listener, NULL);
+    return ESP_OK;
+}
+
+flight_state_t bean_flight_get_state(void)
+{
+    return flight_state;
+}
+
+bool bean_flight_is_held(void)
+{
+    return flight_held;
+}
+
+float bean_flight_get_max_altitude(void)
+{
+    return flight_sm.max_altitude_m;
+}
+
+static void enqueue_measurement(measurement_type_t type, uint32_t timestamp, const char *fmt, ...)
+  __attribute__((format(printf, 3, 4)));
+
+static void enqueue_measurement(measurement_type_t type, uint32_t timestamp, const char *fmt, ...)
+{
+    log_data_t log_data = { .measurement_type = type, .timestamp = timestamp };
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(log_data.measurement_value, sizeof(log_data.measurement_value), fmt, args);
+    va_end(args);
+
+    // Never block the acquisition path on the logger
+    if (xQueueSend(flight_ctx->data_log_queue, &log_data, 0) == pdPASS)
+    {
+        BEAN_TRACE(BEAN_TRACE_QUEUE_PUSH, type);
+    }
+    else
+    {
+        BEAN_TRACE(BEAN_TRACE_QUEUE_DROP, type);
+        actions.dropped_samples++;
+        bean_metrics_add(BEAN_METRIC_SAMPLES_DROPPED, 1);
+    }
+}
+
+static void log_sample(const flight_sample_t *sample)
+{
+    if (log_imu && sample->accel_valid)
+        enqueue_measurement(MEASUREMENT_TYPE_ACCELERATION,
+                            sample->timestamp_ms,
+                            "%.2f;%.2f;%.2f",
+                            sample->accel[0],
+                            sample->accel[1],
+                            sample->accel[2]);
+    if (log_imu && sample->gyro_valid)
+        enqueue_measurement(MEASUREMENT_TYPE_GYROSCOPE,
+                            sample->timestamp_ms,
+                            "%.2f;%.2f;%.2f",
+                            sample->gyro[0],
+                            sample->gyro[1],
+                            sample->gyro[2]);
+    if (log_baro && sample->baro_valid)
+    {
+        enqueue_measurement(MEASUREMENT_TYPE_PRESSURE, sample->timestamp_ms, "%.2f", sample->pressure_pa);
+        enqueue_measurement(MEASUREMENT_TYPE_TEMPERATURE, sample->timestamp_ms, "%.2f", sample->temperature_c);
+    }
+}
+
+// The high-g interrupt wakes the task on the pad, so it can sample slowly until then
+static bool pad_wait(void)
+{
+    return flight_sm.state == FLIGHT_STATE_ARMED && high_g_int_gpio >= 0 && pad_loop_delay_ms > loop_delay_ms &&
+           !pad_woken;
+}
+
+// The launch window is counted in samples of loop_delay, so the first high-g interrupt ends the slow wait for the
+// window and the cross-check. Without a launch in that time it was a false trigger, back to the slow wait.
+static void update_pad_wake(const flight_sample_t *sample)
+{
+    if (flight_sm.state != FLIGHT_STATE_ARMED)
+    {
+        pad_woken = false;
+        return;
+    }
+    if (sample->hw_high_g)
+    {
+        uint32_t hold_ms = flight_sm.config.crosscheck_window_ms;
+        if (hold_ms < flight_sm.config.launch.window_ms)
+            hold_ms = flight_sm.config.launch.window_ms;
+        pad_woken          = true;
+        pad_woken_until_ms = sample->timestamp_ms + hold_ms;
+    }
+    else if (pad_woken && (int32_t)(sample->timestamp_ms - pad_woken_until_ms) >= 0)
+    {
+        pad_woken = false;
+    }
+}
+
+// The accel keeps its rate, the high-g feature and the launch detection run on it
+static void set_pad_mode(bool enable)
+{
+    pad_mode = enable;
+    if (enable)
+    {
+        if (set_gyro_power_mode(BMI08_GYRO_PM_SUSPEND) != ESP_OK)
+            ESP_LOGW(TAG, "Failed to suspend gyro");
+        if (bean_altimeter_set_odr(PAD_BARO_ODR) != ESP_OK)
+            ESP_LOGW(TAG, "Failed to lower altimeter ODR");
+        bean_power_enter_pad_mode();
+        return;
+    }
+
+    bean_power_exit_pad_mode();
+    if (set_gyro_power_mode(BMI08_GYRO_PM_NORMAL) != ESP_OK)
+        ESP_LOGW(TAG, "Failed to resume gyro");
+    gyro_ready_us = esp_timer_get_time() + GYRO_STARTUP_US;
+    if (bean_altimeter_set_odr(FLIGHT_BARO_ODR) != ESP_OK)
+        ESP_LOGW(TAG, "Failed to restore altimeter ODR");
+}
+
+// The same test as the any-motion feature that wakes the board up again: a change on any axis between two samples
+static bool standby_idle(const flight_sample_t *sample)
+{
+    if (!sample->accel_valid)
+        return false;
+
+    bool moved = false;
+    for (int i = 0; i < 3; i++)
+    {
+        float change = sample->accel[i] - last_accel[i];
+        moved |= change > standby_threshold_ms2 || change < -standby_threshold_ms2;
+        last_accel[i] = sample->accel[i];
+    }
+    if (moved)
+        last_motion_ms = sample->timestamp_ms;
+    return standby_idle_ms > 0 && sample->timestamp_ms - last_motion_ms >= standby_idle_ms;
+}
+
+// Nothing comes back from here, the wake-up is a fresh boot. Only the accelerometer keeps running, for the
+// any-motion feature, which needs the accel powered: 50 Hz is the rate its duration steps are given for.
+static void enter_standby(const char *reason)
+{
+    const bean_config_bean_power_standby_t *standby = &bean_config_get()->bean_power.standby;
+    ESP_LOGI(TAG, "Standby (%s) in %s", reason, flight_state_name(flight_sm.state));
+    bean_power_exit_pad_mode();
+    bean_context_log_event(flight_ctx,
+                           EVENT_ID_STANDBY,
+                           "reason=%s;state=%s;wake_gpio=%d;threshold_ms2=%.2f;duration_ms=%ld",
+                           reason,
+                           flight_state_name(flight_sm.state),
+                           standby_gpio,
+                           standby->wake_threshold_ms2,
+                           standby->wake_duration_ms);
+    bean_storage_logger_close(flight_ctx);
+    for (int waited_ms = 0; waited_ms < STANDBY_LOG_WAIT_MS && !bean_storage_logs_closed(); waited_ms += 100)
+        vTaskDelay(pdMS_TO_TICKS(100));
+
+    bean_pyro_hold_safe();
+    if (set_gyro_power_mode(BMI08_GYRO_PM_DEEP_SUSPEND) != ESP_OK)
+        ESP_LOGW(TAG, "Failed to suspend gyro");
+    if (bean_altimeter_sleep() != ESP_OK)
+        ESP_LOGW(TAG, "Failed to put altimeter to sleep");
+
+    uint8_t status = 0;
+    if (set_accel_odr(BMI08_ACCEL_ODR_50_HZ) == ESP_OK &&
+        bean_imu_enable_any_motion(standby->wake_threshold_ms2, (uint32_t)standby->wake_duration_ms) == ESP_OK &&
+        bean_imu_route_any_motion_int(standby_int_pin) == ESP_OK &&
+        bean_imu_get_feature_status(&status) == ESP_OK) // Clears a latched interrupt, it would wake the board
+        bean_power_deep_sleep(standby_gpio);
+
+    // Logs closed and sensors reconfigured, a clean boot is the way back to the pad
+    ESP_LOGE(TAG, "Standby failed, restarting");
+    esp_restart();
+}
+
+esp_err_t bean_flight_request_standby(void)
+{
+    if (flight_acquisition_task_handle == NULL || flight_sm.state > FLIGHT_STATE_ARMED)
+        return ESP_ERR_INVALID_STATE;
+    if (!bean_power_can_wake_on(standby_gpio))
+        return ESP_ERR_NOT_SUPPORTED;
+
+    standby_reason = "request";
+    xTaskNotifyGive(flight_acquisition_task_handle); // Cuts the pad wait short
+    return ESP_OK;
+}
+
+esp_err_t bean_flight_hold(bool hold)
+{
+    if (flight_acquisition_task_handle == NULL || flight_sm.state > FLIGHT_STATE_ARMED)
+        return ESP_ERR_INVALID_STATE;
+
+    hold_wanted  = hold;
+    hold_pending = true;
+    xTaskNotifyGive(flight_acquisition_task_handle); // Cuts the pad wait short
+    return ESP_OK;
+}
+
+const flight_checkpoint_t *bean_flight_checkpoint(void)
+{
+    // RTC memory holds garbage after a power-on, only a warm reset can leave a flight behind
+    if (esp_reset_reason() == ESP_RST_POWERON || !flight_checkpoint_valid(&checkpoint, firmware_id()))
+        return NULL;
+    return &checkpoint;
+}
+
+void bean_flight_discard_checkpoint(void)
+{
+    flight_checkpoint_clear(&checkpoint);
+}
+
+esp_err_t bean_flight_resume(const flight_checkpoint_t *cp)
+{
+    if (flight_ctx == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    flight_checkpoint_restore(cp, &flight_sm, esp_log_timestamp());
+    flight_state = flight_sm.state;
+
+    flight_actions_resume(&actions, &flight_sm);
+
+    ESP_LOGW(TAG,
+             "Resumed %s after reset %d, %lu ms into the flight at %.1f m",
+             flight_state_name(flight_sm.state),
+             esp_reset_reason(),
+             cp->flight_ms,
+             cp->altitude_m);
+    bean_context_log_event(flight_ctx,
+                           EVENT_ID_RESUME,
+                           "reason=%d;state=%s;flight_ms=%lu;altitude_m=%.1f;velocity_ms=%.1f;sequence=%lu",
+                           esp_reset_reason(),
+                           flight_state_name(flight_sm.state),
+                           cp->flight_ms,
+                           cp->altitude_m,
+                           cp->velocity_ms,
+                           cp->sequence);
+    return ESP_OK;
+}
+
+static void update_airbrake(void)
+{
+    const flight_estimator_t *est = &flight_sm.estimator;
+    bool coasting                 = est->velocity_ms > 0.0f && est->accel_ms2 < 0.0f;
+    bool was_active               = airbrake.active;
+    float deflection =
+      airbrake_update(&airbrake, est->altitude_m, est->velocity_ms, est->accel_ms2, loop_delay_ms / 1000.0f, coasting);
+    set_servo(actions.airbrake_servo_channel,
+              actions.airbrake_retracted_deg +
+                deflection * (actions.airbrake_deployed_deg - actions.airbrake_retracted_deg));
+
+    if (airbrake.active && !was_active)
+        ESP_LOGI(TAG, "Airbrake control active, predicted apogee %.1f m", airbrake.predicted_apogee_m);
+}
+
+static void read_sensors(flight_sample_t *sample)
+{
+    BEAN_TRACE(BEAN_TRACE_IMU_READ_BEGIN, 0);
+    sample->accel_valid = bean_imu_update_accel() == ESP_OK;
+    if (sample->accel_valid)
+    {
+        sample->accel[0] = get_x_accel_data();
+        sample->accel[1] = get_y_accel_data();
+        sample->accel[2] = get_z_accel_data();
+    }
+
+    sample->gyro_valid = !pad_mode && esp_timer_get_time() >= gyro_ready_us && bean_imu_update_gyro() == ESP_OK;
+    if (sample->gyro_valid)
+    {
+        sample->gyro[0] = get_x_gyro_data();
+        sample->gyro[1] = get_y_gyro_data();
+        sample->gyro[2] = get_z_gyro_data();
+    }
+    BEAN_TRACE(BEAN_TRACE_IMU_READ_END, 0);
+
+    BEAN_TRACE(BEAN_TRACE_BARO_READ_BEGIN, 0);
+    sample->baro_valid = bean_altimeter_update() == ESP_OK;
+    BEAN_TRACE(BEAN_TRACE_BARO_READ_END, 0);
+    if (sample->baro_valid)
+    {
+        sample->pressure_pa   = (float)bean_altimeter_get_pressure();
+        sample->temperature_c = (float)bean_altimeter_get_temperature();
+    }
+
+    // The feature status is cleared on read, so it is read once and shared by both features
+    bool want_high_g    = hw_high_g_enabled && flight_sm.state <= FLIGHT_STATE_ASCENDING;
+    bool want_no_motion = hw_no_motion_enabled && flight_sm.state >= FLIGHT_STATE_ASCENDING;
+    uint8_t status      = 0;
+    if ((want_high_g || want_no_motion) && bean_imu_get_feature_status(&status) == ESP_OK)
+    {
+        sample->hw_no_motion = want_no_motion && (status & BMI088_MM_ACCEL_NO_MOT_INT) != 0;
+        sample->hw_high_g    = want_high_g && (status & BMI088_MM_ACCEL_HIGH_G_INT) != 0;
+    }
+
+    if (want_high_g && high_g_pending)
+    {
+        sample->hw_high_g              = true;
+        sample->hw_high_g_timestamp_ms = high_g_timestamp_ms;
+        high_g_pending                 = false;
+    }
+    else if (sample->hw_high_g)
+    {
+        sample->hw_high_g_timestamp_ms = sample->timestamp_ms;
+    }
+
+    if (sample->hw_high_g && bean_imu_get_high_g_output(&high_g_axis) != ESP_OK)
+        memset(&high_g_axis, 0, sizeof(high_g_axis));
+}
+
+// Logging follows a patch right away, the detection settings only on the pad: a running flight keeps its settings
+static bool apply_pending_config(void)
+{
+    config_pending = false;
+    if (flight_sm.state > FLIGHT_STATE_ARMED)
+    {
+        log_baro = bean_config_get()->bean_core.logging.baro;
+        log_imu  = bean_config_get()->bean_core.logging.imu;
+        ESP_LOGW(TAG, "Config changed in %s, only the logging is applied", flight_state_name(flight_sm.state));
+        return false;
+    }
+
+    // Back to pre-launch, the launch detection starts over with the new settings
+    start_state_machine();
+    return true;
+}
+
+static void apply_pending_hold(void)
+{
+    hold_pending            = false;
+    flight_state_t previous = flight_sm.state;
+    if (!flight_sm_hold(&flight_sm, hold_wanted, esp_log_timestamp()))
+    {
+        ESP_LOGW(TAG, "No hold in %s", flight_state_name(flight_sm.state));
+        return;
+    }
+
+    flight_state = flight_sm.state;
+    flight_held  = flight_sm.held;
+    ESP_LOGI(TAG, "%s", flight_sm.held ? "Held in pre_launch" : "Hold released");
+    if (previous != flight_sm.state)
+        flight_actions_transition(&actions, &flight_sm, previous);
+}
+
+void vtask_flight_acquisition(void *pvParameter)
+{
+    ESP_LOGI(TAG, "Flight acquisition task started");
+    TickType_t last_wake_tick = xTaskGetTickCount();
+    TickType_t period_ticks   = pdMS_TO_TICKS(loop_delay_ms);
+    if (period_ticks == 0)
+        period_ticks = 1;
+
+    while (1)
+    {
+        if (pad_wait())
+        {
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(pad_loop_delay_ms));
+            last_wake_tick = xTaskGetTickCount();
+        }
+        else
+        {
+            vTaskDelayUntil(&last_wake_tick, period_ticks);
+        }
+
+        // Sensors are asleep and the logs are closed, nothing left to sample
+        if (flight_sm.state == FLIGHT_STATE_LANDED)
+            continue;
+
+        // Full clock from the wake-up to the end of the sample, also in the pad mode
+        bean_power_acquire(BEAN_POWER_LOCK_ACQUISITION);
+        BEAN_TRACE(BEAN_TRACE_SAMPLE_BEGIN, flight_sm.state);
+        if (standby_reason != NULL && flight_sm.state <= FLIGHT_STATE_ARMED)
+            enter_standby(standby_reason);
+        if (config_pending && apply_pending_config())
+        {
+            period_ticks = pdMS_TO_TICKS(loop_delay_ms);
+            if (period_ticks == 0)
+                period_ticks = 1;
+        }
+        if (hold_pending)
+            apply_pending_hold();
+
+        sample_time_us         = esp_timer_get_time();
+        flight_sample_t sample = { .timestamp_ms = esp_log_timestamp() };
+        read_sensors(&sample);
+        log_sample(&sample);
+
+        flight_state_t previous = flight_sm.state;
+        if (flight_sm_step(&flight_sm, &sample))
+        {
+            flight_state = flight_sm.state;
+            actions.launch_axis = high_g_axis_name();
+            flight_actions_transition(&actions, &flight_sm, previous);
+            if (flight_sm.state == FLIGHT_STATE_LANDED)
+                period_ticks = pdMS_TO_TICKS(landed_loop_delay_ms);
+        }
+        // Left on the first high-g interrupt or the sample that saw the launch, the next one has the sensors back at
+        // their flight rates
+        update_pad_wake(&sample);
+        bool want_pad_mode = pad_power_save && pad_wait();
+        if (want_pad_mode != pad_mode)
+            set_pad_mode(want_pad_mode);
+        if (flight_sm.state <= FLIGHT_STATE_ARMED && !flight_sm.held && standby_idle(&sample) &&
+            bean_power_can_wake_on(standby_gpio))
+            standby_reason = "idle";
+        if (actions.airbrake_enabled && flight_sm.state == FLIGHT_STATE_ASCENDING)
+            update_airbrake();
+        flight_actions_sample(&actions, &flight_sm);
+
+        // Under a hundred bytes to RTC memory, cheap enough for every sample
+        flight_checkpoint_origin_t origin = {
+            .firmware    = firmware,
+            .config_hash = bean_storage_config_hash(),
+            .log_number  = bean_storage_log_number(),
+        };
+        flight_checkpoint_save(&checkpoint, &flight_sm, sample.timestamp_ms, &origin);
+        BEAN_TRACE(BEAN_TRACE_SAMPLE_END, flight_sm.state);
+        bean_power_release(BEAN_POWER_LOCK_ACQUISITION);
+    }
+}
+
+esp_err_t bean_flight_start(void)
+{
+    if (flight_ctx == NULL)
+    {
+        ESP_LOGE(TAG, "Flight not initialized");
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    firmware = firmware_id();
+    xTaskCreate(&vtask_flight_acquisition,
+                "flight_acquisition",
+                BEAN_FLIGHT_TASK_STACK_SIZE,
+                NULL,
+                BEAN_FLIGHT_TASK_PRIORITY,
+                &flight_acquisition_task_handle);
+    if (flight_acquisition_task_handle == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to create flight acquisition task");
+        return ESP_FAIL;
+    }
+    bean_metrics_watch_task(flight_acquisition_task_handle);
+    return ESP_OK;
+}
@@ -0,0 +1,238 @@
+#include "flight_actions.h"
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include "bean_hal.h"
+
+#define EVENT_LENGTH 256
+
+static const char *TAG = "FLIGHT_ACTIONS";
+
+void flight_actions_init(flight_actions_t *actions, const flight_actions_io_t *io)
+{
+    *actions = (flight_actions_t){
+        .io                   = *io,
+        .drogue_pyro_channel  = -1,
+        .main_pyro_channel    = -1,
+        .drogue_servo_channel = -1,
+        .main_servo_channel   = -1,
+    };
+}
+
+void flight_actions_load(flight_actions_t *actions, const bean_config_t *config)
+{
+    const bean_config_bean_core_flight_states_t *states = &config->bean_core.flight_states;
+    const bean_config_bean_core_airbrake_t *brake       = &config->bean_core.airbrake;
+
+    actions->drogue_pyro_channel    = states->drogue_deployed.enabled ? states->drogue_deployed.pyro_channel : -1;
+    actions->drogue_servo_channel   = states->drogue_deployed.enabled ? states->drogue_deployed.servo_channel : -1;
+    actions->drogue_servo_deg       = states->drogue_deployed.servo_position;
+    actions->main_pyro_channel      = states->main_deployed.enabled ? states->main_deployed.pyro_channel : -1;
+    actions->main_servo_channel     = states->main_deployed.enabled ? states->main_deployed.servo_channel : -1;
+    actions->main_servo_deg         = states->main_deployed.servo_position;
+    actions->airbrake_enabled       = brake->enabled;
+    actions->airbrake_servo_channel = brake->servo_channel;
+    actions->airbrake_retracted_deg = brake->retracted_deg;
+    actions->airbrake_deployed_deg  = brake->deployed_deg;
+}
+
+static void log_event(flight_actions_t *actions, event_id_t id, const char *fmt, ...)
+  __attribute__((format(printf, 3, 4)));
+
+static void log_event(flight_actions_t *actions, event_id_t id, const char *fmt, ...)
+{
+    char data[EVENT_LENGTH];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(data, sizeof(data), fmt, args);
+    va_end(args);
+    actions->io.log_event(actions->io.ctx, id, data);
+}
+
+static void arm_pyro(flight_actions_t *actions, int channel)
+{
+    if (channel >= 0 && !actions->io.arm_pyro(actions->io.ctx, (uint8_t)channel))
+        log_event(actions, EVENT_ID_PYRO_FIRE, "channel=%d;error=arm", channel);
+}
+
+static void fire_pyro(flight_actions_t *actions, int channel, const char *reason)
+{
+    if (channel < 0)
+        return;
+
+    pyro_fire_record_t record;
+    const char *error = actions->io.fire_pyro(actions->io.ctx, (uint8_t)channel, &record);
+    if (error)
+    {
+        log_event(actions, EVENT_ID_PYRO_FIRE, "channel=%d;reason=%s;error=%s", channel, reason, error);
+        return;
+    }
+    BEAN_LOGI(TAG, "Pyro %d fired (%s), %" PRId64 " us after the detection sample", channel, reason, record.latency_us);
+    log_event(actions,
+              EVENT_ID_PYRO_FIRE,
+              "channel=%d;reason=%s;detect_us=%" PRId64 ";fire_us=%" PRId64 ";latency_us=%" PRId64,
+              channel,
+              reason,
+              record.detect_us,
+              record.fire_us,
+              record.latency_us);
+}
+
+static void set_servo(flight_actions_t *actions, int channel, float position_deg)
+{
+    if (channel >= 0 && actions->io.set_servo)
+        actions->io.set_servo(actions->io.ctx, (uint8_t)channel, position_deg);
+}
+
+static void capture_sag(flight_actions_t *actions, const char *reason)
+{
+    if (actions->io.capture_sag)
+        actions->io.capture_sag(actions->io.ctx, reason);
+}
+
+static void deploy(flight_actions_t *actions, int pyro_channel, int servo_channel, float servo_deg, const char *reason)
+{
+    fire_pyro(actions, pyro_channel, reason);
+    set_servo(actions, servo_channel, servo_deg);
+    if (pyro_channel >= 0 || servo_channel >= 0)
+        capture_sag(actions, reason);
+}
+
+static void log_landing(flight_actions_t *actions, const flight_sm_t *sm)
+{
+    BEAN_LOGI(TAG,
+              "Landed after %" PRIu32 " ms, max altitude %.1f m, max accel %.1f m/s^2",
+              sm->landed_ms - sm->launch_ms,
+              sm->max_altitude_m,
+              sm->max_accel_ms2);
+    log_event(actions,
+              EVENT_ID_FLIGHT_SUMMARY,
+              "launch=%" PRIu32 ";apogee=%" PRIu32 ";landed=%" PRIu32 ";flight_ms=%" PRIu32
+              ";max_alt_m=%.1f;max_accel_ms2=%.1f;ground_pa=%.1f;baro_rejected=%" PRIu32 ";dropped=%" PRIu32,
+              sm->launch_ms,
+              sm->apogee_ms,
+              sm->landed_ms,
+              sm->landed_ms - sm->launch_ms,
+              sm->max_altitude_m,
+              sm->max_accel_ms2,
+              sm->ground_pressure_pa,
+              sm->estimator.baro_rejected,
+              actions->dropped_samples);
+}
+
+void flight_actions_transition(flight_actions_t *actions, const flight_sm_t *sm, flight_state_t previous)
+{
+    // Deployments go first, everything below can wait
+    if (sm->state == FLIGHT_STATE_DROGUE_DEPLOYED)
+    {
+        deploy(
+          actions, actions->drogue_pyro_channel, actions->drogue_servo_channel, actions->drogue_servo_deg, "drogue");
+    }
+    else if (sm->state == FLIGHT_STATE_MAIN_DEPLOYED)
+    {
+        deploy(actions, actions->main_pyro_channel, actions->main_servo_channel, actions->main_servo_deg, "main");
+    }
+
+    // The brakes only fly in the ascent, retract them before the chutes come out
+    if (actions->airbrake_enabled && previous == FLIGHT_STATE_ASCENDING)
+    {
+        set_servo(actions, actions->airbrake_servo_channel, actions->airbrake_retracted_deg);
+        capture_sag(actions, "airbrake");
+    }
+
+    BEAN_LOGI(TAG, "State %s -> %s", flight_state_name(previous), flight_state_name(sm->state));
+    log_event(actions, EVENT_ID_STATE_CHANGE, "%s->%s", flight_state_name(previous), flight_state_name(sm->state));
+
+    if (sm->state == FLIGHT_STATE_ASCENDING)
+    {
+        arm_pyro(actions, actions->drogue_pyro_channel);
+        arm_pyro(actions, actions->main_pyro_channel);
+    }
+
+    if (sm->state == FLIGHT_STATE_ASCENDING && sm->launch_trigger == FLIGHT_LAUNCH_TRIGGER_HARDWARE)
+    {
+        log_event(actions,
+                  EVENT_ID_LAUNCH,
+                  "trigger=hardware;detected=%" PRIu32 ";axis=%s",
+                  sm->launch_ms,
+                  actions->launch_axis ? actions->launch_axis : "unknown");
+    }
+    else if (sm->state == FLIGHT_STATE_ASCENDING)
+    {
+        log_event(actions,
+                  EVENT_ID_LAUNCH,
+                  "trigger=software;first_motion=%" PRIu32 ";detected=%" PRIu32,
+                  sm->launch.first_motion_timestamp_ms,
+                  sm->launch.launch_timestamp_ms);
+    }
+    else if (sm->state == FLIGHT_STATE_DROGUE_DEPLOYED)
+    {
+        log_event(actions,
+                  EVENT_ID_APOGEE,
+                  "altitude_m=%.1f;max_alt_m=%.1f;trigger=%s",
+                  sm->estimator.altitude_m,
+                  sm->max_altitude_m,
+                  sm->apogee_timeout ? "timeout" : "velocity");
+    }
+    else if (sm->state == FLIGHT_STATE_LANDED)
+    {
+        log_landing(actions, sm);
+        if (actions->io.landed)
+            actions->io.landed(actions->io.ctx);
+    }
+}
+
+void flight_actions_sample(flight_actions_t *actions, flight_sm_t *sm)
+{
+    if (sm->estimator.lockout_changed)
+    {
+        sm->estimator.lockout_changed = false;
+        log_event(actions,
+                  EVENT_ID_BARO_LOCKOUT,
+                  "locked=%d;velocity_ms=%.1f;altitude_m=%.1f",
+                  sm->estimator.locked_out,
+                  sm->estimator.velocity_ms,
+                  sm->estimator.altitude_m);
+    }
+
+    if (sm->crosscheck_decided)
+    {
+        const launch_crosscheck_t *check = &sm->crosscheck;
+        sm->crosscheck_decided           = false;
+        if (check->result == LAUNCH_CROSSCHECK_AGREE)
+        {
+            BEAN_LOGI(TAG,
+                      "Launch triggers agree, software %" PRId32 " ms after hardware",
+                      (int32_t)(check->sw_timestamp_ms - check->hw_timestamp_ms));
+        }
+        else
+        {
+            BEAN_LOGW(TAG, "Launch triggers disagree: %s", launch_crosscheck_result_name(check->result));
+        }
+        log_event(actions,
+                  EVENT_ID_LAUNCH_CROSSCHECK,
+                  "result=%s;hw=%" PRIu32 ";sw=%" PRIu32 ";state=%s",
+                  launch_crosscheck_result_name(check->result),
+                  check->hw_seen ? check->hw_timestamp_ms : 0,
+                  check->sw_seen ? check->sw_timestamp_ms : 0,
+                  flight_state_name(sm->state));
+    }
+}
+
+void flight_actions_resume(flight_actions_t *actions, const flight_sm_t *sm)
+{
+    // The pyro and servo drivers came up in their power-on state, put the deployments back where the flight left them
+    if (sm->state == FLIGHT_STATE_ASCENDING)
+    {
+        arm_pyro(actions, actions->drogue_pyro_channel);
+        arm_pyro(actions, actions->main_pyro_channel);
+    }
+    else if (sm->state == FLIGHT_STATE_DROGUE_DEPLOYED)
+    {
+        arm_pyro(actions, actions->main_pyro_channel);
+    }
+    if (sm->state >= FLIGHT_STATE_DROGUE_DEPLOYED)
+        set_servo(actions, actions->drogue_servo_channel, actions->drogue_servo_deg);
+    if (sm->state >= FLIGHT_STATE_MAIN_DEPLOYED)
+        set_servo(actions, actions->main_servo_channel, actions->main_servo_deg);
+}
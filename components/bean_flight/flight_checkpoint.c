@@ -0,0 +1,114 @@
+#include "flight_checkpoint.h"
+#include <stddef.h>
+#include <string.h>
+
+#define FLAG_APOGEE_TIMEOUT 0x01
+#define FLAG_LOCKED_OUT     0x02
+
+static bool in_flight(flight_state_t state)
+{
+    return state >= FLIGHT_STATE_ASCENDING && state <= FLIGHT_STATE_MAIN_DEPLOYED;
+}
+
+// Bitwise CRC-32 (IEEE), the checkpoint is small enough that a table is not worth the memory
+static uint32_t crc32(const void *data, size_t length)
+{
+    const uint8_t *bytes = data;
+    uint32_t crc         = 0xFFFFFFFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        crc ^= bytes[i];
+        for (int bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static uint32_t checkpoint_crc(const flight_checkpoint_t *cp)
+{
+    return crc32(cp, offsetof(flight_checkpoint_t, crc));
+}
+
+void flight_checkpoint_save(flight_checkpoint_t *cp,
+                            const flight_sm_t *sm,
+                            uint32_t now_ms,
+                            const flight_checkpoint_origin_t *origin)
+{
+    if (!in_flight(sm->state))
+    {
+        if (cp->magic != 0)
+            flight_checkpoint_clear(cp);
+        return;
+    }
+
+    const flight_estimator_t *est = &sm->estimator;
+    uint32_t sequence             = cp->magic == FLIGHT_CHECKPOINT_MAGIC ? cp->sequence + 1 : 0;
+
+    memset(cp, 0, sizeof(*cp));
+    memcpy(cp->p, est->p, sizeof(cp->p));
+    cp->magic              = FLIGHT_CHECKPOINT_MAGIC;
+    cp->origin             = *origin;
+    cp->sequence           = sequence;
+    cp->state              = (uint8_t)sm->state;
+    cp->launch_trigger     = (uint8_t)sm->launch_trigger;
+    cp->crosscheck_result  = (uint8_t)sm->crosscheck.result;
+    cp->flags              = (sm->apogee_timeout ? FLAG_APOGEE_TIMEOUT : 0) | (est->locked_out ? FLAG_LOCKED_OUT : 0);
+    cp->flight_ms          = now_ms - sm->launch_ms;
+    cp->in_state_ms        = now_ms - sm->state_entered_ms;
+    cp->apogee_flight_ms   = sm->state > FLIGHT_STATE_ASCENDING ? sm->apogee_ms - sm->launch_ms : 0;
+    cp->lockout_ms         = est->locked_out ? now_ms - est->lockout_entered_ms : 0;
+    cp->altitude_m         = est->altitude_m;
+    cp->velocity_ms        = est->velocity_ms;
+    cp->gravity_ms2        = est->gravity_ms2;
+    cp->ground_pressure_pa = sm->ground_pressure_pa;
+    cp->max_altitude_m     = sm->max_altitude_m;
+    cp->max_accel_ms2      = sm->max_accel_ms2;
+    cp->crc                = checkpoint_crc(cp);
+}
+
+bool flight_checkpoint_valid(const flight_checkpoint_t *cp, uint32_t firmware)
+{
+    return cp->magic == FLIGHT_CHECKPOINT_MAGIC && cp->crc == checkpoint_crc(cp) && cp->origin.firmware == firmware &&
+           in_flight((flight_state_t)cp->state);
+}
+
+void flight_checkpoint_restore(const flight_checkpoint_t *cp, flight_sm_t *sm, uint32_t now_ms)
+{
+    flight_estimator_t *est = &sm->estimator;
+
+    sm->state               = (flight_state_t)cp->state;
+    sm->started             = true;
+    sm->state_entered_ms    = now_ms - cp->in_state_ms;
+    sm->launch_trigger      = (flight_launch_trigger_t)cp->launch_trigger;
+    sm->launch_ms           = now_ms - cp->flight_ms;
+    sm->apogee_ms           = sm->launch_ms + cp->apogee_flight_ms;
+    sm->apogee_timeout      = (cp->flags & FLAG_APOGEE_TIMEOUT) != 0;
+    sm->ground_pressure_pa  = cp->ground_pressure_pa;
+    sm->has_ground_pressure = true;
+    sm->max_altitude_m      = cp->max_altitude_m;
+    sm->max_accel_ms2       = cp->max_accel_ms2;
+
+    // An undecided cross-check can not be finished, the triggers seen before the reset are gone
+    sm->crosscheck.result = cp->crosscheck_result == LAUNCH_CROSSCHECK_PENDING
+                              ? (sm->launch_trigger == FLIGHT_LAUNCH_TRIGGER_HARDWARE ? LAUNCH_CROSSCHECK_HW_ONLY
+                                                                                      : LAUNCH_CROSSCHECK_SW_ONLY)
+                              : (launch_crosscheck_result_t)cp->crosscheck_result;
+    landing_detect_reset(&sm->landing);
+
+    // Initialized, so the first sample predicts from the saved altitude instead of snapping to the baro
+    memcpy(est->p, cp->p, sizeof(est->p));
+    est->initialized        = true;
+    est->last_timestamp_ms  = now_ms;
+    est->altitude_m         = cp->altitude_m;
+    est->velocity_ms        = cp->velocity_ms;
+    est->gravity_ms2        = cp->gravity_ms2;
+    est->gravity_frozen     = true;
+    est->locked_out         = (cp->flags & FLAG_LOCKED_OUT) != 0;
+    est->lockout_entered_ms = now_ms - cp->lockout_ms;
+    sm->altitude_m          = cp->altitude_m;
+}
+
+void flight_checkpoint_clear(flight_checkpoint_t *cp)
+{
+    memset(cp, 0, sizeof(*cp));
+}
@@ -0,0 +1,76 @@
+#include "flight_config.h"
+#include <string.h>
+#include "bean_hal.h"
+
+static const char *TAG = "FLIGHT_CONFIG";
+
+static flight_estimator_lockout_mode_t config_lockout_mode(const char *mode,
+                                                           flight_estimator_lockout_mode_t default_value)
+{
+    if (strcmp(mode, "off") == 0)
+        return FLIGHT_ESTIMATOR_LOCKOUT_OFF;
+    if (strcmp(mode, "ignore") == 0)
+        return FLIGHT_ESTIMATOR_LOCKOUT_IGNORE;
+    if (strcmp(mode, "deweight") == 0)
+        return FLIGHT_ESTIMATOR_LOCKOUT_DEWEIGHT;
+    BEAN_LOGW(TAG, "Unknown mach_lockout mode %s", mode);
+    return default_value;
+}
+
+uint32_t flight_config_loop_delay_ms(const bean_config_t *config)
+{
+    uint32_t loop_delay_ms = (uint32_t)config->bean_core.loop_delay;
+    return loop_delay_ms < 1 ? 1 : loop_delay_ms;
+}
+
+void flight_config_load(const bean_config_t *config, flight_sm_config_t *sm_config, airbrake_config_t *brake_config)
+{
+    const bean_config_bean_core_t *core                                    = &config->bean_core;
+    const bean_config_bean_core_flight_states_t *states                    = &core->flight_states;
+    const bean_config_bean_core_flight_states_armed_hw_high_g_t *hw_high_g = &states->armed.hw_high_g;
+    const bean_config_bean_core_estimator_t *estimator                     = &core->estimator;
+    const bean_config_bean_core_airbrake_t *brake                          = &core->airbrake;
+    uint32_t loop_delay_ms                                                 = flight_config_loop_delay_ms(config);
+
+    *sm_config = (flight_sm_config_t){
+        .pre_launch_timeout_ms = (uint32_t)states->pre_launch.timeout_ms,
+        .launch                = { .threshold_ms2       = states->armed.accel_threshold_ms2,
+                                   .release_ms2         = states->armed.release_threshold_ms2,
+                                   .spike_clip_ms2      = states->armed.spike_clip_ms2,
+                                   .min_window_fraction = states->armed.min_window_fraction,
+                                   .motion_ms2          = states->armed.motion_threshold_ms2,
+                                   .window_ms           = (uint32_t)states->armed.threshold_duration_ms,
+                                   .sample_period_ms    = loop_delay_ms },
+        .hw_launch_trigger     = hw_high_g->enabled && hw_high_g->launch_trigger,
+        .crosscheck_window_ms  = (uint32_t)hw_high_g->crosscheck_window_ms,
+        .estimator             = { .vertical_axis       = (uint8_t)estimator->vertical_axis,
+                                   .vertical_sign       = (float)estimator->vertical_sign,
+                                   .accel_noise_ms2     = estimator->accel_noise_ms2,
+                                   .baro_noise_m        = estimator->baro_noise_m,
+                                   .lockout_mode        = config_lockout_mode(estimator->mach_lockout.mode,
+                                                                              FLIGHT_ESTIMATOR_LOCKOUT_IGNORE),
+                                   .lockout_velocity_ms = estimator->mach_lockout.velocity_ms,
+                                   .release_velocity_ms = estimator->mach_lockout.release_velocity_ms,
+                                   .min_lockout_ms      = (uint32_t)estimator->mach_lockout.min_duration_ms,
+                                   .deweight_factor     = estimator->mach_lockout.deweight_factor,
+                                   .rate_tolerance_ms   = estimator->mach_lockout.rate_tolerance_ms,
+                                   .rate_window_ms      = (uint32_t)estimator->mach_lockout.rate_window_ms,
+                                   .sample_period_ms    = loop_delay_ms },
+        .apogee_min_time_ms    = (uint32_t)states->ascending.apogee_min_time_ms,
+        .apogee_max_time_ms    = (uint32_t)states->ascending.apogee_max_time_ms,
+        .main_height_m         = states->drogue_deployed.deploy_height_m,
+        .min_flight_time_ms    = (uint32_t)states->landed.min_flight_time_ms,
+        .landing               = { .altitude_variance_m2 = states->landed.altitude_variance_m2,
+                                   .accel_tolerance_ms2  = states->landed.accel_tolerance_ms2,
+                                   .window_ms            = (uint32_t)states->landed.quiet_duration_ms,
+                                   .sample_period_ms     = loop_delay_ms },
+    };
+
+    *brake_config = (airbrake_config_t){
+        .target_apogee_m   = brake->target_apogee_m,
+        .kp                = brake->kp,
+        .ki                = brake->ki,
+        .min_velocity_ms   = brake->min_velocity_ms,
+        .drag_filter_alpha = brake->drag_filter_alpha,
+    };
+}
@@ -0,0 +1,173 @@
+#include "flight_estimator.h"
+#include <math.h>
+#include <string.h>
+
+#define GRAVITY_EARTH    (9.80665f)
+#define GRAVITY_ALPHA    0.01f // Pad averaging of the accelerometer reading at rest
+#define GRAVITY_REST_MS2 1.0f // Only readings this close to the average count as at rest
+#define MAX_DT_S         0.1f // Longer gaps are clamped, the prediction would only add noise
+#define REJECT_RESYNC_MS 1000 // After this long with every baro sample rejected, trust the baro until it agrees again
+#define INITIAL_VARIANCE 100.0f
+
+void flight_estimator_init(flight_estimator_t *est, const flight_estimator_config_t *config)
+{
+    memset(est, 0, sizeof(*est));
+    est->config      = *config;
+    est->gravity_ms2 = GRAVITY_EARTH;
+    if (est->config.vertical_axis > 2)
+        est->config.vertical_axis = 2;
+
+    uint32_t period = config->sample_period_ms ? config->sample_period_ms : 1;
+    uint32_t length = (config->rate_window_ms + period / 2) / period;
+    if (length < 1)
+        length = 1;
+    if (length > FLIGHT_ESTIMATOR_RATE_BUFFER_LENGTH - 1)
+        length = FLIGHT_ESTIMATOR_RATE_BUFFER_LENGTH - 1;
+    est->rate_length = (uint16_t)length;
+
+    est->p[0][0] = INITIAL_VARIANCE;
+    est->p[1][1] = INITIAL_VARIANCE;
+}
+
+void flight_estimator_freeze_gravity(flight_estimator_t *est)
+{
+    est->gravity_frozen = true;
+}
+
+static void predict(flight_estimator_t *est, float dt, float accel)
+{
+    est->altitude_m += est->velocity_ms * dt + 0.5f * accel * dt * dt;
+    est->velocity_ms += accel * dt;
+
+    // P = F P F' + G G' q, with F = [1 dt; 0 1] and G = [dt^2 / 2; dt]
+    float p00 = est->p[0][0], p01 = est->p[0][1], p10 = est->p[1][0], p11 = est->p[1][1];
+    float q   = est->config.accel_noise_ms2 * est->config.accel_noise_ms2;
+    float g0  = 0.5f * dt * dt;
+    float g1  = dt;
+
+    est->p[0][0] = p00 + dt * (p10 + p01) + dt * dt * p11 + g0 * g0 * q;
+    est->p[0][1] = p01 + dt * p11 + g0 * g1 * q;
+    est->p[1][0] = p10 + dt * p11 + g0 * g1 * q;
+    est->p[1][1] = p11 + g1 * g1 * q;
+}
+
+static void correct(flight_estimator_t *est, float altitude_m, float noise_m)
+{
+    float innovation = altitude_m - est->altitude_m;
+    float s          = est->p[0][0] + noise_m * noise_m;
+    float k0         = est->p[0][0] / s;
+    float k1         = est->p[1][0] / s;
+
+    est->altitude_m += k0 * innovation;
+    est->velocity_ms += k1 * innovation;
+
+    float p00 = est->p[0][0], p01 = est->p[0][1];
+    est->p[0][0] -= k0 * p00;
+    est->p[0][1] -= k0 * p01;
+    est->p[1][0] -= k1 * p00;
+    est->p[1][1] -= k1 * p01;
+}
+
+static void update_lockout(flight_estimator_t *est, uint32_t timestamp_ms)
+{
+    float speed = fabsf(est->velocity_ms);
+
+    if (!est->locked_out && est->config.lockout_mode != FLIGHT_ESTIMATOR_LOCKOUT_OFF &&
+        speed >= est->config.lockout_velocity_ms)
+    {
+        est->locked_out         = true;
+        est->lockout_entered_ms = timestamp_ms;
+        est->lockout_changed    = true;
+    }
+    else if (est->locked_out && speed < est->config.release_velocity_ms &&
+             timestamp_ms - est->lockout_entered_ms >= est->config.min_lockout_ms)
+    {
+        est->locked_out      = false;
+        est->lockout_changed = true;
+    }
+}
+
+// Baro rate over the baseline, false until the history is long enough
+static bool update_baro_rate(flight_estimator_t *est, float altitude_m)
+{
+    est->baro_history[est->head] = altitude_m;
+    est->head                    = (uint16_t)((est->head + 1) % FLIGHT_ESTIMATOR_RATE_BUFFER_LENGTH);
+    if (est->count < FLIGHT_ESTIMATOR_RATE_BUFFER_LENGTH)
+        est->count++;
+    if (est->count <= est->rate_length)
+        return false;
+
+    uint16_t oldest =
+      (uint16_t)((est->head + FLIGHT_ESTIMATOR_RATE_BUFFER_LENGTH - 1 - est->rate_length) %
+                 FLIGHT_ESTIMATOR_RATE_BUFFER_LENGTH);
+    float baseline_s  = (float)(est->rate_length * est->config.sample_period_ms) / 1000.0f;
+    est->baro_rate_ms = (altitude_m - est->baro_history[oldest]) / baseline_s;
+    return true;
+}
+
+static bool baro_rate_agrees(flight_estimator_t *est)
+{
+    if (est->config.rate_tolerance_ms <= 0.0f)
+        return true;
+
+    // The baro rate is a difference over the baseline, so it lags the velocity by half of it
+    float baseline_s = (float)(est->rate_length * est->config.sample_period_ms) / 1000.0f;
+    float expected   = est->velocity_ms - est->accel_ms2 * baseline_s * 0.5f;
+    return fabsf(est->baro_rate_ms - expected) <= est->config.rate_tolerance_ms;
+}
+
+void flight_estimator_update(flight_estimator_t *est,
+                             uint32_t timestamp_ms,
+                             const float *accel,
+                             const float *baro_altitude_m)
+{
+    if (!est->initialized)
+    {
+        est->initialized       = true;
+        est->last_timestamp_ms = timestamp_ms;
+        if (baro_altitude_m)
+            est->altitude_m = *baro_altitude_m;
+    }
+
+    float dt = (float)(timestamp_ms - est->last_timestamp_ms) / 1000.0f;
+    if (dt > MAX_DT_S)
+        dt = MAX_DT_S;
+    est->last_timestamp_ms = timestamp_ms;
+
+    if (accel)
+    {
+        float reading = est->config.vertical_sign * accel[est->config.vertical_axis];
+        if (!est->gravity_frozen && fabsf(reading - est->gravity_ms2) < GRAVITY_REST_MS2)
+            est->gravity_ms2 += GRAVITY_ALPHA * (reading - est->gravity_ms2);
+        est->accel_ms2 = reading - est->gravity_ms2;
+    }
+    predict(est, dt, accel ? est->accel_ms2 : 0.0f);
+    update_lockout(est, timestamp_ms);
+
+    if (!baro_altitude_m)
+        return;
+
+    bool has_rate = update_baro_rate(est, *baro_altitude_m);
+    if (est->locked_out && est->config.lockout_mode == FLIGHT_ESTIMATOR_LOCKOUT_IGNORE)
+        return;
+
+    // Reject spikes, unless the baro has disagreed for so long that the estimate is the one that is off
+    if (has_rate && !baro_rate_agrees(est))
+    {
+        est->rejected_run_ms += (uint32_t)(dt * 1000.0f);
+        if (est->rejected_run_ms < REJECT_RESYNC_MS)
+        {
+            est->baro_rejected++;
+            return;
+        }
+    }
+    else
+    {
+        est->rejected_run_ms = 0;
+    }
+
+    float noise = est->config.baro_noise_m;
+    if (est->locked_out && est->config.lockout_mode == FLIGHT_ESTIMATOR_LOCKOUT_DEWEIGHT)
+        noise *= est->config.deweight_factor;
+    correct(est, *baro_altitude_m, noise);
+}
@@ -0,0 +1,190 @@
+#include "flight_sm.h"
+#include <math.h>
+#include <string.h>
+
+#define GROUND_PRESSURE_ALPHA 0.01f // Pad pressure averaging, ~1 s time constant at 100 Hz
+
+static const char *state_names[FLIGHT_STATE_COUNT] = {
+    "pre_launch", "armed", "ascending", "drogue_deployed", "main_deployed", "landed",
+};
+
+const char *flight_state_name(flight_state_t state)
+{
+    if (state >= FLIGHT_STATE_COUNT)
+        return "unknown";
+    return state_names[state];
+}
+
+float flight_sample_accel_magnitude(const flight_sample_t *sample)
+{
+    return sqrtf(sample->accel[0] * sample->accel[0] + sample->accel[1] * sample->accel[1] +
+                 sample->accel[2] * sample->accel[2]);
+}
+
+float flight_pressure_to_altitude(float pressure_pa, float reference_pressure_pa)
+{
+    return 44330.0f * (1.0f - powf(pressure_pa / reference_pressure_pa, 0.1903f));
+}
+
+void flight_sm_init(flight_sm_t *sm, const flight_sm_config_t *config)
+{
+    memset(sm, 0, sizeof(*sm));
+    sm->config = *config;
+    sm->state  = FLIGHT_STATE_PRE_LAUNCH;
+    launch_detect_init(&sm->launch, &config->launch);
+    launch_crosscheck_init(&sm->crosscheck, config->crosscheck_window_ms);
+    landing_detect_init(&sm->landing, &config->landing);
+    flight_estimator_init(&sm->estimator, &config->estimator);
+}
+
+const char *flight_launch_trigger_name(flight_launch_trigger_t trigger)
+{
+    switch (trigger)
+    {
+    case FLIGHT_LAUNCH_TRIGGER_SOFTWARE:
+        return "software";
+    case FLIGHT_LAUNCH_TRIGGER_HARDWARE:
+        return "hardware";
+    default:
+        return "none";
+    }
+}
+
+static void enter_state(flight_sm_t *sm, flight_state_t state, uint32_t timestamp_ms)
+{
+    sm->state            = state;
+    sm->state_entered_ms = timestamp_ms;
+}
+
+bool flight_sm_hold(flight_sm_t *sm, bool hold, uint32_t timestamp_ms)
+{
+    if (sm->state > FLIGHT_STATE_ARMED)
+        return false;
+
+    // The pad wait starts over on the release too, the board was just handled
+    sm->held    = hold;
+    sm->started = true;
+    launch_crosscheck_reset(&sm->crosscheck);
+    enter_state(sm, FLIGHT_STATE_PRE_LAUNCH, timestamp_ms);
+    return true;
+}
+
+bool flight_sm_step(flight_sm_t *sm, const flight_sample_t *sample)
+{
+    flight_state_t previous = sm->state;
+
+    if (!sm->started)
+    {
+        sm->started          = true;
+        sm->state_entered_ms = sample->timestamp_ms;
+    }
+    uint32_t in_state_ms = sample->timestamp_ms - sm->state_entered_ms;
+    bool on_pad          = sm->state == FLIGHT_STATE_PRE_LAUNCH || sm->state == FLIGHT_STATE_ARMED;
+    float accel_ms2      = sample->accel_valid ? flight_sample_accel_magnitude(sample) : 0.0f;
+    uint32_t flight_ms   = sample->timestamp_ms - sm->launch_ms;
+
+    if (sample->baro_valid)
+    {
+        if (!sm->has_ground_pressure)
+        {
+            sm->ground_pressure_pa  = sample->pressure_pa;
+            sm->has_ground_pressure = true;
+        }
+        else if (on_pad)
+        {
+            sm->ground_pressure_pa += GROUND_PRESSURE_ALPHA * (sample->pressure_pa - sm->ground_pressure_pa);
+        }
+        sm->altitude_m = flight_pressure_to_altitude(sample->pressure_pa, sm->ground_pressure_pa);
+    }
+    flight_estimator_update(&sm->estimator,
+                            sample->timestamp_ms,
+                            sample->accel_valid ? sample->accel : NULL,
+                            sample->baro_valid ? &sm->altitude_m : NULL);
+
+    if (!on_pad && sm->state != FLIGHT_STATE_LANDED)
+    {
+        if (sm->estimator.altitude_m > sm->max_altitude_m)
+            sm->max_altitude_m = sm->estimator.altitude_m;
+        if (accel_ms2 > sm->max_accel_ms2)
+            sm->max_accel_ms2 = accel_ms2;
+    }
+
+    // Both triggers keep being watched after the launch until the cross-check is decided
+    bool cross_checking = sm->state == FLIGHT_STATE_ARMED ||
+                          (sm->state == FLIGHT_STATE_ASCENDING && sm->crosscheck.result == LAUNCH_CROSSCHECK_PENDING);
+    if (cross_checking)
+    {
+        // A verdict on the pad without a launch was a false trigger, watch for the next one
+        if (sm->state == FLIGHT_STATE_ARMED && sm->crosscheck.result != LAUNCH_CROSSCHECK_PENDING)
+            launch_crosscheck_reset(&sm->crosscheck);
+
+        if (sample->hw_high_g)
+            launch_crosscheck_hw(&sm->crosscheck, sample->hw_high_g_timestamp_ms);
+        if (sample->accel_valid && launch_detect_update(&sm->launch, sample->timestamp_ms, accel_ms2))
+            launch_crosscheck_sw(&sm->crosscheck, sm->launch.launch_timestamp_ms);
+        if (launch_crosscheck_update(&sm->crosscheck, sample->timestamp_ms))
+            sm->crosscheck_decided = true;
+    }
+
+    switch (sm->state)
+    {
+    case FLIGHT_STATE_PRE_LAUNCH:
+        if (!sm->held && in_state_ms >= sm->config.pre_launch_timeout_ms)
+        {
+            launch_detect_reset(&sm->launch);
+            enter_state(sm, FLIGHT_STATE_ARMED, sample->timestamp_ms);
+        }
+        break;
+    case FLIGHT_STATE_ARMED:
+        if (sm->launch.launched)
+        {
+            // The flight started at the first motion, not when the detector was convinced
+            sm->launch_trigger = FLIGHT_LAUNCH_TRIGGER_SOFTWARE;
+            sm->launch_ms      = sm->launch.first_motion_timestamp_ms;
+        }
+        else if (sample->hw_high_g && sm->config.hw_launch_trigger)
+        {
+            sm->launch_trigger = FLIGHT_LAUNCH_TRIGGER_HARDWARE;
+            sm->launch_ms      = sample->hw_high_g_timestamp_ms;
+        }
+        if (sm->launch_trigger != FLIGHT_LAUNCH_TRIGGER_NONE)
+        {
+            flight_estimator_freeze_gravity(&sm->estimator);
+            landing_detect_reset(&sm->landing);
+            enter_state(sm, FLIGHT_STATE_ASCENDING, sm->launch_ms);
+        }
+        break;
+    case FLIGHT_STATE_ASCENDING:
+    case FLIGHT_STATE_DROGUE_DEPLOYED:
+    case FLIGHT_STATE_MAIN_DEPLOYED:
+        if (sample->accel_valid && sample->baro_valid &&
+            landing_detect_update(&sm->landing, sm->altitude_m, accel_ms2, sample->hw_no_motion) &&
+            flight_ms >= sm->config.min_flight_time_ms)
+        {
+            sm->landed_ms = sample->timestamp_ms;
+            enter_state(sm, FLIGHT_STATE_LANDED, sample->timestamp_ms);
+        }
+        else if (sm->state == FLIGHT_STATE_ASCENDING)
+        {
+            // The velocity is not trusted for apogee while the baro is locked out
+            bool descending = !sm->estimator.locked_out && sm->estimator.velocity_ms < 0.0f;
+            if ((descending && flight_ms >= sm->config.apogee_min_time_ms) ||
+                flight_ms >= sm->config.apogee_max_time_ms)
+            {
+                sm->apogee_ms      = sample->timestamp_ms;
+                sm->apogee_timeout = !descending;
+                enter_state(sm, FLIGHT_STATE_DROGUE_DEPLOYED, sample->timestamp_ms);
+            }
+        }
+        else if (sm->state == FLIGHT_STATE_DROGUE_DEPLOYED)
+        {
+            if (sm->estimator.velocity_ms < 0.0f && sm->estimator.altitude_m <= sm->config.main_height_m)
+                enter_state(sm, FLIGHT_STATE_MAIN_DEPLOYED, sample->timestamp_ms);
+        }
+        break;
+    default:
+        break;
+    }
+
+    return sm->state != previous;
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Airbrake controller: deflects the brakes to hit a target apogee.
+ *
+ * Runs once per estimator tick during the coast. The apogee is predicted in closed form from the estimated altitude,
+ * velocity and drag (quadratic drag plus gravity), so the cost per tick is constant. The drag coefficient is measured
+ * from the deceleration, it already contains the effect of the current deflection, so a PI loop on the predicted
+ * overshoot closes the loop.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+typedef struct airbrake_config
+{
+    float target_apogee_m;
+    float kp; // Deflection per m of predicted overshoot
+    float ki; // Deflection per m*s of predicted overshoot
+    float min_velocity_ms; // Below this the brakes retract, close to apogee the prediction means nothing
+    float drag_filter_alpha; // Smoothing of the measured drag coefficient, 0..1
+} airbrake_config_t;
+
+typedef struct airbrake
+{
+    airbrake_config_t config;
+    float drag_k; // Drag deceleration / v^2, in 1/m
+    bool has_drag;
+    float integral; // m*s
+    float predicted_apogee_m;
+    float deflection; // 0 retracted .. 1 fully deployed
+    bool active;
+} airbrake_t;
+
+void airbrake_init(airbrake_t *brake, const airbrake_config_t *config);
+
+/**
+ * @brief Predicts the apogee of a coasting body with quadratic drag.
+ *
+ * @param drag_k Drag deceleration divided by v^2
+ */
+float airbrake_predict_apogee(float altitude_m, float velocity_ms, float drag_k);
+
+/**
+ * @brief Runs the controller for one estimator tick.
+ *
+ * @param altitude_m Estimated altitude above the pad
+ * @param velocity_ms Estimated vertical velocity
+ * @param accel_ms2 Estimated vertical acceleration, gravity removed (so about -g - drag in the coast)
+ * @param dt_s Time since the previous tick
+ * @param coasting The motor burned out and the rocket is still ascending
+ * @return The deflection, 0 retracted .. 1 fully deployed
+ */
+float airbrake_update(airbrake_t *brake,
+                      float altitude_m,
+                      float velocity_ms,
+                      float accel_ms2,
+                      float dt_s,
+                      bool coasting);
@@ -0,0 +1,77 @@
+#pragma once
+#include "esp_err.h"
+#include "bean_context.h"
+#include "flight_sm.h"
+#include "flight_checkpoint.h"
+
+#define BEAN_FLIGHT_TASK_PRIORITY   (configMAX_PRIORITIES - 2) // Acquisition is the deadline bound path
+#define BEAN_FLIGHT_TASK_STACK_SIZE 4096
+
+/**
+ * @brief Loads the flight configuration from the config store.
+ *
+ * @param ctx The bean context, used for the log queues
+ * @return ESP_OK on success
+ */
+esp_err_t bean_flight_init(bean_context_t *ctx);
+
+/**
+ * @brief Starts the acquisition task that samples the sensors, logs them and runs the flight state machine.
+ *
+ * @return ESP_OK when the task was created
+ */
+esp_err_t bean_flight_start(void);
+
+/**
+ * @brief Gets the current flight state.
+ */
+flight_state_t bean_flight_get_state(void);
+
+/**
+ * @brief Gets the highest estimated altitude above the pad since the launch, in m.
+ */
+float bean_flight_get_max_altitude(void);
+
+/**
+ * @brief Asks the acquisition task to put the board into standby, a deep sleep until it is moved.
+ *
+ * The task closes the logs, latches the pyros low, leaves only the accelerometer any-motion feature running on the
+ * high-g interrupt wire and sleeps. The wake-up is a fresh boot.
+ *
+ * @return ESP_ERR_INVALID_STATE off the pad, ESP_ERR_NOT_SUPPORTED when `int_gpio` is no RTC GPIO
+ */
+esp_err_t bean_flight_request_standby(void);
+
+/**
+ * @brief Asks the acquisition task to hold the flight in pre_launch, or to release it.
+ *
+ * While held the launch detection is not armed, an armed board goes back to pre_launch and the idle standby is off.
+ * The hold lasts until the release, config patches included. It is in place once bean_flight_is_held says so.
+ *
+ * @return ESP_ERR_INVALID_STATE off the pad
+ */
+esp_err_t bean_flight_hold(bool hold);
+
+/**
+ * @brief Tells whether the acquisition task holds the flight in pre_launch.
+ */
+bool bean_flight_is_held(void);
+
+/**
+ * @brief Looks for a flight interrupted by a warm reset.
+ *
+ * @return The checkpoint left in RTC memory by that flight, NULL after a power-on or when there is none
+ */
+const flight_checkpoint_t *bean_flight_checkpoint(void);
+
+/**
+ * @brief Puts the flight back to a checkpoint, between bean_flight_init() and bean_flight_start().
+ *
+ * The pyros that were still to fire are armed again and the deployment servos are moved back to their positions.
+ */
+esp_err_t bean_flight_resume(const flight_checkpoint_t *cp);
+
+/**
+ * @brief Drops the checkpoint, so the next boot starts on the pad whatever the reset.
+ */
+void bean_flight_discard_checkpoint(void);
@@ -0,0 +1,67 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "bean_config.h"
+#include "bean_context.h"
+#include "flight_sm.h"
+#include "pyro_sched.h"
+
+/*
+ * What the flight does with the decisions of the state machine: the deployments on the transitions, the airbrake
+ * retraction, the events and the flight summary. Shared by bean_flight and the host tools, so a replayed log goes
+ * through the same deployments and events as the board.
+ *
+ * All outputs go through flight_actions_io_t, so this file has no ESP-IDF dependencies and is part of the host build.
+ */
+
+typedef struct flight_actions_io
+{
+    bool (*arm_pyro)(void *ctx, uint8_t channel);
+    const char *(*fire_pyro)(void *ctx, uint8_t channel, pyro_fire_record_t *record); // NULL when fired, else the error
+    void (*set_servo)(void *ctx, uint8_t channel, float position_deg); // May be NULL
+    void (*capture_sag)(void *ctx, const char *reason); // Battery sag capture around an actuation, may be NULL
+    void (*log_event)(void *ctx, event_id_t id, const char *data);
+    void (*landed)(void *ctx); // After the flight summary, disarm the pyros and close the logs, may be NULL
+    void *ctx;
+} flight_actions_io_t;
+
+typedef struct flight_actions
+{
+    flight_actions_io_t io;
+    int drogue_pyro_channel; // -1 when the deployment is disabled
+    int main_pyro_channel;
+    int drogue_servo_channel; // -1 when no servo moves at the deployment
+    int main_servo_channel;
+    float drogue_servo_deg;
+    float main_servo_deg;
+    bool airbrake_enabled;
+    int airbrake_servo_channel;
+    float airbrake_retracted_deg;
+    float airbrake_deployed_deg;
+    const char *launch_axis; // Of the high-g feature for a hardware launch, "+z" and the like, set by the caller
+    uint32_t dropped_samples; // Counted by the caller, for the flight summary
+} flight_actions_t;
+
+void flight_actions_init(flight_actions_t *actions, const flight_actions_io_t *io);
+
+/**
+ * @brief Takes the deployment channels and positions and the airbrake servo from the config.
+ */
+void flight_actions_load(flight_actions_t *actions, const bean_config_t *config);
+
+/**
+ * @brief Acts on a transition of the state machine, right after the flight_sm_step() that reported it.
+ *
+ * Deployments first, then the events. On the landing the flight summary is logged and io.landed called.
+ */
+void flight_actions_transition(flight_actions_t *actions, const flight_sm_t *sm, flight_state_t previous);
+
+/**
+ * @brief Logs the baro lockout changes and the cross-check verdict of the last sample, and clears their flags.
+ */
+void flight_actions_sample(flight_actions_t *actions, flight_sm_t *sm);
+
+/**
+ * @brief Arms the pyros still to fire and moves the deployment servos back, for a flight resumed from a checkpoint.
+ */
+void flight_actions_resume(flight_actions_t *actions, const flight_sm_t *sm);
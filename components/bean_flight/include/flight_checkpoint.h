@@ -0,0 +1,75 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "flight_sm.h"
+
+/*
+ * Snapshot of the flight state machine that survives a warm reset (watchdog, panic, brownout).
+ *
+ * The acquisition task saves it on every sample while the rocket is in the air. After a reset a valid checkpoint lets
+ * the boot resume the flight where it was instead of starting over on the pad. Times are kept relative to the launch
+ * and to the entry of the current state, the clock starts from zero again after the reset.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+#define FLIGHT_CHECKPOINT_MAGIC 0x50434642 // "BFCP"
+
+typedef struct flight_checkpoint_origin
+{
+    uint32_t firmware; // Identifies the code that wrote the checkpoint, a different build never resumes it
+    uint32_t config_hash; // Hash of the conf.json the flight was configured from
+    int32_t log_number; // Log files the flight writes to
+} flight_checkpoint_origin_t;
+
+typedef struct flight_checkpoint
+{
+    uint32_t magic;
+    flight_checkpoint_origin_t origin;
+    uint32_t sequence; // Incremented on every save
+
+    uint8_t state;
+    uint8_t launch_trigger;
+    uint8_t crosscheck_result;
+    uint8_t flags;
+    uint32_t flight_ms; // Time since launch
+    uint32_t in_state_ms; // Time since the current state was entered
+    uint32_t apogee_flight_ms; // Apogee, relative to the launch
+    uint32_t lockout_ms; // Time since the baro lockout was entered
+
+    float altitude_m;
+    float velocity_ms;
+    float p[2][2];
+    float gravity_ms2;
+    float ground_pressure_pa;
+    float max_altitude_m;
+    float max_accel_ms2;
+
+    uint32_t crc; // Over everything above
+} flight_checkpoint_t;
+
+/**
+ * @brief Saves the state machine, or clears the checkpoint when the rocket is not in the air.
+ *
+ * @param now_ms Timestamp of the sample the state machine was last stepped with
+ */
+void flight_checkpoint_save(flight_checkpoint_t *cp,
+                            const flight_sm_t *sm,
+                            uint32_t now_ms,
+                            const flight_checkpoint_origin_t *origin);
+
+/**
+ * @brief Checks the magic, the CRC, the firmware and that the saved state is an in-flight state.
+ */
+bool flight_checkpoint_valid(const flight_checkpoint_t *cp, uint32_t firmware);
+
+/**
+ * @brief Puts a state machine fresh out of flight_sm_init() back to the saved state.
+ *
+ * The launch and landing detectors start empty, the landing detector refills its window within the next samples.
+ *
+ * @param now_ms Timestamp of the next sample on the new clock
+ */
+void flight_checkpoint_restore(const flight_checkpoint_t *cp, flight_sm_t *sm, uint32_t now_ms);
+
+void flight_checkpoint_clear(flight_checkpoint_t *cp);
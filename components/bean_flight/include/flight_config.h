@@ -0,0 +1,24 @@
+#pragma once
+#include "bean_config.h"
+#include "airbrake.h"
+#include "flight_sm.h"
+
+/*
+ * Settings of the state machine and the airbrake controller from the typed configuration, shared by bean_flight and
+ * the host tools so both run the same flight logic.
+ *
+ * Only needs the generated bean_config.h and bean_hal for the log, so it is part of the host build.
+ */
+
+/**
+ * @brief Fills the state machine and airbrake settings from `bean_core` in the config.
+ *
+ * The sample periods follow `bean_core.loop_delay`, at least 1 ms. The hardware launch trigger is taken as configured,
+ * the caller clears it when the high-g feature could not be set up.
+ */
+void flight_config_load(const bean_config_t *config, flight_sm_config_t *sm_config, airbrake_config_t *brake_config);
+
+/**
+ * @brief Gets the acquisition period of `bean_core.loop_delay`, in ms, at least 1.
+ */
+uint32_t flight_config_loop_delay_ms(const bean_config_t *config);
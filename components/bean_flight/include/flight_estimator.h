@@ -0,0 +1,87 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Vertical estimator: two state (altitude, velocity) Kalman filter driven by the accelerometer, corrected by the baro.
+ *
+ * Around Mach 1 the static pressure around the body is disturbed and the baro reads garbage, so while the inertial
+ * velocity is high the baro corrections are locked out or de-weighted. Every baro sample is also cross-checked: the
+ * baro altitude rate has to agree with the inertial velocity, otherwise the sample is rejected.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+#define FLIGHT_ESTIMATOR_RATE_BUFFER_LENGTH 32 // Upper bound of the baro rate baseline, in samples
+
+typedef enum flight_estimator_lockout_mode
+{
+    FLIGHT_ESTIMATOR_LOCKOUT_OFF, // Baro is always used
+    FLIGHT_ESTIMATOR_LOCKOUT_IGNORE, // Baro is ignored in the high velocity phase
+    FLIGHT_ESTIMATOR_LOCKOUT_DEWEIGHT, // Baro noise is scaled up in the high velocity phase
+} flight_estimator_lockout_mode_t;
+
+typedef struct flight_estimator_config
+{
+    uint8_t vertical_axis; // Accelerometer axis pointing up on the pad (0 = x, 1 = y, 2 = z)
+    float vertical_sign; // 1 or -1, sign of that axis when pointing up
+    float accel_noise_ms2; // Process noise of the accelerometer input
+    float baro_noise_m; // Standard deviation of the baro altitude
+
+    flight_estimator_lockout_mode_t lockout_mode;
+    float lockout_velocity_ms; // |v| above which the baro is locked out
+    float release_velocity_ms; // |v| below which the lockout is released (hysteresis)
+    uint32_t min_lockout_ms; // Minimum time the lockout holds once entered
+    float deweight_factor; // Baro noise multiplier in the deweight mode
+
+    float rate_tolerance_ms; // Max difference between the baro rate and the inertial velocity, 0 disables the check
+    uint32_t rate_window_ms; // Baseline of the baro rate
+    uint32_t sample_period_ms; // Nominal time between two samples
+} flight_estimator_config_t;
+
+typedef struct flight_estimator
+{
+    flight_estimator_config_t config;
+    bool initialized;
+    uint32_t last_timestamp_ms;
+
+    float altitude_m;
+    float velocity_ms;
+    float accel_ms2; // Vertical acceleration, gravity removed
+    float p[2][2]; // Covariance of altitude and velocity
+
+    float gravity_ms2; // Vertical axis reading at rest, averaged on the pad so the accel bias is removed
+    bool gravity_frozen; // Set at launch, the pad average stops there
+
+    bool locked_out;
+    uint32_t lockout_entered_ms;
+    bool lockout_changed; // Set on the sample that entered or released the lockout, cleared by the caller
+
+    // Baro altitude history for the rate cross-check
+    float baro_history[FLIGHT_ESTIMATOR_RATE_BUFFER_LENGTH];
+    uint16_t rate_length;
+    uint16_t head;
+    uint16_t count;
+    float baro_rate_ms;
+    uint32_t baro_rejected; // Baro samples rejected by the rate cross-check
+    uint32_t rejected_run_ms; // Time every baro sample has been rejected
+} flight_estimator_t;
+
+void flight_estimator_init(flight_estimator_t *est, const flight_estimator_config_t *config);
+
+/**
+ * @brief Stops averaging the accelerometer reading at rest, called at launch.
+ */
+void flight_estimator_freeze_gravity(flight_estimator_t *est);
+
+/**
+ * @brief Runs one predict step with the accelerometer and, if there is one, one baro correction.
+ *
+ * @param timestamp_ms Timestamp of the sample
+ * @param accel Accelerometer sample in m/s^2, NULL if there was none
+ * @param baro_altitude_m Baro altitude above the pad, NULL if there was none
+ */
+void flight_estimator_update(flight_estimator_t *est,
+                             uint32_t timestamp_ms,
+                             const float *accel,
+                             const float *baro_altitude_m);
@@ -0,0 +1,114 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "launch_detect.h"
+#include "landing_detect.h"
+#include "launch_crosscheck.h"
+#include "flight_estimator.h"
+
+/*
+ * Flight state machine. Platform independent: it is fed with samples and reports transitions,
+ * the caller is responsible for the sensors, the logging and the actuators.
+ */
+
+typedef enum flight_state
+{
+    FLIGHT_STATE_PRE_LAUNCH,
+    FLIGHT_STATE_ARMED,
+    FLIGHT_STATE_ASCENDING,
+    FLIGHT_STATE_DROGUE_DEPLOYED,
+    FLIGHT_STATE_MAIN_DEPLOYED,
+    FLIGHT_STATE_LANDED,
+    FLIGHT_STATE_COUNT
+} flight_state_t;
+
+typedef enum flight_launch_trigger
+{
+    FLIGHT_LAUNCH_TRIGGER_NONE,
+    FLIGHT_LAUNCH_TRIGGER_SOFTWARE, // Sliding window detector
+    FLIGHT_LAUNCH_TRIGGER_HARDWARE, // High-g feature of the accelerometer
+} flight_launch_trigger_t;
+
+typedef struct flight_sample
+{
+    uint32_t timestamp_ms;
+    bool accel_valid;
+    float accel[3]; // m/s^2
+    bool gyro_valid;
+    float gyro[3]; // deg/s
+    bool baro_valid;
+    float pressure_pa;
+    float temperature_c;
+    bool hw_no_motion; // No-motion feature of the accelerometer fired
+    bool hw_high_g; // High-g feature of the accelerometer fired since the last sample
+    uint32_t hw_high_g_timestamp_ms; // When it fired, the interrupt time if it is wired
+} flight_sample_t;
+
+typedef struct flight_sm_config
+{
+    uint32_t pre_launch_timeout_ms; // Time spent in pre_launch before the launch detector is armed
+    launch_detect_config_t launch;
+    bool hw_launch_trigger; // The high-g feature alone launches, otherwise it is only cross-checked
+    uint32_t crosscheck_window_ms; // Max time between the hardware and the software trigger
+    flight_estimator_config_t estimator;
+    uint32_t apogee_min_time_ms; // Apogee is not considered before this time after launch
+    uint32_t apogee_max_time_ms; // Apogee is declared at this time after launch, whatever the estimator says
+    float main_height_m; // Estimated altitude under which the main state is entered on the way down
+    uint32_t min_flight_time_ms; // Landing is not considered before this time after launch
+    landing_detect_config_t landing;
+} flight_sm_config_t;
+
+typedef struct flight_sm
+{
+    flight_sm_config_t config;
+    flight_state_t state;
+    uint32_t state_entered_ms;
+    bool started;
+    bool held; // Kept in pre_launch until released, see flight_sm_hold
+    launch_detect_t launch;
+    launch_crosscheck_t crosscheck;
+    bool crosscheck_decided; // Set on the sample that decided the cross-check, cleared by the caller
+    landing_detect_t landing;
+    flight_estimator_t estimator;
+
+    float ground_pressure_pa; // Averaged on the pad, frozen at launch
+    bool has_ground_pressure;
+    float altitude_m; // Baro altitude above the pad
+
+    // Flight summary
+    flight_launch_trigger_t launch_trigger;
+    uint32_t launch_ms;
+    uint32_t apogee_ms;
+    bool apogee_timeout; // Apogee was declared by apogee_max_time_ms
+    uint32_t landed_ms;
+    float max_altitude_m;
+    float max_accel_ms2;
+} flight_sm_t;
+
+void flight_sm_init(flight_sm_t *sm, const flight_sm_config_t *config);
+
+/**
+ * @brief Runs the state machine for one sample.
+ *
+ * @return true if the state changed on this sample
+ */
+bool flight_sm_step(flight_sm_t *sm, const flight_sample_t *sample);
+
+/**
+ * @brief Holds the state machine in pre_launch, or releases it. An armed state machine goes back to pre_launch, after
+ * the release the launch detector is armed again once pre_launch_timeout_ms went by.
+ *
+ * @return false once launched, there is no hold in flight
+ */
+bool flight_sm_hold(flight_sm_t *sm, bool hold, uint32_t timestamp_ms);
+
+const char *flight_state_name(flight_state_t state);
+
+const char *flight_launch_trigger_name(flight_launch_trigger_t trigger);
+
+float flight_sample_accel_magnitude(const flight_sample_t *sample);
+
+/**
+ * @brief Converts a pressure to an altitude above the reference pressure (international barometric formula).
+ */
+float flight_pressure_to_altitude(float pressure_pa, float reference_pressure_pa);
@@ -0,0 +1,58 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Landing detector: the baro altitude has to be steady and the accelerometer quiet for a full window.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+#define LANDING_DETECT_BUFFER_LENGTH 512 // Upper bound of the window, in samples
+
+typedef struct landing_detect_config
+{
+    float altitude_variance_m2; // Baro altitude variance over the window under which the altitude is steady
+    float accel_tolerance_ms2; // Max deviation of |a| from 1 g for a sample to be quiet
+    uint32_t window_ms; // Duration both conditions have to hold
+    uint32_t sample_period_ms; // Nominal time between two samples
+} landing_detect_config_t;
+
+typedef struct landing_detect
+{
+    landing_detect_config_t config;
+    uint16_t window_length;
+    int64_t variance_limit; // altitude_variance_m2 scaled to mm^2 * window_length^2
+
+    // Altitudes are kept in mm relative to the first sample, so the sums are exact integers
+    int32_t altitude_reference_mm;
+    bool has_reference;
+    int32_t altitude_mm[LANDING_DETECT_BUFFER_LENGTH];
+    uint8_t moving[LANDING_DETECT_BUFFER_LENGTH];
+    uint16_t head;
+    uint16_t count;
+
+    int64_t sum;
+    int64_t sum_squares;
+    uint16_t moving_count;
+
+    bool landed;
+} landing_detect_t;
+
+void landing_detect_init(landing_detect_t *det, const landing_detect_config_t *config);
+void landing_detect_reset(landing_detect_t *det);
+
+/**
+ * @brief Feeds one sample into the detector. Constant time per sample.
+ *
+ * @param altitude_m Baro altitude
+ * @param accel_magnitude_ms2 Magnitude of the acceleration vector, including gravity
+ * @param hw_no_motion The accelerometer's own no-motion detector fired, counts as a quiet sample
+ * @return true once the rocket has landed
+ */
+bool landing_detect_update(landing_detect_t *det, float altitude_m, float accel_magnitude_ms2, bool hw_no_motion);
+
+/**
+ * @brief Variance of the altitude over the current window in m^2.
+ */
+float landing_detect_variance(const landing_detect_t *det);
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Cross-check of the two launch triggers: the software detector and the high-g feature of the accelerometer.
+ * Both have to fire within a window of each other, otherwise the trigger that fired alone is reported.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+typedef enum launch_crosscheck_result
+{
+    LAUNCH_CROSSCHECK_PENDING,
+    LAUNCH_CROSSCHECK_AGREE,
+    LAUNCH_CROSSCHECK_HW_ONLY,
+    LAUNCH_CROSSCHECK_SW_ONLY,
+} launch_crosscheck_result_t;
+
+typedef struct launch_crosscheck
+{
+    uint32_t window_ms; // Max time between the two triggers
+    bool hw_seen;
+    uint32_t hw_timestamp_ms;
+    bool sw_seen;
+    uint32_t sw_timestamp_ms;
+    launch_crosscheck_result_t result;
+} launch_crosscheck_t;
+
+void launch_crosscheck_init(launch_crosscheck_t *check, uint32_t window_ms);
+void launch_crosscheck_reset(launch_crosscheck_t *check);
+
+/**
+ * @brief Records the hardware (high-g) trigger, only the first one counts.
+ */
+void launch_crosscheck_hw(launch_crosscheck_t *check, uint32_t timestamp_ms);
+
+/**
+ * @brief Records the software detector trigger, only the first one counts.
+ */
+void launch_crosscheck_sw(launch_crosscheck_t *check, uint32_t timestamp_ms);
+
+/**
+ * @brief Decides the result once both triggers fired or the window expired.
+ *
+ * @param now_ms Timestamp of the current sample
+ * @return true on the call that decided the result
+ */
+bool launch_crosscheck_update(launch_crosscheck_t *check, uint32_t now_ms);
+
+const char *launch_crosscheck_result_name(launch_crosscheck_result_t result);
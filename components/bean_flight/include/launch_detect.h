@@ -0,0 +1,65 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Launch detector working on the acceleration magnitude.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+#define LAUNCH_DETECT_BUFFER_LENGTH 128 // Pre-launch buffer, also the upper bound of the detection window
+
+typedef struct launch_detect_config
+{
+    float threshold_ms2; // |a| a sample has to exceed to start counting as thrust
+    float release_ms2; // |a| a thrusting sample has to drop below to stop counting (hysteresis)
+    float spike_clip_ms2; // Samples are clipped to this before entering the running sum
+    float min_window_fraction; // Fraction of the window that has to be thrusting
+    float motion_ms2; // |a| that counts as motion when searching the pre-launch buffer
+    uint32_t window_ms; // Duration the thrust condition has to hold
+    uint32_t sample_period_ms; // Nominal time between two samples
+} launch_detect_config_t;
+
+typedef struct launch_detect
+{
+    launch_detect_config_t config;
+    uint16_t window_length; // Window size in samples
+    uint16_t min_high_samples; // Thrusting samples needed inside the window
+    int32_t threshold_sum; // Running sum the window has to reach, in mm/s^2
+
+    // Pre-launch ring buffer, the detection window is the newest window_length entries
+    uint32_t timestamps[LAUNCH_DETECT_BUFFER_LENGTH];
+    int32_t clipped[LAUNCH_DETECT_BUFFER_LENGTH]; // mm/s^2
+    float magnitude[LAUNCH_DETECT_BUFFER_LENGTH];
+    uint8_t high[LAUNCH_DETECT_BUFFER_LENGTH];
+    uint16_t head; // Next write position
+    uint16_t count; // Valid entries in the ring buffer
+
+    int32_t window_sum; // Integer so that the running sum never drifts, even after hours on the pad
+    uint16_t window_high;
+    bool thrusting; // Hysteresis state of the latest sample
+
+    bool launched;
+    uint32_t launch_timestamp_ms; // Sample at which the launch was confirmed
+    uint32_t first_motion_timestamp_ms; // Start of the motion that led to the launch
+} launch_detect_t;
+
+/**
+ * @brief Initializes the detector, the window is clamped to LAUNCH_DETECT_BUFFER_LENGTH samples.
+ */
+void launch_detect_init(launch_detect_t *det, const launch_detect_config_t *config);
+
+/**
+ * @brief Clears the window and the launch flag but keeps the configuration.
+ */
+void launch_detect_reset(launch_detect_t *det);
+
+/**
+ * @brief Feeds one sample into the detector. Constant time per sample until the launch is detected.
+ *
+ * @param timestamp_ms Timestamp of the sample
+ * @param accel_magnitude_ms2 Magnitude of the acceleration vector, including gravity
+ * @return true on the sample that confirms the launch and on every sample after that
+ */
+bool launch_detect_update(launch_detect_t *det, uint32_t timestamp_ms, float accel_magnitude_ms2);
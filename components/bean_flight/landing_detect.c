@@ -0,0 +1,118 @@
+#include "landing_detect.h"
+#include <math.h>
+#include <string.h>
+
+#define GRAVITY_EARTH   (9.80665f)
+#define REBASE_LIMIT_MM 1000000 // Keep the squares far away from overflowing, re-base after 1 km of descent
+
+static uint16_t ring_index(uint16_t head, uint16_t back)
+{
+    return (uint16_t)((head + LANDING_DETECT_BUFFER_LENGTH - back) % LANDING_DETECT_BUFFER_LENGTH);
+}
+
+void landing_detect_init(landing_detect_t *det, const landing_detect_config_t *config)
+{
+    det->config = *config;
+
+    uint32_t period = config->sample_period_ms ? config->sample_period_ms : 1;
+    uint32_t length = (config->window_ms + period - 1) / period;
+    if (length < 2)
+        length = 2;
+    if (length > LANDING_DETECT_BUFFER_LENGTH)
+        length = LANDING_DETECT_BUFFER_LENGTH;
+    det->window_length = (uint16_t)length;
+
+    // var = (n * sum_sq - sum^2) / n^2, compare without dividing
+    det->variance_limit = (int64_t)(config->altitude_variance_m2 * 1e6f) * (int64_t)length * (int64_t)length;
+
+    landing_detect_reset(det);
+}
+
+void landing_detect_reset(landing_detect_t *det)
+{
+    memset(det->altitude_mm, 0, sizeof(det->altitude_mm));
+    memset(det->moving, 0, sizeof(det->moving));
+    det->altitude_reference_mm = 0;
+    det->has_reference         = false;
+    det->head                  = 0;
+    det->count                 = 0;
+    det->sum                   = 0;
+    det->sum_squares           = 0;
+    det->moving_count          = 0;
+    det->landed                = false;
+}
+
+// Moves the reference to the newest sample and rebuilds the sums, only needed after a large altitude change
+static void rebase(landing_detect_t *det, int32_t new_reference_mm)
+{
+    int32_t shift = new_reference_mm - det->altitude_reference_mm;
+    uint16_t used = det->count < det->window_length ? det->count : det->window_length;
+
+    det->sum         = 0;
+    det->sum_squares = 0;
+    for (uint16_t back = 1; back <= used; back++)
+    {
+        uint16_t idx = ring_index(det->head, back);
+        det->altitude_mm[idx] -= shift;
+        det->sum += det->altitude_mm[idx];
+        det->sum_squares += (int64_t)det->altitude_mm[idx] * det->altitude_mm[idx];
+    }
+    det->altitude_reference_mm = new_reference_mm;
+}
+
+bool landing_detect_update(landing_detect_t *det, float altitude_m, float accel_magnitude_ms2, bool hw_no_motion)
+{
+    if (det->landed)
+        return true;
+
+    int32_t absolute_mm = (int32_t)lroundf(altitude_m * 1000.0f);
+    if (!det->has_reference)
+    {
+        det->altitude_reference_mm = absolute_mm;
+        det->has_reference         = true;
+    }
+    else if (absolute_mm - det->altitude_reference_mm > REBASE_LIMIT_MM ||
+             det->altitude_reference_mm - absolute_mm > REBASE_LIMIT_MM)
+    {
+        rebase(det, absolute_mm);
+    }
+
+    int32_t altitude_mm = absolute_mm - det->altitude_reference_mm;
+    float deviation     = fabsf(accel_magnitude_ms2 - GRAVITY_EARTH);
+    uint8_t moving      = (hw_no_motion || deviation <= det->config.accel_tolerance_ms2) ? 0 : 1;
+
+    if (det->count >= det->window_length)
+    {
+        uint16_t oldest = ring_index(det->head, det->window_length);
+        det->sum -= det->altitude_mm[oldest];
+        det->sum_squares -= (int64_t)det->altitude_mm[oldest] * det->altitude_mm[oldest];
+        det->moving_count -= det->moving[oldest];
+    }
+
+    det->altitude_mm[det->head] = altitude_mm;
+    det->moving[det->head]      = moving;
+    det->sum += altitude_mm;
+    det->sum_squares += (int64_t)altitude_mm * altitude_mm;
+    det->moving_count += moving;
+
+    det->head = (uint16_t)((det->head + 1) % LANDING_DETECT_BUFFER_LENGTH);
+    if (det->count < LANDING_DETECT_BUFFER_LENGTH)
+        det->count++;
+
+    if (det->count < det->window_length || det->moving_count > 0)
+        return false;
+
+    int64_t n      = det->window_length;
+    int64_t spread = n * det->sum_squares - det->sum * det->sum;
+    det->landed    = spread <= det->variance_limit;
+    return det->landed;
+}
+
+float landing_detect_variance(const landing_detect_t *det)
+{
+    int64_t n = det->count < det->window_length ? det->count : det->window_length;
+    if (n < 2)
+        return 0.0f;
+    int64_t spread = n * det->sum_squares - det->sum * det->sum;
+    return (float)spread / (float)(n * n) / 1e6f;
+}
@@ -0,0 +1,60 @@
+#include "launch_crosscheck.h"
+
+static const char *result_names[] = { "pending", "agree", "hw_only", "sw_only" };
+
+const char *launch_crosscheck_result_name(launch_crosscheck_result_t result)
+{
+    if (result > LAUNCH_CROSSCHECK_SW_ONLY)
+        return "unknown";
+    return result_names[result];
+}
+
+void launch_crosscheck_init(launch_crosscheck_t *check, uint32_t window_ms)
+{
+    check->window_ms = window_ms;
+    launch_crosscheck_reset(check);
+}
+
+void launch_crosscheck_reset(launch_crosscheck_t *check)
+{
+    check->hw_seen         = false;
+    check->hw_timestamp_ms = 0;
+    check->sw_seen         = false;
+    check->sw_timestamp_ms = 0;
+    check->result          = LAUNCH_CROSSCHECK_PENDING;
+}
+
+void launch_crosscheck_hw(launch_crosscheck_t *check, uint32_t timestamp_ms)
+{
+    if (check->hw_seen)
+        return;
+    check->hw_seen         = true;
+    check->hw_timestamp_ms = timestamp_ms;
+}
+
+void launch_crosscheck_sw(launch_crosscheck_t *check, uint32_t timestamp_ms)
+{
+    if (check->sw_seen)
+        return;
+    check->sw_seen         = true;
+    check->sw_timestamp_ms = timestamp_ms;
+}
+
+bool launch_crosscheck_update(launch_crosscheck_t *check, uint32_t now_ms)
+{
+    if (check->result != LAUNCH_CROSSCHECK_PENDING || (!check->hw_seen && !check->sw_seen))
+        return false;
+
+    if (check->hw_seen && check->sw_seen)
+    {
+        check->result = LAUNCH_CROSSCHECK_AGREE;
+        return true;
+    }
+
+    uint32_t first_ms = check->hw_seen ? check->hw_timestamp_ms : check->sw_timestamp_ms;
+    if (now_ms - first_ms < check->window_ms)
+        return false;
+
+    check->result = check->hw_seen ? LAUNCH_CROSSCHECK_HW_ONLY : LAUNCH_CROSSCHECK_SW_ONLY;
+    return true;
+}
@@ -0,0 +1,108 @@
+#include "launch_detect.h"
+#include <string.h>
+
+static uint16_t ring_index(uint16_t head, uint16_t back)
+{
+    return (uint16_t)((head + LAUNCH_DETECT_BUFFER_LENGTH - back) % LAUNCH_DETECT_BUFFER_LENGTH);
+}
+
+void launch_detect_init(launch_detect_t *det, const launch_detect_config_t *config)
+{
+    det->config = *config;
+
+    uint32_t period = config->sample_period_ms ? config->sample_period_ms : 1;
+    uint32_t length = (config->window_ms + period - 1) / period;
+    if (length < 1)
+        length = 1;
+    if (length > LAUNCH_DETECT_BUFFER_LENGTH)
+        length = LAUNCH_DETECT_BUFFER_LENGTH;
+    det->window_length = (uint16_t)length;
+
+    float fraction = config->min_window_fraction;
+    if (fraction <= 0.0f || fraction > 1.0f)
+        fraction = 1.0f;
+    det->min_high_samples = (uint16_t)(fraction * length + 0.999f);
+
+    det->threshold_sum = (int32_t)(config->threshold_ms2 * 1000.0f) * (int32_t)length;
+
+    launch_detect_reset(det);
+}
+
+void launch_detect_reset(launch_detect_t *det)
+{
+    memset(det->timestamps, 0, sizeof(det->timestamps));
+    memset(det->clipped, 0, sizeof(det->clipped));
+    memset(det->magnitude, 0, sizeof(det->magnitude));
+    memset(det->high, 0, sizeof(det->high));
+    det->head                      = 0;
+    det->count                     = 0;
+    det->window_sum                = 0;
+    det->window_high               = 0;
+    det->thrusting                 = false;
+    det->launched                  = false;
+    det->launch_timestamp_ms       = 0;
+    det->first_motion_timestamp_ms = 0;
+}
+
+// Walks back through the pre-launch buffer to the start of the motion run that ends at the newest sample.
+// Only runs once, on the sample that confirms the launch.
+static uint32_t find_first_motion(const launch_detect_t *det)
+{
+    uint32_t first = det->timestamps[ring_index(det->head, 1)];
+    for (uint16_t back = 1; back <= det->count; back++)
+    {
+        uint16_t idx = ring_index(det->head, back);
+        if (det->magnitude[idx] < det->config.motion_ms2)
+            break;
+        first = det->timestamps[idx];
+    }
+    return first;
+}
+
+bool launch_detect_update(launch_detect_t *det, uint32_t timestamp_ms, float accel_magnitude_ms2)
+{
+    if (det->launched)
+        return true;
+
+    // Schmitt trigger on the individual samples, so thrust ripple around the threshold keeps counting
+    if (det->thrusting)
+        det->thrusting = accel_magnitude_ms2 >= det->config.release_ms2;
+    else
+        det->thrusting = accel_magnitude_ms2 >= det->config.threshold_ms2;
+
+    float clipped = accel_magnitude_ms2;
+    if (clipped > det->config.spike_clip_ms2)
+        clipped = det->config.spike_clip_ms2;
+    if (clipped < 0.0f)
+        clipped = 0.0f;
+
+    // Drop the sample that leaves the window before its slot can be overwritten
+    if (det->count >= det->window_length)
+    {
+        uint16_t oldest = ring_index(det->head, det->window_length);
+        det->window_sum -= det->clipped[oldest];
+        det->window_high -= det->high[oldest];
+    }
+
+    det->timestamps[det->head] = timestamp_ms;
+    det->clipped[det->head]    = (int32_t)(clipped * 1000.0f);
+    det->magnitude[det->head]  = accel_magnitude_ms2;
+    det->high[det->head]       = det->thrusting ? 1 : 0;
+    det->window_sum += det->clipped[det->head];
+    det->window_high += det->high[det->head];
+
+    det->head = (uint16_t)((det->head + 1) % LAUNCH_DETECT_BUFFER_LENGTH);
+    if (det->count < LAUNCH_DETECT_BUFFER_LENGTH)
+        det->count++;
+
+    if (det->count < det->window_length)
+        return false;
+
+    if (det->window_sum >= det->threshold_sum && det->window_high >= det->min_high_samples)
+    {
+        det->launched                  = true;
+        det->launch_timestamp_ms       = timestamp_ms;
+        det->first_motion_timestamp_ms = find_first_motion(det);
+    }
+    return det->launched;
+}
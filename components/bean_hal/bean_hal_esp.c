@@ -0,0 +1,173 @@
+#include "bean_hal.h"
+#include <unistd.h>
+#include "driver/gpio.h"
+#include "driver/i2c.h"
+#include "esp_heap_caps.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+
+#define I2C_PORT I2C_NUM_0
+
+static TickType_t to_ticks(uint32_t timeout_ms)
+{
+    return timeout_ms == BEAN_HAL_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+}
+
+int64_t bean_hal_time_us(void)
+{
+    return esp_timer_get_time();
+}
+
+uint32_t bean_hal_time_ms(void)
+{
+    return esp_log_timestamp();
+}
+
+void bean_hal_delay_ms(uint32_t ms)
+{
+    vTaskDelay(pdMS_TO_TICKS(ms));
+}
+
+void bean_hal_delay_us(uint32_t us)
+{
+    esp_rom_delay_us(us);
+}
+
+esp_err_t bean_hal_task_create(void (*function)(void *),
+                               const char *name,
+                               uint32_t stack_size,
+                               void *arg,
+                               uint32_t priority,
+                               bean_hal_task_t *task)
+{
+    return xTaskCreate(function, name, stack_size, arg, priority, task) == pdPASS ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+bean_hal_queue_t bean_hal_queue_create(size_t length, size_t item_size)
+{
+    return xQueueCreate(length, item_size);
+}
+
+bool bean_hal_queue_send(bean_hal_queue_t queue, const void *item, uint32_t timeout_ms)
+{
+    return xQueueSend(queue, item, to_ticks(timeout_ms)) == pdPASS;
+}
+
+bool bean_hal_queue_receive(bean_hal_queue_t queue, void *item, uint32_t timeout_ms)
+{
+    return xQueueReceive(queue, item, to_ticks(timeout_ms)) == pdTRUE;
+}
+
+size_t bean_hal_queue_waiting(bean_hal_queue_t queue)
+{
+    return uxQueueMessagesWaiting(queue);
+}
+
+bean_hal_mutex_t bean_hal_mutex_create(void)
+{
+    return xSemaphoreCreateMutex();
+}
+
+void bean_hal_mutex_lock(bean_hal_mutex_t mutex)
+{
+    xSemaphoreTake(mutex, portMAX_DELAY);
+}
+
+void bean_hal_mutex_unlock(bean_hal_mutex_t mutex)
+{
+    xSemaphoreGive(mutex);
+}
+
+bean_hal_event_group_t bean_hal_event_group_create(void)
+{
+    return xEventGroupCreate();
+}
+
+bean_hal_bits_t bean_hal_event_group_set_bits(bean_hal_event_group_t group, bean_hal_bits_t bits)
+{
+    return xEventGroupSetBits(group, bits);
+}
+
+bean_hal_bits_t bean_hal_event_group_clear_bits(bean_hal_event_group_t group, bean_hal_bits_t bits)
+{
+    return xEventGroupClearBits(group, bits);
+}
+
+bean_hal_bits_t bean_hal_event_group_get_bits(bean_hal_event_group_t group)
+{
+    return xEventGroupGetBits(group);
+}
+
+size_t bean_hal_heap_free(void)
+{
+    return heap_caps_get_free_size(MALLOC_CAP_8BIT);
+}
+
+size_t bean_hal_heap_min_free(void)
+{
+    return heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+}
+
+size_t bean_hal_heap_largest_block(void)
+{
+    return heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+}
+
+FILE *bean_hal_fopen(const char *path, const char *mode)
+{
+    return fopen(path, mode);
+}
+
+DIR *bean_hal_opendir(const char *path)
+{
+    return opendir(path);
+}
+
+esp_err_t bean_hal_fsync(FILE *file)
+{
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0)
+        return ESP_FAIL;
+    return ESP_OK;
+}
+
+esp_err_t bean_hal_i2c_init(int sda_gpio, int scl_gpio, uint32_t clock_hz)
+{
+    const i2c_config_t conf = {
+        .mode             = I2C_MODE_MASTER,
+        .sda_io_num       = sda_gpio,
+        .scl_io_num       = scl_gpio,
+        .sda_pullup_en    = GPIO_PULLUP_ENABLE,
+        .scl_pullup_en    = GPIO_PULLUP_ENABLE,
+        .master.clk_speed = clock_hz,
+        .clk_flags        = 0,
+    };
+    esp_err_t ret = i2c_param_config(I2C_PORT, &conf);
+    if (ret != ESP_OK)
+        return ret;
+    return i2c_driver_install(I2C_PORT, conf.mode, 0, 0, 0);
+}
+
+esp_err_t bean_hal_i2c_write(uint8_t address, const uint8_t *data, size_t length, uint32_t timeout_ms)
+{
+    return i2c_master_write_to_device(I2C_PORT, address, data, length, to_ticks(timeout_ms));
+}
+
+esp_err_t bean_hal_i2c_write_read(uint8_t address,
+                                  const uint8_t *out,
+                                  size_t out_length,
+                                  uint8_t *in,
+                                  size_t in_length,
+                                  uint32_t timeout_ms)
+{
+    return i2c_master_write_read_device(I2C_PORT, address, out, out_length, in, in_length, to_ticks(timeout_ms));
+}
+
+esp_err_t bean_hal_gpio_set_level(int gpio, uint32_t level)
+{
+    return gpio_set_level(gpio, level);
+}
+
+int bean_hal_gpio_get_level(int gpio)
+{
+    return gpio_get_level(gpio);
+}
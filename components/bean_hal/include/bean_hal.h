@@ -0,0 +1,170 @@
+#pragma once
+#include <dirent.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "esp_err.h"
+
+/*
+ * Thin platform layer: the queues, tasks, time, log, files, I2C and GPIO that the portable components use. The ESP-IDF
+ * backend (bean_hal_esp.c) maps it onto FreeRTOS and the IDF drivers, the POSIX backend (posix/bean_hal_posix.c) onto
+ * pthreads and the host file system for the host build in host/. BEAN_HAL_POSIX selects the POSIX one.
+ */
+
+#define BEAN_HAL_WAIT_FOREVER UINT32_MAX // A timeout that never expires
+
+#if BEAN_HAL_POSIX
+typedef struct bean_hal_queue *bean_hal_queue_t;
+typedef struct bean_hal_mutex *bean_hal_mutex_t;
+typedef struct bean_hal_event_group *bean_hal_event_group_t;
+typedef struct bean_hal_task *bean_hal_task_t;
+typedef uint32_t bean_hal_bits_t;
+#else
+#include "freertos/FreeRTOS.h"
+#include "freertos/event_groups.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/task.h"
+// The FreeRTOS handles themselves, so the code that is not ported keeps working on the same objects
+typedef QueueHandle_t bean_hal_queue_t;
+typedef SemaphoreHandle_t bean_hal_mutex_t;
+typedef EventGroupHandle_t bean_hal_event_group_t;
+typedef TaskHandle_t bean_hal_task_t;
+typedef EventBits_t bean_hal_bits_t;
+#endif
+
+// Log, the ESP_LOGx macros on the target
+#if BEAN_HAL_POSIX
+typedef enum bean_hal_log_level
+{
+    BEAN_HAL_LOG_NONE,
+    BEAN_HAL_LOG_ERROR,
+    BEAN_HAL_LOG_WARN,
+    BEAN_HAL_LOG_INFO,
+    BEAN_HAL_LOG_DEBUG,
+} bean_hal_log_level_t;
+
+void bean_hal_log(bean_hal_log_level_t level, const char *tag, const char *fmt, ...)
+  __attribute__((format(printf, 3, 4)));
+
+#define BEAN_LOGE(tag, fmt, ...) bean_hal_log(BEAN_HAL_LOG_ERROR, tag, fmt, ##__VA_ARGS__)
+#define BEAN_LOGW(tag, fmt, ...) bean_hal_log(BEAN_HAL_LOG_WARN, tag, fmt, ##__VA_ARGS__)
+#define BEAN_LOGI(tag, fmt, ...) bean_hal_log(BEAN_HAL_LOG_INFO, tag, fmt, ##__VA_ARGS__)
+#define BEAN_LOGD(tag, fmt, ...) bean_hal_log(BEAN_HAL_LOG_DEBUG, tag, fmt, ##__VA_ARGS__)
+#else
+#include "esp_log.h"
+#define BEAN_LOGE ESP_LOGE
+#define BEAN_LOGW ESP_LOGW
+#define BEAN_LOGI ESP_LOGI
+#define BEAN_LOGD ESP_LOGD
+#endif
+
+/**
+ * @brief Gets the time since boot in us, the esp_timer on the target.
+ */
+int64_t bean_hal_time_us(void);
+
+/**
+ * @brief Gets the time since boot in ms, as in the log lines.
+ */
+uint32_t bean_hal_time_ms(void);
+
+/**
+ * @brief Blocks the calling task, other tasks run meanwhile.
+ */
+void bean_hal_delay_ms(uint32_t ms);
+
+/**
+ * @brief Busy waits, for the short delays of the sensor drivers.
+ */
+void bean_hal_delay_us(uint32_t us);
+
+/**
+ * @brief Starts a task. The stack size and priority only apply on the target.
+ */
+esp_err_t bean_hal_task_create(void (*function)(void *),
+                               const char *name,
+                               uint32_t stack_size,
+                               void *arg,
+                               uint32_t priority,
+                               bean_hal_task_t *task);
+
+/**
+ * @brief Creates a queue of fixed size items, copied in and out.
+ *
+ * @return NULL when out of memory
+ */
+bean_hal_queue_t bean_hal_queue_create(size_t length, size_t item_size);
+
+/**
+ * @brief Copies an item to the back of the queue, waiting up to the timeout for room. Not from an ISR.
+ *
+ * @return false when the queue stayed full
+ */
+bool bean_hal_queue_send(bean_hal_queue_t queue, const void *item, uint32_t timeout_ms);
+
+/**
+ * @brief Takes the item at the front of the queue, waiting up to the timeout for one.
+ *
+ * @return false when the queue stayed empty
+ */
+bool bean_hal_queue_receive(bean_hal_queue_t queue, void *item, uint32_t timeout_ms);
+
+size_t bean_hal_queue_waiting(bean_hal_queue_t queue);
+
+bean_hal_mutex_t bean_hal_mutex_create(void);
+void bean_hal_mutex_lock(bean_hal_mutex_t mutex);
+void bean_hal_mutex_unlock(bean_hal_mutex_t mutex);
+
+bean_hal_event_group_t bean_hal_event_group_create(void);
+bean_hal_bits_t bean_hal_event_group_set_bits(bean_hal_event_group_t group, bean_hal_bits_t bits);
+bean_hal_bits_t bean_hal_event_group_clear_bits(bean_hal_event_group_t group, bean_hal_bits_t bits);
+bean_hal_bits_t bean_hal_event_group_get_bits(bean_hal_event_group_t group);
+
+/**
+ * @brief Gets the free heap of 8 bit capable memory, its lowest point since boot and its largest block.
+ *
+ * 0 on the host, where the heap is not bounded.
+ */
+size_t bean_hal_heap_free(void);
+size_t bean_hal_heap_min_free(void);
+size_t bean_hal_heap_largest_block(void);
+
+/**
+ * @brief Opens a file on the storage, by its path on the target (STORAGE_BASE_PATH "/...").
+ *
+ * The host maps the path into its storage directory, see bean_hal_posix_set_root().
+ */
+FILE *bean_hal_fopen(const char *path, const char *mode);
+
+DIR *bean_hal_opendir(const char *path);
+
+/**
+ * @brief Flushes the stdio buffer of a file and syncs it to the storage.
+ */
+esp_err_t bean_hal_fsync(FILE *file);
+
+/**
+ * @brief Sets up the I2C master with the internal pull-ups, for every bean_hal_i2c_* call after it.
+ */
+esp_err_t bean_hal_i2c_init(int sda_gpio, int scl_gpio, uint32_t clock_hz);
+
+esp_err_t bean_hal_i2c_write(uint8_t address, const uint8_t *data, size_t length, uint32_t timeout_ms);
+
+/**
+ * @brief Writes and then reads in one transaction, with a repeated start: a register address, then its contents.
+ */
+esp_err_t bean_hal_i2c_write_read(uint8_t address,
+                                  const uint8_t *out,
+                                  size_t out_length,
+                                  uint8_t *in,
+                                  size_t in_length,
+                                  uint32_t timeout_ms);
+
+/**
+ * @brief Drives a GPIO that is configured as an output.
+ */
+esp_err_t bean_hal_gpio_set_level(int gpio, uint32_t level);
+
+int bean_hal_gpio_get_level(int gpio);
@@ -0,0 +1,593 @@
+/*
+Description: POSIX backend of bean_hal, for the host build (host/). Tasks are threads, queues and event groups are
+guarded by a mutex and condition variables, the time is the monotonic clock since the start of the process, or a
+virtual clock for a replay, and the storage is a directory.
+*/
+
+#include "bean_hal_posix.h"
+#include <errno.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+struct bean_hal_queue
+{
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    size_t length;
+    size_t item_size;
+    size_t head; // Next item to receive
+    size_t count;
+    uint8_t *items;
+};
+
+struct bean_hal_mutex
+{
+    pthread_mutex_t lock;
+};
+
+struct bean_hal_event_group
+{
+    pthread_mutex_t lock;
+    bean_hal_bits_t bits;
+};
+
+struct bean_hal_task
+{
+    pthread_t thread;
+    void (*function)(void *);
+    void *arg;
+};
+
+typedef struct i2c_device
+{
+    uint8_t address;
+    bean_hal_posix_i2c_transfer_t transfer;
+    void *device;
+    bean_hal_posix_i2c_stats_t stats;
+    uint64_t bus_bits;
+} i2c_device_t;
+
+static pthread_once_t clock_once = PTHREAD_ONCE_INIT;
+static struct timespec clock_start;
+static atomic_bool virtual_clock;
+static atomic_int_least64_t virtual_time_us;
+static bean_hal_log_level_t log_level = BEAN_HAL_LOG_INFO;
+static char storage_root[PATH_MAX]    = ".";
+static pthread_mutex_t bus_lock       = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t i2c_clock_hz          = 100000;
+static i2c_device_t i2c_devices[BEAN_HAL_POSIX_I2C_DEVICES];
+static int gpio_levels[BEAN_HAL_POSIX_GPIOS];
+
+static void start_clock(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &clock_start);
+}
+
+int64_t bean_hal_time_us(void)
+{
+    if (atomic_load(&virtual_clock))
+        return atomic_load(&virtual_time_us);
+    pthread_once(&clock_once, start_clock);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)(now.tv_sec - clock_start.tv_sec) * 1000000 + (now.tv_nsec - clock_start.tv_nsec) / 1000;
+}
+
+uint32_t bean_hal_time_ms(void)
+{
+    return (uint32_t)(bean_hal_time_us() / 1000);
+}
+
+void bean_hal_posix_use_virtual_clock(int64_t start_us)
+{
+    atomic_store(&virtual_time_us, start_us);
+    atomic_store(&virtual_clock, true);
+}
+
+void bean_hal_posix_set_clock(int64_t time_us)
+{
+    int64_t now_us = atomic_load(&virtual_time_us);
+    while (now_us < time_us && !atomic_compare_exchange_weak(&virtual_time_us, &now_us, time_us))
+        ;
+}
+
+// On the virtual clock a delay is the time it moves on by, the other threads get a chance to run in it
+static bool virtual_delay(int64_t us)
+{
+    if (!atomic_load(&virtual_clock))
+        return false;
+    atomic_fetch_add(&virtual_time_us, us);
+    sched_yield();
+    return true;
+}
+
+void bean_hal_delay_ms(uint32_t ms)
+{
+    if (virtual_delay((int64_t)ms * 1000))
+        return;
+    struct timespec delay = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000 };
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR)
+        ;
+}
+
+void bean_hal_delay_us(uint32_t us)
+{
+    if (virtual_delay(us))
+        return;
+    int64_t end_us = bean_hal_time_us() + us;
+    while (bean_hal_time_us() < end_us)
+        ;
+}
+
+void bean_hal_log(bean_hal_log_level_t level, const char *tag, const char *fmt, ...)
+{
+    static const char letters[] = { 'N', 'E', 'W', 'I', 'D' };
+    if (level > log_level || level == BEAN_HAL_LOG_NONE)
+        return;
+
+    // One fprintf per line, so the lines of two threads do not interleave
+    char line[512];
+    int length = snprintf(line, sizeof(line), "%c (%u) %s: ", letters[level], (unsigned)bean_hal_time_ms(), tag);
+    va_list args;
+    va_start(args, fmt);
+    if (length > 0 && (size_t)length < sizeof(line))
+        vsnprintf(&line[length], sizeof(line) - (size_t)length, fmt, args);
+    va_end(args);
+    fprintf(stderr, "%s\n", line);
+}
+
+void bean_hal_posix_set_log_level(bean_hal_log_level_t level)
+{
+    log_level = level;
+}
+
+static void *run_task(void *arg)
+{
+    bean_hal_task_t task = arg;
+    task->function(task->arg);
+    return NULL;
+}
+
+esp_err_t bean_hal_task_create(void (*function)(void *),
+                               const char *name,
+                               uint32_t stack_size,
+                               void *arg,
+                               uint32_t priority,
+                               bean_hal_task_t *task)
+{
+    // Lives as long as the process, like the tasks of the firmware
+    bean_hal_task_t created = calloc(1, sizeof(*created));
+    if (created == NULL)
+        return ESP_ERR_NO_MEM;
+    created->function = function;
+    created->arg      = arg;
+    if (pthread_create(&created->thread, NULL, run_task, created) != 0)
+    {
+        free(created);
+        return ESP_ERR_NO_MEM;
+    }
+    pthread_detach(created->thread);
+    if (task != NULL)
+        *task = created;
+    return ESP_OK;
+}
+
+static struct timespec add_ms(struct timespec time, uint32_t ms)
+{
+    time.tv_sec += ms / 1000;
+    time.tv_nsec += (long)(ms % 1000) * 1000000;
+    if (time.tv_nsec >= 1000000000)
+    {
+        time.tv_sec++;
+        time.tv_nsec -= 1000000000;
+    }
+    return time;
+}
+
+static struct timespec monotonic_after(uint32_t ms)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return add_ms(time, ms);
+}
+
+// Timeouts are absolute times of the clock in use: the monotonic clock, which the condition variables are set to, or
+// the virtual one
+static struct timespec deadline(uint32_t timeout_ms)
+{
+    if (!atomic_load(&virtual_clock))
+        return monotonic_after(timeout_ms);
+    int64_t now_us       = atomic_load(&virtual_time_us);
+    struct timespec time = { .tv_sec = now_us / 1000000, .tv_nsec = (long)(now_us % 1000000) * 1000 };
+    return add_ms(time, timeout_ms);
+}
+
+// Waits on the condition until it is signalled or the deadline passed, with the lock held
+static bool wait(pthread_cond_t *cond, pthread_mutex_t *lock, uint32_t timeout_ms, const struct timespec *until)
+{
+    if (timeout_ms == 0)
+        return false;
+    if (timeout_ms == BEAN_HAL_WAIT_FOREVER)
+        return pthread_cond_wait(cond, lock) == 0;
+    if (!atomic_load(&virtual_clock))
+        return pthread_cond_timedwait(cond, lock, until) == 0;
+
+    // Nothing signals the virtual clock, it is looked at every ms
+    int64_t until_us = (int64_t)until->tv_sec * 1000000 + until->tv_nsec / 1000;
+    while (atomic_load(&virtual_time_us) < until_us)
+    {
+        struct timespec poll = monotonic_after(1);
+        if (pthread_cond_timedwait(cond, lock, &poll) == 0)
+            return true;
+    }
+    return false;
+}
+
+static void init_cond(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+bean_hal_queue_t bean_hal_queue_create(size_t length, size_t item_size)
+{
+    bean_hal_queue_t queue = calloc(1, sizeof(*queue));
+    if (queue == NULL)
+        return NULL;
+    queue->items = malloc(length * item_size);
+    if (queue->items == NULL)
+    {
+        free(queue);
+        return NULL;
+    }
+    queue->length    = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&queue->lock, NULL);
+    init_cond(&queue->not_empty);
+    init_cond(&queue->not_full);
+    return queue;
+}
+
+bool bean_hal_queue_send(bean_hal_queue_t queue, const void *item, uint32_t timeout_ms)
+{
+    struct timespec until = deadline(timeout_ms);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == queue->length)
+    {
+        if (!wait(&queue->not_full, &queue->lock, timeout_ms, &until))
+        {
+            pthread_mutex_unlock(&queue->lock);
+            return false;
+        }
+    }
+    size_t tail = (queue->head + queue->count) % queue->length;
+    memcpy(&queue->items[tail * queue->item_size], item, queue->item_size);
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+bool bean_hal_queue_receive(bean_hal_queue_t queue, void *item, uint32_t timeout_ms)
+{
+    struct timespec until = deadline(timeout_ms);
+    pthread_mutex_lock(&queue->lock);
+    while (queue->count == 0)
+    {
+        if (!wait(&queue->not_empty, &queue->lock, timeout_ms, &until))
+        {
+            pthread_mutex_unlock(&queue->lock);
+            return false;
+        }
+    }
+    memcpy(item, &queue->items[queue->head * queue->item_size], queue->item_size);
+    queue->head = (queue->head + 1) % queue->length;
+    queue->count--;
+    pthread_cond_signal(&queue->not_full);
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+size_t bean_hal_queue_waiting(bean_hal_queue_t queue)
+{
+    pthread_mutex_lock(&queue->lock);
+    size_t count = queue->count;
+    pthread_mutex_unlock(&queue->lock);
+    return count;
+}
+
+bean_hal_mutex_t bean_hal_mutex_create(void)
+{
+    bean_hal_mutex_t mutex = calloc(1, sizeof(*mutex));
+    if (mutex != NULL)
+        pthread_mutex_init(&mutex->lock, NULL);
+    return mutex;
+}
+
+void bean_hal_mutex_lock(bean_hal_mutex_t mutex)
+{
+    pthread_mutex_lock(&mutex->lock);
+}
+
+void bean_hal_mutex_unlock(bean_hal_mutex_t mutex)
+{
+    pthread_mutex_unlock(&mutex->lock);
+}
+
+bean_hal_event_group_t bean_hal_event_group_create(void)
+{
+    bean_hal_event_group_t group = calloc(1, sizeof(*group));
+    if (group != NULL)
+        pthread_mutex_init(&group->lock, NULL);
+    return group;
+}
+
+bean_hal_bits_t bean_hal_event_group_set_bits(bean_hal_event_group_t group, bean_hal_bits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    group->bits |= bits;
+    bean_hal_bits_t now = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return now;
+}
+
+// Returns the bits from before the clear, like xEventGroupClearBits()
+bean_hal_bits_t bean_hal_event_group_clear_bits(bean_hal_event_group_t group, bean_hal_bits_t bits)
+{
+    pthread_mutex_lock(&group->lock);
+    bean_hal_bits_t before = group->bits;
+    group->bits &= ~bits;
+    pthread_mutex_unlock(&group->lock);
+    return before;
+}
+
+bean_hal_bits_t bean_hal_event_group_get_bits(bean_hal_event_group_t group)
+{
+    pthread_mutex_lock(&group->lock);
+    bean_hal_bits_t bits = group->bits;
+    pthread_mutex_unlock(&group->lock);
+    return bits;
+}
+
+size_t bean_hal_heap_free(void)
+{
+    return 0;
+}
+
+size_t bean_hal_heap_min_free(void)
+{
+    return 0;
+}
+
+size_t bean_hal_heap_largest_block(void)
+{
+    return 0;
+}
+
+void bean_hal_posix_set_root(const char *directory)
+{
+    snprintf(storage_root, sizeof(storage_root), "%s", directory);
+}
+
+// Creates every missing directory of a path, like mkdir -p
+static void make_directories(char *path)
+{
+    for (char *slash = strchr(path + 1, '/'); slash != NULL; slash = strchr(slash + 1, '/'))
+    {
+        *slash = '\0';
+        mkdir(path, 0755);
+        *slash = '/';
+    }
+    mkdir(path, 0755);
+}
+
+static void map_path(const char *path, char *mapped, size_t size)
+{
+    snprintf(mapped, size, "%s%s%s", storage_root, path[0] == '/' ? "" : "/", path);
+}
+
+FILE *bean_hal_fopen(const char *path, const char *mode)
+{
+    char mapped[PATH_MAX];
+    map_path(path, mapped, sizeof(mapped));
+    if (mode[0] == 'w' || mode[0] == 'a')
+    {
+        char *slash = strrchr(mapped, '/');
+        if (slash != NULL && slash != mapped)
+        {
+            *slash = '\0';
+            make_directories(mapped);
+            *slash = '/';
+        }
+    }
+    return fopen(mapped, mode);
+}
+
+// The storage is always mounted on the target, so its directory is created on the host
+DIR *bean_hal_opendir(const char *path)
+{
+    char mapped[PATH_MAX];
+    map_path(path, mapped, sizeof(mapped));
+    make_directories(mapped);
+    return opendir(mapped);
+}
+
+esp_err_t bean_hal_fsync(FILE *file)
+{
+    if (fflush(file) != 0 || fsync(fileno(file)) != 0)
+        return ESP_FAIL;
+    return ESP_OK;
+}
+
+esp_err_t bean_hal_i2c_init(int sda_gpio, int scl_gpio, uint32_t clock_hz)
+{
+    if (clock_hz == 0)
+        return ESP_ERR_INVALID_ARG;
+    pthread_mutex_lock(&bus_lock);
+    i2c_clock_hz = clock_hz;
+    pthread_mutex_unlock(&bus_lock);
+    return ESP_OK;
+}
+
+esp_err_t bean_hal_posix_i2c_attach(uint8_t address, bean_hal_posix_i2c_transfer_t transfer, void *device)
+{
+    esp_err_t ret = ESP_ERR_NO_MEM;
+    pthread_mutex_lock(&bus_lock);
+    for (int i = 0; i < BEAN_HAL_POSIX_I2C_DEVICES; i++)
+    {
+        if (i2c_devices[i].transfer == NULL || i2c_devices[i].address == address)
+        {
+            i2c_devices[i] = (i2c_device_t){ .address = address, .transfer = transfer, .device = device };
+            ret            = ESP_OK;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&bus_lock);
+    return ret;
+}
+
+void bean_hal_posix_i2c_detach(uint8_t address)
+{
+    pthread_mutex_lock(&bus_lock);
+    for (int i = 0; i < BEAN_HAL_POSIX_I2C_DEVICES; i++)
+    {
+        if (i2c_devices[i].transfer != NULL && i2c_devices[i].address == address)
+            i2c_devices[i] = (i2c_device_t){ 0 };
+    }
+    pthread_mutex_unlock(&bus_lock);
+}
+
+void bean_hal_posix_i2c_get_stats(uint8_t address, bean_hal_posix_i2c_stats_t *stats)
+{
+    *stats = (bean_hal_posix_i2c_stats_t){ 0 };
+    pthread_mutex_lock(&bus_lock);
+    for (int i = 0; i < BEAN_HAL_POSIX_I2C_DEVICES; i++)
+    {
+        if (i2c_devices[i].transfer != NULL && i2c_devices[i].address == address)
+        {
+            *stats             = i2c_devices[i].stats;
+            stats->bus_time_us = i2c_devices[i].bus_bits * 1000000 / i2c_clock_hz;
+        }
+    }
+    pthread_mutex_unlock(&bus_lock);
+}
+
+void bean_hal_posix_i2c_clear_stats(void)
+{
+    pthread_mutex_lock(&bus_lock);
+    for (int i = 0; i < BEAN_HAL_POSIX_I2C_DEVICES; i++)
+    {
+        i2c_devices[i].stats    = (bean_hal_posix_i2c_stats_t){ 0 };
+        i2c_devices[i].bus_bits = 0;
+    }
+    pthread_mutex_unlock(&bus_lock);
+}
+
+// Start, the address byte and a bit of acknowledge per byte, then a repeated start and the address again for a read,
+// and the stop
+static uint64_t transaction_bits(size_t out_length, size_t in_length)
+{
+    uint64_t bits = 1 + 9 * (1 + out_length) + 1;
+    if (in_length > 0)
+        bits += 1 + 9 * (1 + in_length);
+    return bits;
+}
+
+// One transaction at a time, as on the real bus
+static esp_err_t transfer(uint8_t address, const uint8_t *out, size_t out_length, uint8_t *in, size_t in_length)
+{
+    esp_err_t ret = ESP_FAIL; // No acknowledge
+    pthread_mutex_lock(&bus_lock);
+    for (int i = 0; i < BEAN_HAL_POSIX_I2C_DEVICES; i++)
+    {
+        i2c_device_t *device = &i2c_devices[i];
+        if (device->transfer != NULL && device->address == address)
+        {
+            ret = device->transfer(device->device, out, out_length, in, in_length);
+            device->stats.transactions++;
+            device->stats.bytes += out_length + in_length;
+            device->bus_bits += transaction_bits(out_length, in_length);
+            if (ret != ESP_OK)
+                device->stats.failures++;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&bus_lock);
+    return ret;
+}
+
+esp_err_t bean_hal_i2c_write(uint8_t address, const uint8_t *data, size_t length, uint32_t timeout_ms)
+{
+    return transfer(address, data, length, NULL, 0);
+}
+
+esp_err_t bean_hal_i2c_write_read(uint8_t address,
+                                  const uint8_t *out,
+                                  size_t out_length,
+                                  uint8_t *in,
+                                  size_t in_length,
+                                  uint32_t timeout_ms)
+{
+    return transfer(address, out, out_length, in, in_length);
+}
+
+// An output keeps the level it was set to, an input reads whatever the host set it to
+esp_err_t bean_hal_gpio_set_level(int gpio, uint32_t level)
+{
+    if (gpio < 0 || gpio >= BEAN_HAL_POSIX_GPIOS)
+        return ESP_ERR_INVALID_ARG;
+    __atomic_store_n(&gpio_levels[gpio], level != 0, __ATOMIC_RELAXED);
+    return ESP_OK;
+}
+
+int bean_hal_gpio_get_level(int gpio)
+{
+    if (gpio < 0 || gpio >= BEAN_HAL_POSIX_GPIOS)
+        return 0;
+    return __atomic_load_n(&gpio_levels[gpio], __ATOMIC_RELAXED);
+}
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    switch (code)
+    {
+    case ESP_OK:
+        return "ESP_OK";
+    case ESP_FAIL:
+        return "ESP_FAIL";
+    case ESP_ERR_NO_MEM:
+        return "ESP_ERR_NO_MEM";
+    case ESP_ERR_INVALID_ARG:
+        return "ESP_ERR_INVALID_ARG";
+    case ESP_ERR_INVALID_STATE:
+        return "ESP_ERR_INVALID_STATE";
+    case ESP_ERR_INVALID_SIZE:
+        return "ESP_ERR_INVALID_SIZE";
+    case ESP_ERR_NOT_FOUND:
+        return "ESP_ERR_NOT_FOUND";
+    case ESP_ERR_NOT_SUPPORTED:
+        return "ESP_ERR_NOT_SUPPORTED";
+    case ESP_ERR_TIMEOUT:
+        return "ESP_ERR_TIMEOUT";
+    case ESP_ERR_INVALID_RESPONSE:
+        return "ESP_ERR_INVALID_RESPONSE";
+    case ESP_ERR_INVALID_CRC:
+        return "ESP_ERR_INVALID_CRC";
+    case ESP_ERR_INVALID_VERSION:
+        return "ESP_ERR_INVALID_VERSION";
+    default:
+        return "UNKNOWN ERROR";
+    }
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+#include "bean_hal.h"
+
+/*
+ * What only the host has: where the storage lives, the log level, a virtual clock, and the hooks to put simulated
+ * devices on the I2C bus and look at the GPIOs.
+ */
+
+#define BEAN_HAL_POSIX_I2C_DEVICES 8
+#define BEAN_HAL_POSIX_GPIOS       64
+
+/**
+ * @brief A device on the simulated I2C bus, it gets every transaction to its address.
+ *
+ * A write is a transfer with no in bytes, a write_read one with both.
+ *
+ * @return ESP_OK, or an error that the driver sees as a failed transfer
+ */
+typedef esp_err_t (*bean_hal_posix_i2c_transfer_t)(void *device,
+                                                   const uint8_t *out,
+                                                   size_t out_length,
+                                                   uint8_t *in,
+                                                   size_t in_length);
+
+/**
+ * @brief Sets the directory that stands in for the storage, the target paths are mapped below it. "." by default.
+ */
+void bean_hal_posix_set_root(const char *directory);
+
+/**
+ * @brief Sets the most verbose level that is printed, BEAN_HAL_LOG_INFO by default.
+ */
+void bean_hal_posix_set_log_level(bean_hal_log_level_t level);
+
+/**
+ * @brief Replaces the monotonic clock by a virtual one that starts at start_us and only moves when it is told to.
+ *
+ * bean_hal_time_us() reads it, the delays move it on instead of sleeping and a timeout expires once the clock passed
+ * it, so a recorded flight runs as fast as the host computes it. Meant for one thread that drives the time, call it
+ * before the tasks are created.
+ */
+void bean_hal_posix_use_virtual_clock(int64_t start_us);
+
+/**
+ * @brief Moves the virtual clock on to time_us, it never goes back. Does nothing on the monotonic clock.
+ */
+void bean_hal_posix_set_clock(int64_t time_us);
+
+/**
+ * @brief Puts a device on the I2C bus, a transaction to an address without one fails like a missing acknowledge.
+ *
+ * @return ESP_ERR_NO_MEM when BEAN_HAL_POSIX_I2C_DEVICES are attached already
+ */
+esp_err_t bean_hal_posix_i2c_attach(uint8_t address, bean_hal_posix_i2c_transfer_t transfer, void *device);
+
+void bean_hal_posix_i2c_detach(uint8_t address);
+
+/**
+ * @brief What went over the bus to one address since it was attached or the stats were cleared.
+ */
+typedef struct
+{
+    uint32_t transactions;
+    uint32_t failures;    // Transactions that did not return ESP_OK
+    uint64_t bytes;       // Register and data bytes, the address bytes are not counted
+    uint64_t bus_time_us; // What the transactions take on the wire at the clock of bean_hal_i2c_init(), 100 kHz before
+} bean_hal_posix_i2c_stats_t;
+
+/**
+ * @brief Gets the bus stats of an attached device, all 0 for an address without one.
+ */
+void bean_hal_posix_i2c_get_stats(uint8_t address, bean_hal_posix_i2c_stats_t *stats);
+
+void bean_hal_posix_i2c_clear_stats(void);
@@ -0,0 +1,6 @@
+#pragma once
+
+/*
+ * Host stand-in for the generated sdkconfig.h: the options of the host build. The firmware features that need the
+ * target (CONFIG_BEAN_TRACE, CONFIG_PM_ENABLE) are off, so their hooks compile away.
+ */
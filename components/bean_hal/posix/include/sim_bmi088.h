@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+#include "bean_hal_posix.h"
+
+/*
+ * Register model of the BMI088 for the simulated I2C bus of the host build: the accelerometer and the gyroscope as the
+ * two I2C devices they are, so bean_imu.c and the Bosch driver run unchanged against it.
+ *
+ * Covers what the drivers use: the chip IDs, the soft resets, the power, range and rate registers, the data, the
+ * sensortime, the temperature, both FIFOs, the upload of the feature engine with its config space, the high-g,
+ * any-motion and no-motion features, the interrupt status and the accelerometer interrupt pins. The timing follows
+ * bean_hal_time_us(): the data registers and the FIFOs move on at the output data rate, caught up on every
+ * transaction. The motion comes from a source, a waveform or a replayed log, sampled at each output data tick.
+ */
+
+#define SIM_BMI088_ACCEL_CHIP_ID 0x1E
+#define SIM_BMI088_GYRO_CHIP_ID  0x0F
+
+/**
+ * @brief The motion at a point in time, in the axes of the sensor.
+ *
+ * @param arg The arg given to sim_bmi088_create()
+ * @param time_us The bean_hal_time_us() of the sample
+ * @param accel_ms2 Gets the specific force in m/s^2, what the accelerometer measures (+9.81 on the up axis at rest)
+ * @param gyro_dps Gets the rate of turn in deg/s
+ */
+typedef void (*sim_bmi088_source_t)(void *arg, int64_t time_us, float accel_ms2[3], float gyro_dps[3]);
+
+typedef struct sim_bmi088 sim_bmi088_t;
+
+/**
+ * @brief Makes a BMI088 as it is after power on, with the motion of the source.
+ */
+sim_bmi088_t *sim_bmi088_create(sim_bmi088_source_t source, void *arg);
+
+/**
+ * @brief Puts the accelerometer and the gyroscope on the simulated I2C bus.
+ *
+ * @param int1_gpio GPIO that the INT1 pin of the accelerometer drives through bean_hal_gpio_set_level(), -1 for none
+ * @param int2_gpio The same for INT2
+ */
+esp_err_t sim_bmi088_attach(sim_bmi088_t *sim,
+                            uint8_t accel_address,
+                            uint8_t gyro_address,
+                            int int1_gpio,
+                            int int2_gpio);
+
+/**
+ * @brief Catches the model up to now without a transaction, for a host that only watches the interrupt pins.
+ */
+void sim_bmi088_update(sim_bmi088_t *sim);
+
+/**
+ * @brief Takes the model off the bus and frees it.
+ */
+void sim_bmi088_destroy(sim_bmi088_t *sim);
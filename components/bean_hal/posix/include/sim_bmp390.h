@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+#include "bean_hal_posix.h"
+
+/*
+ * Register model of the BMP390 for the simulated I2C bus of the host build, so bean_altimeter.c and the Bosch BMP3
+ * driver run unchanged against it.
+ *
+ * Covers the chip ID, the soft reset and the commands, the trimming data in the NVM with its CRC, the power, rate,
+ * oversampling and filter registers with the configuration error of a normal mode that does not fit the rate, the
+ * forced and normal modes, the data, status, interrupt status and sensortime registers and the FIFO. The timing
+ * follows bean_hal_time_us(): in the normal mode the data and the FIFO move on at the output data rate, caught up on
+ * every transaction. The pressure and temperature come from a source, a waveform or a replayed log, and are put in
+ * the data registers as the raw values that the compensation of the datasheet turns back into them.
+ */
+
+#define SIM_BMP390_CHIP_ID 0x60
+
+/**
+ * @brief The air at a point in time.
+ *
+ * @param arg The arg given to sim_bmp390_create()
+ * @param time_us The bean_hal_time_us() of the measurement
+ * @param pressure_pa Gets the pressure, 30000 to 125000 Pa
+ * @param temperature_c Gets the temperature, -40 to 85 degC
+ */
+typedef void (*sim_bmp390_source_t)(void *arg, int64_t time_us, float *pressure_pa, float *temperature_c);
+
+typedef struct sim_bmp390 sim_bmp390_t;
+
+/**
+ * @brief Makes a BMP390 as it is after power on, with the air of the source.
+ */
+sim_bmp390_t *sim_bmp390_create(sim_bmp390_source_t source, void *arg);
+
+esp_err_t sim_bmp390_attach(sim_bmp390_t *sim, uint8_t address);
+
+/**
+ * @brief Breaks the CRC of the trimming data, for the error path of the driver.
+ */
+void sim_bmp390_corrupt_trimming(sim_bmp390_t *sim);
+
+/**
+ * @brief Takes the model off the bus and frees it.
+ */
+void sim_bmp390_destroy(sim_bmp390_t *sim);
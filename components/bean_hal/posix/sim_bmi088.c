@@ -0,0 +1,759 @@
+/*
+Description: Register model of the BMI088 on the simulated I2C bus of the POSIX backend, see sim_bmi088.h.
+
+The register addresses, reset values and encodings follow the BMI088 datasheet. The model does not take them from the
+Bosch driver, so a driver that gets one wrong fails here as it would on the chip.
+
+What is simplified:
+- A sample is the source at the output data tick, there is no filter and no noise
+- The feature engine runs the high-g feature at the output data rate and the motion features every 20 ms, on the
+  thresholds and durations of its config space, not on the uploaded stream
+- A frame cut by the end of a FIFO read is read again by the next one
+*/
+
+#include "sim_bmi088.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_fifo.h"
+
+#define GRAVITY_EARTH (9.80665f)
+
+// Accelerometer registers
+#define ACC_CHIP_ID         0x00
+#define ACC_STATUS          0x03
+#define ACC_X_LSB           0x12
+#define ACC_SENSORTIME_0    0x18
+#define ACC_INT_STAT_0      0x1C
+#define ACC_INT_STAT_1      0x1D
+#define ACC_TEMP_MSB        0x22
+#define ACC_FIFO_LENGTH_0   0x24
+#define ACC_FIFO_DATA       0x26
+#define ACC_HIGH_G_OUT      0x29
+#define ACC_INTERNAL_STAT   0x2A
+#define ACC_CONF            0x40
+#define ACC_RANGE           0x41
+#define ACC_FIFO_DOWNS      0x45
+#define ACC_FIFO_WTM_0      0x46
+#define ACC_FIFO_CONFIG_0   0x48
+#define ACC_FIFO_CONFIG_1   0x49
+#define ACC_INT1_IO_CONF    0x53
+#define ACC_INT_LATCH_CONF  0x55
+#define ACC_INT1_MAP        0x56
+#define ACC_INT1_INT2_MAP   0x58
+#define ACC_INIT_CTRL       0x59
+#define ACC_FEATURE_ADDR_0  0x5B
+#define ACC_FEATURE_ADDR_1  0x5C
+#define ACC_FEATURE_CFG     0x5E
+#define ACC_PWR_CONF        0x7C
+#define ACC_PWR_CTRL        0x7D
+#define ACC_SOFTRESET       0x7E
+#define ACC_REGISTERS       0x80
+
+// Gyroscope registers
+#define GYR_CHIP_ID       0x00
+#define GYR_X_LSB         0x02
+#define GYR_INT_STAT_1    0x0A
+#define GYR_FIFO_STATUS   0x0E
+#define GYR_RANGE         0x0F
+#define GYR_BANDWIDTH     0x10
+#define GYR_LPM1          0x11
+#define GYR_SOFTRESET     0x14
+#define GYR_FIFO_WM_EN    0x1E
+#define GYR_FIFO_CONFIG_0 0x3D
+#define GYR_FIFO_CONFIG_1 0x3E
+#define GYR_FIFO_DATA     0x3F
+#define GYR_REGISTERS     0x40
+
+#define SOFTRESET_CMD       0xB6
+#define CONFIG_STREAM_SIZE  6144
+#define FEATURE_SPACE_SIZE  64
+#define ACC_FIFO_SIZE       1024
+#define ACC_FIFO_FRAME      7 // Header and the 3 axes
+#define ACC_FIFO_HEADER     0x84
+#define ACC_FIFO_TIME_FRAME 0x44
+#define ACC_FIFO_OVER_READ  0x80
+#define GYR_FIFO_FRAMES     100
+#define SENSORTIME_NS       39063 // 39.0625 us a tick, 24 bits
+#define MOTION_STEP_US      20000
+#define MAX_CATCH_UP_TICKS  256 // More than both FIFOs hold, the older ticks are skipped after a long gap
+
+// Bits of the status and map registers
+#define STAT_ANY_MOTION 0x02
+#define STAT_HIGH_G     0x04
+#define STAT_NO_MOTION  0x20
+#define STAT_DRDY       0x80
+#define STAT_FIFO_WM    0x02
+#define STAT_FIFO_FULL  0x01
+#define GYR_STAT_FIFO   0x10
+
+struct sim_bmi088
+{
+    pthread_mutex_t lock;
+    sim_bmi088_source_t source;
+    void *arg;
+    uint8_t accel_address;
+    uint8_t gyro_address;
+    int int_gpio[2];
+    int int_level[2];
+    int64_t epoch_us;
+
+    uint8_t acc[ACC_REGISTERS];
+    uint8_t feature[FEATURE_SPACE_SIZE];
+    size_t stream_bytes;
+    bool stream_error;
+    size_t feature_offset; // In the config space, for the current transaction
+    int64_t accel_next_us;
+    uint32_t accel_ticks;
+    uint8_t feature_events; // Of the last tick, what a pin that is not latched shows
+    uint8_t data_events;
+    sim_fifo_t accel_fifo;
+    uint8_t accel_fifo_data[ACC_FIFO_SIZE];
+    float motion_reference[3];
+    int64_t motion_next_us;
+    uint32_t high_g_us;
+    bool high_g_armed;
+    uint32_t any_motion_steps;
+    uint32_t no_motion_steps;
+
+    uint8_t gyr[GYR_REGISTERS];
+    int64_t gyro_next_us;
+    sim_fifo_t gyro_fifo;
+    uint8_t gyro_fifo_data[GYR_FIFO_FRAMES * 6];
+};
+
+static int16_t to_lsb(float value, float full_scale)
+{
+    float lsb = value / full_scale * 32768.0f;
+    if (lsb > 32767.0f)
+        return INT16_MAX;
+    if (lsb < -32768.0f)
+        return INT16_MIN;
+    return (int16_t)lrintf(lsb);
+}
+
+static void put_axes(uint8_t *out, const int16_t axes[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        out[2 * i]     = (uint8_t)(axes[i] & 0xFF);
+        out[2 * i + 1] = (uint8_t)((uint16_t)axes[i] >> 8);
+    }
+}
+
+static uint16_t feature_word(const sim_bmi088_t *sim, int word)
+{
+    return (uint16_t)(sim->feature[2 * word] | sim->feature[2 * word + 1] << 8);
+}
+
+static void set_level(sim_bmi088_t *sim, int pin, int level)
+{
+    if (sim->int_gpio[pin] < 0 || sim->int_level[pin] == level)
+        return;
+    sim->int_level[pin] = level;
+    bean_hal_gpio_set_level(sim->int_gpio[pin], (uint32_t)level);
+}
+
+// A latched pin holds until the status is read, one that is not shows the events of the last tick
+static void update_pins(sim_bmi088_t *sim)
+{
+    bool latched      = (sim->acc[ACC_INT_LATCH_CONF] & 0x01) != 0;
+    uint8_t features  = latched ? sim->acc[ACC_INT_STAT_0] : sim->feature_events;
+    uint8_t data      = latched ? sim->acc[ACC_INT_STAT_1] : sim->data_events;
+    uint8_t data_map  = sim->acc[ACC_INT1_INT2_MAP];
+    uint8_t data_pins = 0;
+    if (data & STAT_DRDY)
+        data_pins |= data_map & 0x44;
+    if (data & STAT_FIFO_WM)
+        data_pins |= data_map & 0x22;
+    if (data & STAT_FIFO_FULL)
+        data_pins |= data_map & 0x11;
+
+    for (int pin = 0; pin < 2; pin++)
+    {
+        uint8_t io_conf = sim->acc[ACC_INT1_IO_CONF + pin];
+        if ((io_conf & 0x08) == 0) // Output off
+            continue;
+        bool active = (features & sim->acc[ACC_INT1_MAP + pin]) != 0 || (data_pins & (pin == 0 ? 0x07 : 0x70)) != 0;
+        bool high   = (io_conf & 0x02) != 0;
+        set_level(sim, pin, active == high);
+    }
+}
+
+/* Accelerometer */
+
+static float accel_range_g(const sim_bmi088_t *sim)
+{
+    return 3.0f * (float)(1 << (sim->acc[ACC_RANGE] & 0x03));
+}
+
+static int64_t accel_period_us(const sim_bmi088_t *sim)
+{
+    int odr = sim->acc[ACC_CONF] & 0x0F;
+    if (odr < 0x05 || odr > 0x0C)
+        odr = 0x08;
+    return 80000 >> (odr - 0x05);
+}
+
+static bool accel_active(const sim_bmi088_t *sim)
+{
+    return (sim->acc[ACC_PWR_CTRL] & 0x04) != 0;
+}
+
+static bool feature_engine_ready(const sim_bmi088_t *sim)
+{
+    return sim->acc[ACC_INTERNAL_STAT] == 0x01;
+}
+
+static void accel_reset(sim_bmi088_t *sim)
+{
+    memset(sim->acc, 0, sizeof(sim->acc));
+    memset(sim->feature, 0, sizeof(sim->feature));
+    sim->acc[ACC_CHIP_ID]        = SIM_BMI088_ACCEL_CHIP_ID;
+    sim->acc[ACC_CONF]           = 0xA8;
+    sim->acc[ACC_RANGE]          = 0x01;
+    sim->acc[ACC_FIFO_DOWNS]     = 0x80;
+    sim->acc[ACC_FIFO_WTM_0 + 1] = 0x02;
+    sim->acc[ACC_FIFO_CONFIG_0]  = 0x02;
+    sim->acc[ACC_FIFO_CONFIG_1]  = 0x10;
+    sim->acc[ACC_PWR_CONF]       = 0x03;
+    sim->stream_bytes            = 0;
+    sim->stream_error            = false;
+    sim->accel_ticks             = 0;
+    sim->feature_events          = 0;
+    sim->data_events             = 0;
+    sim->high_g_us               = 0;
+    sim->high_g_armed            = true;
+    sim->any_motion_steps        = 0;
+    sim->no_motion_steps         = 0;
+    sim_fifo_clear(&sim->accel_fifo);
+}
+
+static void high_g_step(sim_bmi088_t *sim, const float accel_g[3], uint32_t period_us)
+{
+    uint16_t threshold_word = feature_word(sim, 3);
+    uint16_t select_word    = feature_word(sim, 4);
+    if ((select_word & 0x8000) == 0)
+        return;
+
+    // 5.11 format g, the duration in 2.5 ms steps
+    float threshold_g  = (threshold_word & 0x7FFF) / 2048.0f;
+    float hysteresis_g = (select_word & 0x0FFF) / 2048.0f;
+    uint32_t duration  = (uint32_t)(feature_word(sim, 5) & 0x0FFF) * 2500;
+    int axis           = -1;
+    bool below         = true;
+    for (int i = 0; i < 3; i++)
+    {
+        if ((select_word & (0x1000 << i)) == 0)
+            continue;
+        if (fabsf(accel_g[i]) > threshold_g && axis < 0)
+            axis = i;
+        if (fabsf(accel_g[i]) > threshold_g - hysteresis_g)
+            below = false;
+    }
+
+    if (below)
+        sim->high_g_armed = true;
+    if (axis < 0 || !sim->high_g_armed)
+    {
+        sim->high_g_us = 0;
+        return;
+    }
+    sim->high_g_us += period_us;
+    if (sim->high_g_us >= duration)
+    {
+        sim->acc[ACC_HIGH_G_OUT] = (uint8_t)((0x08 << axis) | (accel_g[axis] < 0.0f ? 0x40 : 0x00));
+        sim->feature_events |= STAT_HIGH_G;
+        sim->high_g_armed = false;
+        sim->high_g_us    = 0;
+    }
+}
+
+// Both motion features compare the acceleration with the one of the step before
+static void motion_step(sim_bmi088_t *sim, const float accel_g[3])
+{
+    float change_g[3];
+    for (int i = 0; i < 3; i++)
+    {
+        change_g[i]              = fabsf(accel_g[i] - sim->motion_reference[i]);
+        sim->motion_reference[i] = accel_g[i];
+    }
+
+    // Word 0 and 1 for any-motion, 11 and 12 for no-motion: 5.11 format g and the enable, then the steps and the axes
+    static const struct
+    {
+        int word;
+        bool moving;
+        uint8_t status;
+    } features[] = { { 0, true, STAT_ANY_MOTION }, { 11, false, STAT_NO_MOTION } };
+    for (size_t f = 0; f < sizeof(features) / sizeof(features[0]); f++)
+    {
+        uint16_t config_word = feature_word(sim, features[f].word);
+        uint16_t axes_word   = feature_word(sim, features[f].word + 1);
+        uint32_t *steps      = features[f].moving ? &sim->any_motion_steps : &sim->no_motion_steps;
+        if ((config_word & 0x0800) == 0)
+        {
+            *steps = 0;
+            continue;
+        }
+
+        float threshold_g = (config_word & 0x07FF) / 2048.0f;
+        uint32_t duration = axes_word & 0x1FFF;
+        bool moving       = false;
+        for (int i = 0; i < 3; i++)
+        {
+            if ((axes_word & (0x2000 << i)) && change_g[i] > threshold_g)
+                moving = true;
+        }
+
+        if (moving != features[f].moving)
+        {
+            *steps = 0;
+            continue;
+        }
+        (*steps)++;
+        if (*steps == (duration > 0 ? duration : 1))
+            sim->feature_events |= features[f].status;
+    }
+}
+
+static void accel_tick(sim_bmi088_t *sim, int64_t time_us, uint32_t period_us)
+{
+    float accel_ms2[3] = { 0.0f, 0.0f, 0.0f };
+    float gyro_dps[3];
+    sim->source(sim->arg, time_us, accel_ms2, gyro_dps);
+
+    float range_g = accel_range_g(sim);
+    float accel_g[3];
+    int16_t axes[3];
+    for (int i = 0; i < 3; i++)
+    {
+        accel_g[i] = accel_ms2[i] / GRAVITY_EARTH;
+        axes[i]    = to_lsb(accel_g[i], range_g);
+    }
+    put_axes(&sim->acc[ACC_X_LSB], axes);
+    sim->feature_events = 0;
+    sim->data_events    = STAT_DRDY;
+    sim->acc[ACC_STATUS] |= 0x80;
+
+    // The FIFO keeps one sample in 2^downs
+    uint8_t downs = (sim->acc[ACC_FIFO_DOWNS] >> 4) & 0x07;
+    if ((sim->acc[ACC_FIFO_CONFIG_1] & 0x40) && (sim->accel_ticks & ((1u << downs) - 1)) == 0)
+    {
+        uint8_t frame[ACC_FIFO_FRAME] = { ACC_FIFO_HEADER };
+        put_axes(&frame[1], axes);
+        sim_fifo_push(&sim->accel_fifo, frame, (sim->acc[ACC_FIFO_CONFIG_0] & 0x01) == 0);
+        uint16_t watermark = (uint16_t)(sim->acc[ACC_FIFO_WTM_0] | (sim->acc[ACC_FIFO_WTM_0 + 1] & 0x1F) << 8);
+        if (sim->accel_fifo.length >= watermark)
+            sim->data_events |= STAT_FIFO_WM;
+        if (sim_fifo_full(&sim->accel_fifo))
+            sim->data_events |= STAT_FIFO_FULL;
+    }
+    sim->accel_ticks++;
+
+    if (feature_engine_ready(sim))
+    {
+        high_g_step(sim, accel_g, period_us);
+        if (time_us >= sim->motion_next_us)
+        {
+            motion_step(sim, accel_g);
+            sim->motion_next_us = time_us + MOTION_STEP_US;
+        }
+    }
+    sim->acc[ACC_INT_STAT_0] |= sim->feature_events;
+    sim->acc[ACC_INT_STAT_1] |= sim->data_events;
+}
+
+static void accel_catch_up(sim_bmi088_t *sim, int64_t now_us)
+{
+    if (!accel_active(sim))
+        return;
+    int64_t period_us = accel_period_us(sim);
+    if (now_us - sim->accel_next_us > MAX_CATCH_UP_TICKS * period_us)
+        sim->accel_next_us += (now_us - sim->accel_next_us) / period_us * period_us - MAX_CATCH_UP_TICKS * period_us;
+    while (sim->accel_next_us <= now_us)
+    {
+        accel_tick(sim, sim->accel_next_us, (uint32_t)period_us);
+        sim->accel_next_us += period_us;
+    }
+}
+
+static uint8_t accel_fifo_byte(sim_bmi088_t *sim, int64_t now_us)
+{
+    sim_fifo_t *fifo = &sim->accel_fifo;
+    if (fifo->read < fifo->length)
+        return fifo->data[fifo->read++];
+
+    // Past the last frame comes a sensortime frame, then the over-read byte
+    size_t extra = fifo->read++ - fifo->length;
+    if (extra >= 4)
+        return ACC_FIFO_OVER_READ;
+    if (extra == 0)
+        return ACC_FIFO_TIME_FRAME;
+    uint32_t ticks = (uint32_t)((now_us - sim->epoch_us) * 1000 / SENSORTIME_NS);
+    return (uint8_t)(ticks >> (8 * (extra - 1)));
+}
+
+static uint8_t accel_read_register(sim_bmi088_t *sim, uint8_t reg, int64_t now_us)
+{
+    switch (reg)
+    {
+    case ACC_SENSORTIME_0:
+    case ACC_SENSORTIME_0 + 1:
+    case ACC_SENSORTIME_0 + 2:
+    {
+        uint32_t ticks = (uint32_t)((now_us - sim->epoch_us) * 1000 / SENSORTIME_NS);
+        return (uint8_t)(ticks >> (8 * (reg - ACC_SENSORTIME_0)));
+    }
+    case ACC_TEMP_MSB:
+        return 0x02; // 25 degC, 0.125 K per LSB from 23 degC
+    case ACC_FIFO_LENGTH_0:
+        return (uint8_t)(sim->accel_fifo.length & 0xFF);
+    case ACC_FIFO_LENGTH_0 + 1:
+        return (uint8_t)((sim->accel_fifo.length >> 8) & 0x3F);
+    case ACC_FIFO_DATA:
+        return accel_fifo_byte(sim, now_us);
+    case ACC_FEATURE_CFG:
+        return sim->feature_offset < FEATURE_SPACE_SIZE ? sim->feature[sim->feature_offset++] : 0;
+    default:
+        return sim->acc[reg & (ACC_REGISTERS - 1)];
+    }
+}
+
+static void accel_read(sim_bmi088_t *sim, uint8_t reg, uint8_t *in, size_t length, int64_t now_us)
+{
+    sim->feature_offset = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        // The FIFO and the config space are windows, every other register increments the address
+        in[i] = accel_read_register(sim, reg, now_us);
+        if (reg == ACC_INT_STAT_0 || reg == ACC_INT_STAT_1)
+            sim->acc[reg] = 0; // Cleared on read
+        if (reg == ACC_X_LSB)
+            sim->acc[ACC_STATUS] &= ~0x80;
+        if (reg != ACC_FIFO_DATA && reg != ACC_FEATURE_CFG)
+            reg = (uint8_t)((reg + 1) & (ACC_REGISTERS - 1));
+    }
+    if (sim->accel_fifo.read > 0)
+        sim_fifo_end_read(&sim->accel_fifo);
+}
+
+// The config stream goes through the window at the word address of 0x5B/0x5C, the feature config once it is running
+static void accel_write_feature(sim_bmi088_t *sim, uint8_t value)
+{
+    if (feature_engine_ready(sim))
+    {
+        if (sim->feature_offset < FEATURE_SPACE_SIZE)
+            sim->feature[sim->feature_offset] = value;
+        sim->feature_offset++;
+        return;
+    }
+
+    // The stream is only taken with the advanced power save off and the loading stopped
+    size_t word_address = (size_t)(sim->acc[ACC_FEATURE_ADDR_1] << 4 | (sim->acc[ACC_FEATURE_ADDR_0] & 0x0F));
+    if (sim->acc[ACC_PWR_CONF] != 0x00 || sim->acc[ACC_INIT_CTRL] != 0x00 ||
+        word_address * 2 + sim->feature_offset != sim->stream_bytes)
+        sim->stream_error = true;
+    sim->stream_bytes++;
+    sim->feature_offset++;
+}
+
+static void accel_write_register(sim_bmi088_t *sim, uint8_t reg, uint8_t value, int64_t now_us)
+{
+    switch (reg)
+    {
+    case ACC_SOFTRESET:
+        if (value == SOFTRESET_CMD)
+            accel_reset(sim);
+        return;
+    case ACC_FEATURE_CFG:
+        accel_write_feature(sim, value);
+        return;
+    case ACC_INIT_CTRL:
+        sim->acc[reg] = value;
+        if (value == 0x00)
+        {
+            sim->acc[ACC_INTERNAL_STAT] = 0x00;
+            sim->stream_bytes           = 0;
+            sim->stream_error           = false;
+        }
+        else
+        {
+            // 0x01 once the whole stream is in, 0x02 (init_err) otherwise
+            bool loaded                 = !sim->stream_error && sim->stream_bytes >= CONFIG_STREAM_SIZE;
+            sim->acc[ACC_INTERNAL_STAT] = loaded ? 0x01 : 0x02;
+            memset(sim->feature, 0, sizeof(sim->feature));
+            sim->motion_next_us = now_us;
+        }
+        return;
+    case ACC_PWR_CTRL:
+        if ((value & 0x04) && !accel_active(sim))
+            sim->accel_next_us = now_us + accel_period_us(sim);
+        sim->acc[reg] = value;
+        return;
+    case ACC_CONF:
+        sim->acc[reg]      = value;
+        sim->accel_next_us = now_us + accel_period_us(sim);
+        return;
+    case ACC_FIFO_CONFIG_0:
+    case ACC_FIFO_CONFIG_1:
+        sim->acc[reg] = value;
+        sim_fifo_clear(&sim->accel_fifo);
+        return;
+    default:
+        // Below 0x40 everything is read only
+        if (reg >= ACC_CONF)
+            sim->acc[reg] = value;
+        return;
+    }
+}
+
+static void accel_write(sim_bmi088_t *sim, uint8_t reg, const uint8_t *data, size_t length, int64_t now_us)
+{
+    sim->feature_offset = 0;
+    for (size_t i = 0; i < length; i++)
+    {
+        accel_write_register(sim, reg, data[i], now_us);
+        if (reg != ACC_FEATURE_CFG)
+            reg = (uint8_t)((reg + 1) & (ACC_REGISTERS - 1));
+    }
+}
+
+static esp_err_t accel_transfer(void *device, const uint8_t *out, size_t out_length, uint8_t *in, size_t in_length)
+{
+    sim_bmi088_t *sim = device;
+    if (out_length == 0)
+        return ESP_FAIL;
+
+    int64_t now_us = bean_hal_time_us();
+    pthread_mutex_lock(&sim->lock);
+    accel_catch_up(sim, now_us);
+    if (in_length == 0)
+        accel_write(sim, out[0], out + 1, out_length - 1, now_us);
+    else
+        accel_read(sim, out[0], in, in_length, now_us);
+    update_pins(sim);
+    pthread_mutex_unlock(&sim->lock);
+    return ESP_OK;
+}
+
+/* Gyroscope */
+
+static int64_t gyro_period_us(const sim_bmi088_t *sim)
+{
+    static const int64_t periods_us[] = { 500, 500, 1000, 2500, 5000, 10000, 5000, 10000 };
+    return periods_us[sim->gyr[GYR_BANDWIDTH] & 0x07];
+}
+
+static float gyro_range_dps(const sim_bmi088_t *sim)
+{
+    uint8_t range = sim->gyr[GYR_RANGE] & 0x07;
+    return 2000.0f / (float)(1 << (range > 4 ? 0 : range));
+}
+
+static bool gyro_active(const sim_bmi088_t *sim)
+{
+    return sim->gyr[GYR_LPM1] == 0x00;
+}
+
+static void gyro_reset(sim_bmi088_t *sim)
+{
+    memset(sim->gyr, 0, sizeof(sim->gyr));
+    sim->gyr[GYR_CHIP_ID]    = SIM_BMI088_GYRO_CHIP_ID;
+    sim->gyr[GYR_BANDWIDTH]  = 0x80;
+    sim->gyr[0x16]           = 0x0F; // INT3_INT4_IO_CONF
+    sim->gyr[GYR_FIFO_WM_EN] = 0x08;
+    sim->gyro_fifo.frame     = 6;
+    sim_fifo_clear(&sim->gyro_fifo);
+}
+
+static void gyro_tick(sim_bmi088_t *sim, int64_t time_us)
+{
+    float accel_ms2[3];
+    float gyro_dps[3] = { 0.0f, 0.0f, 0.0f };
+    sim->source(sim->arg, time_us, accel_ms2, gyro_dps);
+
+    float range_dps = gyro_range_dps(sim);
+    int16_t axes[3];
+    for (int i = 0; i < 3; i++)
+        axes[i] = to_lsb(gyro_dps[i], range_dps);
+    put_axes(&sim->gyr[GYR_X_LSB], axes);
+    sim->gyr[GYR_INT_STAT_1] |= STAT_DRDY;
+
+    // Bypass, FIFO or stream mode, with all axes or the one of the data select
+    uint8_t config = sim->gyr[GYR_FIFO_CONFIG_1];
+    uint8_t mode   = config >> 6;
+    if (mode == 0)
+        return;
+    uint8_t frame[6];
+    uint8_t select = config & 0x03;
+    put_axes(frame, axes);
+    if (select != 0)
+        memmove(frame, &frame[2 * (select - 1)], 2);
+    sim_fifo_push(&sim->gyro_fifo, frame, mode == 2);
+
+    uint8_t watermark = sim->gyr[GYR_FIFO_CONFIG_0] & 0x7F;
+    if ((sim->gyr[GYR_FIFO_WM_EN] & 0x80) && watermark > 0 && sim->gyro_fifo.length / sim->gyro_fifo.frame >= watermark)
+        sim->gyr[GYR_INT_STAT_1] |= GYR_STAT_FIFO;
+}
+
+static void gyro_catch_up(sim_bmi088_t *sim, int64_t now_us)
+{
+    if (!gyro_active(sim))
+        return;
+    int64_t period_us = gyro_period_us(sim);
+    if (now_us - sim->gyro_next_us > MAX_CATCH_UP_TICKS * period_us)
+        sim->gyro_next_us += (now_us - sim->gyro_next_us) / period_us * period_us - MAX_CATCH_UP_TICKS * period_us;
+    while (sim->gyro_next_us <= now_us)
+    {
+        gyro_tick(sim, sim->gyro_next_us);
+        sim->gyro_next_us += period_us;
+    }
+}
+
+static uint8_t gyro_read_register(sim_bmi088_t *sim, uint8_t reg)
+{
+    sim_fifo_t *fifo = &sim->gyro_fifo;
+    switch (reg)
+    {
+    case GYR_FIFO_STATUS:
+        return (uint8_t)((fifo->overrun ? 0x80 : 0x00) | ((fifo->length / fifo->frame) & 0x7F));
+    case GYR_FIFO_DATA:
+        // An empty FIFO reads as -32768
+        if (fifo->read < fifo->length)
+            return fifo->data[fifo->read++];
+        return (fifo->read++ & 1) ? 0x80 : 0x00;
+    default:
+        return sim->gyr[reg & (GYR_REGISTERS - 1)];
+    }
+}
+
+static void gyro_read(sim_bmi088_t *sim, uint8_t reg, uint8_t *in, size_t length)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        in[i] = gyro_read_register(sim, reg);
+        if (reg == GYR_INT_STAT_1)
+            sim->gyr[reg] = 0;
+        if (reg != GYR_FIFO_DATA)
+            reg = (uint8_t)((reg + 1) & (GYR_REGISTERS - 1));
+    }
+    if (sim->gyro_fifo.read > 0)
+    {
+        sim_fifo_end_read(&sim->gyro_fifo);
+        sim->gyro_fifo.overrun = false;
+    }
+}
+
+static void gyro_write_register(sim_bmi088_t *sim, uint8_t reg, uint8_t value, int64_t now_us)
+{
+    switch (reg)
+    {
+    case GYR_SOFTRESET:
+        if (value == SOFTRESET_CMD)
+            gyro_reset(sim);
+        return;
+    case GYR_LPM1:
+        if (value == 0x00 && !gyro_active(sim))
+            sim->gyro_next_us = now_us + gyro_period_us(sim);
+        sim->gyr[reg] = value;
+        return;
+    case GYR_BANDWIDTH:
+        sim->gyr[reg]     = value | 0x80;
+        sim->gyro_next_us = now_us + gyro_period_us(sim);
+        return;
+    case GYR_FIFO_CONFIG_1:
+        sim->gyr[reg]        = value;
+        sim->gyro_fifo.frame = (value & 0x03) == 0 ? 6 : 2;
+        sim_fifo_clear(&sim->gyro_fifo);
+        return;
+    default:
+        // Below the range everything is read only
+        if (reg >= GYR_RANGE)
+            sim->gyr[reg] = value;
+        return;
+    }
+}
+
+static esp_err_t gyro_transfer(void *device, const uint8_t *out, size_t out_length, uint8_t *in, size_t in_length)
+{
+    sim_bmi088_t *sim = device;
+    if (out_length == 0)
+        return ESP_FAIL;
+
+    int64_t now_us = bean_hal_time_us();
+    pthread_mutex_lock(&sim->lock);
+    gyro_catch_up(sim, now_us);
+    if (in_length == 0)
+    {
+        uint8_t reg = out[0];
+        for (size_t i = 1; i < out_length; i++, reg = (uint8_t)((reg + 1) & (GYR_REGISTERS - 1)))
+            gyro_write_register(sim, reg, out[i], now_us);
+    }
+    else
+    {
+        gyro_read(sim, out[0], in, in_length);
+    }
+    pthread_mutex_unlock(&sim->lock);
+    return ESP_OK;
+}
+
+sim_bmi088_t *sim_bmi088_create(sim_bmi088_source_t source, void *arg)
+{
+    sim_bmi088_t *sim = calloc(1, sizeof(*sim));
+    if (!sim)
+        return NULL;
+    pthread_mutex_init(&sim->lock, NULL);
+    sim->source           = source;
+    sim->arg              = arg;
+    sim->int_gpio[0]      = -1;
+    sim->int_gpio[1]      = -1;
+    sim->epoch_us         = bean_hal_time_us();
+    sim->accel_fifo.data  = sim->accel_fifo_data;
+    sim->accel_fifo.size  = ACC_FIFO_SIZE;
+    sim->accel_fifo.frame = ACC_FIFO_FRAME;
+    sim->gyro_fifo.data   = sim->gyro_fifo_data;
+    sim->gyro_fifo.size   = sizeof(sim->gyro_fifo_data);
+    accel_reset(sim);
+    gyro_reset(sim);
+    return sim;
+}
+
+esp_err_t sim_bmi088_attach(sim_bmi088_t *sim,
+                            uint8_t accel_address,
+                            uint8_t gyro_address,
+                            int int1_gpio,
+                            int int2_gpio)
+{
+    sim->accel_address = accel_address;
+    sim->gyro_address  = gyro_address;
+    sim->int_gpio[0]   = int1_gpio;
+    sim->int_gpio[1]   = int2_gpio;
+    sim->int_level[0]  = -1;
+    sim->int_level[1]  = -1;
+    esp_err_t ret      = bean_hal_posix_i2c_attach(accel_address, accel_transfer, sim);
+    if (ret == ESP_OK)
+        ret = bean_hal_posix_i2c_attach(gyro_address, gyro_transfer, sim);
+    return ret;
+}
+
+void sim_bmi088_update(sim_bmi088_t *sim)
+{
+    int64_t now_us = bean_hal_time_us();
+    pthread_mutex_lock(&sim->lock);
+    accel_catch_up(sim, now_us);
+    gyro_catch_up(sim, now_us);
+    update_pins(sim);
+    pthread_mutex_unlock(&sim->lock);
+}
+
+void sim_bmi088_destroy(sim_bmi088_t *sim)
+{
+    if (!sim)
+        return;
+    bean_hal_posix_i2c_detach(sim->accel_address);
+    bean_hal_posix_i2c_detach(sim->gyro_address);
+    pthread_mutex_destroy(&sim->lock);
+    free(sim);
+}
@@ -0,0 +1,491 @@
+/*
+Description: Register model of the BMP390 on the simulated I2C bus of the POSIX backend, see sim_bmp390.h.
+
+The register addresses, reset values, encodings and the compensation follow the BMP390 datasheet. The model does not
+take them from the Bosch driver, so a driver that gets one wrong fails here as it would on the chip. The trimming data
+is one made up set in the ranges of real parts, with the CRC at 0x30 that bean_altimeter.c checks.
+
+What is simplified:
+- A measurement is the source at the output data tick, there is no oversampling, filter or noise
+- A forced measurement is done at once, the measurement time only decides the configuration error
+- A frame cut by the end of a FIFO read is read again by the next one
+*/
+
+#include "sim_bmp390.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include "sim_fifo.h"
+
+#define REG_CHIP_ID       0x00
+#define REG_REV_ID        0x01
+#define REG_ERR           0x02
+#define REG_STATUS        0x03
+#define REG_DATA          0x04
+#define REG_SENSORTIME    0x0C
+#define REG_EVENT         0x10
+#define REG_INT_STATUS    0x11
+#define REG_FIFO_LENGTH   0x12
+#define REG_FIFO_DATA     0x14
+#define REG_FIFO_WTM      0x15
+#define REG_FIFO_CONFIG_1 0x17
+#define REG_FIFO_CONFIG_2 0x18
+#define REG_INT_CTRL      0x19
+#define REG_PWR_CTRL      0x1B
+#define REG_OSR           0x1C
+#define REG_ODR           0x1D
+#define REG_CONFIG        0x1F
+#define REG_TRIM_CRC      0x30
+#define REG_CALIB_DATA    0x31
+#define REG_CMD           0x7E
+#define REGISTERS         0x80
+
+#define CALIB_LENGTH     21
+#define CMD_SOFTRESET    0xB6
+#define CMD_FIFO_FLUSH   0xB0
+#define FIFO_SIZE        512
+#define FIFO_TEMP_PRESS  0x94
+#define FIFO_TEMP        0x90
+#define FIFO_PRESS       0x84
+#define FIFO_SENSORTIME  0xA0
+#define FIFO_EMPTY       0x80
+#define RAW_DISABLED     0x800000 // What a data register holds for a disabled measurement
+#define SENSORTIME_NS    39063    // 39.0625 us a tick, 24 bits
+#define MAX_CATCH_UP_ODR 128      // More than the FIFO holds, the older ticks are skipped after a long gap
+
+#define ERR_CMD  0x02
+#define ERR_CONF 0x04
+
+#define STATUS_CMD_READY  0x10
+#define STATUS_DRDY_PRESS 0x20
+#define STATUS_DRDY_TEMP  0x40
+
+#define INT_FIFO_WTM  0x01
+#define INT_FIFO_FULL 0x02
+#define INT_DRDY      0x08
+
+#define MODE_SLEEP  0x00
+#define MODE_NORMAL 0x03
+
+// The NVM of a made up part, in the order of the registers from 0x31
+static const struct
+{
+    uint16_t t1;
+    uint16_t t2;
+    int8_t t3;
+    int16_t p1;
+    int16_t p2;
+    int8_t p3;
+    int8_t p4;
+    uint16_t p5;
+    uint16_t p6;
+    int8_t p7;
+    int8_t p8;
+    int16_t p9;
+    int8_t p10;
+    int8_t p11;
+} nvm = { 27500, 19000, -7, 2500, -1900, 35, 0, 25000, 29000, 3, -6, 16000, -30, -60 };
+
+// The trimming coefficients as the datasheet scales them for the floating point compensation
+typedef struct calib
+{
+    double t1, t2, t3;
+    double p1, p2, p3, p4, p5, p6, p7, p8, p9, p10, p11;
+} calib_t;
+
+struct sim_bmp390
+{
+    pthread_mutex_t lock;
+    sim_bmp390_source_t source;
+    void *arg;
+    uint8_t address;
+    int64_t epoch_us;
+    uint8_t regs[REGISTERS];
+    calib_t calib;
+    int64_t next_us;
+    uint32_t ticks;
+    sim_fifo_t fifo;
+    uint8_t fifo_data[FIFO_SIZE];
+};
+
+static void put_u24(uint8_t *out, uint32_t value)
+{
+    out[0] = (uint8_t)(value & 0xFF);
+    out[1] = (uint8_t)((value >> 8) & 0xFF);
+    out[2] = (uint8_t)((value >> 16) & 0xFF);
+}
+
+// CRC-8 with the polynomial 0x1D over the trimming data, seed and final xor 0xFF
+static uint8_t trimming_crc(const uint8_t *data, size_t length)
+{
+    uint8_t crc = 0xFF;
+    for (size_t i = 0; i < length; i++)
+    {
+        uint8_t byte = data[i];
+        for (int bit = 0; bit < 8; bit++)
+        {
+            bool xor_poly = ((crc ^ byte) & 0x80) != 0;
+            crc           = (uint8_t)(crc << 1);
+            byte          = (uint8_t)(byte << 1);
+            if (xor_poly)
+                crc ^= 0x1D;
+        }
+    }
+    return crc ^ 0xFF;
+}
+
+static void load_nvm(sim_bmp390_t *sim)
+{
+    uint8_t *out = &sim->regs[REG_CALIB_DATA];
+    size_t i     = 0;
+    out[i++]     = (uint8_t)(nvm.t1 & 0xFF);
+    out[i++]     = (uint8_t)(nvm.t1 >> 8);
+    out[i++]     = (uint8_t)(nvm.t2 & 0xFF);
+    out[i++]     = (uint8_t)(nvm.t2 >> 8);
+    out[i++]     = (uint8_t)nvm.t3;
+    out[i++]     = (uint8_t)((uint16_t)nvm.p1 & 0xFF);
+    out[i++]     = (uint8_t)((uint16_t)nvm.p1 >> 8);
+    out[i++]     = (uint8_t)((uint16_t)nvm.p2 & 0xFF);
+    out[i++]     = (uint8_t)((uint16_t)nvm.p2 >> 8);
+    out[i++]     = (uint8_t)nvm.p3;
+    out[i++]     = (uint8_t)nvm.p4;
+    out[i++]     = (uint8_t)(nvm.p5 & 0xFF);
+    out[i++]     = (uint8_t)(nvm.p5 >> 8);
+    out[i++]     = (uint8_t)(nvm.p6 & 0xFF);
+    out[i++]     = (uint8_t)(nvm.p6 >> 8);
+    out[i++]     = (uint8_t)nvm.p7;
+    out[i++]     = (uint8_t)nvm.p8;
+    out[i++]     = (uint8_t)((uint16_t)nvm.p9 & 0xFF);
+    out[i++]     = (uint8_t)((uint16_t)nvm.p9 >> 8);
+    out[i++]     = (uint8_t)nvm.p10;
+    out[i++]     = (uint8_t)nvm.p11;
+
+    sim->regs[REG_TRIM_CRC] = trimming_crc(out, CALIB_LENGTH);
+
+    sim->calib = (calib_t){
+        .t1  = nvm.t1 * 256.0,
+        .t2  = nvm.t2 / 1073741824.0,      // 2^30
+        .t3  = nvm.t3 / 281474976710656.0, // 2^48
+        .p1  = (nvm.p1 - 16384) / 1048576.0,
+        .p2  = (nvm.p2 - 16384) / 536870912.0,
+        .p3  = nvm.p3 / 4294967296.0,
+        .p4  = nvm.p4 / 137438953472.0,
+        .p5  = nvm.p5 * 8.0,
+        .p6  = nvm.p6 / 64.0,
+        .p7  = nvm.p7 / 256.0,
+        .p8  = nvm.p8 / 32768.0,
+        .p9  = nvm.p9 / 281474976710656.0,
+        .p10 = nvm.p10 / 281474976710656.0,
+        .p11 = nvm.p11 / 36893488147419103232.0, // 2^65
+    };
+}
+
+static double compensate_temperature(const calib_t *c, double raw)
+{
+    double partial = raw - c->t1;
+    return partial * c->t2 + partial * partial * c->t3;
+}
+
+static double compensate_pressure(const calib_t *c, double raw, double t)
+{
+    double offset      = c->p5 + c->p6 * t + c->p7 * t * t + c->p8 * t * t * t;
+    double sensitivity = raw * (c->p1 + c->p2 * t + c->p3 * t * t + c->p4 * t * t * t);
+    return offset + sensitivity + raw * raw * (c->p9 + c->p10 * t) + raw * raw * raw * c->p11;
+}
+
+// The raw value that the compensation turns into the target, by bisection: both are monotonic over the 24 bits
+static uint32_t uncompensate(const calib_t *c, double target, bool pressure, double t)
+{
+    uint32_t low  = 0;
+    uint32_t high = 0xFFFFFF;
+    double at_low = pressure ? compensate_pressure(c, low, t) : compensate_temperature(c, low);
+    bool rising   = at_low < (pressure ? compensate_pressure(c, high, t) : compensate_temperature(c, high));
+    while (low < high)
+    {
+        uint32_t middle = low + (high - low) / 2;
+        double value    = pressure ? compensate_pressure(c, middle, t) : compensate_temperature(c, middle);
+        if ((value < target) == rising)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+static void reset(sim_bmp390_t *sim)
+{
+    memset(sim->regs, 0, REG_TRIM_CRC);
+    sim->regs[REG_CHIP_ID]       = SIM_BMP390_CHIP_ID;
+    sim->regs[REG_REV_ID]        = 0x01;
+    sim->regs[REG_STATUS]        = STATUS_CMD_READY;
+    sim->regs[REG_EVENT]         = 0x01; // Power on detected
+    sim->regs[REG_FIFO_WTM]      = 0x01;
+    sim->regs[REG_FIFO_CONFIG_1] = 0x02;
+    sim->regs[REG_FIFO_CONFIG_2] = 0x02;
+    sim->regs[REG_INT_CTRL]      = 0x02;
+    sim->regs[REG_OSR]           = 0x02;
+    put_u24(&sim->regs[REG_DATA], RAW_DISABLED);
+    put_u24(&sim->regs[REG_DATA + 3], RAW_DISABLED);
+    sim->ticks = 0;
+    sim_fifo_clear(&sim->fifo);
+}
+
+static uint8_t mode(const sim_bmp390_t *sim)
+{
+    return (sim->regs[REG_PWR_CTRL] >> 4) & 0x03;
+}
+
+static int64_t period_us(const sim_bmp390_t *sim)
+{
+    uint8_t odr = sim->regs[REG_ODR] & 0x1F;
+    return (int64_t)5000 << (odr > 17 ? 17 : odr);
+}
+
+// Conversion time of the datasheet for the enabled measurements and their oversampling
+static int64_t measurement_us(const sim_bmp390_t *sim)
+{
+    uint8_t pwr_ctrl = sim->regs[REG_PWR_CTRL];
+    uint8_t osr      = sim->regs[REG_OSR];
+    int64_t time_us  = 234;
+    if (pwr_ctrl & 0x01)
+        time_us += 392 + 2020 * (1 << (osr & 0x07));
+    if (pwr_ctrl & 0x02)
+        time_us += 163 + 2020 * (1 << ((osr >> 3) & 0x07));
+    return time_us;
+}
+
+static uint32_t sensortime(const sim_bmp390_t *sim, int64_t now_us)
+{
+    return (uint32_t)((now_us - sim->epoch_us) * 1000 / SENSORTIME_NS) & 0xFFFFFF;
+}
+
+static void measure(sim_bmp390_t *sim, int64_t time_us)
+{
+    float pressure_pa   = 101325.0f;
+    float temperature_c = 25.0f;
+    sim->source(sim->arg, time_us, &pressure_pa, &temperature_c);
+
+    uint8_t pwr_ctrl  = sim->regs[REG_PWR_CTRL];
+    uint32_t raw_temp = uncompensate(&sim->calib, temperature_c, false, 0.0);
+    double t          = compensate_temperature(&sim->calib, raw_temp);
+    uint32_t raw_pres = uncompensate(&sim->calib, pressure_pa, true, t);
+    put_u24(&sim->regs[REG_DATA], (pwr_ctrl & 0x01) ? raw_pres : RAW_DISABLED);
+    put_u24(&sim->regs[REG_DATA + 3], (pwr_ctrl & 0x02) ? raw_temp : RAW_DISABLED);
+    put_u24(&sim->regs[REG_SENSORTIME], sensortime(sim, time_us));
+    sim->regs[REG_STATUS] |= (pwr_ctrl & 0x01 ? STATUS_DRDY_PRESS : 0) | (pwr_ctrl & 0x02 ? STATUS_DRDY_TEMP : 0);
+    sim->regs[REG_INT_STATUS] |= INT_DRDY;
+
+    // The FIFO takes one measurement in 2^subsampling, with the temperature first
+    uint8_t config = sim->regs[REG_FIFO_CONFIG_1];
+    bool temp      = (config & 0x10) && (pwr_ctrl & 0x02);
+    bool pres      = (config & 0x08) && (pwr_ctrl & 0x01);
+    uint8_t subs   = sim->regs[REG_FIFO_CONFIG_2] & 0x07;
+    if ((config & 0x01) && (temp || pres) && (sim->ticks++ & ((1u << subs) - 1)) == 0)
+    {
+        uint8_t frame[7];
+        size_t length   = 0;
+        frame[length++] = temp && pres ? FIFO_TEMP_PRESS : (temp ? FIFO_TEMP : FIFO_PRESS);
+        if (temp)
+        {
+            put_u24(&frame[length], raw_temp);
+            length += 3;
+        }
+        if (pres)
+        {
+            put_u24(&frame[length], raw_pres);
+            length += 3;
+        }
+        sim->fifo.frame = length;
+        sim_fifo_push(&sim->fifo, frame, (config & 0x02) == 0);
+
+        uint16_t watermark = (uint16_t)(sim->regs[REG_FIFO_WTM] | (sim->regs[REG_FIFO_WTM + 1] & 0x01) << 8);
+        if (sim->fifo.length >= watermark)
+            sim->regs[REG_INT_STATUS] |= INT_FIFO_WTM;
+        if (sim_fifo_full(&sim->fifo))
+            sim->regs[REG_INT_STATUS] |= INT_FIFO_FULL;
+    }
+}
+
+static void catch_up(sim_bmp390_t *sim, int64_t now_us)
+{
+    if (mode(sim) != MODE_NORMAL)
+        return;
+    int64_t period = period_us(sim);
+    if (now_us - sim->next_us > MAX_CATCH_UP_ODR * period)
+        sim->next_us += (now_us - sim->next_us) / period * period - MAX_CATCH_UP_ODR * period;
+    while (sim->next_us <= now_us)
+    {
+        measure(sim, sim->next_us);
+        sim->next_us += period;
+    }
+}
+
+static uint8_t fifo_byte(sim_bmp390_t *sim, int64_t now_us)
+{
+    sim_fifo_t *fifo = &sim->fifo;
+    if (fifo->read < fifo->length)
+        return fifo->data[fifo->read++];
+
+    // Past the last frame comes a sensortime frame when it is enabled, then the empty frame
+    size_t extra = fifo->read++ - fifo->length;
+    if ((sim->regs[REG_FIFO_CONFIG_1] & 0x04) == 0 || extra >= 4)
+        return FIFO_EMPTY;
+    if (extra == 0)
+        return FIFO_SENSORTIME;
+    return (uint8_t)(sensortime(sim, now_us) >> (8 * (extra - 1)));
+}
+
+static void read_registers(sim_bmp390_t *sim, uint8_t reg, uint8_t *in, size_t length, int64_t now_us)
+{
+    for (size_t i = 0; i < length; i++)
+    {
+        switch (reg)
+        {
+        case REG_FIFO_LENGTH:
+            in[i] = (uint8_t)(sim->fifo.length & 0xFF);
+            break;
+        case REG_FIFO_LENGTH + 1:
+            in[i] = (uint8_t)((sim->fifo.length >> 8) & 0x01);
+            break;
+        case REG_FIFO_DATA:
+            in[i] = fifo_byte(sim, now_us);
+            break;
+        default:
+            in[i] = sim->regs[reg];
+            break;
+        }
+
+        // The errors, the event and the interrupt status are cleared on read, the data ready by reading the data
+        if (reg == REG_ERR || reg == REG_EVENT || reg == REG_INT_STATUS)
+            sim->regs[reg] = 0;
+        else if (reg == REG_DATA)
+            sim->regs[REG_STATUS] &= (uint8_t)~STATUS_DRDY_PRESS;
+        else if (reg == REG_DATA + 3)
+            sim->regs[REG_STATUS] &= (uint8_t)~STATUS_DRDY_TEMP;
+        if (reg != REG_FIFO_DATA)
+            reg = (uint8_t)((reg + 1) & (REGISTERS - 1));
+    }
+    if (sim->fifo.read > 0)
+        sim_fifo_end_read(&sim->fifo);
+}
+
+static void write_pwr_ctrl(sim_bmp390_t *sim, uint8_t value, int64_t now_us)
+{
+    uint8_t old_mode        = mode(sim);
+    sim->regs[REG_PWR_CTRL] = value & 0x33;
+    uint8_t new_mode        = mode(sim);
+
+    if (new_mode == MODE_NORMAL && old_mode != MODE_NORMAL)
+    {
+        // A normal mode whose measurement does not fit in the period is refused
+        if (measurement_us(sim) > period_us(sim))
+        {
+            sim->regs[REG_ERR] |= ERR_CONF;
+            sim->regs[REG_PWR_CTRL] &= 0x03;
+            return;
+        }
+        sim->next_us = now_us + period_us(sim);
+    }
+    else if (new_mode == 0x01 || new_mode == 0x02)
+    {
+        // Forced: one measurement, then back to sleep
+        measure(sim, now_us);
+        sim->regs[REG_PWR_CTRL] &= 0x03;
+    }
+}
+
+static void write_register(sim_bmp390_t *sim, uint8_t reg, uint8_t value, int64_t now_us)
+{
+    switch (reg)
+    {
+    case REG_CMD:
+        if (value == CMD_SOFTRESET)
+            reset(sim);
+        else if (value == CMD_FIFO_FLUSH)
+            sim_fifo_clear(&sim->fifo);
+        else
+            sim->regs[REG_ERR] |= ERR_CMD;
+        return;
+    case REG_PWR_CTRL:
+        write_pwr_ctrl(sim, value, now_us);
+        return;
+    case REG_ODR:
+        sim->regs[reg] = value;
+        sim->next_us   = now_us + period_us(sim);
+        return;
+    case REG_FIFO_CONFIG_1:
+    case REG_FIFO_CONFIG_2:
+        sim->regs[reg] = value;
+        sim_fifo_clear(&sim->fifo);
+        sim->ticks = 0;
+        return;
+    default:
+        // Only the settings are written, the rest is read only
+        if (reg >= REG_FIFO_WTM && reg <= REG_CONFIG)
+            sim->regs[reg] = value;
+        return;
+    }
+}
+
+static esp_err_t transfer(void *device, const uint8_t *out, size_t out_length, uint8_t *in, size_t in_length)
+{
+    sim_bmp390_t *sim = device;
+    if (out_length == 0)
+        return ESP_FAIL;
+
+    int64_t now_us = bean_hal_time_us();
+    pthread_mutex_lock(&sim->lock);
+    catch_up(sim, now_us);
+    if (in_length > 0)
+    {
+        read_registers(sim, out[0], in, in_length, now_us);
+    }
+    else
+    {
+        // A burst write is made of register and value pairs
+        for (size_t i = 0; i + 1 < out_length; i += 2)
+            write_register(sim, out[i], out[i + 1], now_us);
+    }
+    pthread_mutex_unlock(&sim->lock);
+    return ESP_OK;
+}
+
+sim_bmp390_t *sim_bmp390_create(sim_bmp390_source_t source, void *arg)
+{
+    sim_bmp390_t *sim = calloc(1, sizeof(*sim));
+    if (!sim)
+        return NULL;
+    pthread_mutex_init(&sim->lock, NULL);
+    sim->source     = source;
+    sim->arg        = arg;
+    sim->epoch_us   = bean_hal_time_us();
+    sim->fifo.data  = sim->fifo_data;
+    sim->fifo.size  = FIFO_SIZE;
+    sim->fifo.frame = 7;
+    load_nvm(sim);
+    reset(sim);
+    return sim;
+}
+
+esp_err_t sim_bmp390_attach(sim_bmp390_t *sim, uint8_t address)
+{
+    sim->address = address;
+    return bean_hal_posix_i2c_attach(address, transfer, sim);
+}
+
+void sim_bmp390_corrupt_trimming(sim_bmp390_t *sim)
+{
+    pthread_mutex_lock(&sim->lock);
+    sim->regs[REG_TRIM_CRC] ^= 0xFF;
+    pthread_mutex_unlock(&sim->lock);
+}
+
+void sim_bmp390_destroy(sim_bmp390_t *sim)
+{
+    if (!sim)
+        return;
+    bean_hal_posix_i2c_detach(sim->address);
+    pthread_mutex_destroy(&sim->lock);
+    free(sim);
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * The frame FIFO of the sensor models: frames of one size at a time, read out byte by byte through a data register.
+ */
+
+typedef struct sim_fifo
+{
+    uint8_t *data;
+    size_t size;
+    size_t length;
+    size_t read; // Bytes read in the current transaction
+    size_t frame;
+    bool overrun;
+} sim_fifo_t;
+
+static inline void sim_fifo_clear(sim_fifo_t *fifo)
+{
+    fifo->length  = 0;
+    fifo->read    = 0;
+    fifo->overrun = false;
+}
+
+static inline bool sim_fifo_full(const sim_fifo_t *fifo)
+{
+    return fifo->length + fifo->frame > fifo->size;
+}
+
+// In stream mode the oldest frames make room, in FIFO mode the new one is lost
+static inline void sim_fifo_push(sim_fifo_t *fifo, const uint8_t *frame, bool stream)
+{
+    if (sim_fifo_full(fifo))
+    {
+        fifo->overrun = true;
+        if (!stream)
+            return;
+        size_t drop = fifo->frame * ((fifo->length + fifo->frame - fifo->size + fifo->frame - 1) / fifo->frame);
+        memmove(fifo->data, fifo->data + drop, fifo->length - drop);
+        fifo->length -= drop;
+    }
+    memcpy(fifo->data + fifo->length, frame, fifo->frame);
+    fifo->length += fifo->frame;
+}
+
+// The whole frames that were read leave the FIFO, a frame cut by the end of the read stays for the next one
+static inline void sim_fifo_end_read(sim_fifo_t *fifo)
+{
+    size_t consumed = fifo->read - fifo->read % fifo->frame;
+    if (consumed > fifo->length)
+        consumed = fifo->length;
+    memmove(fifo->data, fifo->data + consumed, fifo->length - consumed);
+    fifo->length -= consumed;
+    fifo->read = 0;
+}
@@ -0,0 +1,294 @@
+#include <stdio.h>
+#include <sys/time.h>
+#include "bean_power.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "esp_attr.h"
+#include "esp_sleep.h"
+#include "esp_system.h"
+#include "driver/rtc_io.h"
+#include "freertos/FreeRTOS.h"
+#include "sdkconfig.h"
+
+#if CONFIG_PM_ENABLE
+#include "esp_pm.h"
+#endif
+
+static const char *TAG = "bean_power";
+
+// Kept in RTC memory through the deep sleep, 0 when the board did not go to standby
+RTC_DATA_ATTR static time_t standby_entered_s = 0;
+
+#if CONFIG_PM_ENABLE
+
+static const esp_pm_lock_type_t lock_types[BEAN_POWER_LOCK_COUNT] = {
+    [BEAN_POWER_LOCK_ACQUISITION] = ESP_PM_CPU_FREQ_MAX,
+    [BEAN_POWER_LOCK_STORAGE]     = ESP_PM_CPU_FREQ_MAX,
+    [BEAN_POWER_LOCK_LED]         = ESP_PM_APB_FREQ_MAX,
+    [BEAN_POWER_LOCK_BEEP]        = ESP_PM_NO_LIGHT_SLEEP,
+};
+
+static const char *lock_names[BEAN_POWER_LOCK_COUNT] = {
+    [BEAN_POWER_LOCK_ACQUISITION] = "acquisition",
+    [BEAN_POWER_LOCK_STORAGE]     = "storage",
+    [BEAN_POWER_LOCK_LED]         = "led",
+    [BEAN_POWER_LOCK_BEEP]        = "beep",
+};
+
+static esp_pm_lock_handle_t locks[BEAN_POWER_LOCK_COUNT];
+static esp_pm_lock_handle_t awake_lock; // Held outside the pad mode
+static portMUX_TYPE power_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static bean_context_t *power_ctx = NULL;
+static bool light_sleep          = false;
+static bool pad_mode             = false;
+static int64_t mode_start_us     = 0;
+
+// Updated from the light sleep exit callback, with the scheduler stopped
+static volatile uint32_t sleep_wakeups = 0;
+static volatile uint64_t sleep_us      = 0;
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+static esp_err_t IRAM_ATTR light_sleep_exit_callback(int64_t sleep_time_us, void *arg)
+{
+    sleep_wakeups++;
+    sleep_us += sleep_time_us;
+    return ESP_OK;
+}
+#endif
+
+// Created on first use, the loggers and the LED task can get here before bean_power_init()
+static esp_pm_lock_handle_t get_lock(bean_power_lock_t lock)
+{
+    if (locks[lock] != NULL)
+        return locks[lock];
+
+    esp_pm_lock_handle_t handle = NULL;
+    if (esp_pm_lock_create(lock_types[lock], 0, lock_names[lock], &handle) != ESP_OK)
+        return NULL;
+
+    portENTER_CRITICAL(&power_lock);
+    if (locks[lock] == NULL)
+    {
+        locks[lock] = handle;
+        handle      = NULL;
+    }
+    portEXIT_CRITICAL(&power_lock);
+
+    // Another task was faster
+    if (handle != NULL)
+        esp_pm_lock_delete(handle);
+    return locks[lock];
+}
+
+static void reset_stats(void)
+{
+    portENTER_CRITICAL(&power_lock);
+    sleep_wakeups = 0;
+    sleep_us      = 0;
+    mode_start_us = esp_timer_get_time();
+    portEXIT_CRITICAL(&power_lock);
+}
+
+esp_err_t bean_power_init(bean_context_t *ctx)
+{
+    const bean_config_bean_power_t *config = &bean_config_get()->bean_power;
+    power_ctx                              = ctx;
+    light_sleep                            = config->light_sleep;
+
+    // Full clock until the pad mode, acquired before the clock may drop
+    ESP_RETURN_ON_ERROR(esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "awake", &awake_lock), TAG, "awake lock");
+    ESP_RETURN_ON_ERROR(esp_pm_lock_acquire(awake_lock), TAG, "awake lock");
+
+    esp_pm_config_t pm_config = {
+        .max_freq_mhz       = CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ,
+        .min_freq_mhz       = (int)config->min_cpu_freq_mhz,
+        .light_sleep_enable = light_sleep,
+    };
+    ESP_RETURN_ON_ERROR(esp_pm_configure(&pm_config), TAG, "esp_pm_configure");
+
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    esp_pm_sleep_cbs_register_config_t callbacks = {
+        .exit_cb = light_sleep_exit_callback,
+    };
+    ESP_RETURN_ON_ERROR(esp_pm_light_sleep_register_cbs(&callbacks), TAG, "light sleep callbacks");
+#endif
+
+    reset_stats();
+    ESP_LOGI(TAG,
+             "%d..%d MHz, light sleep %s, pad power save %s",
+             pm_config.min_freq_mhz,
+             pm_config.max_freq_mhz,
+             light_sleep ? "on" : "off",
+             config->pad_power_save ? "on" : "off");
+    return ESP_OK;
+}
+
+void bean_power_acquire(bean_power_lock_t lock)
+{
+    esp_pm_lock_handle_t handle = get_lock(lock);
+    if (handle != NULL)
+        esp_pm_lock_acquire(handle);
+}
+
+void bean_power_release(bean_power_lock_t lock)
+{
+    esp_pm_lock_handle_t handle = get_lock(lock);
+    if (handle != NULL)
+        esp_pm_lock_release(handle);
+}
+
+esp_err_t bean_power_enter_pad_mode(void)
+{
+    // Followed live, the clock range and the light sleep only at boot
+    if (!bean_config_get()->bean_power.pad_power_save || awake_lock == NULL)
+        return ESP_ERR_NOT_SUPPORTED;
+    if (pad_mode)
+        return ESP_OK;
+
+    reset_stats();
+    pad_mode = true;
+    esp_pm_lock_release(awake_lock);
+    ESP_LOGI(TAG, "Pad mode");
+    return ESP_OK;
+}
+
+void bean_power_exit_pad_mode(void)
+{
+    if (!pad_mode)
+        return;
+    esp_pm_lock_acquire(awake_lock);
+    pad_mode = false;
+
+    bean_power_stats_t stats;
+    bean_power_get_stats(&stats);
+    reset_stats();
+
+    uint32_t wakeups_per_s = stats.elapsed_ms > 0 ? (uint32_t)((uint64_t)stats.wakeups * 1000 / stats.elapsed_ms) : 0;
+    uint32_t sleep_pct     = stats.elapsed_ms > 0 ? (uint32_t)(stats.sleep_us / 10 / stats.elapsed_ms) : 0;
+    ESP_LOGI(TAG,
+             "Pad mode left after %lu ms, %lu wakeups/s, %lu %% in light sleep",
+             stats.elapsed_ms,
+             wakeups_per_s,
+             sleep_pct);
+    if (power_ctx != NULL)
+    {
+        bean_context_log_event(power_ctx,
+                               EVENT_ID_PAD_POWER,
+                               "pad_ms=%lu;wakeups=%lu;wakeups_per_s=%lu;sleep_pct=%lu;light_sleep=%d",
+                               stats.elapsed_ms,
+                               stats.wakeups,
+                               wakeups_per_s,
+                               sleep_pct,
+                               light_sleep);
+    }
+}
+
+bool bean_power_in_pad_mode(void)
+{
+    return pad_mode;
+}
+
+void bean_power_get_stats(bean_power_stats_t *stats)
+{
+    portENTER_CRITICAL(&power_lock);
+    stats->pad_mode   = pad_mode;
+    stats->elapsed_ms = (uint32_t)((esp_timer_get_time() - mode_start_us) / 1000);
+    stats->wakeups    = sleep_wakeups;
+    stats->sleep_us   = sleep_us;
+    portEXIT_CRITICAL(&power_lock);
+}
+
+void bean_power_print_report(void)
+{
+    bean_power_stats_t stats;
+    bean_power_get_stats(&stats);
+    float elapsed_s = stats.elapsed_ms / 1000.0f;
+
+    printf("Mode: %s for %.1f s\n", stats.pad_mode ? "pad" : "awake", elapsed_s);
+#if CONFIG_PM_LIGHT_SLEEP_CALLBACKS
+    printf("Light sleep: %lu wakeups, %.1f /s, %.1f %% asleep\n",
+           stats.wakeups,
+           elapsed_s > 0.0f ? stats.wakeups / elapsed_s : 0.0f,
+           elapsed_s > 0.0f ? stats.sleep_us / 10.0f / stats.elapsed_ms : 0.0f);
+#else
+    printf("Light sleep: not counted without CONFIG_PM_LIGHT_SLEEP_CALLBACKS\n");
+#endif
+#if CONFIG_PM_PROFILING
+    // Time in each power mode and per lock since boot
+    esp_pm_dump_locks(stdout);
+#endif
+}
+
+#else // CONFIG_PM_ENABLE
+
+esp_err_t bean_power_init(bean_context_t *ctx)
+{
+    ESP_LOGW(TAG, "No power management, CONFIG_PM_ENABLE is off");
+    return ESP_OK;
+}
+
+void bean_power_acquire(bean_power_lock_t lock) {}
+
+void bean_power_release(bean_power_lock_t lock) {}
+
+esp_err_t bean_power_enter_pad_mode(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void bean_power_exit_pad_mode(void) {}
+
+bool bean_power_in_pad_mode(void)
+{
+    return false;
+}
+
+void bean_power_get_stats(bean_power_stats_t *stats)
+{
+    *stats = (bean_power_stats_t){ 0 };
+}
+
+void bean_power_print_report(void)
+{
+    printf("No power management, CONFIG_PM_ENABLE is off\n");
+}
+
+#endif // CONFIG_PM_ENABLE
+
+bool bean_power_can_wake_on(int gpio)
+{
+    return gpio >= 0 && rtc_gpio_is_valid_gpio(gpio);
+}
+
+esp_err_t bean_power_deep_sleep(int wake_gpio)
+{
+    if (!bean_power_can_wake_on(wake_gpio))
+        return ESP_ERR_INVALID_ARG;
+
+    ESP_RETURN_ON_ERROR(esp_sleep_enable_ext0_wakeup(wake_gpio, 1), TAG, "Wake-up on GPIO %d", wake_gpio);
+    // The digital pull-down is gone in deep sleep, the RTC one keeps the line low between the interrupts
+    rtc_gpio_pullup_dis(wake_gpio);
+    rtc_gpio_pulldown_en(wake_gpio);
+
+    // The RTC clock keeps the time of day running through the deep sleep
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    standby_entered_s = now.tv_sec > 0 ? now.tv_sec : 1;
+
+    ESP_LOGI(TAG, "Standby, wake-up on GPIO %d", wake_gpio);
+    esp_deep_sleep_start();
+    return ESP_FAIL; // Never gets here
+}
+
+bool bean_power_woke_from_standby(uint32_t *slept_s)
+{
+    if (esp_reset_reason() != ESP_RST_DEEPSLEEP || standby_entered_s == 0)
+        return false;
+
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    *slept_s = now.tv_sec > standby_entered_s ? (uint32_t)(now.tv_sec - standby_entered_s) : 0;
+    return true;
+}
@@ -0,0 +1,53 @@
+#include "bean_power.h"
+#include <stdio.h>
+
+/*
+ * The host build's stand-in for bean_power.c: no clocks to scale and no sleep, like a target without
+ * CONFIG_PM_ENABLE. Only built by host/CMakeLists.txt.
+ */
+
+esp_err_t bean_power_init(bean_context_t *ctx)
+{
+    return ESP_OK;
+}
+
+void bean_power_acquire(bean_power_lock_t lock) {}
+
+void bean_power_release(bean_power_lock_t lock) {}
+
+esp_err_t bean_power_enter_pad_mode(void)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+void bean_power_exit_pad_mode(void) {}
+
+bool bean_power_in_pad_mode(void)
+{
+    return false;
+}
+
+void bean_power_get_stats(bean_power_stats_t *stats)
+{
+    *stats = (bean_power_stats_t){ 0 };
+}
+
+void bean_power_print_report(void)
+{
+    printf("No power management on the host\n");
+}
+
+bool bean_power_can_wake_on(int gpio)
+{
+    return false;
+}
+
+esp_err_t bean_power_deep_sleep(int wake_gpio)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+bool bean_power_woke_from_standby(uint32_t *slept_s)
+{
+    return false;
+}
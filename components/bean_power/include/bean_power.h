@@ -0,0 +1,82 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "bean_context.h"
+
+// Everything that needs the clock or the peripherals to keep running holds one of these while it does
+typedef enum bean_power_lock
+{
+    BEAN_POWER_LOCK_ACQUISITION, // Full CPU clock while a sample is taken and processed
+    BEAN_POWER_LOCK_STORAGE, // Full CPU clock while the loggers write
+    BEAN_POWER_LOCK_LED, // APB clock and no light sleep while an LED is lit, the LEDC runs from the APB clock
+    BEAN_POWER_LOCK_BEEP, // No light sleep while a tone plays
+    BEAN_POWER_LOCK_COUNT
+} bean_power_lock_t;
+
+typedef struct bean_power_stats
+{
+    bool pad_mode;
+    uint32_t elapsed_ms; // Since the pad mode was entered, or left
+    uint32_t wakeups; // From light sleep
+    uint64_t sleep_us; // In light sleep
+} bean_power_stats_t;
+
+/**
+ * @brief Configures the dynamic frequency scaling and the light sleep from `bean_power` in the config.
+ *
+ * Until the pad mode is entered the CPU runs at full clock and never sleeps. Without CONFIG_PM_ENABLE the whole
+ * component does nothing.
+ */
+esp_err_t bean_power_init(bean_context_t *ctx);
+
+/**
+ * @brief Holds a power management lock, they count so every acquire needs a release.
+ *
+ * Cheap enough for every sample, and safe before bean_power_init().
+ */
+void bean_power_acquire(bean_power_lock_t lock);
+
+void bean_power_release(bean_power_lock_t lock);
+
+/**
+ * @brief Lets the clock drop and the chip sleep whenever no lock is held, meant for the wait on the pad.
+ *
+ * @return ESP_ERR_NOT_SUPPORTED when `pad_power_save` is off or there is no power management
+ */
+esp_err_t bean_power_enter_pad_mode(void);
+
+/**
+ * @brief Back to full clock, logs the wakeups and the residency of the pad mode as EVENT_ID_PAD_POWER.
+ */
+void bean_power_exit_pad_mode(void);
+
+bool bean_power_in_pad_mode(void);
+
+void bean_power_get_stats(bean_power_stats_t *stats);
+
+/**
+ * @brief Prints the stats and, with CONFIG_PM_PROFILING, the time spent in each power mode and lock.
+ */
+void bean_power_print_report(void);
+
+/**
+ * @brief Tells whether a GPIO can wake the chip from deep sleep, only the RTC GPIOs can.
+ */
+bool bean_power_can_wake_on(int gpio);
+
+/**
+ * @brief Goes to deep sleep until the GPIO goes high, the chip boots from scratch on the wake-up.
+ *
+ * Whatever has to stay put through the sleep must be latched before, see bean_pyro_hold_safe().
+ *
+ * @return Only on a failure, ESP_ERR_INVALID_ARG for a GPIO that can not wake the chip
+ */
+esp_err_t bean_power_deep_sleep(int wake_gpio);
+
+/**
+ * @brief Tells whether this boot is the wake-up from bean_power_deep_sleep().
+ *
+ * @param slept_s Gets the time spent in deep sleep, in s
+ */
+bool bean_power_woke_from_standby(uint32_t *slept_s);
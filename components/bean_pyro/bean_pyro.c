@@ -0,0 +1,210 @@
+#include "bean_pyro.h"
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "driver/gptimer.h"
+#include "freertos/FreeRTOS.h"
+#include "bean_context.h"
+
+static const char *TAG = "BEAN_PYRO";
+
+static pyro_sched_t pyro_sched;
+static gptimer_handle_t hold_timer = NULL;
+static portMUX_TYPE pyro_lock      = portMUX_INITIALIZER_UNLOCKED;
+static bool initialized            = false;
+static bool hold_timer_running     = false; // Enabled and started, only changed from the task that arms and disarms
+
+static gpio_num_t channel_pin(uint8_t channel)
+{
+    switch (channel)
+    {
+    case 0:
+        return PIN_PYRO_0;
+    case 1:
+        return PIN_PYRO_1;
+    case 2:
+        return PIN_PYRO_2;
+    default:
+        return PIN_PYRO_3;
+    }
+}
+
+static void IRAM_ATTR io_set_output(void *ctx, uint8_t channel, bool on)
+{
+    gpio_set_level(channel_pin(channel), on ? 1 : 0);
+}
+
+static int64_t IRAM_ATTR io_now_us(void *ctx)
+{
+    return esp_timer_get_time();
+}
+
+// The hold timer counts in us, the next alarm is set relative to its current count
+static void IRAM_ATTR io_schedule(void *ctx, int64_t delay_us)
+{
+    if (delay_us < 0)
+    {
+        gptimer_set_alarm_action(hold_timer, NULL);
+        return;
+    }
+
+    uint64_t count = 0;
+    gptimer_get_raw_count(hold_timer, &count);
+    gptimer_alarm_config_t alarm = { .alarm_count = count + (delay_us > 0 ? (uint64_t)delay_us : 1) };
+    gptimer_set_alarm_action(hold_timer, &alarm);
+}
+
+static bool IRAM_ATTR hold_timer_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx)
+{
+    taskENTER_CRITICAL_ISR(&pyro_lock);
+    pyro_sched_service(&pyro_sched);
+    taskEXIT_CRITICAL_ISR(&pyro_lock);
+    return false;
+}
+
+// An enabled gptimer holds an APB clock lock of the power management, which keeps the pad mode out of the light
+// sleep. So the hold timer only runs while a channel is armed, from the launch to the last hold or the landing.
+static esp_err_t start_hold_timer(void)
+{
+    if (hold_timer_running)
+        return ESP_OK;
+    ESP_RETURN_ON_ERROR(gptimer_enable(hold_timer), TAG, "Failed to enable hold timer");
+    esp_err_t ret = gptimer_start(hold_timer);
+    if (ret != ESP_OK)
+    {
+        gptimer_disable(hold_timer);
+        ESP_LOGE(TAG, "Failed to start hold timer");
+        return ret;
+    }
+    hold_timer_running = true;
+    return ESP_OK;
+}
+
+// gptimer_disable() can not run in the timer interrupt that ends the last hold, the timer is stopped by the next
+// disarm from the task instead (the landing disarms every channel)
+static void stop_hold_timer_when_idle(void)
+{
+    bool pending = false;
+    taskENTER_CRITICAL(&pyro_lock);
+    for (uint8_t ch = 0; ch < PYRO_SCHED_CHANNELS; ch++)
+    {
+        pyro_channel_state_t state = pyro_sched_state(&pyro_sched, ch);
+        pending                    = pending || state == PYRO_CHANNEL_ARMED || state == PYRO_CHANNEL_FIRING;
+    }
+    taskEXIT_CRITICAL(&pyro_lock);
+    if (pending || !hold_timer_running)
+        return;
+
+    gptimer_stop(hold_timer);
+    gptimer_disable(hold_timer);
+    hold_timer_running = false;
+}
+
+esp_err_t bean_pyro_init(void)
+{
+    const bean_config_bean_pyro_t *config = &bean_config_get()->bean_pyro;
+    uint32_t hold_ms                      = (uint32_t)config->hold_ms;
+    uint32_t arm_timeout_ms               = (uint32_t)config->arm_timeout_ms;
+
+    // Outputs low before anything else
+    gpio_config_t io_conf = {
+        .pin_bit_mask = (1ULL << PIN_PYRO_0) | (1ULL << PIN_PYRO_1) | (1ULL << PIN_PYRO_2) | (1ULL << PIN_PYRO_3),
+        .mode         = GPIO_MODE_OUTPUT,
+        .pull_down_en = GPIO_PULLDOWN_ENABLE,
+        .intr_type    = GPIO_INTR_DISABLE,
+    };
+    for (uint8_t ch = 0; ch < PYRO_SCHED_CHANNELS; ch++)
+        gpio_set_level(channel_pin(ch), 0);
+    ESP_RETURN_ON_ERROR(gpio_config(&io_conf), TAG, "Failed to configure pyro GPIOs");
+    // Still held low after a standby, the level was set above
+    for (uint8_t ch = 0; ch < PYRO_SCHED_CHANNELS; ch++)
+        gpio_hold_dis(channel_pin(ch));
+
+    gptimer_config_t timer_config = {
+        .clk_src       = GPTIMER_CLK_SRC_DEFAULT,
+        .direction     = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,
+    };
+    ESP_RETURN_ON_ERROR(gptimer_new_timer(&timer_config, &hold_timer), TAG, "Failed to create hold timer");
+    gptimer_event_callbacks_t callbacks = { .on_alarm = hold_timer_alarm };
+    ESP_RETURN_ON_ERROR(gptimer_register_event_callbacks(hold_timer, &callbacks, NULL), TAG, "Hold timer callback");
+
+    pyro_io_t io = { .set_output = io_set_output, .now_us = io_now_us, .schedule = io_schedule, .ctx = NULL };
+    pyro_sched_init(&pyro_sched, &io, hold_ms * 1000, arm_timeout_ms * 1000);
+    initialized = true;
+
+    ESP_LOGI(TAG, "Pyro hold %lu ms, arm timeout %lu ms", hold_ms, arm_timeout_ms);
+    return ESP_OK;
+}
+
+static esp_err_t to_esp_err(pyro_result_t result)
+{
+    switch (result)
+    {
+    case PYRO_OK:
+        return ESP_OK;
+    case PYRO_ERR_CHANNEL:
+        return ESP_ERR_INVALID_ARG;
+    default:
+        return ESP_ERR_INVALID_STATE;
+    }
+}
+
+esp_err_t bean_pyro_arm(uint8_t channel)
+{
+    if (!initialized)
+        return ESP_ERR_INVALID_STATE;
+
+    // Running before the channel is armed, the arm timeout and the hold are alarms on its count
+    ESP_RETURN_ON_ERROR(start_hold_timer(), TAG, "Channel %u not armed", channel);
+    taskENTER_CRITICAL(&pyro_lock);
+    pyro_result_t result = pyro_sched_arm(&pyro_sched, channel);
+    taskEXIT_CRITICAL(&pyro_lock);
+
+    if (result != PYRO_OK)
+    {
+        ESP_LOGW(TAG, "Arm channel %u failed: %s", channel, pyro_result_name(result));
+        stop_hold_timer_when_idle();
+    }
+    return to_esp_err(result);
+}
+
+void bean_pyro_disarm_all(void)
+{
+    if (!initialized)
+        return;
+
+    taskENTER_CRITICAL(&pyro_lock);
+    for (uint8_t ch = 0; ch < PYRO_SCHED_CHANNELS; ch++)
+        pyro_sched_disarm(&pyro_sched, ch);
+    taskEXIT_CRITICAL(&pyro_lock);
+    stop_hold_timer_when_idle();
+}
+
+void bean_pyro_hold_safe(void)
+{
+    bean_pyro_disarm_all();
+    for (uint8_t ch = 0; ch < PYRO_SCHED_CHANNELS; ch++)
+    {
+        gpio_set_level(channel_pin(ch), 0);
+        gpio_hold_en(channel_pin(ch));
+    }
+    // The digital pads only keep their hold in deep sleep with this
+    gpio_deep_sleep_hold_en();
+}
+
+esp_err_t bean_pyro_fire(uint8_t channel, int64_t detect_us, pyro_fire_record_t *record)
+{
+    if (!initialized)
+        return ESP_ERR_INVALID_STATE;
+
+    // Nothing in here blocks, the hold time is ended by the timer interrupt
+    taskENTER_CRITICAL(&pyro_lock);
+    pyro_result_t result = pyro_sched_fire(&pyro_sched, channel, detect_us, record);
+    taskEXIT_CRITICAL(&pyro_lock);
+
+    if (result != PYRO_OK)
+        ESP_LOGW(TAG, "Fire channel %u failed: %s", channel, pyro_result_name(result));
+    return to_esp_err(result);
+}
@@ -0,0 +1,43 @@
+#pragma once
+#include "esp_err.h"
+#include "pyro_sched.h"
+
+/**
+ * @brief Drives all pyro outputs low and sets up the hold timer.
+ *
+ * Reads `bean_pyro.hold_ms` and `bean_pyro.arm_timeout_ms` from the config store.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t bean_pyro_init(void);
+
+/**
+ * @brief Arms a channel (0 to PYRO_SCHED_CHANNELS - 1).
+ *
+ * @return ESP_OK when armed, ESP_ERR_INVALID_ARG for an unknown channel, ESP_ERR_INVALID_STATE if it already fired
+ */
+esp_err_t bean_pyro_arm(uint8_t channel);
+
+/**
+ * @brief Disarms all channels, a firing output is switched off right away.
+ */
+void bean_pyro_disarm_all(void);
+
+/**
+ * @brief Disarms all channels and latches the outputs low, they stay low through a deep sleep.
+ *
+ * bean_pyro_init() releases the latch again.
+ */
+void bean_pyro_hold_safe(void);
+
+/**
+ * @brief Fires an armed channel. Safe to call from the acquisition task, it does not block.
+ *
+ * The output is switched off by the hold timer after `bean_pyro.hold_ms`.
+ *
+ * @param channel Channel to fire
+ * @param detect_us esp_timer timestamp of the sample that led to this command
+ * @param record Gets the fire timestamp and the detection to edge latency, may be NULL
+ * @return ESP_OK when fired, ESP_ERR_INVALID_STATE if the channel is not armed or already fired
+ */
+esp_err_t bean_pyro_fire(uint8_t channel, int64_t detect_us, pyro_fire_record_t *record);
@@ -0,0 +1,88 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Pyro channel scheduler: arming, one-shot firing with a fixed hold time and the arm timeout.
+ *
+ * All I/O goes through pyro_io_t, so this file has no ESP-IDF dependencies and can be run on a host against a GPIO
+ * stand-in. The caller serializes the calls, pyro_sched_service() is meant to run from the hold timer interrupt.
+ */
+
+#define PYRO_SCHED_CHANNELS 4
+
+typedef enum pyro_channel_state
+{
+    PYRO_CHANNEL_DISARMED,
+    PYRO_CHANNEL_ARMED,
+    PYRO_CHANNEL_FIRING, // Output on, waiting for the end of the hold time
+    PYRO_CHANNEL_FIRED,
+} pyro_channel_state_t;
+
+typedef enum pyro_result
+{
+    PYRO_OK,
+    PYRO_ERR_CHANNEL, // No such channel
+    PYRO_ERR_NOT_ARMED,
+    PYRO_ERR_ALREADY_FIRED,
+} pyro_result_t;
+
+typedef struct pyro_io
+{
+    void (*set_output)(void *ctx, uint8_t channel, bool on);
+    int64_t (*now_us)(void *ctx); // Monotonic time, same time base as the detection timestamps
+    void (*schedule)(void *ctx, int64_t delay_us); // Call pyro_sched_service() after delay_us, < 0 cancels
+    void *ctx;
+} pyro_io_t;
+
+typedef struct pyro_fire_record
+{
+    uint8_t channel;
+    int64_t detect_us; // Sample that led to the fire command
+    int64_t fire_us; // Output edge
+    int64_t latency_us; // fire_us - detect_us
+} pyro_fire_record_t;
+
+typedef struct pyro_channel
+{
+    pyro_channel_state_t state;
+    int64_t deadline_us; // End of the hold time when firing, arm timeout when armed
+    pyro_fire_record_t record;
+} pyro_channel_t;
+
+typedef struct pyro_sched
+{
+    pyro_io_t io;
+    uint32_t hold_us; // Time the output stays on
+    uint32_t arm_timeout_us; // Armed channels disarm after this, 0 keeps them armed
+    pyro_channel_t channels[PYRO_SCHED_CHANNELS];
+} pyro_sched_t;
+
+/**
+ * @brief Initializes the scheduler and drives all outputs off.
+ */
+void pyro_sched_init(pyro_sched_t *sched, const pyro_io_t *io, uint32_t hold_us, uint32_t arm_timeout_us);
+
+pyro_result_t pyro_sched_arm(pyro_sched_t *sched, uint8_t channel);
+
+/**
+ * @brief Disarms a channel, a firing output is switched off right away.
+ */
+pyro_result_t pyro_sched_disarm(pyro_sched_t *sched, uint8_t channel);
+
+/**
+ * @brief Fires an armed channel: output on now, off after the hold time.
+ *
+ * @param detect_us Timestamp of the sample that led to this command
+ * @param record Gets the fire timestamp and the detection to edge latency, may be NULL
+ */
+pyro_result_t pyro_sched_fire(pyro_sched_t *sched, uint8_t channel, int64_t detect_us, pyro_fire_record_t *record);
+
+/**
+ * @brief Ends the hold times and arm timeouts that expired and schedules the next deadline.
+ */
+void pyro_sched_service(pyro_sched_t *sched);
+
+pyro_channel_state_t pyro_sched_state(const pyro_sched_t *sched, uint8_t channel);
+
+const char *pyro_result_name(pyro_result_t result);
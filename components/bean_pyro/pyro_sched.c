@@ -0,0 +1,133 @@
+#include "pyro_sched.h"
+#include <string.h>
+
+static const char *result_names[] = { "ok", "invalid channel", "not armed", "already fired" };
+
+const char *pyro_result_name(pyro_result_t result)
+{
+    if (result > PYRO_ERR_ALREADY_FIRED)
+        return "unknown";
+    return result_names[result];
+}
+
+// Schedules the service call for the earliest pending deadline, or cancels it when there is none
+static void reschedule(pyro_sched_t *sched, int64_t now_us)
+{
+    bool pending     = false;
+    int64_t earliest = 0;
+    for (uint8_t ch = 0; ch < PYRO_SCHED_CHANNELS; ch++)
+    {
+        const pyro_channel_t *channel = &sched->channels[ch];
+        bool arm_expires              = channel->state == PYRO_CHANNEL_ARMED && sched->arm_timeout_us > 0;
+        bool has_deadline             = channel->state == PYRO_CHANNEL_FIRING || arm_expires;
+        if (has_deadline && (!pending || channel->deadline_us < earliest))
+        {
+            earliest = channel->deadline_us;
+            pending  = true;
+        }
+    }
+
+    if (!pending)
+        sched->io.schedule(sched->io.ctx, -1);
+    else
+        sched->io.schedule(sched->io.ctx, earliest > now_us ? earliest - now_us : 0);
+}
+
+void pyro_sched_init(pyro_sched_t *sched, const pyro_io_t *io, uint32_t hold_us, uint32_t arm_timeout_us)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->io             = *io;
+    sched->hold_us        = hold_us;
+    sched->arm_timeout_us = arm_timeout_us;
+    for (uint8_t ch = 0; ch < PYRO_SCHED_CHANNELS; ch++)
+        sched->io.set_output(sched->io.ctx, ch, false);
+}
+
+pyro_result_t pyro_sched_arm(pyro_sched_t *sched, uint8_t channel)
+{
+    if (channel >= PYRO_SCHED_CHANNELS)
+        return PYRO_ERR_CHANNEL;
+    pyro_channel_t *ch = &sched->channels[channel];
+    if (ch->state == PYRO_CHANNEL_FIRING || ch->state == PYRO_CHANNEL_FIRED)
+        return PYRO_ERR_ALREADY_FIRED;
+
+    int64_t now_us  = sched->io.now_us(sched->io.ctx);
+    ch->state       = PYRO_CHANNEL_ARMED;
+    ch->deadline_us = now_us + sched->arm_timeout_us;
+    reschedule(sched, now_us);
+    return PYRO_OK;
+}
+
+pyro_result_t pyro_sched_disarm(pyro_sched_t *sched, uint8_t channel)
+{
+    if (channel >= PYRO_SCHED_CHANNELS)
+        return PYRO_ERR_CHANNEL;
+    pyro_channel_t *ch = &sched->channels[channel];
+    if (ch->state == PYRO_CHANNEL_FIRING)
+    {
+        sched->io.set_output(sched->io.ctx, channel, false);
+        ch->state = PYRO_CHANNEL_FIRED;
+    }
+    else if (ch->state == PYRO_CHANNEL_ARMED)
+    {
+        ch->state = PYRO_CHANNEL_DISARMED;
+    }
+    reschedule(sched, sched->io.now_us(sched->io.ctx));
+    return PYRO_OK;
+}
+
+pyro_result_t pyro_sched_fire(pyro_sched_t *sched, uint8_t channel, int64_t detect_us, pyro_fire_record_t *record)
+{
+    if (channel >= PYRO_SCHED_CHANNELS)
+        return PYRO_ERR_CHANNEL;
+    pyro_channel_t *ch = &sched->channels[channel];
+    if (ch->state == PYRO_CHANNEL_FIRING || ch->state == PYRO_CHANNEL_FIRED)
+        return PYRO_ERR_ALREADY_FIRED;
+    if (ch->state != PYRO_CHANNEL_ARMED)
+        return PYRO_ERR_NOT_ARMED;
+
+    // Edge first, the bookkeeping can wait
+    sched->io.set_output(sched->io.ctx, channel, true);
+    int64_t fire_us = sched->io.now_us(sched->io.ctx);
+
+    ch->state             = PYRO_CHANNEL_FIRING;
+    ch->deadline_us       = fire_us + sched->hold_us;
+    ch->record.channel    = channel;
+    ch->record.detect_us  = detect_us;
+    ch->record.fire_us    = fire_us;
+    ch->record.latency_us = fire_us - detect_us;
+    reschedule(sched, fire_us);
+
+    if (record)
+        *record = ch->record;
+    return PYRO_OK;
+}
+
+void pyro_sched_service(pyro_sched_t *sched)
+{
+    int64_t now_us = sched->io.now_us(sched->io.ctx);
+    for (uint8_t ch = 0; ch < PYRO_SCHED_CHANNELS; ch++)
+    {
+        pyro_channel_t *channel = &sched->channels[ch];
+        if (channel->deadline_us > now_us)
+            continue;
+
+        if (channel->state == PYRO_CHANNEL_FIRING)
+        {
+            sched->io.set_output(sched->io.ctx, ch, false);
+            channel->state = PYRO_CHANNEL_FIRED;
+        }
+        else if (channel->state == PYRO_CHANNEL_ARMED && sched->arm_timeout_us > 0)
+        {
+            channel->state = PYRO_CHANNEL_DISARMED;
+        }
+    }
+    reschedule(sched, now_us);
+}
+
+pyro_channel_state_t pyro_sched_state(const pyro_sched_t *sched, uint8_t channel)
+{
+    if (channel >= PYRO_SCHED_CHANNELS)
+        return PYRO_CHANNEL_DISARMED;
+    return sched->channels[channel].state;
+}
@@ -0,0 +1,140 @@
+#include "bean_servo.h"
+#include <math.h>
+#include "esp_log.h"
+#include "esp_check.h"
+#include "esp_timer.h"
+#include "driver/ledc.h"
+#include "freertos/FreeRTOS.h"
+#include "bean_context.h"
+#include "servo_slew.h"
+
+// LEDC channels 0 to 5 and timer 0 are used by the LEDs
+#define SERVO_LEDC_TIMER      LEDC_TIMER_1
+#define SERVO_LEDC_RESOLUTION LEDC_TIMER_14_BIT
+#define SERVO_FRAME_HZ        50
+#define SERVO_FRAME_US        (1000000 / SERVO_FRAME_HZ)
+
+static const char *TAG = "BEAN_SERVO";
+
+static const ledc_channel_t servo_ledc_channels[BEAN_SERVO_CHANNELS] = { LEDC_CHANNEL_6, LEDC_CHANNEL_7 };
+
+static servo_slew_t servos[BEAN_SERVO_CHANNELS];
+static portMUX_TYPE servo_lock       = portMUX_INITIALIZER_UNLOCKED;
+static esp_timer_handle_t slew_timer = NULL;
+static bool slewing                  = false; // The timer is armed or running, under servo_lock
+static bool initialized              = false;
+static uint32_t min_pulse_us         = 1000;
+static uint32_t max_pulse_us         = 2000;
+static float range_deg               = 180.0f;
+
+static uint32_t pulse_to_duty(uint32_t pulse_us)
+{
+    return (uint32_t)(((uint64_t)pulse_us << SERVO_LEDC_RESOLUTION) / SERVO_FRAME_US);
+}
+
+static void write_position(uint8_t index, float position_deg)
+{
+    uint32_t duty = pulse_to_duty(servo_pulse_us(position_deg, min_pulse_us, max_pulse_us, range_deg));
+    ledc_set_duty(LEDC_LOW_SPEED_MODE, servo_ledc_channels[index], duty);
+    ledc_update_duty(LEDC_LOW_SPEED_MODE, servo_ledc_channels[index]);
+}
+
+// One slew step per PWM frame, the servo can not follow faster anyway. The timer only runs while a servo moves, a
+// standing servo costs no wakeups
+static void slew_timer_callback(void *arg)
+{
+    for (uint8_t i = 0; i < BEAN_SERVO_CHANNELS; i++)
+    {
+        taskENTER_CRITICAL(&servo_lock);
+        float previous = servos[i].position_deg;
+        float position = servo_slew_step(&servos[i], 1.0f / SERVO_FRAME_HZ);
+        taskEXIT_CRITICAL(&servo_lock);
+
+        if (position != previous)
+            write_position(i, position);
+    }
+
+    // Checked again under the lock, a target set in the meantime must not be missed
+    taskENTER_CRITICAL(&servo_lock);
+    slewing = false;
+    for (uint8_t i = 0; i < BEAN_SERVO_CHANNELS; i++)
+        slewing |= servos[i].position_deg != servos[i].target_deg;
+    bool rearm = slewing;
+    taskEXIT_CRITICAL(&servo_lock);
+
+    if (rearm)
+        esp_timer_start_once(slew_timer, SERVO_FRAME_US);
+}
+
+esp_err_t bean_servo_init(void)
+{
+    const bean_config_bean_servo_t *config = &bean_config_get()->bean_servo;
+    float max_rate_dps                     = config->max_rate_dps;
+    float initial_deg                      = config->initial_deg;
+    min_pulse_us                           = (uint32_t)config->min_pulse_us;
+    max_pulse_us                           = (uint32_t)config->max_pulse_us;
+    range_deg                              = config->range_deg;
+
+    ledc_timer_config_t ledc_timer = { .speed_mode      = LEDC_LOW_SPEED_MODE,
+                                       .duty_resolution = SERVO_LEDC_RESOLUTION,
+                                       .timer_num       = SERVO_LEDC_TIMER,
+                                       .freq_hz         = SERVO_FRAME_HZ,
+                                       .clk_cfg         = LEDC_AUTO_CLK };
+    ESP_RETURN_ON_ERROR(ledc_timer_config(&ledc_timer), TAG, "Error configuring servo LEDC timer");
+
+    const gpio_num_t pins[BEAN_SERVO_CHANNELS] = { PIN_SERVO1, PIN_SERVO2 };
+    for (uint8_t i = 0; i < BEAN_SERVO_CHANNELS; i++)
+    {
+        servo_slew_init(&servos[i], initial_deg, max_rate_dps, 0.0f, range_deg);
+        ledc_channel_config_t ledc_conf = {
+            .channel    = servo_ledc_channels[i],
+            .duty       = pulse_to_duty(servo_pulse_us(initial_deg, min_pulse_us, max_pulse_us, range_deg)),
+            .gpio_num   = pins[i],
+            .intr_type  = LEDC_INTR_DISABLE,
+            .speed_mode = LEDC_LOW_SPEED_MODE,
+            .timer_sel  = SERVO_LEDC_TIMER,
+        };
+        ESP_RETURN_ON_ERROR(ledc_channel_config(&ledc_conf), TAG, "Error configuring servo %u", i + 1);
+    }
+
+    const esp_timer_create_args_t timer_args = { .callback = slew_timer_callback, .name = "servo_slew" };
+    ESP_RETURN_ON_ERROR(esp_timer_create(&timer_args, &slew_timer), TAG, "Error creating slew timer");
+
+    initialized = true;
+    ESP_LOGI(TAG,
+             "Servos %lu-%lu us over %.0f deg, max %.0f deg/s",
+             min_pulse_us,
+             max_pulse_us,
+             range_deg,
+             max_rate_dps);
+    return ESP_OK;
+}
+
+esp_err_t bean_servo_set(uint8_t channel, float position_deg)
+{
+    if (channel < 1 || channel > BEAN_SERVO_CHANNELS)
+        return ESP_ERR_INVALID_ARG;
+    if (!initialized)
+        return ESP_ERR_INVALID_STATE;
+
+    taskENTER_CRITICAL(&servo_lock);
+    servo_slew_set_target(&servos[channel - 1], position_deg);
+    bool start = !slewing && servos[channel - 1].position_deg != servos[channel - 1].target_deg;
+    slewing |= start;
+    taskEXIT_CRITICAL(&servo_lock);
+
+    if (start)
+        ESP_RETURN_ON_ERROR(esp_timer_start_once(slew_timer, SERVO_FRAME_US), TAG, "Error starting slew timer");
+    return ESP_OK;
+}
+
+float bean_servo_get(uint8_t channel)
+{
+    if (channel < 1 || channel > BEAN_SERVO_CHANNELS)
+        return NAN;
+
+    taskENTER_CRITICAL(&servo_lock);
+    float position = servos[channel - 1].position_deg;
+    taskEXIT_CRITICAL(&servo_lock);
+    return position;
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+#define BEAN_SERVO_CHANNELS 2 // Channel 1 is PIN_SERVO1, channel 2 is PIN_SERVO2
+
+/**
+ * @brief Sets up the servo PWM outputs and the slew timer.
+ *
+ * Reads `bean_servo` from the config store. The servos hold their `initial_deg` position until commanded.
+ *
+ * @return ESP_OK on success
+ */
+esp_err_t bean_servo_init(void);
+
+/**
+ * @brief Commands a servo position. Does not block, the servo moves there at most at `bean_servo.max_rate_dps`.
+ *
+ * @param channel 1 or 2
+ * @param position_deg Target position, clamped to 0 .. `bean_servo.range_deg`
+ * @return ESP_OK on success, ESP_ERR_INVALID_ARG for an unknown channel
+ */
+esp_err_t bean_servo_set(uint8_t channel, float position_deg);
+
+/**
+ * @brief Gets the position currently sent to a servo, NAN for an unknown channel.
+ */
+float bean_servo_get(uint8_t channel);
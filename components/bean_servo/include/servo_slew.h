@@ -0,0 +1,37 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Slew rate limiter of one servo: the commanded target is followed at a bounded angular rate.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+typedef struct servo_slew
+{
+    float position_deg; // Position sent to the servo
+    float target_deg; // Last commanded position
+    float max_rate_dps; // 0 disables the limit
+    float min_deg;
+    float max_deg;
+} servo_slew_t;
+
+void servo_slew_init(servo_slew_t *slew, float initial_deg, float max_rate_dps, float min_deg, float max_deg);
+
+/**
+ * @brief Sets the target, clamped to the range of the servo.
+ */
+void servo_slew_set_target(servo_slew_t *slew, float target_deg);
+
+/**
+ * @brief Moves the position towards the target by at most max_rate_dps * dt_s.
+ *
+ * @return The new position
+ */
+float servo_slew_step(servo_slew_t *slew, float dt_s);
+
+/**
+ * @brief Maps a position to a pulse width, linear between min_pulse_us at 0 deg and max_pulse_us at range_deg.
+ */
+uint32_t servo_pulse_us(float position_deg, uint32_t min_pulse_us, uint32_t max_pulse_us, float range_deg);
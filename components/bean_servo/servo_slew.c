@@ -0,0 +1,44 @@
+#include "servo_slew.h"
+
+static float clamp(float value, float min, float max)
+{
+    if (value < min)
+        return min;
+    if (value > max)
+        return max;
+    return value;
+}
+
+void servo_slew_init(servo_slew_t *slew, float initial_deg, float max_rate_dps, float min_deg, float max_deg)
+{
+    slew->min_deg      = min_deg;
+    slew->max_deg      = max_deg;
+    slew->max_rate_dps = max_rate_dps;
+    slew->position_deg = clamp(initial_deg, min_deg, max_deg);
+    slew->target_deg   = slew->position_deg;
+}
+
+void servo_slew_set_target(servo_slew_t *slew, float target_deg)
+{
+    slew->target_deg = clamp(target_deg, slew->min_deg, slew->max_deg);
+}
+
+float servo_slew_step(servo_slew_t *slew, float dt_s)
+{
+    float error = slew->target_deg - slew->position_deg;
+    float limit = slew->max_rate_dps * dt_s;
+
+    if (slew->max_rate_dps <= 0.0f || (error <= limit && error >= -limit))
+        slew->position_deg = slew->target_deg;
+    else
+        slew->position_deg += error > 0.0f ? limit : -limit;
+    return slew->position_deg;
+}
+
+uint32_t servo_pulse_us(float position_deg, uint32_t min_pulse_us, uint32_t max_pulse_us, float range_deg)
+{
+    if (range_deg <= 0.0f)
+        return min_pulse_us;
+    float fraction = clamp(position_deg / range_deg, 0.0f, 1.0f);
+    return min_pulse_us + (uint32_t)(fraction * (float)(max_pulse_us - min_pulse_us) + 0.5f);
+}
@@ -1,5 +1,6 @@
 #include "bean_storage.h"
 #include "bean_context.h"
+#include "bean_metrics.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -14,16 +15,22 @@
 #include "bean_storage_usb.h"
 #include "sys/dirent.h"
 #include "bean_storage_logger.h"
+#include "esp_timer.h"
+#include "esp_rom_crc.h"
 
-#define HOST_ID      SPI2_HOST //SPI3_HOST
-#define SPI_DMA_CHAN SPI_DMA_CH_AUTO
+#define HOST_ID           SPI2_HOST //SPI3_HOST
+#define SPI_DMA_CHAN      SPI_DMA_CH_AUTO
+#define FLASH_IO_MODE     SPI_FLASH_DIO
+#define FLASH_IO_MODE_STR "dio"
+#define FLASH_FREQ_MHZ    40
 
 static esp_flash_t *flash;
 const char *partition_label = "storage";
 
-static const char *TAG         = "BEAN_STORAGE";
-const char *base_path          = STORAGE_BASE_PATH;
-static wl_handle_t s_wl_handle = WL_INVALID_HANDLE;
+static const char *TAG           = "BEAN_STORAGE";
+const char *base_path            = STORAGE_BASE_PATH;
+static wl_handle_t s_wl_handle   = WL_INVALID_HANDLE;
+static uint32_t config_file_hash = 0; // Hash of conf.json as it was loaded or last saved
 
 TaskHandle_t storage_data_logger_task_handle, storage_event_logger_task_handle;
 esp_err_t init_config_file(bean_context_t *ctx);
@@ -42,8 +49,8 @@ static esp_flash_t *init_ext_flash(void)
         .host_id   = HOST_ID,
         .cs_id     = 0,
         .cs_io_num = PIN_FLASH_CS,
-        .io_mode   = SPI_FLASH_DIO,
-        .freq_mhz  = 40,
+        .io_mode   = FLASH_IO_MODE,
+        .freq_mhz  = FLASH_FREQ_MHZ,
     };
 
     ESP_LOGI(TAG, "Initializing external SPI Flash");
@@ -116,7 +123,7 @@ static bool mount_fatfs(const char *partition_label)
     return true;
 }
 
-esp_err_t bean_storage_init(bean_context_t *ctx)
+static esp_err_t mount_storage(void)
 {
     // Set up SPI bus and initialize the external SPI Flash chip
     flash = init_ext_flash();
@@ -133,19 +140,11 @@ esp_err_t bean_storage_init(bean_context_t *ctx)
         ESP_LOGE(TAG, "Failed to mount FATFS");
         return ESP_FAIL;
     }
+    return ESP_OK;
+}
 
-    if (init_config_file(ctx) != ESP_OK)
-    {
-        ESP_LOGE(TAG, "Failed to initialize configuration");
-        return ESP_FAIL;
-    }
-
-    if (bean_storage_logger_init() != ESP_OK)
-    {
-        ESP_LOGE(TAG, "Failed to initialize storage logger");
-        return ESP_FAIL;
-    }
-
+static void start_loggers(bean_context_t *ctx)
+{
     xTaskCreate(&vtask_data_log_handler,
                 "data_log_handler",
                 4096,
@@ -158,9 +157,61 @@ esp_err_t bean_storage_init(bean_context_t *ctx)
                 (void *)ctx,
                 tskIDLE_PRIORITY,
                 &storage_event_logger_task_handle);
+    bean_metrics_watch_task(storage_data_logger_task_handle);
+    bean_metrics_watch_task(storage_event_logger_task_handle);
+}
+
+esp_err_t bean_storage_init(bean_context_t *ctx)
+{
+    if (mount_storage() != ESP_OK)
+        return ESP_FAIL;
+
+    if (init_config_file(ctx) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to initialize configuration");
+        return ESP_FAIL;
+    }
+
+    if (bean_storage_logger_init() != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to initialize storage logger");
+        return ESP_FAIL;
+    }
+
+    start_loggers(ctx);
     return ESP_OK;
 }
 
+esp_err_t bean_storage_resume(bean_context_t *ctx, int log_number, uint32_t config_hash)
+{
+    // The checkpoints keep the key of the snapshot, so a second reset in the same flight resumes as well
+    config_file_hash = config_hash;
+    if (mount_storage() != ESP_OK)
+        return ESP_FAIL;
+
+    bean_storage_logger_resume(log_number);
+    start_loggers(ctx);
+    return ESP_OK;
+}
+
+uint32_t bean_storage_config_hash(void)
+{
+    return config_file_hash;
+}
+
+esp_err_t bean_storage_flash_info(bean_storage_flash_info_t *info)
+{
+    if (flash == NULL)
+        return ESP_ERR_INVALID_STATE;
+
+    *info = (bean_storage_flash_info_t){
+        .size     = flash->size,
+        .io_mode  = FLASH_IO_MODE_STR,
+        .freq_mhz = FLASH_FREQ_MHZ,
+    };
+    return esp_flash_read_id(flash, &info->id);
+}
+
 esp_err_t storage_write_file(char *filename, const char *data)
 {
     char *abs_filename = malloc(strlen(base_path) + strlen(filename) + 2);
@@ -277,9 +328,8 @@ static char *trim_whitespace(char *str)
     return str;
 }
 
-static esp_err_t write_config_file(bean_context_t *ctx, const char *filename)
+static esp_err_t write_config_file(const cJSON *conf, const char *filename, uint32_t *file_hash)
 {
-    const cJSON *conf = config_store_get();
     if (conf == NULL)
     {
         ESP_LOGE(TAG, "Failed to get config from context");
@@ -297,19 +347,21 @@ static esp_err_t write_config_file(bean_context_t *ctx, const char *filename)
     if (f == NULL)
     {
         ESP_LOGE(TAG, "Failed to open config file for writing");
-        free(json_string);
+        cJSON_free(json_string);
         return ESP_FAIL;
     }
 
     // Write all config values
+    size_t length = strlen(json_string);
     fprintf(f, "%s", json_string);
     fclose(f);
-    free(json_string);
+    *file_hash = esp_rom_crc32_le(0, (const uint8_t *)json_string, length);
+    cJSON_free(json_string);
 
     return ESP_OK;
 }
 
-static esp_err_t read_config_file(const char *filename, cJSON **config_json)
+static esp_err_t read_config_file(const char *filename, char **contents, size_t *length)
 {
 
     FILE *f = fopen(filename, "r");
@@ -352,44 +404,57 @@ static esp_err_t read_config_file(const char *filename, cJSON **config_json)
     }
 
     json_buffer[file_size] = '\0';
-
-    // Parse JSON
-    *config_json = cJSON_Parse(json_buffer);
-    free(json_buffer);
-
-    if (*config_json == NULL)
-    {
-        ESP_LOGE(TAG, "Failed to parse config file as JSON");
-        return ESP_FAIL;
-    }
-
+    *contents              = json_buffer;
+    *length                = (size_t)file_size;
     return ESP_OK;
 }
 
-esp_err_t init_config_file(bean_context_t *ctx)
+static esp_err_t load_config_file(bean_context_t *ctx)
 {
+    int64_t start_us   = esp_timer_get_time();
     char *abs_filename = malloc(strlen(base_path) + strlen(CONFIG_FILE_NAME) + 2);
     strcpy(abs_filename, base_path);
     strcat(abs_filename, "/");
     strcat(abs_filename, CONFIG_FILE_NAME);
 
-    cJSON *config_json        = NULL;
+    char *contents            = NULL;
+    size_t length             = 0;
+    uint32_t file_hash        = 0;
     bool needs_storage_update = true;
 
-    if (read_config_file(abs_filename, &config_json) == ESP_OK)
+    if (read_config_file(abs_filename, &contents, &length) == ESP_OK)
     {
-        // Merge the loaded JSON config with bean context
-        config_merge_result_t result = bean_context_initialize_config(config_json);
-
-        ESP_LOGI(TAG,
-                 "Config loaded: %d items updated, %d ignored, %d type mismatches",
-                 result.items_updated,
-                 result.items_ignored,
-                 result.type_mismatches);
-
-        // Clean up the JSON object
-        // cJSON_Delete(config_json); // crashes
-        needs_storage_update = result.needs_storage_update;
+        // Fast path: the file did not change since the last boot, take the merged config from NVS
+        file_hash = esp_rom_crc32_le(0, (const uint8_t *)contents, length);
+        if (bean_context_load_config_snapshot(file_hash) == ESP_OK)
+        {
+            ESP_LOGI(TAG, "Config unchanged, loaded from snapshot in %lld us", esp_timer_get_time() - start_us);
+            config_file_hash = file_hash;
+            free(contents);
+            free(abs_filename);
+            return ESP_OK;
+        }
+
+        cJSON *config_json = cJSON_Parse(contents);
+        if (config_json)
+        {
+            // Merge the loaded JSON config with bean context
+            config_merge_result_t result = bean_context_initialize_config(config_json);
+
+            ESP_LOGI(TAG,
+                     "Config loaded: %d items updated, %d ignored, %d type mismatches",
+                     result.items_updated,
+                     result.items_ignored,
+                     result.type_mismatches);
+
+            cJSON_Delete(config_json);
+            needs_storage_update = result.needs_storage_update;
+        }
+        else
+        {
+            ESP_LOGE(TAG, "Failed to parse config file as JSON");
+        }
+        free(contents);
     }
     else
     {
@@ -399,7 +464,7 @@ esp_err_t init_config_file(bean_context_t *ctx)
     if (needs_storage_update)
     {
         // Write default config file
-        if (write_config_file(ctx, abs_filename) != ESP_OK)
+        if (write_config_file(config_store_get(), abs_filename, &file_hash) != ESP_OK)
         {
             ESP_LOGE(TAG, "Failed to create default config file");
             free(abs_filename);
@@ -407,10 +472,46 @@ esp_err_t init_config_file(bean_context_t *ctx)
         }
     }
 
+    if (bean_context_store_config_snapshot(file_hash) != ESP_OK)
+        ESP_LOGW(TAG, "Failed to store config snapshot, the next boot parses the file again");
+    config_file_hash = file_hash;
+
+    ESP_LOGI(TAG, "Config parsed and merged in %lld us", esp_timer_get_time() - start_us);
     free(abs_filename);
     return ESP_OK;
 }
 
+esp_err_t init_config_file(bean_context_t *ctx)
+{
+    // The cJSON trees only live in the session arena, released in one go once the typed config is decoded
+    bean_context_config_begin();
+    esp_err_t ret = load_config_file(ctx);
+    bean_context_config_end();
+    return ret;
+}
+
+esp_err_t bean_storage_save_config(void)
+{
+    char abs_filename[sizeof(STORAGE_BASE_PATH) + sizeof(CONFIG_FILE_NAME) + 1];
+    snprintf(abs_filename, sizeof(abs_filename), "%s/%s", base_path, CONFIG_FILE_NAME);
+
+    // The running config may hold live patches, so the file is written from the typed config and not the merged tree
+    bean_context_config_begin();
+    cJSON *conf        = bean_config_encode(bean_config_get());
+    uint32_t file_hash = 0;
+    esp_err_t ret      = write_config_file(conf, abs_filename, &file_hash);
+    cJSON_Delete(conf);
+    bean_context_config_end();
+    if (ret != ESP_OK)
+        return ret;
+
+    if (bean_context_store_config_snapshot(file_hash) != ESP_OK)
+        ESP_LOGW(TAG, "Failed to store config snapshot, the next boot parses the file again");
+    config_file_hash = file_hash;
+    ESP_LOGI(TAG, "Config saved to %s", abs_filename);
+    return ESP_OK;
+}
+
 esp_err_t storage_enable_usb_msc(void)
 {
     ESP_LOGI(TAG, "Enabling USB MSC");
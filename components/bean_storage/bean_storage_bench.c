@@ -0,0 +1,338 @@
+#include "bean_storage_bench.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/unistd.h>
+#include "cJSON.h"
+#include "esp_idf_version.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_vfs_fat.h"
+#include "sdkconfig.h"
+#include "bean_power.h"
+#include "bean_storage.h"
+
+#define BENCH_MAX_RECORDS      16384 // Latency samples per run, a run stops once they are taken
+#define BENCH_MAX_RECORD_SIZE  4096
+#define BENCH_FREE_MARGIN      (64 * 1024) // Left free on the volume next to a run, for the logs
+#define BENCH_DEFAULT_RUN_KB   256
+#define BENCH_DEFAULT_STALL_US 20000
+
+static const char *TAG = "BEAN_STORAGE_BENCH";
+
+static const char *sync_names[BEAN_STORAGE_BENCH_SYNC_COUNT] = {
+    [BEAN_STORAGE_BENCH_SYNC_CLOSE]    = "close",
+    [BEAN_STORAGE_BENCH_SYNC_PERIODIC] = "periodic",
+    [BEAN_STORAGE_BENCH_SYNC_RECORD]   = "record",
+};
+
+typedef struct bench_result
+{
+    uint32_t record_size;
+    uint32_t buffer_size;
+    bean_storage_bench_sync_t sync;
+    uint32_t records;
+    uint32_t bytes;
+    uint32_t elapsed_us; // From the open to the end of the close
+    uint32_t p50_us; // Latency of a record: its fwrite and the sync that followed it, if any
+    uint32_t p99_us;
+    uint32_t max_us;
+    uint32_t stalls; // Records above the stall threshold
+    uint32_t stall_total_us;
+    uint32_t syncs;
+    uint32_t sync_max_us;
+    uint32_t close_us;
+} bench_result_t;
+
+void bean_storage_bench_default_plan(bean_storage_bench_plan_t *plan)
+{
+    *plan = (bean_storage_bench_plan_t){
+        .record_sizes      = { 32, 128, 512 },
+        .record_size_count = 3,
+        .buffer_sizes      = { 0, 4096, 16384 },
+        .buffer_size_count = 3,
+        .syncs             = { BEAN_STORAGE_BENCH_SYNC_CLOSE,
+                               BEAN_STORAGE_BENCH_SYNC_PERIODIC,
+                               BEAN_STORAGE_BENCH_SYNC_RECORD },
+        .sync_count        = 3,
+        .run_bytes         = BENCH_DEFAULT_RUN_KB * 1024,
+        .stall_us          = BENCH_DEFAULT_STALL_US,
+    };
+}
+
+const char *bean_storage_bench_sync_name(bean_storage_bench_sync_t sync)
+{
+    return sync < BEAN_STORAGE_BENCH_SYNC_COUNT ? sync_names[sync] : "unknown";
+}
+
+static int compare_latency(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest rank of a sorted array
+static uint32_t percentile(const uint32_t *sorted, uint32_t count, uint32_t percent)
+{
+    if (count == 0)
+        return 0;
+    uint32_t rank = (count * percent + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+// Looks like a line of the data log: digits and commas, ending in a newline
+static void fill_record(char *record, uint32_t size)
+{
+    for (uint32_t i = 0; i + 1 < size; i++)
+        record[i] = i % 8 == 7 ? ',' : (char)('0' + i % 10);
+    record[size - 1] = '\n';
+}
+
+static esp_err_t run_once(const char *path,
+                          const bean_storage_bench_plan_t *plan,
+                          const char *record,
+                          uint32_t *latencies,
+                          bench_result_t *result)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return ESP_FAIL;
+    }
+    if (result->buffer_size == 0)
+        setvbuf(file, NULL, _IONBF, 0);
+    else
+        setvbuf(file, NULL, _IOFBF, result->buffer_size);
+
+    bool ok               = true;
+    int64_t start_us      = esp_timer_get_time();
+    int64_t last_sync_us  = start_us;
+    int64_t run_max_us    = (int64_t)BEAN_STORAGE_BENCH_RUN_MAX_MS * 1000;
+    int64_t sync_every_us = (int64_t)BEAN_STORAGE_FLUSH_INTERVAL_MS * 1000;
+    while (ok && result->bytes < plan->run_bytes && result->records < BENCH_MAX_RECORDS)
+    {
+        int64_t write_us = esp_timer_get_time();
+        if (write_us - start_us > run_max_us)
+            break;
+
+        ok = fwrite(record, 1, result->record_size, file) == result->record_size;
+        if (ok && (result->sync == BEAN_STORAGE_BENCH_SYNC_RECORD ||
+                   (result->sync == BEAN_STORAGE_BENCH_SYNC_PERIODIC && write_us - last_sync_us >= sync_every_us)))
+        {
+            int64_t sync_us = esp_timer_get_time();
+            ok              = fflush(file) == 0 && fsync(fileno(file)) == 0;
+            uint32_t took   = (uint32_t)(esp_timer_get_time() - sync_us);
+            if (took > result->sync_max_us)
+                result->sync_max_us = took;
+            result->syncs++;
+            last_sync_us = sync_us;
+        }
+
+        uint32_t latency_us          = (uint32_t)(esp_timer_get_time() - write_us);
+        latencies[result->records++] = latency_us;
+        result->bytes += result->record_size;
+        if (latency_us > plan->stall_us)
+        {
+            result->stalls++;
+            result->stall_total_us += latency_us;
+        }
+    }
+
+    int64_t close_us = esp_timer_get_time();
+    if (fclose(file) != 0)
+        ok = false;
+    int64_t end_us     = esp_timer_get_time();
+    result->close_us   = (uint32_t)(end_us - close_us);
+    result->elapsed_us = (uint32_t)(end_us - start_us);
+    unlink(path);
+
+    qsort(latencies, result->records, sizeof(uint32_t), compare_latency);
+    result->p50_us = percentile(latencies, result->records, 50);
+    result->p99_us = percentile(latencies, result->records, 99);
+    result->max_us = result->records > 0 ? latencies[result->records - 1] : 0;
+
+    if (!ok)
+        ESP_LOGE(TAG, "Write to %s failed after %lu bytes", path, result->bytes);
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+// Bytes per us are MB/s
+static double mb_per_s(const bench_result_t *result)
+{
+    return result->elapsed_us > 0 ? (double)result->bytes / result->elapsed_us : 0.0;
+}
+
+static void print_result(const bench_result_t *result)
+{
+    printf("%6lu %6lu %-8s %7lu %6.3f %8lu %8lu %8lu %6lu %6lu %8lu\n",
+           result->record_size,
+           result->buffer_size,
+           sync_names[result->sync],
+           result->records,
+           mb_per_s(result),
+           result->p50_us,
+           result->p99_us,
+           result->max_us,
+           result->stalls,
+           result->syncs,
+           result->sync_max_us);
+}
+
+static cJSON *encode_result(const bench_result_t *result)
+{
+    cJSON *run = cJSON_CreateObject();
+    cJSON_AddNumberToObject(run, "record_size", result->record_size);
+    cJSON_AddNumberToObject(run, "buffer_size", result->buffer_size);
+    cJSON_AddStringToObject(run, "sync", sync_names[result->sync]);
+    cJSON_AddNumberToObject(run, "records", result->records);
+    cJSON_AddNumberToObject(run, "bytes", result->bytes);
+    cJSON_AddNumberToObject(run, "elapsed_us", result->elapsed_us);
+    cJSON_AddNumberToObject(run, "mb_per_s", mb_per_s(result));
+    cJSON_AddNumberToObject(run, "p50_us", result->p50_us);
+    cJSON_AddNumberToObject(run, "p99_us", result->p99_us);
+    cJSON_AddNumberToObject(run, "max_us", result->max_us);
+    cJSON_AddNumberToObject(run, "stalls", result->stalls);
+    cJSON_AddNumberToObject(run, "stall_total_us", result->stall_total_us);
+    cJSON_AddNumberToObject(run, "syncs", result->syncs);
+    cJSON_AddNumberToObject(run, "sync_max_us", result->sync_max_us);
+    cJSON_AddNumberToObject(run, "close_us", result->close_us);
+    return run;
+}
+
+// The flash and the stack under test, to tell the files of different boards and builds apart
+static cJSON *encode_setup(const bean_storage_bench_plan_t *plan)
+{
+    cJSON *setup = cJSON_CreateObject();
+    bean_storage_flash_info_t flash;
+    if (bean_storage_flash_info(&flash) == ESP_OK)
+    {
+        cJSON *chip = cJSON_AddObjectToObject(setup, "flash");
+        cJSON_AddNumberToObject(chip, "id", flash.id);
+        cJSON_AddNumberToObject(chip, "size", flash.size);
+        cJSON_AddStringToObject(chip, "io_mode", flash.io_mode);
+        cJSON_AddNumberToObject(chip, "freq_mhz", flash.freq_mhz);
+    }
+    cJSON_AddStringToObject(setup, "backend", "fatfs+wl");
+    cJSON_AddNumberToObject(setup, "sector_size", CONFIG_WL_SECTOR_SIZE);
+    cJSON_AddNumberToObject(setup, "cpu_mhz", CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ);
+    cJSON_AddStringToObject(setup, "idf", esp_get_idf_version());
+    cJSON_AddNumberToObject(setup, "run_bytes", plan->run_bytes);
+    cJSON_AddNumberToObject(setup, "stall_us", plan->stall_us);
+    cJSON_AddNumberToObject(setup, "uptime_ms", (double)(esp_timer_get_time() / 1000));
+    return setup;
+}
+
+static esp_err_t write_json(const char *path, cJSON *report)
+{
+    char *text = cJSON_Print(report);
+    if (text == NULL)
+        return ESP_ERR_NO_MEM;
+
+    FILE *file = fopen(path, "w");
+    bool ok    = file != NULL && fputs(text, file) >= 0;
+    if (file != NULL && fclose(file) != 0)
+        ok = false;
+    cJSON_free(text);
+    if (!ok)
+    {
+        ESP_LOGE(TAG, "Failed to write %s", path);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t check_plan(const bean_storage_bench_plan_t *plan)
+{
+    if (plan->record_size_count == 0 || plan->buffer_size_count == 0 || plan->sync_count == 0 || plan->run_bytes == 0)
+        return ESP_ERR_INVALID_ARG;
+    for (int i = 0; i < plan->record_size_count; i++)
+    {
+        if (plan->record_sizes[i] == 0 || plan->record_sizes[i] > BENCH_MAX_RECORD_SIZE)
+            return ESP_ERR_INVALID_ARG;
+    }
+    for (int i = 0; i < plan->sync_count; i++)
+    {
+        if (plan->syncs[i] >= BEAN_STORAGE_BENCH_SYNC_COUNT)
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    uint64_t total_bytes = 0;
+    uint64_t free_bytes  = 0;
+    if (esp_vfs_fat_info(STORAGE_BASE_PATH, &total_bytes, &free_bytes) != ESP_OK)
+        return ESP_ERR_INVALID_STATE;
+    if (free_bytes < (uint64_t)plan->run_bytes + BENCH_FREE_MARGIN)
+    {
+        ESP_LOGE(TAG, "Only %llu bytes free, a run needs %lu", free_bytes, plan->run_bytes + BENCH_FREE_MARGIN);
+        return ESP_ERR_NO_MEM;
+    }
+    return ESP_OK;
+}
+
+esp_err_t bean_storage_bench(const bean_storage_bench_plan_t *plan, const char *json_path)
+{
+    esp_err_t ret = check_plan(plan);
+    if (ret != ESP_OK)
+        return ret;
+
+    uint32_t *latencies = malloc(BENCH_MAX_RECORDS * sizeof(uint32_t));
+    char *record        = malloc(BENCH_MAX_RECORD_SIZE);
+    cJSON *report       = cJSON_CreateObject();
+    if (latencies == NULL || record == NULL || report == NULL)
+    {
+        free(latencies);
+        free(record);
+        cJSON_Delete(report);
+        return ESP_ERR_NO_MEM;
+    }
+    cJSON_AddItemToObject(report, "setup", encode_setup(plan));
+    cJSON *runs = cJSON_AddArrayToObject(report, "runs");
+
+    // The full clock for every run, the pad mode would otherwise measure its clock changes as well
+    bean_power_acquire(BEAN_POWER_LOCK_STORAGE);
+    printf("%6s %6s %-8s %7s %6s %8s %8s %8s %6s %6s %8s\n",
+           "record",
+           "buffer",
+           "sync",
+           "records",
+           "MB/s",
+           "p50_us",
+           "p99_us",
+           "max_us",
+           "stalls",
+           "syncs",
+           "sync_max");
+    for (int r = 0; r < plan->record_size_count && ret == ESP_OK; r++)
+    {
+        fill_record(record, plan->record_sizes[r]);
+        for (int b = 0; b < plan->buffer_size_count && ret == ESP_OK; b++)
+        {
+            for (int s = 0; s < plan->sync_count && ret == ESP_OK; s++)
+            {
+                bench_result_t result = {
+                    .record_size = plan->record_sizes[r],
+                    .buffer_size = plan->buffer_sizes[b],
+                    .sync        = plan->syncs[s],
+                };
+                ret = run_once(STORAGE_BASE_PATH "/" BEAN_STORAGE_BENCH_FILE_NAME, plan, record, latencies, &result);
+                if (ret == ESP_OK)
+                {
+                    print_result(&result);
+                    cJSON_AddItemToArray(runs, encode_result(&result));
+                }
+            }
+        }
+    }
+    bean_power_release(BEAN_POWER_LOCK_STORAGE);
+
+    if (ret == ESP_OK)
+        ret = write_json(json_path, report);
+    if (ret == ESP_OK)
+        ESP_LOGI(TAG, "Results written to %s", json_path);
+    cJSON_Delete(report);
+    free(record);
+    free(latencies);
+    return ret;
+}
@@ -1,26 +1,30 @@
 #include "bean_context.h"
 #include "bean_storage.h"
-#include "esp_log.h"
-#include "freertos/idf_additions.h"
-#include "portmacro.h"
-#include "projdefs.h"
-#include "sys/dirent.h"
+#include "bean_power.h"
+#include "bean_metrics.h"
+#include "bean_trace.h"
+#include "bean_hal.h"
 #include <ctype.h>
+#include <dirent.h>
+#include <inttypes.h>
 #include <stdint.h>
 #include <stdio.h>
-#include <sys/unistd.h>
+#include <stdlib.h>
+#include <string.h>
 
 static const char *TAG      = "BEAN_STORAGE_LOGGER";
 static int log_number       = 0;
 static FILE *data_log_file  = NULL;
 static FILE *event_log_file = NULL;
+static volatile bool logs_closed = false; // Set by the event logger once it handled EVENT_ID_LOG_CLOSE
+static bool logs_resumed         = false; // The files already have their headers from before a warm reset
 
 int get_next_log_number(void)
 {
-    DIR *dir = opendir(STORAGE_BASE_PATH);
+    DIR *dir = bean_hal_opendir(STORAGE_BASE_PATH);
     if (dir == NULL)
     {
-        ESP_LOGE(TAG, "Failed to open directory");
+        BEAN_LOGE(TAG, "Failed to open directory");
         return 0; // Start with 1 if directory can't be opened
     }
 
@@ -36,7 +40,7 @@ int get_next_log_number(void)
         {
             lowercase_name[i] = tolower(lowercase_name[i]);
         }
-        ESP_LOGI(TAG, "Found file: %s", lowercase_name);
+        BEAN_LOGI(TAG, "Found file: %s", lowercase_name);
         if (strstr(lowercase_name, "log_") == lowercase_name && strstr(lowercase_name, ".csv") != NULL)
         {
 
@@ -59,35 +63,96 @@ esp_err_t bean_storage_logger_init()
 {
 
     log_number = get_next_log_number();
-    ESP_LOGI(TAG, "Using log_number %u", log_number);
+    BEAN_LOGI(TAG, "Using log_number %u", log_number);
 
     return ESP_OK;
 }
 
+esp_err_t bean_storage_logger_resume(int number)
+{
+    // No directory scan, the files of the interrupted flight are appended to
+    log_number   = number;
+    logs_resumed = true;
+    BEAN_LOGI(TAG, "Resuming log_number %u", log_number);
+    return ESP_OK;
+}
+
+int bean_storage_log_number(void)
+{
+    return log_number;
+}
+
+esp_err_t bean_storage_logger_close(bean_context_t *ctx)
+{
+    // Goes through the event queue so everything logged before it still ends up in the file
+    return bean_context_log_event(ctx, EVENT_ID_LOG_CLOSE, "closing logs");
+}
+
+bool bean_storage_logs_closed(void)
+{
+    // The data log closes last, once its queue ran empty
+    return logs_closed && data_log_file == NULL;
+}
+
+// The flash write of a sync blocks the logger, its duration goes to bean_metrics
+static void sync_log_file(FILE *file)
+{
+    int64_t start_us = bean_hal_time_us();
+    BEAN_TRACE(BEAN_TRACE_FLASH_WRITE_BEGIN, file == event_log_file);
+    bean_hal_fsync(file);
+    BEAN_TRACE(BEAN_TRACE_FLASH_WRITE_END, file == event_log_file);
+    bean_metrics_add(BEAN_METRIC_FSYNCS, 1);
+    bean_metrics_peak(BEAN_METRIC_FSYNC_MAX_US, (uint32_t)(bean_hal_time_us() - start_us));
+}
+
+static void close_log_file(FILE **file)
+{
+    if (*file == NULL)
+        return;
+    bean_power_acquire(BEAN_POWER_LOCK_STORAGE);
+    sync_log_file(*file);
+    fclose(*file);
+    *file = NULL;
+    bean_power_release(BEAN_POWER_LOCK_STORAGE);
+}
+
 void vtask_data_log_handler(void *pvParameter)
 {
     bean_context_t *ctx = (bean_context_t *)pvParameter;
     log_data_t received_data;
     bool initialized = false, has_written = false;
-    TickType_t last_sync_tick    = 0;
-    uint16_t sync_tick_threshold = pdMS_TO_TICKS(BEAN_STORAGE_FLUSH_INTERVAL_MS);
+    uint32_t last_sync_ms = 0;
 
     while (1)
     {
-        if (xQueueReceive(ctx->data_log_queue, &received_data, sync_tick_threshold) == pdTRUE)
+        if (!bean_hal_queue_receive(ctx->data_log_queue, &received_data, BEAN_STORAGE_FLUSH_INTERVAL_MS))
+        {
+            // Only close once the queue is drained, so samples taken before the close are kept
+            if (logs_closed && data_log_file != NULL)
+            {
+                close_log_file(&data_log_file);
+                has_written = false;
+                BEAN_LOGI(TAG, "Data log closed");
+            }
+        }
+        else
         {
+            // The sample just taken counts, the queue was one fuller before
+            bean_metrics_peak(BEAN_METRIC_DATA_QUEUE_PEAK, bean_hal_queue_waiting(ctx->data_log_queue) + 1);
+            BEAN_TRACE(BEAN_TRACE_QUEUE_POP, received_data.measurement_type);
             if (!ctx->is_not_usb_msc)
                 continue;
 
-            if (!initialized)
+            if (!initialized && !logs_closed)
             {
                 char file_name[13], full_path[23];
                 // Initialize data log file
                 sprintf(file_name, "log_d%03d.csv", log_number);
                 snprintf(full_path, sizeof(full_path), "%s/%s", STORAGE_BASE_PATH, file_name);
-                data_log_file = fopen(full_path, "a");
+                data_log_file = bean_hal_fopen(full_path, "a");
                 setvbuf(data_log_file, NULL, _IOFBF, 8192 * 2); // Increase buffer size for speed
-                fprintf(data_log_file, "timestamp,measurement_type,value\n"); // Write headers
+                if (!logs_resumed)
+                    fprintf(data_log_file, "timestamp,measurement_type,value\n"); // Write headers
 
                 initialized = true;
             }
@@ -95,24 +160,29 @@ void vtask_data_log_handler(void *pvParameter)
             if (data_log_file == NULL)
                 continue;
 
+            // A full buffer is written to the flash right here
+            bean_power_acquire(BEAN_POWER_LOCK_STORAGE);
+            BEAN_TRACE(BEAN_TRACE_LOG_WRITE_BEGIN, received_data.measurement_type);
             fprintf(data_log_file,
-                    "%lu,%d,%s\n",
+                    "%" PRIu32 ",%d,%s\n",
                     received_data.timestamp,
                     received_data.measurement_type,
                     received_data.measurement_value);
+            BEAN_TRACE(BEAN_TRACE_LOG_WRITE_END, received_data.measurement_type);
+            bean_power_release(BEAN_POWER_LOCK_STORAGE);
             has_written = true;
         }
 
         // Check if we need to sync (every 1 second and only if we've written something)
         if (has_written && data_log_file != NULL)
         {
-            TickType_t current_tick = xTaskGetTickCount();
-            uint16_t delta_ticks    = current_tick - last_sync_tick;
-            if (delta_ticks >= sync_tick_threshold)
+            uint32_t now_ms = bean_hal_time_ms();
+            if (now_ms - last_sync_ms >= BEAN_STORAGE_FLUSH_INTERVAL_MS)
             {
-                fflush(data_log_file);
-                fsync(fileno(data_log_file));
-                last_sync_tick = current_tick;
+                bean_power_acquire(BEAN_POWER_LOCK_STORAGE);
+                sync_log_file(data_log_file);
+                bean_power_release(BEAN_POWER_LOCK_STORAGE);
+                last_sync_ms = now_ms;
                 has_written    = false; // Reset flag after sync
             }
         }
@@ -124,13 +194,13 @@ void vtask_event_log_handler(void *pvParameter)
     bean_context_t *ctx = (bean_context_t *)pvParameter;
     event_data_t received_data;
     bool initialized = false, has_written = false;
-    TickType_t last_sync_tick    = 0;
-    uint16_t sync_tick_threshold = pdMS_TO_TICKS(BEAN_STORAGE_FLUSH_INTERVAL_MS);
+    uint32_t last_sync_ms = 0;
 
     while (1)
     {
-        if (xQueueReceive(ctx->event_queue, &received_data, sync_tick_threshold) == pdTRUE)
+        if (bean_hal_queue_receive(ctx->event_queue, &received_data, BEAN_STORAGE_FLUSH_INTERVAL_MS))
         {
+            bean_metrics_peak(BEAN_METRIC_EVENT_QUEUE_PEAK, bean_hal_queue_waiting(ctx->event_queue) + 1);
             if (ctx->is_not_usb_msc)
             {
                 if (!initialized)
@@ -139,9 +209,10 @@ void vtask_event_log_handler(void *pvParameter)
                     // Initialize data log file
                     sprintf(file_name, "log_e%03d.csv", log_number);
                     snprintf(full_path, sizeof(full_path), "%s/%s", STORAGE_BASE_PATH, file_name);
-                    event_log_file = fopen(full_path, "a");
+                    event_log_file = bean_hal_fopen(full_path, "a");
                     setvbuf(event_log_file, NULL, _IOFBF, 8192 * 2); // Increase file buffer for speed
-                    fprintf(event_log_file, "timestamp,event_id,event_data\n"); // Write headers
+                    if (!logs_resumed)
+                        fprintf(event_log_file, "timestamp,event_id,event_data\n"); // Write headers
 
                     initialized = true;
                 }
@@ -149,12 +220,22 @@ void vtask_event_log_handler(void *pvParameter)
                 if (event_log_file != NULL)
                 {
 
+                    bean_power_acquire(BEAN_POWER_LOCK_STORAGE);
                     fprintf(event_log_file,
-                            "%lu,%d,%s\n",
+                            "%" PRIu32 ",%d,%s\n",
                             received_data.timestamp,
                             received_data.event_id,
                             received_data.event_data ? received_data.event_data : "");
+                    bean_power_release(BEAN_POWER_LOCK_STORAGE);
                     has_written = true;
+
+                    if (received_data.event_id == EVENT_ID_LOG_CLOSE)
+                    {
+                        close_log_file(&event_log_file);
+                        has_written = false;
+                        logs_closed = true;
+                        BEAN_LOGI(TAG, "Event log closed");
+                    }
                 }
             }
 
@@ -165,13 +246,13 @@ void vtask_event_log_handler(void *pvParameter)
         // Check if we need to sync (every 1 second and only if we've written something)
         if (has_written && event_log_file != NULL)
         {
-            TickType_t current_tick = xTaskGetTickCount();
-            uint16_t delta_ticks    = current_tick - last_sync_tick;
-            if (delta_ticks >= sync_tick_threshold)
+            uint32_t now_ms = bean_hal_time_ms();
+            if (now_ms - last_sync_ms >= BEAN_STORAGE_FLUSH_INTERVAL_MS)
             {
-                fflush(event_log_file);
-                fsync(fileno(event_log_file));
-                last_sync_tick = current_tick;
+                bean_power_acquire(BEAN_POWER_LOCK_STORAGE);
+                sync_log_file(event_log_file);
+                bean_power_release(BEAN_POWER_LOCK_STORAGE);
+                last_sync_ms = now_ms;
                 has_written    = false; // Reset flag after sync
             }
         }
@@ -5,10 +5,43 @@
 #define BEAN_STORAGE_FLUSH_INTERVAL_MS 1000
 #define STORAGE_BASE_PATH              "/extflash"
 
+typedef struct bean_storage_flash_info
+{
+    uint32_t id; // JEDEC ID
+    uint32_t size; // Bytes
+    const char *io_mode; // SPI mode, "dio"
+    int freq_mhz;
+} bean_storage_flash_info_t;
+
 esp_err_t bean_storage_init(bean_context_t *ctx);
+
+/**
+ * @brief Brings storage back after a warm reset in flight: mounts the flash and continues the given log files.
+ *
+ * The config is not read from the file and the directory is not scanned, the caller restores the config itself.
+ *
+ * @param config_hash Hash of the conf.json the flight was configured from, bean_storage_config_hash() returns it
+ * from here on, also when the flash fails to mount
+ */
+esp_err_t bean_storage_resume(bean_context_t *ctx, int log_number, uint32_t config_hash);
+
+/**
+ * @brief Gets the hash of conf.json as it was loaded or last saved, the key of the config snapshot in NVS.
+ */
+uint32_t bean_storage_config_hash(void);
+
+/**
+ * @brief Gets the external flash chip and how it is driven, once the storage is mounted.
+ */
+esp_err_t bean_storage_flash_info(bean_storage_flash_info_t *info);
 esp_err_t storage_write_file(char *filename, const char *data);
 esp_err_t storage_list_files();
 esp_err_t storage_read_file(char *filename);
 esp_err_t storage_append_file(char *filename, const char *data);
 esp_err_t storage_delete_file(char *filename);
 esp_err_t storage_enable_usb_msc(void);
+
+/**
+ * @brief Writes the running configuration, live patches included, to conf.json and refreshes the NVS snapshot.
+ */
+esp_err_t bean_storage_save_config(void);
@@ -0,0 +1,51 @@
+#pragma once
+#include <stdint.h>
+#include "esp_err.h"
+
+/*
+ * Storage benchmark: writes synthetic log streams through the same stdio, FATFS and wear levelling stack as the loggers
+ * and measures the throughput and the latency of each record, for every combination of record size, stdio buffer and
+ * sync policy in a plan.
+ */
+
+#define BEAN_STORAGE_BENCH_MAX_VALUES 4 // Values per dimension of a plan
+#define BEAN_STORAGE_BENCH_FILE_NAME  "bench.bin"
+#define BEAN_STORAGE_BENCH_JSON_NAME  "bench.json"
+#define BEAN_STORAGE_BENCH_RUN_MAX_MS 10000 // A run stops early after this, a sync per record is slow
+
+typedef enum bean_storage_bench_sync
+{
+    BEAN_STORAGE_BENCH_SYNC_CLOSE, // Only the close at the end of the run
+    BEAN_STORAGE_BENCH_SYNC_PERIODIC, // Flush and fsync every BEAN_STORAGE_FLUSH_INTERVAL_MS, like the loggers
+    BEAN_STORAGE_BENCH_SYNC_RECORD, // Flush and fsync after every record
+    BEAN_STORAGE_BENCH_SYNC_COUNT
+} bean_storage_bench_sync_t;
+
+typedef struct bean_storage_bench_plan
+{
+    uint32_t record_sizes[BEAN_STORAGE_BENCH_MAX_VALUES]; // Bytes per write
+    uint8_t record_size_count;
+    uint32_t buffer_sizes[BEAN_STORAGE_BENCH_MAX_VALUES]; // setvbuf() size, 0 is unbuffered
+    uint8_t buffer_size_count;
+    bean_storage_bench_sync_t syncs[BEAN_STORAGE_BENCH_MAX_VALUES];
+    uint8_t sync_count;
+    uint32_t run_bytes; // Written by each run
+    uint32_t stall_us; // A record that took longer counts as a stall
+} bean_storage_bench_plan_t;
+
+/**
+ * @brief Fills in the default plan: the record sizes of the logs, no buffer up to the buffer of the loggers, every
+ * sync policy.
+ */
+void bean_storage_bench_default_plan(bean_storage_bench_plan_t *plan);
+
+const char *bean_storage_bench_sync_name(bean_storage_bench_sync_t sync);
+
+/**
+ * @brief Runs the plan, prints a line per run and writes the results with the flash details to a JSON file.
+ *
+ * Blocks the caller for the whole plan. The loggers keep running and write next to it, so on the pad only.
+ *
+ * @return ESP_ERR_NO_MEM when the volume has no room for a run, ESP_FAIL when a run or the JSON file failed
+ */
+esp_err_t bean_storage_bench(const bean_storage_bench_plan_t *plan, const char *json_path);
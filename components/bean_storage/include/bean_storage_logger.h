@@ -1,5 +1,28 @@
 #include "esp_err.h"
+#include "bean_context.h"
 
 void vtask_data_log_handler(void *pvParameter);
 void vtask_event_log_handler(void *pvParameter);
 esp_err_t bean_storage_logger_init();
+
+/**
+ * @brief Continues the logs of a flight interrupted by a warm reset, instead of scanning for the next free number.
+ */
+esp_err_t bean_storage_logger_resume(int number);
+
+/**
+ * @brief Gets the number of the log files in use.
+ */
+int bean_storage_log_number(void);
+
+/**
+ * @brief Closes the data and event logs after everything that is already queued has been written.
+ *
+ * Samples that are logged after this call are dropped.
+ */
+esp_err_t bean_storage_logger_close(bean_context_t *ctx);
+
+/**
+ * @brief Tells whether both logs were closed and synced after bean_storage_logger_close().
+ */
+bool bean_storage_logs_closed(void);
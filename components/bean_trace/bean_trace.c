@@ -0,0 +1,228 @@
+#include "bean_trace.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#if CONFIG_BEAN_TRACE
+
+static const char *TAG = "BEAN_TRACE";
+
+#define TRACE_MAGIC       0x54524143 // Marks rings written by an earlier boot
+#define TRACE_RING_LENGTH CONFIG_BEAN_TRACE_RING_LENGTH
+
+// In .noinit, a panic or watchdog reset leaves it to the next boot
+typedef struct trace_buffer
+{
+    uint32_t magic;
+    uint32_t crashed;
+    _Atomic uint32_t heads[portNUM_PROCESSORS]; // Records ever written to each ring
+    _Atomic uint32_t task_count; // Task ids handed out, 0 is the FreeRTOS default and never handed out
+    char task_names[BEAN_TRACE_MAX_TASKS][BEAN_TRACE_TASK_NAME_LENGTH];
+    bean_trace_record_t records[portNUM_PROCESSORS][TRACE_RING_LENGTH];
+} trace_buffer_t;
+
+static __NOINIT_ATTR trace_buffer_t trace;
+static volatile bool recording = false;
+static bool crash_pending      = false;
+
+static void reset_buffer(void)
+{
+    memset(&trace, 0, offsetof(trace_buffer_t, records));
+    trace.magic = TRACE_MAGIC;
+    atomic_store(&trace.task_count, 1);
+    strcpy(trace.task_names[BEAN_TRACE_TASK_OTHER], "other");
+}
+
+// Handed out on the first record of a task and kept in its FreeRTOS task number (configUSE_TRACE_FACILITY)
+static uint8_t IRAM_ATTR task_id(TaskHandle_t task)
+{
+    UBaseType_t id = uxTaskGetTaskNumber(task);
+    if (id != 0)
+        return (uint8_t)id;
+
+    id = atomic_fetch_add_explicit(&trace.task_count, 1, memory_order_relaxed);
+    if (id >= BEAN_TRACE_TASK_OTHER)
+    {
+        id = BEAN_TRACE_TASK_OTHER;
+    }
+    else
+    {
+        // No strncpy, this can run in the scheduler with the flash cache off
+        const char *name = pcTaskGetName(task);
+        for (int i = 0; i < BEAN_TRACE_TASK_NAME_LENGTH - 1 && name[i] != '\0'; i++)
+            trace.task_names[id][i] = name[i];
+    }
+    vTaskSetTaskNumber(task, id);
+    return (uint8_t)id;
+}
+
+// The slot is taken with one atomic add, a writer that preempts another one on the same core just takes the next
+static void IRAM_ATTR write_record(bean_trace_event_t event, uint8_t task, uint16_t arg)
+{
+    int core      = esp_cpu_get_core_id();
+    uint32_t slot = atomic_fetch_add_explicit(&trace.heads[core], 1, memory_order_relaxed) % TRACE_RING_LENGTH;
+
+    trace.records[core][slot] = (bean_trace_record_t){
+        .timestamp_us = (uint32_t)esp_timer_get_time(),
+        .event        = (uint8_t)event,
+        .task         = task,
+        .arg          = arg,
+    };
+}
+
+void IRAM_ATTR bean_trace_record(bean_trace_event_t event, uint16_t arg)
+{
+    if (!recording)
+        return;
+    write_record(event, xPortInIsrContext() ? BEAN_TRACE_TASK_ISR : task_id(xTaskGetCurrentTaskHandle()), arg);
+}
+
+// traceTASK_SWITCHED_IN() of the kernel with CONFIG_BEAN_TRACE_TASK_SWITCHES, the new task is the current one already
+void IRAM_ATTR bean_trace_task_switched_in(void)
+{
+    if (recording)
+        write_record(BEAN_TRACE_TASK_SWITCH, task_id(xTaskGetCurrentTaskHandle()), 0);
+}
+
+static bool crash_reset(esp_reset_reason_t reason)
+{
+    return reason == ESP_RST_PANIC || reason == ESP_RST_INT_WDT || reason == ESP_RST_TASK_WDT || reason == ESP_RST_WDT;
+}
+
+void bean_trace_init(void)
+{
+    // Only a reset that keeps the RAM powered leaves a trace, the one of a crash is kept over the resets that follow
+    esp_reset_reason_t reason = esp_reset_reason();
+    bool powered              = reason != ESP_RST_POWERON && reason != ESP_RST_BROWNOUT && reason != ESP_RST_DEEPSLEEP;
+    if (powered && trace.magic == TRACE_MAGIC && (trace.crashed || crash_reset(reason)))
+    {
+        trace.crashed = true;
+        crash_pending = true;
+        ESP_LOGW(TAG, "Trace of a crash kept, recording starts once it is saved");
+        return;
+    }
+
+    reset_buffer();
+    recording = true;
+}
+
+static esp_err_t write_file(const char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+    {
+        ESP_LOGE(TAG, "Failed to open %s", path);
+        return ESP_FAIL;
+    }
+
+    bean_trace_file_header_t header = {
+        .magic            = BEAN_TRACE_FILE_MAGIC,
+        .version          = BEAN_TRACE_FILE_VERSION,
+        .cores            = portNUM_PROCESSORS,
+        .crashed          = trace.crashed != 0,
+        .task_count       = BEAN_TRACE_MAX_TASKS,
+        .task_name_length = BEAN_TRACE_TASK_NAME_LENGTH,
+    };
+    uint32_t heads[portNUM_PROCESSORS];
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        heads[core]               = atomic_load(&trace.heads[core]);
+        header.record_count[core] = heads[core] < TRACE_RING_LENGTH ? heads[core] : TRACE_RING_LENGTH;
+        header.overwritten[core]  = heads[core] - header.record_count[core];
+    }
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(trace.task_names, sizeof(trace.task_names), 1, file) == 1;
+    for (int core = 0; core < portNUM_PROCESSORS && ok; core++)
+    {
+        // Oldest first: from the slot after the newest record to the end of the ring, then from its start
+        uint32_t count = header.record_count[core];
+        uint32_t start = (heads[core] - count) % TRACE_RING_LENGTH;
+        uint32_t tail  = count < TRACE_RING_LENGTH - start ? count : TRACE_RING_LENGTH - start;
+
+        ok = fwrite(&trace.records[core][start], sizeof(bean_trace_record_t), tail, file) == tail;
+        ok = ok && fwrite(&trace.records[core][0], sizeof(bean_trace_record_t), count - tail, file) == count - tail;
+    }
+    if (fclose(file) != 0)
+        ok = false;
+    if (!ok)
+        ESP_LOGE(TAG, "Failed to write %s", path);
+    return ok ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t bean_trace_dump(const char *path)
+{
+    bool was_recording = recording;
+    recording          = false;
+    vTaskDelay(1); // A record that was started on the other core is done by now
+
+    esp_err_t ret = write_file(path);
+    recording     = was_recording;
+    if (ret == ESP_OK)
+        ESP_LOGI(TAG, "Trace written to %s", path);
+    return ret;
+}
+
+esp_err_t bean_trace_save_crash(const char *path)
+{
+    if (!crash_pending)
+        return ESP_OK;
+
+    // Kept for the next boot when it cannot be written
+    esp_err_t ret = write_file(path);
+    if (ret != ESP_OK)
+        return ret;
+
+    ESP_LOGW(TAG, "Trace of the last crash written to %s", path);
+    crash_pending = false;
+    reset_buffer();
+    recording = true;
+    return ESP_OK;
+}
+
+void bean_trace_print_status(void)
+{
+    printf("Trace %s, %d records per core%s\n",
+           recording ? "recording" : "paused",
+           TRACE_RING_LENGTH,
+           crash_pending ? ", the trace of the last crash is not saved yet" : "");
+    for (int core = 0; core < portNUM_PROCESSORS; core++)
+    {
+        uint32_t head = atomic_load(&trace.heads[core]);
+        printf("  core %d: %lu records, %lu overwritten\n",
+               core,
+               head < TRACE_RING_LENGTH ? head : TRACE_RING_LENGTH,
+               head < TRACE_RING_LENGTH ? 0 : head - TRACE_RING_LENGTH);
+    }
+}
+
+#else // CONFIG_BEAN_TRACE
+
+void bean_trace_record(bean_trace_event_t event, uint16_t arg) {}
+
+void bean_trace_init(void) {}
+
+esp_err_t bean_trace_dump(const char *path)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t bean_trace_save_crash(const char *path)
+{
+    return ESP_OK;
+}
+
+void bean_trace_print_status(void)
+{
+    printf("No trace recorder, CONFIG_BEAN_TRACE is off\n");
+}
+
+#endif // CONFIG_BEAN_TRACE
@@ -0,0 +1,41 @@
+#include "bean_trace_format.h"
+
+typedef struct event_info
+{
+    const char *name; // The begin and the end of a span share the name
+    char phase;
+} event_info_t;
+
+static const event_info_t event_info[BEAN_TRACE_EVENT_COUNT] = {
+    [BEAN_TRACE_SAMPLE_BEGIN]      = { "sample", 'B' },
+    [BEAN_TRACE_SAMPLE_END]        = { "sample", 'E' },
+    [BEAN_TRACE_IMU_READ_BEGIN]    = { "imu_read", 'B' },
+    [BEAN_TRACE_IMU_READ_END]      = { "imu_read", 'E' },
+    [BEAN_TRACE_BARO_READ_BEGIN]   = { "baro_read", 'B' },
+    [BEAN_TRACE_BARO_READ_END]     = { "baro_read", 'E' },
+    [BEAN_TRACE_HIGH_G_ISR]        = { "high_g_isr", 'i' },
+    [BEAN_TRACE_ADC_FRAME]         = { "adc_frame", 'i' },
+    [BEAN_TRACE_QUEUE_PUSH]        = { "queue_push", 'i' },
+    [BEAN_TRACE_QUEUE_DROP]        = { "queue_drop", 'i' },
+    [BEAN_TRACE_QUEUE_POP]         = { "queue_pop", 'i' },
+    [BEAN_TRACE_LOG_WRITE_BEGIN]   = { "log_write", 'B' },
+    [BEAN_TRACE_LOG_WRITE_END]     = { "log_write", 'E' },
+    [BEAN_TRACE_FLASH_WRITE_BEGIN] = { "flash_write", 'B' },
+    [BEAN_TRACE_FLASH_WRITE_END]   = { "flash_write", 'E' },
+    [BEAN_TRACE_TASK_SWITCH]       = { "task_switch", 'i' },
+    [BEAN_TRACE_MARK]              = { "mark", 'i' },
+};
+
+const char *bean_trace_event_name(bean_trace_event_t event)
+{
+    if (event >= BEAN_TRACE_EVENT_COUNT)
+        return "unknown";
+    return event_info[event].name;
+}
+
+char bean_trace_event_phase(bean_trace_event_t event)
+{
+    if (event >= BEAN_TRACE_EVENT_COUNT)
+        return 'i';
+    return event_info[event].phase;
+}
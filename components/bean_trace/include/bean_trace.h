@@ -0,0 +1,40 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+#include "esp_err.h"
+#include "sdkconfig.h"
+#include "bean_trace_format.h"
+
+#if CONFIG_BEAN_TRACE
+#define BEAN_TRACE(event, arg) bean_trace_record((event), (uint16_t)(arg))
+#else
+#define BEAN_TRACE(event, arg) ((void)0)
+#endif
+
+/**
+ * @brief Records an event into the ring of the current core, from any task or an ISR. Use BEAN_TRACE(), it compiles
+ * away without CONFIG_BEAN_TRACE.
+ */
+void bean_trace_record(bean_trace_event_t event, uint16_t arg);
+
+/**
+ * @brief Starts the recording, first thing in app_main.
+ *
+ * The rings survive a panic or watchdog reset. When they hold the trace up to such a reset, it is kept and nothing is
+ * recorded until bean_trace_save_crash() has written it.
+ */
+void bean_trace_init(void);
+
+/**
+ * @brief Writes the rings to a file, the recording pauses while it does.
+ */
+esp_err_t bean_trace_dump(const char *path);
+
+/**
+ * @brief Writes the trace of the last panic or watchdog reset, if there is one, and starts the recording.
+ *
+ * @return ESP_OK also when there was nothing to write
+ */
+esp_err_t bean_trace_save_crash(const char *path);
+
+void bean_trace_print_status(void);
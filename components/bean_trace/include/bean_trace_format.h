@@ -0,0 +1,67 @@
+#pragma once
+#include <stdint.h>
+
+/*
+ * Trace records and the layout of a trace file, shared by the recorder and the host converter (tools/trace_convert).
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host.
+ */
+
+#define BEAN_TRACE_FILE_MAGIC       0x43525442 // "BTRC"
+#define BEAN_TRACE_FILE_VERSION     1
+#define BEAN_TRACE_MAX_CORES        2
+#define BEAN_TRACE_MAX_TASKS        32 // Task ids, the last one is shared by the tasks that did not get their own
+#define BEAN_TRACE_TASK_NAME_LENGTH 16 // configMAX_TASK_NAME_LEN
+#define BEAN_TRACE_TASK_OTHER       (BEAN_TRACE_MAX_TASKS - 1)
+#define BEAN_TRACE_TASK_ISR         0xFF // Recorded in an interrupt
+
+typedef enum bean_trace_event
+{
+    BEAN_TRACE_SAMPLE_BEGIN, // One acquisition tick, arg: flight state
+    BEAN_TRACE_SAMPLE_END,
+    BEAN_TRACE_IMU_READ_BEGIN,
+    BEAN_TRACE_IMU_READ_END,
+    BEAN_TRACE_BARO_READ_BEGIN,
+    BEAN_TRACE_BARO_READ_END,
+    BEAN_TRACE_HIGH_G_ISR,
+    BEAN_TRACE_ADC_FRAME, // A DMA frame of the battery ADC handed to the battery task, arg: bytes
+    BEAN_TRACE_QUEUE_PUSH, // Into the data log queue, arg: measurement type
+    BEAN_TRACE_QUEUE_DROP, // The data log queue was full, arg: measurement type
+    BEAN_TRACE_QUEUE_POP, // Out of the data log queue, arg: measurement type
+    BEAN_TRACE_LOG_WRITE_BEGIN, // A sample into the stdio buffer of the data log, a full buffer goes to the flash here
+    BEAN_TRACE_LOG_WRITE_END,
+    BEAN_TRACE_FLASH_WRITE_BEGIN, // Flush and sync of a log file, arg: 0 data log, 1 event log
+    BEAN_TRACE_FLASH_WRITE_END,
+    BEAN_TRACE_TASK_SWITCH, // The recording task is the one switched in
+    BEAN_TRACE_MARK, // From the console, arg: free to use
+    BEAN_TRACE_EVENT_COUNT
+} bean_trace_event_t;
+
+typedef struct bean_trace_record
+{
+    uint32_t timestamp_us; // esp_timer, wraps after 71 minutes
+    uint8_t event;
+    uint8_t task; // Task id, see the task names of the file, BEAN_TRACE_TASK_ISR in an interrupt
+    uint16_t arg;
+} bean_trace_record_t;
+
+// A trace file is this header, task_count names of task_name_length bytes (id 0 first), then the records of each
+// core, oldest first
+typedef struct bean_trace_file_header
+{
+    uint32_t magic;
+    uint16_t version;
+    uint8_t cores;
+    uint8_t crashed; // Recorded up to a panic or watchdog reset
+    uint32_t record_count[BEAN_TRACE_MAX_CORES];
+    uint32_t overwritten[BEAN_TRACE_MAX_CORES]; // Older records the ring had no room for
+    uint16_t task_count;
+    uint16_t task_name_length;
+} bean_trace_file_header_t;
+
+const char *bean_trace_event_name(bean_trace_event_t event);
+
+/**
+ * @brief Phase of the event in the Chrome trace format: 'B' begins a span, 'E' ends it, 'i' is an instant.
+ */
+char bean_trace_event_phase(bean_trace_event_t event);
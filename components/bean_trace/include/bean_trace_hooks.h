@@ -0,0 +1,10 @@
+#pragma once
+
+/*
+ * FreeRTOS trace macros of the recorder, forced into the kernel sources with CONFIG_BEAN_TRACE_TASK_SWITCHES (see
+ * CMakeLists.txt). Nothing else includes this file.
+ */
+
+void bean_trace_task_switched_in(void);
+
+#define traceTASK_SWITCHED_IN() bean_trace_task_switched_in()
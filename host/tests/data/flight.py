@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Writes flight.csv, a data log (log_dNNN.csv format) of a whole flight on two parachutes.
+
+The board is on from the start, 3 s before the launch:
+ - a boost of 1.8 s with motor vibration, the thrust ramps up and tails off
+ - a coast against the air drag to the apogee at about 260 m
+ - the drogue opens 0.5 s after the apogee and the rocket falls at about 20 m/s under it
+ - the main opens at 60 m, the deploy height of default.json, with its opening shock, down to about 6 m/s
+ - the touchdown knocks the rocket over, it lies on its side for the rest of the log
+
+The pressure follows the altitude through the barometric formula of the firmware. Only the acceleration and pressure
+rows are written, the rows the launch detector and the estimator use. The noise is seeded, the same file comes out on
+every run. Replayed by the flight test in host/CMakeLists.txt with both deployments enabled.
+
+Usage: flight.py > flight.csv
+"""
+
+import math
+import random
+
+PERIOD_MS = 10
+START_MS = 12000
+LAUNCH_MS = 3000  # From the start of the log
+GROUND_MS = 8000  # Lying after the touchdown
+GRAVITY = 9.81
+GROUND_PA = 101325.0
+BOOST_MS = 1800
+BOOST_MS2 = 60.0  # Thrust over the mass, at full thrust
+BODY_DRAG = 0.0020  # Drag over the mass, per m
+DROGUE_MS = 20.0
+MAIN_MS = 6.0
+DROGUE_DELAY_MS = 500
+MAIN_HEIGHT_M = 60.0
+
+
+def thrust(boost_ms):
+    """Acceleration of the motor alone, a 100 ms ramp up and a 200 ms tail off"""
+    if boost_ms < 0 or boost_ms >= BOOST_MS:
+        return 0.0
+    if boost_ms < 100:
+        return BOOST_MS2 * boost_ms / 100.0
+    if boost_ms > BOOST_MS - 200:
+        return BOOST_MS2 * (BOOST_MS - boost_ms) / 200.0
+    return BOOST_MS2
+
+
+def drag(velocity, chute):
+    """Drag over the mass for the parachute that is out, against the velocity"""
+    terminal = {None: None, "drogue": DROGUE_MS, "main": MAIN_MS}[chute]
+    k = BODY_DRAG if terminal is None else GRAVITY / (terminal * terminal)
+    return -k * velocity * abs(velocity)
+
+
+def pressure(altitude_m):
+    return GROUND_PA * math.pow(1.0 - altitude_m / 44330.0, 1.0 / 0.1903)
+
+
+def main():
+    rng = random.Random(20240702)
+    dt = PERIOD_MS / 1000.0
+    altitude = 0.0
+    velocity = 0.0
+    chute = None
+    apogee_ms = None
+    landed_ms = None
+    t_ms = 0
+
+    print("timestamp,measurement_type,value")
+    while landed_ms is None or t_ms < landed_ms + GROUND_MS:
+        boost_ms = t_ms - LAUNCH_MS
+        accel = [0.0, 0.0, GRAVITY]  # Specific force in the board frame, z up the rocket
+        noise = 0.08
+        if landed_ms is not None:
+            accel = [GRAVITY, 0.0, 0.0]
+            if t_ms - landed_ms < 300:
+                accel[2] += 25.0 * math.exp(-(t_ms - landed_ms) / 60.0) * math.cos(2.0 * math.pi * 12.0 * t_ms / 1000.0)
+        elif boost_ms >= 0:
+            force = thrust(boost_ms) + drag(velocity, chute)
+            velocity += (force - GRAVITY) * dt
+            altitude += velocity * dt
+            accel[2] = force
+            if 0 <= boost_ms < BOOST_MS:
+                noise = 2.0
+            if apogee_ms is None and boost_ms > BOOST_MS and velocity <= 0.0:
+                apogee_ms = t_ms
+            if apogee_ms is not None and chute is None and t_ms >= apogee_ms + DROGUE_DELAY_MS:
+                chute = "drogue"
+                accel[0] += 15.0  # The shock cord snaps tight
+            if chute == "drogue" and altitude <= MAIN_HEIGHT_M:
+                chute = "main"
+            if altitude <= 0.0 and boost_ms > BOOST_MS:
+                altitude = 0.0
+                velocity = 0.0
+                landed_ms = t_ms
+
+        accel = [a + rng.gauss(0.0, noise) for a in accel]
+        timestamp = START_MS + t_ms
+        print("%d,3,%.2f;%.2f;%.2f" % (timestamp, accel[0], accel[1], accel[2]))
+        print("%d,1,%.2f" % (timestamp, pressure(altitude) + rng.gauss(0.0, 2.0)))
+        t_ms += PERIOD_MS
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Writes pad_handling.csv, a data log (log_dNNN.csv format) of a rocket carried to the pad and knocked on the rail.
+
+The board is on from the start, so the state machine is armed for all of it:
+ - 0 to 1.5 s lying on the bench, the vertical axis (z) horizontal
+ - 1.5 to 7 s carried, walking bounce and sway, a knock on a door frame and one on the carry handle
+ - 7 to 9 s tilted up and slid onto the rail, the stop at the end of the rail rings for a few samples
+ - 9 to 20 s standing on the pad: taps on the rail, a push that sways it and a dropped tool
+
+Only the acceleration and pressure rows are written, the rows the launch detector and the estimator use. The noise
+is seeded, the same file comes out on every run. Replayed by the pad_handling test in host/CMakeLists.txt, which
+checks that nothing in it is a launch.
+
+Usage: pad_handling.py > pad_handling.csv
+"""
+
+import math
+import random
+
+PERIOD_MS = 10
+START_MS = 15000
+LENGTH_MS = 20000
+GRAVITY = 9.81
+GROUND_PA = 101325.0
+PA_PER_M = 12.0
+
+# Time of the first sample of a knock and the acceleration of its samples along an axis, on top of gravity
+KNOCKS = [
+    (3000, 1, [35.0, 48.0]),  # Door frame
+    (5200, 0, [60.0]),  # Handle
+    (8600, 2, [80.0, -30.0, 20.0, -12.0, 6.0]),  # End stop of the rail
+    (11000, 0, [45.0]),  # Tap
+    (13500, 1, [30.0, 25.0]),  # Tap
+    (18200, 2, [120.0]),  # Dropped tool on the rail
+]
+
+
+def gravity_direction(t_ms):
+    """Unit vector of gravity in the board frame: along x lying and carried, along z on the rail"""
+    if t_ms < 7000:
+        angle = 0.0
+    elif t_ms < 9000:
+        angle = (t_ms - 7000) / 2000.0 * math.pi / 2.0
+    else:
+        angle = math.pi / 2.0
+    return [math.cos(angle), 0.0, math.sin(angle)]
+
+
+def main():
+    rng = random.Random(20240611)
+    print("timestamp,measurement_type,value")
+    for t_ms in range(0, LENGTH_MS, PERIOD_MS):
+        t_s = t_ms / 1000.0
+        g = gravity_direction(t_ms)
+        magnitude = GRAVITY
+        sway = [0.0, 0.0, 0.0]
+        height_m = 0.0
+        noise = 0.05
+        if 1500 <= t_ms < 7000:
+            magnitude += 1.5 * math.sin(2.0 * math.pi * 1.8 * t_s)
+            sway[1] = 0.8 * math.sin(2.0 * math.pi * 0.9 * t_s)
+            height_m = 1.0
+            noise = 0.3
+        elif 7000 <= t_ms < 9000:
+            height_m = 1.0 - 0.5 * (t_ms - 7000) / 2000.0
+            noise = 0.5  # Rail buttons rubbing
+        elif t_ms >= 9000:
+            height_m = 0.5
+            if 16000 <= t_ms < 17000:
+                sway[0] = 2.0 * math.exp(-(t_ms - 16000) / 300.0) * math.sin(2.0 * math.pi * 2.0 * t_s)
+
+        accel = [magnitude * g[i] + sway[i] + rng.gauss(0.0, noise) for i in range(3)]
+        for start_ms, axis, values in KNOCKS:
+            index = (t_ms - start_ms) // PERIOD_MS
+            if 0 <= index < len(values):
+                accel[axis] += values[index]
+
+        pressure = GROUND_PA - PA_PER_M * height_m + rng.gauss(0.0, 1.5)
+        timestamp = START_MS + t_ms
+        print("%d,3,%.2f;%.2f;%.2f" % (timestamp, accel[0], accel[1], accel[2]))
+        print("%d,1,%.2f" % (timestamp, pressure))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,46 @@
+#pragma once
+#include <math.h>
+#include <stdio.h>
+
+/*
+ * Checks of the host tests, see host/CMakeLists.txt. A test is a program per module, its main runs the cases with
+ * RUN_CASE and returns host_test_failures, so CTest sees a failed check as a failed test.
+ */
+
+static int host_test_failures;
+
+#define CHECK(condition)                                                                                             \
+    do                                                                                                               \
+    {                                                                                                                \
+        if (!(condition))                                                                                            \
+        {                                                                                                            \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition);                            \
+            host_test_failures++;                                                                                    \
+        }                                                                                                            \
+    } while (0)
+
+#define CHECK_NEAR(value, expected, tolerance)                                                                       \
+    do                                                                                                               \
+    {                                                                                                                \
+        double check_value_ = (value);                                                                               \
+        if (fabs(check_value_ - (double)(expected)) > (tolerance))                                                   \
+        {                                                                                                            \
+            fprintf(stderr,                                                                                          \
+                    "%s:%d: check failed: %s is %g, expected %g +- %g\n",                                            \
+                    __FILE__,                                                                                        \
+                    __LINE__,                                                                                        \
+                    #value,                                                                                          \
+                    check_value_,                                                                                    \
+                    (double)(expected),                                                                              \
+                    (double)(tolerance));                                                                            \
+            host_test_failures++;                                                                                    \
+        }                                                                                                            \
+    } while (0)
+
+#define RUN_CASE(function)                                                                                           \
+    do                                                                                                               \
+    {                                                                                                                \
+        int failures_before_ = host_test_failures;                                                                   \
+        function();                                                                                                  \
+        printf("%-48s %s\n", #function, host_test_failures == failures_before_ ? "ok" : "FAILED");                   \
+    } while (0)
@@ -0,0 +1,40 @@
+# Replays a data log with flight_replay and compares what it prints with the expected output, see host/CMakeLists.txt
+#
+# cmake -DTOOL=<flight_replay> -DLOG=<log_dNNN.csv> [-DCONF=<conf.json>] -DEXPECTED=<expected.txt> -DOUT=<directory>
+#       [-DFORBID=<regex>] -P replay_compare.cmake
+#
+# FORBID fails the test when a line of the output matches it, whatever the expected output says, e.g. a launch in a
+# log of pad handling.
+#
+# The log is given by its file name from its own directory, so the header line is the same in every checkout. After a
+# deliberate change to the flight logic, copy <directory>/replay.txt over the expected output.
+
+get_filename_component(log_dir "${LOG}" DIRECTORY)
+get_filename_component(log_name "${LOG}" NAME)
+set(args "${log_name}" -o "${OUT}")
+if(CONF)
+    list(APPEND args -c "${CONF}")
+endif()
+
+file(REMOVE_RECURSE "${OUT}")
+file(MAKE_DIRECTORY "${OUT}")
+execute_process(
+    COMMAND "${TOOL}" ${args}
+    WORKING_DIRECTORY "${log_dir}"
+    OUTPUT_VARIABLE actual
+    RESULT_VARIABLE result
+)
+file(WRITE "${OUT}/replay.txt" "${actual}")
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "flight_replay failed (${result}) on ${LOG}")
+endif()
+
+if(FORBID AND actual MATCHES "${FORBID}")
+    message(FATAL_ERROR "The replay of ${log_name} has '${CMAKE_MATCH_0}', which it must not have")
+endif()
+
+file(READ "${EXPECTED}" expected)
+if(NOT actual STREQUAL expected)
+    execute_process(COMMAND diff -u "${EXPECTED}" "${OUT}/replay.txt")
+    message(FATAL_ERROR "The replay of ${log_name} differs from ${EXPECTED}")
+endif()
@@ -0,0 +1,74 @@
+#pragma once
+#include <math.h>
+#include "flight_sm.h"
+
+/*
+ * A synthetic flight for the host tests that drive the whole state machine, one flight_sample_t per loop_delay.
+ *
+ * The rocket stands on the pad until launch_ms, boosts at 5 g for 2 s, coasts to the apogee at about 610 m, falls
+ * to the drogue descent rate and comes down under it until SYNTHETIC_MAIN_OPEN_M, where the main slows it down to the
+ * ground. The acceleration is on z, up on the pad, the baro has a deterministic noise of +-0.5 m. The trajectory
+ * does not follow the deployments of the state machine, it is the same with and without them.
+ */
+
+#define SYNTHETIC_PERIOD_MS    10
+#define SYNTHETIC_GRAVITY      9.81f
+#define SYNTHETIC_BOOST_MS     2000
+#define SYNTHETIC_BOOST_MS2    (5.0f * SYNTHETIC_GRAVITY)
+#define SYNTHETIC_DROGUE_MS    (-25.0f)
+#define SYNTHETIC_MAIN_MS      (-6.0f)
+#define SYNTHETIC_MAIN_OPEN_M  45.0f // Below the main height of default.json, the state machine is there first
+#define SYNTHETIC_GROUND_PA    101325.0f
+#define SYNTHETIC_NEVER_LAUNCH UINT32_MAX
+
+typedef struct
+{
+    uint32_t launch_ms;
+    uint32_t t_ms; // Timestamp of the next sample
+    float altitude_m;
+    float velocity_ms;
+    uint32_t noise;
+} synthetic_flight_t;
+
+static inline void synthetic_flight_init(synthetic_flight_t *flight, uint32_t start_ms, uint32_t launch_ms)
+{
+    *flight = (synthetic_flight_t){ .launch_ms = launch_ms, .t_ms = start_ms, .noise = 1 };
+}
+
+// Moves the flight on by one period and fills the sample of its end
+static inline void synthetic_flight_next(synthetic_flight_t *flight, flight_sample_t *sample)
+{
+    float dt       = SYNTHETIC_PERIOD_MS / 1000.0f;
+    float accel    = 0.0f; // Vertical, without gravity
+    bool launched  = flight->t_ms >= flight->launch_ms;
+    bool boosting  = launched && flight->t_ms - flight->launch_ms < SYNTHETIC_BOOST_MS;
+    bool on_ground = !launched || (flight->altitude_m <= 0.0f && flight->velocity_ms <= 0.0f && !boosting);
+
+    if (boosting)
+        accel = SYNTHETIC_BOOST_MS2;
+    else if (on_ground)
+        flight->velocity_ms = 0.0f;
+    else if (flight->altitude_m < SYNTHETIC_MAIN_OPEN_M && flight->velocity_ms < 0.0f)
+        flight->velocity_ms = SYNTHETIC_MAIN_MS;
+    else if (flight->velocity_ms > SYNTHETIC_DROGUE_MS)
+        accel = -SYNTHETIC_GRAVITY;
+    else
+        flight->velocity_ms = SYNTHETIC_DROGUE_MS;
+
+    if (!on_ground || boosting)
+    {
+        flight->altitude_m += flight->velocity_ms * dt + 0.5f * accel * dt * dt;
+        flight->velocity_ms += accel * dt;
+        if (flight->altitude_m < 0.0f)
+            flight->altitude_m = 0.0f;
+    }
+
+    flight->noise         = flight->noise * 1664525u + 1013904223u;
+    float noise_m         = (float)(flight->noise >> 8) / (float)(1u << 24) - 0.5f;
+    float baro_m          = flight->altitude_m + noise_m;
+    *sample               = (flight_sample_t){ .timestamp_ms = flight->t_ms, .accel_valid = true, .baro_valid = true };
+    sample->accel[2]      = accel + SYNTHETIC_GRAVITY;
+    sample->pressure_pa   = SYNTHETIC_GROUND_PA * powf(1.0f - baro_m / 44330.0f, 1.0f / 0.1903f);
+    sample->temperature_c = 20.0f;
+    flight->t_ms += SYNTHETIC_PERIOD_MS;
+}
@@ -0,0 +1,115 @@
+/*
+Description: Host tests of the battery sag capture (components/bean_battery/battery_sag.c): the 1 kHz history, the
+window around an actuation and the sag measured in it.
+
+The voltages are a synthetic 2S pack at 7.8 V with the sag of a pyro channel firing.
+*/
+
+#include "battery_sag.h"
+#include "host_test.h"
+
+#define BASELINE_MV 7800
+#define TRIGGER_US  5000000
+
+// The pack through a pyro fire at the trigger: the drop starts 3 ms in, bottoms out at 600 mV down at 10 ms, recovers
+// linearly over 50 ms and stays 10 mV below the baseline from 60 ms on
+static uint16_t pyro_sag_mv(int32_t ms)
+{
+    if (ms < 3)
+        return BASELINE_MV;
+    if (ms < 10)
+        return (uint16_t)(BASELINE_MV - 600 * (ms - 2) / 8);
+    if (ms < 60)
+        return (uint16_t)(BASELINE_MV - 600 + 590 * (ms - 10) / 50);
+    return BASELINE_MV - 10;
+}
+
+// Pushes the 1 kHz samples from first_us to last_us, the value of each sample from the trace
+static void push(battery_sag_history_t *history, int64_t first_us, int64_t last_us, uint16_t (*trace)(int32_t ms))
+{
+    for (int64_t t = first_us; t <= last_us; t += 1000)
+        battery_sag_history_push(history, trace((int32_t)((t - TRIGGER_US) / 1000)), t);
+}
+
+// The time of the sample in ms, to see which samples went into the window
+static uint16_t time_ms(int32_t ms)
+{
+    return (uint16_t)(ms + 10000);
+}
+
+// The window waits for the samples after the trigger, then has them in order, until they are overwritten
+static void window_of_the_history(void)
+{
+    static battery_sag_history_t history;
+    uint16_t window[BATTERY_SAG_WINDOW_SAMPLES];
+    battery_sag_history_reset(&history);
+    CHECK(battery_sag_history_window(&history, TRIGGER_US, window) == BATTERY_SAG_PENDING);
+
+    // More than the ring before the trigger, so the window wraps around it
+    int64_t first_us = TRIGGER_US - 3000 * 1000;
+    int64_t end_us   = TRIGGER_US + (BATTERY_SAG_POST_MS - 1) * 1000;
+    push(&history, first_us, end_us - 1000, time_ms);
+    CHECK(battery_sag_history_window(&history, TRIGGER_US, window) == BATTERY_SAG_PENDING);
+    push(&history, end_us, end_us, time_ms);
+    CHECK(battery_sag_history_window(&history, TRIGGER_US, window) == BATTERY_SAG_READY);
+    CHECK(window[0] == time_ms(-BATTERY_SAG_PRE_MS));
+    CHECK(window[BATTERY_SAG_PRE_MS] == time_ms(0));
+    CHECK(window[BATTERY_SAG_WINDOW_SAMPLES - 1] == time_ms(BATTERY_SAG_POST_MS - 1));
+
+    // Once the ring went past the start of the window it is gone
+    int64_t last_kept_us = end_us + 1000 * (BATTERY_SAG_HISTORY_SAMPLES - BATTERY_SAG_WINDOW_SAMPLES);
+    push(&history, end_us + 1000, last_kept_us, time_ms);
+    CHECK(battery_sag_history_window(&history, TRIGGER_US, window) == BATTERY_SAG_READY);
+    push(&history, last_kept_us + 1000, last_kept_us + 1000, time_ms);
+    CHECK(battery_sag_history_window(&history, TRIGGER_US, window) == BATTERY_SAG_MISSED);
+}
+
+// The baseline, the depth, the onset and the recovery of a pyro fire
+static void pyro_sag_is_measured(void)
+{
+    static battery_sag_history_t history;
+    uint16_t window[BATTERY_SAG_WINDOW_SAMPLES];
+    battery_sag_history_reset(&history);
+    push(&history, TRIGGER_US - 500 * 1000, TRIGGER_US + BATTERY_SAG_POST_MS * 1000, pyro_sag_mv);
+    CHECK(battery_sag_history_window(&history, TRIGGER_US, window) == BATTERY_SAG_READY);
+
+    battery_sag_result_t result;
+    battery_sag_analyze(window, &result);
+    CHECK(result.baseline_mv == BASELINE_MV);
+    CHECK(result.min_mv == BASELINE_MV - 600);
+    CHECK(result.min_ms == 10);
+    CHECK(result.onset_ms == 3); // 75 mV down, past the 50 of the onset
+    CHECK(result.recovery_ms == 60 - 3); // Within the 20 mV of the recovery from 60 ms on
+}
+
+// A dip above the onset level is no sag, a drop that never comes back has no recovery
+static void small_dip_and_no_recovery(void)
+{
+    uint16_t window[BATTERY_SAG_WINDOW_SAMPLES];
+    for (int i = 0; i < BATTERY_SAG_WINDOW_SAMPLES; i++)
+        window[i] = BASELINE_MV;
+    window[BATTERY_SAG_PRE_MS + 5] = BASELINE_MV - BATTERY_SAG_ONSET_MV;
+
+    battery_sag_result_t result;
+    battery_sag_analyze(window, &result);
+    CHECK(result.min_mv == BASELINE_MV - BATTERY_SAG_ONSET_MV);
+    CHECK(result.min_ms == 5);
+    CHECK(result.onset_ms == -1);
+    CHECK(result.recovery_ms == -1);
+
+    // A shorted channel: the pack stays 300 mV down to the end of the window
+    for (int i = BATTERY_SAG_PRE_MS + 2; i < BATTERY_SAG_WINDOW_SAMPLES; i++)
+        window[i] = BASELINE_MV - 300;
+    battery_sag_analyze(window, &result);
+    CHECK(result.onset_ms == 2);
+    CHECK(result.min_mv == BASELINE_MV - 300);
+    CHECK(result.recovery_ms == -1);
+}
+
+int main(void)
+{
+    RUN_CASE(window_of_the_history);
+    RUN_CASE(pyro_sag_is_measured);
+    RUN_CASE(small_dip_and_no_recovery);
+    return host_test_failures ? 1 : 0;
+}
@@ -0,0 +1,52 @@
+/*
+Description: Host tests of the boot profile (main/boot_profile.c), the EVENT_ID_BOOT line of the event log.
+*/
+
+#include <string.h>
+#include "boot_profile.h"
+#include "host_test.h"
+
+// The durations and the marks of failed stages, in the order they were added
+static void stages_in_the_line(void)
+{
+    boot_profile_t profile;
+    boot_profile_init(&profile, 250000);
+    boot_profile_add(&profile, "context", 250000, 251200, true);
+    boot_profile_add(&profile, "storage", 251200, 1251200, false);
+    boot_profile_add(&profile, "imu", 251300, 262000, true);
+
+    char line[128];
+    size_t length = boot_profile_format(&profile, 1500000, line, sizeof(line));
+    CHECK(strcmp(line, "app_main_us=250000;total_us=1250000;context_us=1200;!storage_us=1000000;imu_us=10700") == 0);
+    CHECK(length == strlen(line));
+}
+
+// A short buffer ends the line after the last stage that fits whole, stages past the limit are counted
+static void cut_at_a_whole_stage(void)
+{
+    boot_profile_t profile;
+    boot_profile_init(&profile, 1000);
+    boot_profile_add(&profile, "context", 1000, 2000, true);
+    boot_profile_add(&profile, "storage", 2000, 3000, true);
+
+    char line[64];
+    const char *head = "app_main_us=1000;total_us=9000;context_us=1000";
+    size_t length    = boot_profile_format(&profile, 10000, line, strlen(head) + 5);
+    CHECK(strcmp(line, head) == 0);
+    CHECK(length == strlen(head));
+
+    CHECK(boot_profile_format(&profile, 10000, line, 10) == 0);
+    CHECK(line[0] == '\0');
+
+    for (int i = 0; i < BOOT_PROFILE_MAX_STAGES; i++)
+        boot_profile_add(&profile, "step", 0, 1, true);
+    CHECK(profile.count == BOOT_PROFILE_MAX_STAGES);
+    CHECK(profile.dropped == 2);
+}
+
+int main(void)
+{
+    RUN_CASE(stages_in_the_line);
+    RUN_CASE(cut_at_a_whole_stage);
+    return host_test_failures ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+/*
+Description: Host tests of the flight checkpoint (components/bean_flight/flight_checkpoint.c), the state that decides
+whether the deployments still happen after a warm reset in flight.
+
+The synthetic flight of synthetic_flight.h is flown once through, then again with a reset in it: the checkpoint of
+the last sample before the reset is restored into a fresh state machine, on a clock that starts over at the boot,
+and the flight goes on from there. The settings are the ones of default.json.
+*/
+
+#include "flight_checkpoint.h"
+#include "flight_config.h"
+#include "host_test.h"
+#include "synthetic_flight.h"
+
+#define START_MS      1000
+#define LAUNCH_MS     (START_MS + 3000)
+#define RESUME_MS     120 // First sample after the reset on the new clock, the boot of resume_steps
+#define FIRMWARE      0x12345678
+#define MAX_FLIGHT_MS 120000
+
+typedef struct
+{
+    int count;
+    flight_state_t state[FLIGHT_STATE_COUNT];
+    uint32_t flight_ms[FLIGHT_STATE_COUNT]; // Since the launch, the same on both clocks
+    float altitude_m[FLIGHT_STATE_COUNT]; // Estimated
+} transitions_t;
+
+static flight_sm_config_t default_config(void)
+{
+    flight_sm_config_t config;
+    airbrake_config_t brake_config;
+    flight_config_load(&bean_config_defaults, &config, &brake_config);
+    return config;
+}
+
+static void record(transitions_t *transitions, const flight_sm_t *sm, uint32_t now_ms)
+{
+    if (transitions->count == FLIGHT_STATE_COUNT)
+        return;
+    transitions->state[transitions->count]      = sm->state;
+    transitions->flight_ms[transitions->count]  = now_ms - sm->launch_ms;
+    transitions->altitude_m[transitions->count] = sm->estimator.altitude_m;
+    transitions->count++;
+}
+
+/*
+ * Flies the synthetic flight to the landing. With reset_in set, the board resets save_after_ms after it entered that
+ * state: the checkpoint of the sample before is restored, gap_ms of samples are lost to the reset and the samples
+ * after it come on the new clock.
+ */
+static transitions_t fly(flight_state_t reset_in, uint32_t save_after_ms, uint32_t gap_ms, flight_checkpoint_t *cp)
+{
+    flight_sm_config_t config = default_config();
+    flight_sm_t sm;
+    flight_sm_init(&sm, &config);
+    synthetic_flight_t flight;
+    synthetic_flight_init(&flight, START_MS, LAUNCH_MS);
+    flight_checkpoint_origin_t origin = { .firmware = FIRMWARE, .config_hash = 0xC0FFEE, .log_number = 7 };
+
+    transitions_t transitions = { 0 };
+    uint32_t shift_ms         = 0; // Old clock minus new clock once the board was reset
+    bool reset                = false;
+    while (sm.state != FLIGHT_STATE_LANDED && flight.t_ms < START_MS + MAX_FLIGHT_MS)
+    {
+        flight_sample_t sample;
+        synthetic_flight_next(&flight, &sample);
+        if (!reset && sm.state == reset_in && sample.timestamp_ms - sm.state_entered_ms >= save_after_ms)
+        {
+            flight_checkpoint_save(cp, &sm, sample.timestamp_ms - SYNTHETIC_PERIOD_MS, &origin);
+            CHECK(flight_checkpoint_valid(cp, FIRMWARE));
+            flight_estimator_t saved = sm.estimator;
+
+            // What survives in RTC memory is the checkpoint, the rest starts over
+            for (uint32_t lost_ms = 0; lost_ms < gap_ms; lost_ms += SYNTHETIC_PERIOD_MS)
+                synthetic_flight_next(&flight, &sample);
+            shift_ms = sample.timestamp_ms - RESUME_MS;
+            flight_sm_init(&sm, &config);
+            flight_checkpoint_restore(cp, &sm, RESUME_MS);
+            CHECK(sm.state == reset_in);
+            CHECK_NEAR(sm.estimator.altitude_m, saved.altitude_m, 1e-3);
+            CHECK_NEAR(sm.estimator.velocity_ms, saved.velocity_ms, 1e-3);
+            reset = true;
+        }
+        sample.timestamp_ms -= shift_ms;
+        if (flight_sm_step(&sm, &sample))
+            record(&transitions, &sm, sample.timestamp_ms);
+    }
+    CHECK(reset_in == FLIGHT_STATE_COUNT || reset);
+    return transitions;
+}
+
+// The same transitions as the flight without the reset, the ones after it late by at most the lost time
+static void check_same_deployments(const transitions_t *reference,
+                                   const transitions_t *resumed,
+                                   flight_state_t reset_in,
+                                   uint32_t late_ms)
+{
+    CHECK(resumed->count == reference->count);
+    for (int i = 0; i < resumed->count && i < reference->count; i++)
+    {
+        CHECK(resumed->state[i] == reference->state[i]);
+        if (resumed->state[i] <= reset_in)
+            continue;
+        int32_t late = (int32_t)(resumed->flight_ms[i] - reference->flight_ms[i]);
+        CHECK(late >= -(int32_t)late_ms && late <= (int32_t)late_ms);
+        if (resumed->state[i] == FLIGHT_STATE_MAIN_DEPLOYED)
+            CHECK_NEAR(resumed->altitude_m[i], reference->altitude_m[i], 2.0);
+    }
+}
+
+static transitions_t reference_flight(void)
+{
+    flight_checkpoint_t cp = { 0 };
+    transitions_t flight   = fly(FLIGHT_STATE_COUNT, 0, 0, &cp);
+    CHECK(flight.count == 5); // armed, ascending, drogue, main, landed
+    for (int i = 0; i < flight.count; i++)
+        CHECK(flight.state[i] == (flight_state_t)(FLIGHT_STATE_ARMED + i));
+    CHECK(cp.magic == 0);
+    return flight;
+}
+
+// A reset in the coast, 4 s before the apogee: the apogee, the main and the landing still follow
+static void resume_mid_ascending(void)
+{
+    transitions_t reference = reference_flight();
+
+    flight_checkpoint_t cp = { 0 };
+    transitions_t resumed  = fly(FLIGHT_STATE_ASCENDING, 8000, 0, &cp);
+    CHECK(cp.state == FLIGHT_STATE_ASCENDING);
+    CHECK(cp.origin.log_number == 7 && cp.origin.config_hash == 0xC0FFEE);
+    check_same_deployments(&reference, &resumed, FLIGHT_STATE_ASCENDING, 50);
+
+    // With 300 ms lost to the reset the flight time runs that much behind, the deployments do not change
+    resumed = fly(FLIGHT_STATE_ASCENDING, 8000, 300, &cp);
+    check_same_deployments(&reference, &resumed, FLIGHT_STATE_ASCENDING, 350);
+}
+
+// A reset under the drogue: the main still comes at its height and the landing follows
+static void resume_mid_drogue(void)
+{
+    transitions_t reference = reference_flight();
+
+    flight_checkpoint_t cp = { 0 };
+    transitions_t resumed  = fly(FLIGHT_STATE_DROGUE_DEPLOYED, 5000, 0, &cp);
+    CHECK(cp.state == FLIGHT_STATE_DROGUE_DEPLOYED);
+    CHECK(cp.apogee_flight_ms == reference.flight_ms[2]);
+    check_same_deployments(&reference, &resumed, FLIGHT_STATE_DROGUE_DEPLOYED, 50);
+
+    resumed = fly(FLIGHT_STATE_DROGUE_DEPLOYED, 5000, 300, &cp);
+    check_same_deployments(&reference, &resumed, FLIGHT_STATE_DROGUE_DEPLOYED, 350);
+}
+
+// Only an intact checkpoint of this firmware, in flight, is resumed
+static void only_valid_checkpoints_resume(void)
+{
+    flight_checkpoint_t cp = { 0 };
+    fly(FLIGHT_STATE_DROGUE_DEPLOYED, 1000, 0, &cp);
+    CHECK(flight_checkpoint_valid(&cp, FIRMWARE));
+    CHECK(!flight_checkpoint_valid(&cp, FIRMWARE + 1));
+
+    flight_checkpoint_t corrupted = cp;
+    corrupted.velocity_ms += 1.0f;
+    CHECK(!flight_checkpoint_valid(&corrupted, FIRMWARE));
+
+    // Saved on the pad it is cleared, a reset there starts over
+    flight_sm_config_t config = default_config();
+    flight_sm_t sm;
+    flight_sm_init(&sm, &config);
+    flight_checkpoint_origin_t origin = { .firmware = FIRMWARE };
+    flight_checkpoint_save(&cp, &sm, START_MS, &origin);
+    CHECK(cp.magic == 0);
+    CHECK(!flight_checkpoint_valid(&cp, FIRMWARE));
+}
+
+int main(void)
+{
+    RUN_CASE(resume_mid_ascending);
+    RUN_CASE(resume_mid_drogue);
+    RUN_CASE(only_valid_checkpoints_resume);
+    return host_test_failures ? 1 : 0;
+}
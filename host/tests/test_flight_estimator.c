@@ -0,0 +1,161 @@
+/*
+Description: Host tests of the vertical estimator (components/bean_flight/flight_estimator.c) through a transonic
+pressure spike.
+
+The synthetic flight has 2 s on the pad, a 3 s boost at 10 g to 300 m/s and a coast at -12 m/s^2 to the apogee 25 s
+after burnout. While the rocket goes through Mach 1 the baro reads 150 m low for 80 ms, as the shock passes the
+static ports. The settings are the ones of default.json.
+*/
+
+#include "flight_estimator.h"
+#include "host_test.h"
+
+#define PERIOD_MS     10
+#define GRAVITY_EARTH (9.80665f)
+#define LAUNCH_MS     2000
+#define BURNOUT_MS    5000
+#define BOOST_MS2     (10.0f * GRAVITY_EARTH)
+#define COAST_MS2     (-12.0f)
+#define SPIKE_MS      4500 // At about 270 m/s
+#define SPIKE_LENGTH  80 // Shorter than the baseline of the baro rate
+#define SPIKE_M       (-150.0f)
+
+static const flight_estimator_config_t default_config = {
+    .vertical_axis       = 2,
+    .vertical_sign       = 1.0f,
+    .accel_noise_ms2     = 0.5f,
+    .baro_noise_m        = 0.5f,
+    .lockout_mode        = FLIGHT_ESTIMATOR_LOCKOUT_IGNORE,
+    .lockout_velocity_ms = 200.0f,
+    .release_velocity_ms = 150.0f,
+    .min_lockout_ms      = 500,
+    .deweight_factor     = 100.0f,
+    .rate_tolerance_ms   = 30.0f,
+    .rate_window_ms      = 100,
+    .sample_period_ms    = PERIOD_MS,
+};
+
+typedef struct
+{
+    bool locked_out_in_spike; // The lockout held over every sample of the spike
+    bool lockout_changed; // The lockout was entered and released again
+    uint32_t first_descent_ms; // First sample with a negative velocity after the launch, 0 if none
+    uint32_t apogee_ms; // Apogee of the trajectory
+    uint32_t baro_rejected;
+    float max_velocity_error_ms;
+} flight_result_t;
+
+static void trajectory(uint32_t t_ms, float *altitude_m, float *velocity_ms, float *accel_ms2)
+{
+    float boost_s = (BURNOUT_MS - LAUNCH_MS) / 1000.0f;
+    if (t_ms < LAUNCH_MS)
+    {
+        *altitude_m  = 0.0f;
+        *velocity_ms = 0.0f;
+        *accel_ms2   = 0.0f;
+    }
+    else if (t_ms < BURNOUT_MS)
+    {
+        float t      = (t_ms - LAUNCH_MS) / 1000.0f;
+        *altitude_m  = 0.5f * BOOST_MS2 * t * t;
+        *velocity_ms = BOOST_MS2 * t;
+        *accel_ms2   = BOOST_MS2;
+    }
+    else
+    {
+        float t      = (t_ms - BURNOUT_MS) / 1000.0f;
+        float v0     = BOOST_MS2 * boost_s;
+        *altitude_m  = 0.5f * BOOST_MS2 * boost_s * boost_s + v0 * t + 0.5f * COAST_MS2 * t * t;
+        *velocity_ms = v0 + COAST_MS2 * t;
+        *accel_ms2   = COAST_MS2;
+    }
+}
+
+// Up to +-0.5 m of baro noise, the same sequence on every run
+static float baro_noise(uint32_t *state)
+{
+    *state = *state * 1664525u + 1013904223u;
+    return ((float)(*state >> 8) / (float)(1u << 24) - 0.5f);
+}
+
+static flight_result_t fly(const flight_estimator_config_t *config)
+{
+    flight_estimator_t est;
+    flight_estimator_init(&est, config);
+    flight_result_t result = { .locked_out_in_spike = true };
+    uint32_t noise         = 1;
+    bool entered           = false;
+    float v0               = BOOST_MS2 * (BURNOUT_MS - LAUNCH_MS) / 1000.0f;
+    result.apogee_ms       = BURNOUT_MS + (uint32_t)(-v0 / COAST_MS2 * 1000.0f);
+
+    for (uint32_t t = 0; t <= result.apogee_ms; t += PERIOD_MS)
+    {
+        float altitude_m, velocity_ms, accel_ms2;
+        trajectory(t, &altitude_m, &velocity_ms, &accel_ms2);
+        if (t == LAUNCH_MS)
+            flight_estimator_freeze_gravity(&est);
+
+        float accel[3] = { 0.0f, 0.0f, accel_ms2 + GRAVITY_EARTH };
+        float baro_m   = altitude_m + baro_noise(&noise);
+        bool in_spike  = t >= SPIKE_MS && t < SPIKE_MS + SPIKE_LENGTH;
+        if (in_spike)
+            baro_m += SPIKE_M;
+        flight_estimator_update(&est, t, accel, &baro_m);
+
+        if (in_spike && !est.locked_out)
+            result.locked_out_in_spike = false;
+        if (est.lockout_changed)
+        {
+            result.lockout_changed = entered;
+            entered                = true;
+            est.lockout_changed    = false;
+        }
+        if (t > LAUNCH_MS && est.velocity_ms < 0.0f && result.first_descent_ms == 0)
+            result.first_descent_ms = t;
+        if (t > LAUNCH_MS && fabsf(est.velocity_ms - velocity_ms) > result.max_velocity_error_ms)
+            result.max_velocity_error_ms = fabsf(est.velocity_ms - velocity_ms);
+    }
+    result.baro_rejected = est.baro_rejected;
+    return result;
+}
+
+// The lockout covers Mach 1, the spike never reaches the filter and is released on the way to the apogee
+static void lockout_engages_through_the_spike(void)
+{
+    flight_result_t result = fly(&default_config);
+    CHECK(result.locked_out_in_spike);
+    CHECK(result.lockout_changed);
+    CHECK(result.first_descent_ms == 0 || result.first_descent_ms > result.apogee_ms - 1000);
+    CHECK(result.max_velocity_error_ms < 5.0f);
+}
+
+// Without the lockout the baro rate cross-check rejects the spike on its own
+static void rate_crosscheck_rejects_the_spike(void)
+{
+    flight_estimator_config_t config = default_config;
+    config.lockout_mode              = FLIGHT_ESTIMATOR_LOCKOUT_OFF;
+    flight_result_t result           = fly(&config);
+    CHECK(!result.lockout_changed);
+    CHECK(result.baro_rejected >= SPIKE_LENGTH / PERIOD_MS);
+    CHECK(result.first_descent_ms == 0 || result.first_descent_ms > result.apogee_ms - 1000);
+    CHECK(result.max_velocity_error_ms < 5.0f);
+}
+
+// With neither the spike goes into the filter and the velocity is off by far more
+static void spike_without_protection_pulls_the_velocity(void)
+{
+    flight_estimator_config_t config = default_config;
+    config.lockout_mode              = FLIGHT_ESTIMATOR_LOCKOUT_OFF;
+    config.rate_tolerance_ms         = 0.0f;
+    flight_result_t result           = fly(&config);
+    CHECK(result.baro_rejected == 0);
+    CHECK(result.max_velocity_error_ms > 8.0f);
+}
+
+int main(void)
+{
+    RUN_CASE(lockout_engages_through_the_spike);
+    RUN_CASE(rate_crosscheck_rejects_the_spike);
+    RUN_CASE(spike_without_protection_pulls_the_velocity);
+    return host_test_failures ? 1 : 0;
+}
@@ -0,0 +1,160 @@
+/*
+Description: Host tests of the flight state machine (components/bean_flight/flight_sm.c) with the settings of
+default.json, as flight_config.c gives them to the firmware.
+
+The samples come from the synthetic flight of synthetic_flight.h.
+*/
+
+#include "flight_config.h"
+#include "host_test.h"
+#include "synthetic_flight.h"
+
+#define START_MS 1000
+
+static flight_sm_config_t default_config(void)
+{
+    flight_sm_config_t config;
+    airbrake_config_t brake_config;
+    flight_config_load(&bean_config_defaults, &config, &brake_config);
+    return config;
+}
+
+// The pad for duration_ms, with a knock that sets off the high-g feature of the accelerometer at knock_ms
+static void pad_with_knock(flight_sm_t *sm, uint32_t duration_ms, uint32_t knock_ms, bool *hw_only)
+{
+    synthetic_flight_t flight;
+    synthetic_flight_init(&flight, START_MS, SYNTHETIC_NEVER_LAUNCH);
+    while (flight.t_ms < START_MS + duration_ms)
+    {
+        flight_sample_t sample;
+        synthetic_flight_next(&flight, &sample);
+        if (sample.timestamp_ms >= knock_ms && sample.timestamp_ms < knock_ms + 2 * SYNTHETIC_PERIOD_MS)
+        {
+            sample.accel[2]               = 45.0f;
+            sample.hw_high_g              = true;
+            sample.hw_high_g_timestamp_ms = sample.timestamp_ms;
+        }
+        flight_sm_step(sm, &sample);
+        if (sm->crosscheck_decided)
+        {
+            *hw_only               = sm->crosscheck.result == LAUNCH_CROSSCHECK_HW_ONLY;
+            sm->crosscheck_decided = false;
+        }
+    }
+}
+
+// A knock on the pad that sets off the high-g feature is cross-checked and logged, it does not launch
+static void lone_high_g_knock_stays_armed(void)
+{
+    flight_sm_config_t config = default_config();
+    CHECK(!config.hw_launch_trigger);
+
+    flight_sm_t sm;
+    flight_sm_init(&sm, &config);
+    bool hw_only = false;
+    pad_with_knock(&sm, 10000, START_MS + 3000, &hw_only);
+    CHECK(sm.state == FLIGHT_STATE_ARMED);
+    CHECK(sm.launch_trigger == FLIGHT_LAUNCH_TRIGGER_NONE);
+    CHECK(hw_only);
+
+    // With the hardware trigger on the same knock is a launch, the software detector never saw one
+    config.hw_launch_trigger = true;
+    flight_sm_init(&sm, &config);
+    hw_only = false;
+    pad_with_knock(&sm, 10000, START_MS + 3000, &hw_only);
+    CHECK(sm.state != FLIGHT_STATE_ARMED);
+    CHECK(sm.launch_trigger == FLIGHT_LAUNCH_TRIGGER_HARDWARE);
+    CHECK(hw_only);
+}
+
+// The main comes out at the deploy height of drogue_deployed on the way down, not at the landing height
+static void main_deploys_at_the_deploy_height(void)
+{
+    flight_sm_config_t config = default_config();
+    CHECK_NEAR(config.main_height_m, bean_config_defaults.bean_core.flight_states.drogue_deployed.deploy_height_m, 0.0);
+
+    flight_sm_t sm;
+    flight_sm_init(&sm, &config);
+    synthetic_flight_t flight;
+    synthetic_flight_init(&flight, START_MS, START_MS + 3000);
+    float drogue_altitude_m = 0.0f, main_altitude_m = 0.0f, main_velocity_ms = 0.0f, main_true_m = 0.0f;
+    while (sm.state != FLIGHT_STATE_LANDED && flight.t_ms < START_MS + 120000)
+    {
+        flight_sample_t sample;
+        synthetic_flight_next(&flight, &sample);
+        if (!flight_sm_step(&sm, &sample))
+            continue;
+        if (sm.state == FLIGHT_STATE_DROGUE_DEPLOYED)
+            drogue_altitude_m = sm.estimator.altitude_m;
+        else if (sm.state == FLIGHT_STATE_MAIN_DEPLOYED)
+        {
+            main_altitude_m  = sm.estimator.altitude_m;
+            main_velocity_ms = sm.estimator.velocity_ms;
+            main_true_m      = flight.altitude_m;
+        }
+    }
+
+    CHECK(sm.state == FLIGHT_STATE_LANDED);
+    CHECK(!sm.apogee_timeout);
+    CHECK(drogue_altitude_m > 550.0f);
+    CHECK_NEAR(main_altitude_m, config.main_height_m, 1.0);
+    CHECK_NEAR(main_true_m, config.main_height_m, 3.0);
+    CHECK_NEAR(main_velocity_ms, SYNTHETIC_DROGUE_MS, 2.0);
+}
+
+// A held state machine stays in pre_launch through a launch, an armed one is taken back, the release arms it after
+// the pad wait
+static void hold_keeps_pre_launch(void)
+{
+    flight_sm_config_t config = default_config();
+    flight_sm_t sm;
+    flight_sm_init(&sm, &config);
+    synthetic_flight_t flight;
+    synthetic_flight_init(&flight, START_MS, START_MS + 5000);
+    flight_sample_t sample;
+    while (flight.t_ms < START_MS + 3000)
+    {
+        synthetic_flight_next(&flight, &sample);
+        flight_sm_step(&sm, &sample);
+    }
+    CHECK(sm.state == FLIGHT_STATE_ARMED);
+
+    CHECK(flight_sm_hold(&sm, true, sample.timestamp_ms));
+    CHECK(sm.state == FLIGHT_STATE_PRE_LAUNCH);
+    while (flight.t_ms < START_MS + 10000)
+    {
+        synthetic_flight_next(&flight, &sample);
+        CHECK(!flight_sm_step(&sm, &sample));
+    }
+    CHECK(sm.state == FLIGHT_STATE_PRE_LAUNCH);
+
+    // Released on the coast: the pad wait again, then armed, no launch seen
+    uint32_t released_ms = sample.timestamp_ms;
+    CHECK(flight_sm_hold(&sm, false, released_ms));
+    while (sm.state == FLIGHT_STATE_PRE_LAUNCH && flight.t_ms < START_MS + 20000)
+    {
+        synthetic_flight_next(&flight, &sample);
+        flight_sm_step(&sm, &sample);
+    }
+    CHECK(sm.state == FLIGHT_STATE_ARMED);
+    CHECK(sample.timestamp_ms - released_ms >= config.pre_launch_timeout_ms);
+
+    // No hold in flight
+    flight_sm_init(&sm, &config);
+    synthetic_flight_init(&flight, START_MS, START_MS + 3000);
+    while (sm.state != FLIGHT_STATE_ASCENDING && flight.t_ms < START_MS + 10000)
+    {
+        synthetic_flight_next(&flight, &sample);
+        flight_sm_step(&sm, &sample);
+    }
+    CHECK(!flight_sm_hold(&sm, true, sample.timestamp_ms));
+    CHECK(sm.state == FLIGHT_STATE_ASCENDING && !sm.held);
+}
+
+int main(void)
+{
+    RUN_CASE(lone_high_g_knock_stays_armed);
+    RUN_CASE(main_deploys_at_the_deploy_height);
+    RUN_CASE(hold_keeps_pre_launch);
+    return host_test_failures ? 1 : 0;
+}
@@ -0,0 +1,213 @@
+/*
+Description: Host tests of the init dependency graph (main/init_graph.c).
+
+A driver stands in for init_runner.c: it runs the ready steps one after the other, with the result a test gives each
+step, and records the order they ran in. The steps have no run function, the graph never calls it.
+*/
+
+#include <string.h>
+#include "host_test.h"
+#include "init_graph.h"
+
+typedef struct
+{
+    int order[INIT_GRAPH_MAX_STEPS]; // Indices in the order the steps ran
+    int ran;
+} run_t;
+
+static bool listed(const char *const *names, const char *name)
+{
+    for (; names && *names; names++)
+    {
+        if (strcmp(*names, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+// Runs the graph to the end, the steps in failing return -1 and the others 0
+static run_t run_graph(init_graph_t *graph, const char *const *failing)
+{
+    run_t run = { 0 };
+    for (int index; (index = init_graph_start_next(graph)) >= 0;)
+    {
+        // Only started once its requirements are done
+        for (uint8_t r = 0; r < graph->count; r++)
+        {
+            if (graph->requires[index] & (1u << r))
+                CHECK(graph->state[r] == INIT_STEP_DONE);
+        }
+        run.order[run.ran++] = index;
+        init_graph_finish(graph, (uint8_t)index, listed(failing, graph->steps[index].name) ? -1 : 0);
+    }
+    CHECK(init_graph_settled(graph));
+    return run;
+}
+
+static int step_index(const init_graph_t *graph, const char *name)
+{
+    for (uint8_t i = 0; i < graph->count; i++)
+    {
+        if (strcmp(graph->steps[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+static init_step_state_t step_state(const init_graph_t *graph, const char *name)
+{
+    return graph->state[step_index(graph, name)];
+}
+
+static bool ran_before(const init_graph_t *graph, const run_t *run, const char *first, const char *second)
+{
+    int first_at = -1, second_at = -1;
+    for (int i = 0; i < run->ran; i++)
+    {
+        if (run->order[i] == step_index(graph, first))
+            first_at = i;
+        if (run->order[i] == step_index(graph, second))
+            second_at = i;
+    }
+    return first_at >= 0 && second_at >= 0 && first_at < second_at;
+}
+
+// The shape of init_steps in main.c: storage loads the config, io brings up the I2C bus, LEDs and buzzer optional
+static const init_step_t boot_steps[] = {
+    { .name = "context" },
+    { .name = "io" },
+    { .name = "storage", .requires = { "context" } },
+    { .name = "led", .optional = true },
+    { .name = "beep", .optional = true },
+    { .name = "pyro", .requires = { "storage" } },
+    { .name = "servo", .requires = { "storage" } },
+    { .name = "battery", .requires = { "storage" } },
+    { .name = "power", .requires = { "storage" }, .optional = true },
+    { .name = "metrics", .requires = { "storage" }, .optional = true },
+    { .name = "trace", .requires = { "storage" }, .optional = true },
+    { .name = "altimeter", .requires = { "io" } },
+    { .name = "imu", .requires = { "io" } },
+    { .name = "flight", .requires = { "imu", "altimeter", "pyro", "servo" } },
+};
+
+#define BOOT_STEPS ((uint8_t)(sizeof(boot_steps) / sizeof(boot_steps[0])))
+
+// Unknown names, a step that needs itself, cycles and too many steps are refused up front
+static void bad_graphs_are_rejected(void)
+{
+    init_graph_t graph;
+    CHECK(init_graph_init(&graph, boot_steps, BOOT_STEPS) == 0);
+
+    const init_step_t unknown[] = { { .name = "a" }, { .name = "b", .requires = { "a", "c" } } };
+    CHECK(init_graph_init(&graph, unknown, 2) == -1);
+
+    const init_step_t self[] = { { .name = "a", .requires = { "a" } } };
+    CHECK(init_graph_init(&graph, self, 1) == -1);
+
+    const init_step_t cycle[] = {
+        { .name = "a" },
+        { .name = "b", .requires = { "a", "d" } },
+        { .name = "c", .requires = { "b" } },
+        { .name = "d", .requires = { "c" } },
+    };
+    CHECK(init_graph_init(&graph, cycle, 4) == -1);
+
+    init_step_t many[INIT_GRAPH_MAX_STEPS + 1];
+    char names[INIT_GRAPH_MAX_STEPS + 1][4];
+    for (int i = 0; i <= INIT_GRAPH_MAX_STEPS; i++)
+    {
+        snprintf(names[i], sizeof(names[i]), "s%d", i);
+        many[i] = (init_step_t){ .name = names[i] };
+    }
+    CHECK(init_graph_init(&graph, many, INIT_GRAPH_MAX_STEPS) == 0);
+    CHECK(init_graph_init(&graph, many, INIT_GRAPH_MAX_STEPS + 1) == -1);
+}
+
+// Every step runs once, after what it needs, and the boot is good
+static void steps_run_after_their_requirements(void)
+{
+    init_graph_t graph;
+    CHECK(init_graph_init(&graph, boot_steps, BOOT_STEPS) == 0);
+    run_t run = run_graph(&graph, NULL);
+
+    CHECK(run.ran == BOOT_STEPS);
+    CHECK(!init_graph_failed(&graph));
+    CHECK(ran_before(&graph, &run, "context", "storage"));
+    CHECK(ran_before(&graph, &run, "storage", "servo"));
+    CHECK(ran_before(&graph, &run, "imu", "flight"));
+    CHECK(ran_before(&graph, &run, "pyro", "flight"));
+    for (uint8_t i = 0; i < graph.count; i++)
+        CHECK(graph.state[i] == INIT_STEP_DONE);
+
+    // Nothing is ready while the only step that is ready is running
+    const init_step_t chain[] = { { .name = "a" }, { .name = "b", .requires = { "a" } } };
+    CHECK(init_graph_init(&graph, chain, 2) == 0);
+    CHECK(init_graph_start_next(&graph) == 0);
+    CHECK(init_graph_start_next(&graph) == -1);
+    CHECK(!init_graph_settled(&graph));
+    init_graph_finish(&graph, 0, 0);
+    CHECK(init_graph_start_next(&graph) == 1);
+}
+
+// A failed step skips everything that needs it, directly or through other steps, the rest still runs
+static void failure_skips_the_dependents(void)
+{
+    init_graph_t graph;
+    CHECK(init_graph_init(&graph, boot_steps, BOOT_STEPS) == 0);
+    const char *const failing[] = { "storage", NULL };
+    run_graph(&graph, failing);
+
+    CHECK(step_state(&graph, "storage") == INIT_STEP_FAILED);
+    CHECK(graph.result[step_index(&graph, "storage")] == -1);
+    CHECK(step_state(&graph, "pyro") == INIT_STEP_SKIPPED);
+    CHECK(step_state(&graph, "trace") == INIT_STEP_SKIPPED);
+    CHECK(step_state(&graph, "flight") == INIT_STEP_SKIPPED); // Through pyro and servo
+    CHECK(step_state(&graph, "imu") == INIT_STEP_DONE);
+    CHECK(step_state(&graph, "led") == INIT_STEP_DONE);
+    CHECK(init_graph_failed(&graph));
+
+    // A result that comes in after the step was given up on, like a timed out step, changes nothing
+    init_graph_finish(&graph, (uint8_t)step_index(&graph, "pyro"), 0);
+    CHECK(step_state(&graph, "pyro") == INIT_STEP_SKIPPED);
+    init_graph_finish(&graph, (uint8_t)step_index(&graph, "storage"), 0);
+    CHECK(step_state(&graph, "storage") == INIT_STEP_FAILED);
+}
+
+// An optional step that fails only takes its own optional dependents along, the boot goes on
+static void optional_failure_is_not_fatal(void)
+{
+    init_graph_t graph;
+    CHECK(init_graph_init(&graph, boot_steps, BOOT_STEPS) == 0);
+    const char *const failing[] = { "led", "power", NULL };
+    run_t run = run_graph(&graph, failing);
+
+    CHECK(step_state(&graph, "led") == INIT_STEP_FAILED);
+    CHECK(step_state(&graph, "power") == INIT_STEP_FAILED);
+    CHECK(step_state(&graph, "servo") == INIT_STEP_DONE);
+    CHECK(step_state(&graph, "flight") == INIT_STEP_DONE);
+    CHECK(run.ran == BOOT_STEPS);
+    CHECK(!init_graph_failed(&graph));
+
+    // A required step behind an optional one is lost with it, and that fails the boot
+    const init_step_t behind_optional[] = {
+        { .name = "a", .optional = true },
+        { .name = "b", .requires = { "a" }, .optional = true },
+        { .name = "c", .requires = { "b" } },
+    };
+    const char *const failing_a[] = { "a", NULL };
+    CHECK(init_graph_init(&graph, behind_optional, 3) == 0);
+    run = run_graph(&graph, failing_a);
+    CHECK(run.ran == 1);
+    CHECK(step_state(&graph, "b") == INIT_STEP_SKIPPED);
+    CHECK(step_state(&graph, "c") == INIT_STEP_SKIPPED);
+    CHECK(init_graph_failed(&graph));
+}
+
+int main(void)
+{
+    RUN_CASE(bad_graphs_are_rejected);
+    RUN_CASE(steps_run_after_their_requirements);
+    RUN_CASE(failure_skips_the_dependents);
+    RUN_CASE(optional_failure_is_not_fatal);
+    return host_test_failures ? 1 : 0;
+}
@@ -0,0 +1,126 @@
+/*
+Description: Host tests of the sliding-window launch detector (components/bean_flight/launch_detect.c).
+
+The traces are synthetic pad handling at the 10 ms period of default.json, with its armed thresholds.
+*/
+
+#include "host_test.h"
+#include "launch_detect.h"
+
+#define PERIOD_MS 10
+#define PAD_MS2   9.81f
+
+static const launch_detect_config_t default_config = {
+    .threshold_ms2       = 12.0f,
+    .release_ms2         = 11.0f,
+    .spike_clip_ms2      = 30.0f,
+    .min_window_fraction = 0.8f,
+    .motion_ms2          = 10.8f,
+    .window_ms           = 150,
+    .sample_period_ms    = PERIOD_MS,
+};
+
+// Feeds a constant magnitude from start_ms for duration_ms, returns the time after the last sample
+static uint32_t feed(launch_detect_t *det, uint32_t start_ms, uint32_t duration_ms, float magnitude_ms2)
+{
+    uint32_t t = start_ms;
+    for (; t < start_ms + duration_ms; t += PERIOD_MS)
+        launch_detect_update(det, t, magnitude_ms2);
+    return t;
+}
+
+// Knocks on the rail: short spikes far above the threshold, up to a few samples long, on a quiet pad
+static void knock_spikes_are_rejected(void)
+{
+    launch_detect_t det;
+    launch_detect_init(&det, &default_config);
+
+    uint32_t t = feed(&det, 0, 2000, PAD_MS2);
+    for (int knock = 0; knock < 20; knock++)
+    {
+        // 1 to 3 samples of up to 40 g, then the pad again
+        int length = 1 + knock % 3;
+        for (int i = 0; i < length; i++, t += PERIOD_MS)
+            CHECK(!launch_detect_update(&det, t, 400.0f));
+        t = feed(&det, t, 80 + 10 * (knock % 5), PAD_MS2);
+    }
+    CHECK(!det.launched);
+
+    // A real motor still gets through after the knocks
+    t = feed(&det, t, 300, 40.0f);
+    CHECK(det.launched);
+
+    // With almost no fraction required only the clip stands between a single knock and the window threshold
+    launch_detect_config_t low_fraction = default_config;
+    low_fraction.min_window_fraction    = 0.05f; // One sample
+    launch_detect_init(&det, &low_fraction);
+    t = feed(&det, 0, 500, PAD_MS2);
+    t = feed(&det, t, PERIOD_MS, 400.0f);
+    t = feed(&det, t, 500, PAD_MS2);
+    CHECK(!det.launched);
+}
+
+// Thrust ripple around the threshold keeps counting while it stays above the release level
+static void hysteresis_holds_through_ripple(void)
+{
+    launch_detect_t det;
+    launch_detect_init(&det, &default_config);
+
+    uint32_t t = feed(&det, 0, 1000, PAD_MS2);
+    t          = feed(&det, t, PERIOD_MS, 13.0f);
+    for (int i = 0; i < 40 && !det.launched; i++, t += PERIOD_MS)
+        launch_detect_update(&det, t, i % 2 ? 13.0f : 11.5f);
+    CHECK(det.launched);
+
+    // The same ripple without hysteresis only counts every other sample, below the fraction of the window
+    launch_detect_config_t no_hysteresis = default_config;
+    no_hysteresis.release_ms2            = no_hysteresis.threshold_ms2;
+    launch_detect_init(&det, &no_hysteresis);
+    t = feed(&det, 0, 1000, PAD_MS2);
+    for (int i = 0; i < 40; i++, t += PERIOD_MS)
+        launch_detect_update(&det, t, i % 2 ? 13.0f : 11.5f);
+    CHECK(!det.launched);
+
+    // Dips below the release level stop the count, a slow lift off the rail is not a launch
+    launch_detect_init(&det, &default_config);
+    t = feed(&det, 0, 1000, PAD_MS2);
+    for (int i = 0; i < 40; i++, t += PERIOD_MS)
+        launch_detect_update(&det, t, i % 2 ? 14.0f : 10.5f);
+    CHECK(!det.launched);
+}
+
+// The first motion is found in the pre-launch buffer, before the samples that confirmed the launch
+static void first_motion_from_the_buffer(void)
+{
+    launch_detect_t det;
+    launch_detect_init(&det, &default_config);
+
+    uint32_t t = feed(&det, 0, 900, PAD_MS2);
+    t          = feed(&det, t, PERIOD_MS, 50.0f); // A knock, separated from the motion by quiet samples
+    t          = feed(&det, t, 90, PAD_MS2);
+    CHECK(t == 1000);
+    t = feed(&det, t, 50, 11.0f); // Igniter and rail friction, motion but not thrust
+    while (!det.launched && t < 2000)
+    {
+        launch_detect_update(&det, t, 20.0f);
+        t += PERIOD_MS;
+    }
+
+    CHECK(det.launched);
+    CHECK(det.first_motion_timestamp_ms == 1000);
+    // 12 thrusting samples out of the 15 of the window, from 1050 on
+    CHECK(det.launch_timestamp_ms == 1160);
+    CHECK(det.first_motion_timestamp_ms < det.launch_timestamp_ms);
+
+    // Later samples keep the result
+    CHECK(launch_detect_update(&det, t, PAD_MS2));
+    CHECK(det.first_motion_timestamp_ms == 1000);
+}
+
+int main(void)
+{
+    RUN_CASE(knock_spikes_are_rejected);
+    RUN_CASE(hysteresis_holds_through_ripple);
+    RUN_CASE(first_motion_from_the_buffer);
+    return host_test_failures ? 1 : 0;
+}
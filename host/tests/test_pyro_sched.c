@@ -0,0 +1,184 @@
+/*
+Description: Host tests of the pyro channel scheduler (components/bean_pyro/pyro_sched.c) against a GPIO stand-in.
+
+The outputs are GPIOs of the POSIX backend of bean_hal and the time is its virtual clock, so every edge is exact to
+the microsecond. The hold timer is a deadline the test serves when the clock gets there, as the alarm would.
+*/
+
+#include "bean_hal.h"
+#include "bean_hal_posix.h"
+#include "host_test.h"
+#include "pyro_sched.h"
+
+#define HOLD_US        1000000
+#define ARM_TIMEOUT_US 30000000
+#define START_US       1000000
+
+static const int channel_gpio[PYRO_SCHED_CHANNELS] = { 10, 11, 12, 13 };
+
+// The stand-in of bean_pyro.c: the GPIO of each channel, the time of its last edge and the hold timer alarm
+typedef struct
+{
+    int64_t edge_us[PYRO_SCHED_CHANNELS];
+    int edges[PYRO_SCHED_CHANNELS];
+    int64_t alarm_us; // -1 when the alarm is off
+} stand_in_t;
+
+static stand_in_t stand_in;
+static pyro_sched_t sched;
+
+static void io_set_output(void *ctx, uint8_t channel, bool on)
+{
+    stand_in_t *io = ctx;
+    if (bean_hal_gpio_get_level(channel_gpio[channel]) != (on ? 1 : 0))
+    {
+        io->edge_us[channel] = bean_hal_time_us();
+        io->edges[channel]++;
+    }
+    bean_hal_gpio_set_level(channel_gpio[channel], on ? 1 : 0);
+}
+
+static int64_t io_now_us(void *ctx)
+{
+    return bean_hal_time_us();
+}
+
+static void io_schedule(void *ctx, int64_t delay_us)
+{
+    stand_in_t *io = ctx;
+    io->alarm_us   = delay_us < 0 ? -1 : bean_hal_time_us() + delay_us;
+}
+
+// Moves the clock on to time_us in steps of 1 ms and serves the alarm when it is due, as the timer interrupt would
+static void run_until(int64_t time_us)
+{
+    for (int64_t now_us = bean_hal_time_us(); now_us < time_us;)
+    {
+        now_us += 1000;
+        if (now_us > time_us)
+            now_us = time_us;
+        if (stand_in.alarm_us >= 0 && stand_in.alarm_us <= now_us)
+            now_us = stand_in.alarm_us;
+        bean_hal_posix_set_clock(now_us);
+        if (stand_in.alarm_us >= 0 && stand_in.alarm_us <= now_us)
+            pyro_sched_service(&sched);
+    }
+}
+
+static void setup(uint32_t arm_timeout_us)
+{
+    stand_in          = (stand_in_t){ .alarm_us = -1 };
+    pyro_io_t io      = { .set_output = io_set_output, .now_us = io_now_us, .schedule = io_schedule, .ctx = &stand_in };
+    int64_t origin_us = bean_hal_time_us();
+    for (uint8_t ch = 0; ch < PYRO_SCHED_CHANNELS; ch++)
+        bean_hal_gpio_set_level(channel_gpio[ch], 1); // Whatever the pins were, init drives them low
+    pyro_sched_init(&sched, &io, HOLD_US, arm_timeout_us);
+    for (uint8_t ch = 0; ch < PYRO_SCHED_CHANNELS; ch++)
+    {
+        CHECK(bean_hal_gpio_get_level(channel_gpio[ch]) == 0);
+        stand_in.edges[ch] = 0;
+    }
+    CHECK(bean_hal_time_us() == origin_us);
+}
+
+// Only an armed channel fires, once, and an armed channel left alone disarms after the timeout
+static void arm_fire_and_timeout(void)
+{
+    setup(ARM_TIMEOUT_US);
+
+    CHECK(pyro_sched_fire(&sched, 0, bean_hal_time_us(), NULL) == PYRO_ERR_NOT_ARMED);
+    CHECK(pyro_sched_arm(&sched, PYRO_SCHED_CHANNELS) == PYRO_ERR_CHANNEL);
+    CHECK(bean_hal_gpio_get_level(channel_gpio[0]) == 0);
+
+    CHECK(pyro_sched_arm(&sched, 0) == PYRO_OK);
+    CHECK(pyro_sched_arm(&sched, 1) == PYRO_OK);
+    int64_t armed_us = bean_hal_time_us();
+    CHECK(stand_in.alarm_us == armed_us + ARM_TIMEOUT_US);
+
+    run_until(armed_us + 2000000);
+    CHECK(pyro_sched_fire(&sched, 0, bean_hal_time_us(), NULL) == PYRO_OK);
+    CHECK(bean_hal_gpio_get_level(channel_gpio[0]) == 1);
+    CHECK(pyro_sched_fire(&sched, 0, bean_hal_time_us(), NULL) == PYRO_ERR_ALREADY_FIRED);
+    CHECK(pyro_sched_arm(&sched, 0) == PYRO_ERR_ALREADY_FIRED);
+
+    // Channel 1 never fires and disarms at the timeout, to the microsecond
+    run_until(armed_us + ARM_TIMEOUT_US - 1);
+    CHECK(pyro_sched_state(&sched, 1) == PYRO_CHANNEL_ARMED);
+    run_until(armed_us + ARM_TIMEOUT_US);
+    CHECK(pyro_sched_state(&sched, 1) == PYRO_CHANNEL_DISARMED);
+    CHECK(pyro_sched_fire(&sched, 1, bean_hal_time_us(), NULL) == PYRO_ERR_NOT_ARMED);
+    CHECK(stand_in.edges[1] == 0);
+    CHECK(stand_in.alarm_us == -1);
+}
+
+// The output stays on for exactly the hold time, also with two channels whose holds overlap
+static void hold_expires_on_time(void)
+{
+    setup(0);
+    CHECK(pyro_sched_arm(&sched, 2) == PYRO_OK);
+    CHECK(pyro_sched_arm(&sched, 3) == PYRO_OK);
+    CHECK(stand_in.alarm_us == -1); // No arm timeout, nothing to wait for
+
+    run_until(bean_hal_time_us() + 5000000);
+    int64_t first_us = bean_hal_time_us();
+    CHECK(pyro_sched_fire(&sched, 2, first_us, NULL) == PYRO_OK);
+    run_until(first_us + 300000);
+    int64_t second_us = bean_hal_time_us();
+    CHECK(pyro_sched_fire(&sched, 3, second_us, NULL) == PYRO_OK);
+    CHECK(stand_in.alarm_us == first_us + HOLD_US);
+
+    run_until(first_us + HOLD_US - 1);
+    CHECK(bean_hal_gpio_get_level(channel_gpio[2]) == 1);
+    run_until(first_us + HOLD_US);
+    CHECK(bean_hal_gpio_get_level(channel_gpio[2]) == 0);
+    CHECK(stand_in.edge_us[2] == first_us + HOLD_US);
+    CHECK(pyro_sched_state(&sched, 2) == PYRO_CHANNEL_FIRED);
+    CHECK(bean_hal_gpio_get_level(channel_gpio[3]) == 1);
+    CHECK(stand_in.alarm_us == second_us + HOLD_US);
+
+    run_until(second_us + HOLD_US + 1000000);
+    CHECK(bean_hal_gpio_get_level(channel_gpio[3]) == 0);
+    CHECK(stand_in.edge_us[3] == second_us + HOLD_US);
+    CHECK(stand_in.edges[2] == 2 && stand_in.edges[3] == 2);
+    CHECK(stand_in.alarm_us == -1);
+
+    // A disarm in the hold ends it right away, the channel is spent
+    setup(0);
+    CHECK(pyro_sched_arm(&sched, 0) == PYRO_OK);
+    CHECK(pyro_sched_fire(&sched, 0, bean_hal_time_us(), NULL) == PYRO_OK);
+    run_until(bean_hal_time_us() + 100000);
+    CHECK(pyro_sched_disarm(&sched, 0) == PYRO_OK);
+    CHECK(bean_hal_gpio_get_level(channel_gpio[0]) == 0);
+    CHECK(pyro_sched_state(&sched, 0) == PYRO_CHANNEL_FIRED);
+    CHECK(stand_in.alarm_us == -1);
+}
+
+// The latency runs from the detection sample to the output edge, whatever came in between
+static void latency_from_detection_to_edge(void)
+{
+    setup(ARM_TIMEOUT_US);
+    CHECK(pyro_sched_arm(&sched, 1) == PYRO_OK);
+    run_until(bean_hal_time_us() + 1000000);
+
+    // The sample that saw the apogee, then the state machine and the logging before the fire command
+    int64_t detect_us = bean_hal_time_us();
+    bean_hal_posix_set_clock(detect_us + 1234);
+    pyro_fire_record_t record;
+    CHECK(pyro_sched_fire(&sched, 1, detect_us, &record) == PYRO_OK);
+
+    CHECK(record.channel == 1);
+    CHECK(record.detect_us == detect_us);
+    CHECK(record.fire_us == stand_in.edge_us[1]);
+    CHECK(record.fire_us == detect_us + 1234);
+    CHECK(record.latency_us == 1234);
+}
+
+int main(void)
+{
+    bean_hal_posix_set_log_level(BEAN_HAL_LOG_WARN);
+    bean_hal_posix_use_virtual_clock(START_US);
+    RUN_CASE(arm_fire_and_timeout);
+    RUN_CASE(hold_expires_on_time);
+    RUN_CASE(latency_from_detection_to_edge);
+    return host_test_failures ? 1 : 0;
+}
@@ -0,0 +1,56 @@
+#include "boot_profile.h"
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+void boot_profile_init(boot_profile_t *profile, int64_t start_us)
+{
+    memset(profile, 0, sizeof(*profile));
+    profile->start_us = start_us;
+}
+
+void boot_profile_add(boot_profile_t *profile, const char *name, int64_t start_us, int64_t end_us, bool ok)
+{
+    if (profile->count >= BOOT_PROFILE_MAX_STAGES)
+    {
+        profile->dropped++;
+        return;
+    }
+    profile->stages[profile->count++] = (boot_stage_t){
+        .name        = name,
+        .start_us    = start_us,
+        .duration_us = end_us - start_us,
+        .ok          = ok,
+    };
+}
+
+size_t boot_profile_format(const boot_profile_t *profile, int64_t now_us, char *buffer, size_t length)
+{
+    if (length == 0)
+        return 0;
+
+    int64_t total_us = now_us - profile->start_us;
+    int written      = snprintf(
+      buffer, length, "app_main_us=%" PRId64 ";total_us=%" PRId64, profile->start_us, total_us);
+    if (written < 0 || (size_t)written >= length)
+    {
+        buffer[0] = '\0';
+        return 0;
+    }
+
+    size_t used = (size_t)written;
+    for (uint8_t i = 0; i < profile->count; i++)
+    {
+        const boot_stage_t *stage = &profile->stages[i];
+        const char *mark          = stage->ok ? "" : "!";
+
+        written = snprintf(buffer + used, length - used, ";%s%s_us=%" PRId64, mark, stage->name, stage->duration_us);
+        if (written < 0 || (size_t)written >= length - used)
+        {
+            buffer[used] = '\0';
+            break;
+        }
+        used += (size_t)written;
+    }
+    return used;
+}
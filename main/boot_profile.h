@@ -0,0 +1,43 @@
+#pragma once
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Boot profile: the duration of each init stage, from timestamps taken by the caller.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host. The caller serializes the calls,
+ * a stage that ran on another task is added once that task is done.
+ */
+
+#define BOOT_PROFILE_MAX_STAGES 20
+
+typedef struct boot_stage
+{
+    const char *name; // Not copied, a string literal
+    int64_t start_us;
+    int64_t duration_us;
+    bool ok;
+} boot_stage_t;
+
+typedef struct boot_profile
+{
+    int64_t start_us; // Entry of app_main, the time before it is the ROM, the bootloader and the startup code
+    uint8_t count;
+    uint8_t dropped; // Stages that did not fit
+    boot_stage_t stages[BOOT_PROFILE_MAX_STAGES];
+} boot_profile_t;
+
+void boot_profile_init(boot_profile_t *profile, int64_t start_us);
+
+void boot_profile_add(boot_profile_t *profile, const char *name, int64_t start_us, int64_t end_us, bool ok);
+
+/**
+ * @brief Writes the profile as one event line: `app_main_us=..;total_us=..;<stage>_us=..;...`
+ *
+ * A failed stage is marked with `!`. The line is cut at the last complete stage that fits.
+ *
+ * @param now_us End of the boot, for the total
+ * @return Length written, without the terminator
+ */
+size_t boot_profile_format(const boot_profile_t *profile, int64_t now_us, char *buffer, size_t length);
@@ -0,0 +1,141 @@
+#include "init_graph.h"
+#include <string.h>
+
+static const char *state_names[] = { "pending", "running", "done", "failed", "skipped" };
+
+const char *init_step_state_name(init_step_state_t state)
+{
+    if (state > INIT_STEP_SKIPPED)
+        return "unknown";
+    return state_names[state];
+}
+
+static int find_step(const init_step_t *steps, uint8_t count, const char *name)
+{
+    for (uint8_t i = 0; i < count; i++)
+    {
+        if (strcmp(steps[i].name, name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Kahn's algorithm: the graph is acyclic when every step can be taken out once its requirements are out
+static bool is_acyclic(const init_graph_t *graph)
+{
+    uint32_t taken = 0;
+    bool progress  = true;
+    while (progress)
+    {
+        progress = false;
+        for (uint8_t i = 0; i < graph->count; i++)
+        {
+            if (!(taken & (1u << i)) && (graph->requires[i] & ~taken) == 0)
+            {
+                taken |= 1u << i;
+                progress = true;
+            }
+        }
+    }
+    return taken == (1u << graph->count) - 1;
+}
+
+int init_graph_init(init_graph_t *graph, const init_step_t *steps, uint8_t count)
+{
+    memset(graph, 0, sizeof(*graph));
+    if (count > INIT_GRAPH_MAX_STEPS)
+        return -1;
+    graph->steps = steps;
+    graph->count = count;
+
+    for (uint8_t i = 0; i < count; i++)
+    {
+        for (uint8_t r = 0; r < INIT_STEP_MAX_REQUIRES && steps[i].requires[r]; r++)
+        {
+            int required = find_step(steps, count, steps[i].requires[r]);
+            if (required < 0 || required == i)
+                return -1;
+            graph->requires[i] |= 1u << required;
+        }
+    }
+    return is_acyclic(graph) ? 0 : -1;
+}
+
+int init_graph_start_next(init_graph_t *graph)
+{
+    for (uint8_t i = 0; i < graph->count; i++)
+    {
+        if (graph->state[i] != INIT_STEP_PENDING)
+            continue;
+
+        bool ready = true;
+        for (uint8_t r = 0; r < graph->count && ready; r++)
+        {
+            if ((graph->requires[i] & (1u << r)) && graph->state[r] != INIT_STEP_DONE)
+                ready = false;
+        }
+        if (ready)
+        {
+            graph->state[i] = INIT_STEP_RUNNING;
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Skips the pending steps that need a step that will never be done, until nothing changes
+static void skip_dependents(init_graph_t *graph)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (uint8_t i = 0; i < graph->count; i++)
+        {
+            if (graph->state[i] != INIT_STEP_PENDING)
+                continue;
+            for (uint8_t r = 0; r < graph->count; r++)
+            {
+                bool lost = graph->state[r] == INIT_STEP_FAILED || graph->state[r] == INIT_STEP_SKIPPED;
+                if ((graph->requires[i] & (1u << r)) && lost)
+                {
+                    graph->state[i] = INIT_STEP_SKIPPED;
+                    changed         = true;
+                    break;
+                }
+            }
+        }
+    }
+}
+
+void init_graph_finish(init_graph_t *graph, uint8_t index, int result)
+{
+    if (index >= graph->count || graph->state[index] != INIT_STEP_RUNNING)
+        return;
+
+    graph->result[index] = result;
+    graph->state[index]  = result == 0 ? INIT_STEP_DONE : INIT_STEP_FAILED;
+    if (result != 0)
+        skip_dependents(graph);
+}
+
+bool init_graph_settled(const init_graph_t *graph)
+{
+    for (uint8_t i = 0; i < graph->count; i++)
+    {
+        if (graph->state[i] == INIT_STEP_PENDING || graph->state[i] == INIT_STEP_RUNNING)
+            return false;
+    }
+    return true;
+}
+
+bool init_graph_failed(const init_graph_t *graph)
+{
+    for (uint8_t i = 0; i < graph->count; i++)
+    {
+        bool lost = graph->state[i] == INIT_STEP_FAILED || graph->state[i] == INIT_STEP_SKIPPED;
+        if (lost && !graph->steps[i].optional)
+            return true;
+    }
+    return false;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Init dependency graph: each step names the steps it needs, the graph tells which steps are ready to run and what
+ * a failure takes down with it.
+ *
+ * This file has no ESP-IDF dependencies so it can be compiled and exercised on a host. It does not run anything, the
+ * executor (init_runner.c) starts the ready steps and reports back with init_graph_finish().
+ */
+
+#define INIT_GRAPH_MAX_STEPS   16
+#define INIT_STEP_MAX_REQUIRES 4
+
+typedef enum init_step_state
+{
+    INIT_STEP_PENDING,
+    INIT_STEP_RUNNING,
+    INIT_STEP_DONE,
+    INIT_STEP_FAILED,
+    INIT_STEP_SKIPPED, // A required step failed or was skipped, this one never ran
+} init_step_state_t;
+
+typedef struct init_step
+{
+    const char *name;
+    int (*run)(void); // 0 on success, an esp_err_t on the target
+    const char *requires[INIT_STEP_MAX_REQUIRES]; // Names of the steps that have to be done first, unused ones NULL
+    bool optional; // The boot goes on without it
+    uint32_t timeout_ms; // 0 waits forever
+} init_step_t;
+
+typedef struct init_graph
+{
+    const init_step_t *steps;
+    uint8_t count;
+    uint32_t requires[INIT_GRAPH_MAX_STEPS]; // Bit i is set when the step needs step i
+    init_step_state_t state[INIT_GRAPH_MAX_STEPS];
+    int result[INIT_GRAPH_MAX_STEPS];
+} init_graph_t;
+
+/**
+ * @brief Resolves the requirements of the steps.
+ *
+ * @return 0, or -1 when a step needs an unknown step, there are too many steps or the requirements form a cycle
+ */
+int init_graph_init(init_graph_t *graph, const init_step_t *steps, uint8_t count);
+
+/**
+ * @brief Gets a pending step whose requirements are all done and marks it as running.
+ *
+ * @return The index of the step, -1 when no step is ready now
+ */
+int init_graph_start_next(init_graph_t *graph);
+
+/**
+ * @brief Records the result of a running step. A failure skips every pending step that needs it, directly or not.
+ *
+ * Results of steps that are not running (a step that already timed out) are ignored.
+ */
+void init_graph_finish(init_graph_t *graph, uint8_t index, int result);
+
+/**
+ * @brief Returns true when no step is pending or running anymore.
+ */
+bool init_graph_settled(const init_graph_t *graph);
+
+/**
+ * @brief Returns true when a step that is not optional failed or was skipped.
+ */
+bool init_graph_failed(const init_graph_t *graph);
+
+const char *init_step_state_name(init_step_state_t state);
@@ -0,0 +1,134 @@
+#include "init_runner.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/queue.h"
+#include "freertos/task.h"
+
+static const char *TAG = "INIT";
+
+typedef struct init_worker
+{
+    const init_step_t *step;
+    uint8_t index;
+} init_worker_t;
+
+typedef struct init_report
+{
+    uint8_t index;
+    esp_err_t result;
+    int64_t start_us;
+    int64_t end_us;
+} init_report_t;
+
+// Never deleted: a step that timed out may still report long after the runner returned
+static QueueHandle_t report_queue = NULL;
+static init_worker_t workers[INIT_GRAPH_MAX_STEPS];
+
+static void vtask_init_worker(void *pvParameter)
+{
+    const init_worker_t *worker = (const init_worker_t *)pvParameter;
+    init_report_t report        = { .index = worker->index, .start_us = esp_timer_get_time() };
+    report.result               = worker->step->run();
+    report.end_us               = esp_timer_get_time();
+    xQueueSend(report_queue, &report, portMAX_DELAY);
+    vTaskDelete(NULL);
+}
+
+static void finish_step(init_graph_t *graph, boot_profile_t *profile, const init_report_t *report)
+{
+    const init_step_t *step = &graph->steps[report->index];
+    init_graph_finish(graph, report->index, report->result);
+    boot_profile_add(profile, step->name, report->start_us, report->end_us, report->result == ESP_OK);
+
+    if (report->result != ESP_OK)
+        ESP_LOGW(TAG,
+                 "%s failed (%s)%s",
+                 step->name,
+                 esp_err_to_name(report->result),
+                 step->optional ? ", continuing without it" : "");
+}
+
+esp_err_t init_runner_run(init_graph_t *graph, boot_profile_t *profile)
+{
+    if (!report_queue)
+        report_queue = xQueueCreate(INIT_GRAPH_MAX_STEPS, sizeof(init_report_t));
+    if (!report_queue)
+        return ESP_ERR_NO_MEM;
+
+    int64_t deadline_us[INIT_GRAPH_MAX_STEPS] = { 0 };
+    int64_t started_us[INIT_GRAPH_MAX_STEPS]  = { 0 };
+    UBaseType_t priority                      = uxTaskPriorityGet(NULL);
+    BaseType_t next_core                      = 0;
+
+    while (!init_graph_settled(graph))
+    {
+        int index;
+        while ((index = init_graph_start_next(graph)) >= 0)
+        {
+            const init_step_t *step = &graph->steps[index];
+            workers[index]          = (init_worker_t){ .step = step, .index = (uint8_t)index };
+            started_us[index]       = esp_timer_get_time();
+            deadline_us[index]      = step->timeout_ms ? started_us[index] + step->timeout_ms * 1000LL : INT64_MAX;
+            if (xTaskCreatePinnedToCore(&vtask_init_worker,
+                                        step->name,
+                                        INIT_RUNNER_TASK_STACK_SIZE,
+                                        &workers[index],
+                                        priority,
+                                        NULL,
+                                        next_core) != pdPASS)
+            {
+                init_report_t report = { .index    = (uint8_t)index,
+                                         .result   = ESP_ERR_NO_MEM,
+                                         .start_us = started_us[index],
+                                         .end_us   = started_us[index] };
+                finish_step(graph, profile, &report);
+                continue;
+            }
+            next_core = (next_core + 1) % portNUM_PROCESSORS;
+        }
+        if (init_graph_settled(graph))
+            break;
+
+        // Wait for the next report, or until the first running step is overdue
+        int64_t next_deadline_us = INT64_MAX;
+        for (uint8_t i = 0; i < graph->count; i++)
+        {
+            if (graph->state[i] == INIT_STEP_RUNNING && deadline_us[i] < next_deadline_us)
+                next_deadline_us = deadline_us[i];
+        }
+        TickType_t ticks = portMAX_DELAY;
+        if (next_deadline_us != INT64_MAX)
+        {
+            int64_t wait_us = next_deadline_us - esp_timer_get_time();
+            ticks           = wait_us > 0 ? pdMS_TO_TICKS(wait_us / 1000) + 1 : 0;
+        }
+
+        init_report_t report;
+        if (xQueueReceive(report_queue, &report, ticks) == pdTRUE)
+        {
+            if (graph->state[report.index] == INIT_STEP_RUNNING)
+                finish_step(graph, profile, &report);
+            continue;
+        }
+
+        int64_t now_us = esp_timer_get_time();
+        for (uint8_t i = 0; i < graph->count; i++)
+        {
+            if (graph->state[i] == INIT_STEP_RUNNING && deadline_us[i] <= now_us)
+            {
+                init_report_t timeout = {
+                    .index = i, .result = ESP_ERR_TIMEOUT, .start_us = started_us[i], .end_us = now_us
+                };
+                finish_step(graph, profile, &timeout);
+            }
+        }
+    }
+
+    for (uint8_t i = 0; i < graph->count; i++)
+    {
+        if (graph->state[i] == INIT_STEP_SKIPPED)
+            ESP_LOGW(TAG, "%s skipped, a step it needs failed", graph->steps[i].name);
+    }
+    return init_graph_failed(graph) ? ESP_FAIL : ESP_OK;
+}
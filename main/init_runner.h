@@ -0,0 +1,17 @@
+#pragma once
+#include "esp_err.h"
+#include "init_graph.h"
+#include "boot_profile.h"
+
+#define INIT_RUNNER_TASK_STACK_SIZE 6144 // The storage step parses the config on it
+
+/**
+ * @brief Runs the steps of an init graph, each on its own task as soon as its requirements are done.
+ *
+ * The worker tasks are spread over the cores and run at the priority of the caller, which waits until the graph
+ * settles. A step that does not finish within its timeout counts as failed with ESP_ERR_TIMEOUT, its task is left to
+ * finish on its own. The duration of every step is added to the boot profile.
+ *
+ * @return ESP_OK, or ESP_FAIL when a step that is not optional failed or was skipped
+ */
+esp_err_t init_runner_run(init_graph_t *graph, boot_profile_t *profile);
@@ -16,44 +16,344 @@
 #include "bean_storage.h"
 #include "bean_battery.h"
 #include "bean_context.h"
+#include "bean_flight.h"
+#include "bean_pyro.h"
+#include "bean_servo.h"
+#include "bean_power.h"
+#include "bean_metrics.h"
+#include "bean_trace.h"
+#include "bean_console.h"
 #include "hal/usb_serial_jtag_ll.h"
 #include "cJSON.h"
+#include "esp_timer.h"
+#include "esp_system.h"
+#include "boot_profile.h"
+#include "init_graph.h"
+#include "init_runner.h"
+
+#define READY_LED_MS 3000 // White LED once the boot is done
 
 static char TAG[] = "MAIN";
 
 static bean_context_t *bean_context = NULL; // The main bean context that is shared between components
+static boot_profile_t boot_profile;
+static const flight_checkpoint_t *resume_checkpoint = NULL; // Set when a warm reset interrupted a flight
+
+// Runs one init step and records how long it took in the boot profile
+#define BOOT_STAGE(name, call)                                                                                         \
+    ({                                                                                                                 \
+        int64_t stage_start_us = esp_timer_get_time();                                                                 \
+        esp_err_t stage_ret    = (call);                                                                               \
+        boot_profile_add(&boot_profile, name, stage_start_us, esp_timer_get_time(), stage_ret == ESP_OK);              \
+        stage_ret;                                                                                                     \
+    })
+
+static esp_err_t init_context(void)
+{
+    return bean_context_init(&bean_context);
+}
+
+static esp_err_t init_storage(void)
+{
+    return bean_storage_init(bean_context);
+}
+
+// The snapshot of the conf.json the interrupted flight was configured from, the file system is not needed for it
+static esp_err_t init_resumed_config(void)
+{
+    return bean_context_load_config_snapshot(resume_checkpoint->origin.config_hash);
+}
+
+static esp_err_t init_resumed_storage(void)
+{
+    return bean_storage_resume(bean_context,
+                               resume_checkpoint->origin.log_number,
+                               resume_checkpoint->origin.config_hash);
+}
+
+static esp_err_t init_battery(void)
+{
+    return bean_battery_init(bean_context);
+}
+
+static esp_err_t init_power(void)
+{
+    return bean_power_init(bean_context);
+}
+
+static esp_err_t init_metrics(void)
+{
+    return bean_metrics_start(bean_context);
+}
+
+// The crash trace waits in RAM until the storage is there, the recording starts once it is written
+static esp_err_t init_trace(void)
+{
+    return bean_trace_save_crash(STORAGE_BASE_PATH "/crash_trace.bin");
+}
+
+static esp_err_t init_flight(void)
+{
+    return bean_flight_init(bean_context);
+}
+
+// Everything that reads the config needs storage, which loads it. The I2C sensors, the SPI flash, the ADC and the
+// buzzer are independent peripherals and come up side by side, the I2C driver serializes the altimeter and the
+// IMU. LEDs and servos share the LEDC peripheral but not its timers or channels, and the LEDC driver locks its
+// registers, so they come up side by side too. The LEDs and the buzzer are optional, the flight computer works
+// without them, and so does it without power management.
+static const init_step_t init_steps[] = {
+    { .name = "context", .run = init_context },
+    { .name = "io", .run = io_init },
+    { .name = "storage", .run = init_storage, .requires = { "context" }, .timeout_ms = 30000 }, // May format
+    { .name = "led", .run = bean_led_init, .optional = true, .timeout_ms = 1000 },
+    { .name = "beep", .run = bean_beep_init, .optional = true, .timeout_ms = 1000 },
+    { .name = "pyro", .run = bean_pyro_init, .requires = { "storage" }, .timeout_ms = 1000 },
+    { .name = "servo", .run = bean_servo_init, .requires = { "storage" }, .timeout_ms = 1000 },
+    { .name = "battery", .run = init_battery, .requires = { "storage" }, .timeout_ms = 1000 },
+    { .name = "power", .run = init_power, .requires = { "storage" }, .optional = true, .timeout_ms = 1000 },
+    { .name = "metrics", .run = init_metrics, .requires = { "storage" }, .optional = true, .timeout_ms = 1000 },
+    { .name = "trace", .run = init_trace, .requires = { "storage" }, .optional = true, .timeout_ms = 2000 },
+    { .name = "altimeter", .run = bean_altimeter_init, .requires = { "io" }, .timeout_ms = 2000 },
+    { .name = "imu", .run = bean_imu_init, .requires = { "io" }, .timeout_ms = 3000 }, // Up to 10 reset retries
+    { .name = "flight", .run = init_flight, .requires = { "imu", "altimeter", "pyro", "servo" }, .timeout_ms = 2000 },
+};
+
+// After a warm reset in flight only what the acquisition needs comes up, with the config from the NVS snapshot.
+// Logging is optional here, the deployments are not. The buzzer is only there for the recovery beacon.
+static const init_step_t resume_steps[] = {
+    { .name = "context", .run = init_context },
+    { .name = "io", .run = io_init },
+    { .name = "config", .run = init_resumed_config, .requires = { "context" }, .timeout_ms = 1000 },
+    { .name = "storage", .run = init_resumed_storage, .requires = { "context" }, .optional = true, .timeout_ms = 5000 },
+    { .name = "metrics", .run = init_metrics, .requires = { "config" }, .optional = true, .timeout_ms = 1000 },
+    { .name = "led", .run = bean_led_init, .optional = true, .timeout_ms = 1000 },
+    { .name = "beep", .run = bean_beep_init, .optional = true, .timeout_ms = 1000 },
+    { .name = "pyro", .run = bean_pyro_init, .requires = { "config" }, .timeout_ms = 1000 },
+    { .name = "servo", .run = bean_servo_init, .requires = { "config" }, .timeout_ms = 1000 },
+    { .name = "altimeter", .run = bean_altimeter_init, .requires = { "io" }, .timeout_ms = 2000 },
+    { .name = "imu", .run = bean_imu_init, .requires = { "io" }, .timeout_ms = 3000 },
+    { .name = "flight", .run = init_flight, .requires = { "imu", "altimeter", "pyro", "servo" }, .timeout_ms = 2000 },
+};
+
+static esp_err_t run_init_steps(const init_step_t *steps, size_t count)
+{
+    init_graph_t graph;
+    if (init_graph_init(&graph, steps, count) != 0)
+    {
+        ESP_LOGE(TAG, "Init steps need an unknown step or form a cycle");
+        return ESP_ERR_INVALID_ARG;
+    }
+    return init_runner_run(&graph, &boot_profile);
+}
 
 esp_err_t bean_init()
 {
-    ESP_RETURN_ON_ERROR(bean_context_init(&bean_context), TAG, "Bean Context Init failed");
-    ESP_RETURN_ON_ERROR(io_init(), TAG, "IO Init failed");
-    ESP_RETURN_ON_ERROR(bean_storage_init(bean_context), TAG, "Storage Init failed");
-    ESP_RETURN_ON_ERROR(bean_led_init(), TAG, "LEDs Init failed");
-    ESP_RETURN_ON_ERROR(bean_battery_init(bean_context), TAG, "Battery Init failed");
-    ESP_RETURN_ON_ERROR(bean_altimeter_init(), TAG, "BMP390 Init failed");
-    ESP_RETURN_ON_ERROR(bean_imu_init(), TAG, "BMI088 Init failed");
-    ESP_RETURN_ON_ERROR(bean_beep_init(), TAG, "Beep Init failed");
+    return run_init_steps(init_steps, sizeof(init_steps) / sizeof(init_steps[0]));
+}
+
+// Returns right away, the beeper task plays it
+static void play_startup_melody(void)
+{
+    const uint16_t notes[] = { NOTE_C6, NOTE_E4, NOTE_G4, NOTE_C5, NOTE_E5 };
+    beep_sequence_t melody;
+    beep_sequence_init(&melody, BEEP_PRIORITY_FEEDBACK, 0);
+    for (size_t i = 0; i < sizeof(notes) / sizeof(notes[0]); i++)
+        beep_sequence_add(&melody, notes[i], 100);
+    bean_beep_play(&melody);
+}
+
+// The LED task goes back to the LED functions on its own once it is over
+static void show_ready_led(void)
+{
+    bean_led_show(LED_BOTH, (led_color_rgb_t){ 255, 255, 255 }, LED_PATTERN_FIXED, READY_LED_MS);
+}
+
+// Red on both LEDs, written directly when the LED task is not running
+static void show_error_led(void)
+{
+    led_color_rgb_t red = { 255, 0, 0 };
+    if (bean_led_show(LED_BOTH, red, LED_PATTERN_FIXED, 0) != ESP_OK)
+        bean_led_set_color(LED_BOTH, red);
+}
+
+// Not fatal, without the LED task the LEDs just stay dark
+static void start_led_task(void)
+{
+    if (BOOT_STAGE("led_task", bean_led_start(bean_context)) != ESP_OK)
+        ESP_LOGW(TAG, "LED task not available");
+}
+
+// Logged once the acquisition runs, the event log only takes events once the MSC check is done
+static void report_boot_profile(void)
+{
+    char line[256];
+    boot_profile_format(&boot_profile, esp_timer_get_time(), line, sizeof(line));
+    ESP_LOGI(TAG, "Boot profile: %s", line);
+    bean_context_log_event(bean_context, EVENT_ID_BOOT, "%s", line);
+}
+
+#define STATE_SEQUENCE(sequence, state, priority)                                                                      \
+    do                                                                                                                 \
+    {                                                                                                                  \
+        beep_sequence_init(sequence, priority, (uint32_t)(state).pattern_interval_ms);                                 \
+        beep_sequence_add_notes(sequence, (state).notes, (state).notes_count, (uint32_t)(state).note_duration_ms);     \
+    } while (0)
+
+// The patterns of bean_beep.states, after the landing the locator tune is followed by the max altitude beep-out
+static void play_state_beeps(flight_state_t state)
+{
+    const bean_config_bean_beep_states_t *states = &bean_config_get()->bean_beep.states;
+    beep_sequence_t sequence;
+    switch (state)
+    {
+    case FLIGHT_STATE_PRE_LAUNCH:
+        STATE_SEQUENCE(&sequence, states->pre_launch, BEEP_PRIORITY_STATE);
+        break;
+    case FLIGHT_STATE_ARMED:
+        STATE_SEQUENCE(&sequence, states->armed, BEEP_PRIORITY_STATE);
+        break;
+    case FLIGHT_STATE_ASCENDING:
+        STATE_SEQUENCE(&sequence, states->ascending, BEEP_PRIORITY_STATE);
+        break;
+    case FLIGHT_STATE_DROGUE_DEPLOYED:
+        STATE_SEQUENCE(&sequence, states->drogue_deployed, BEEP_PRIORITY_STATE);
+        break;
+    case FLIGHT_STATE_MAIN_DEPLOYED:
+        STATE_SEQUENCE(&sequence, states->main_deployed, BEEP_PRIORITY_STATE);
+        break;
+    default:
+        STATE_SEQUENCE(&sequence, states->landed, BEEP_PRIORITY_LOCATOR);
+        beep_sequence_add(&sequence, 0, BEEP_DIGIT_GAP_MS);
+        beep_sequence_add_altitude(&sequence, bean_flight_get_max_altitude());
+        break;
+    }
+
+    // A state without a pattern silences the one of the previous state
+    if (sequence.count == 0)
+        bean_beep_stop(BEEP_PRIORITY_STATE);
+    else
+        bean_beep_play(&sequence);
+}
+
+// Recovery beacon on both LEDs, whatever their function, the LED task keeps the pattern going
+static void show_landed_beacon(void)
+{
+    const bean_config_bean_leds_functions_flight_state_landed_t *led =
+      &bean_config_get()->bean_leds.functions.flight_state.landed;
+
+    led_color_rgb_t color = { 255, 255, 255 };
+    if (led->color_count == 3)
+        color = (led_color_rgb_t){ (uint8_t)led->color[0], (uint8_t)led->color[1], (uint8_t)led->color[2] };
+    bean_led_show(LED_BOTH, color, led_pattern_from_name(led->pattern), 0);
+}
+
+// The LED and beeper tasks do the work, this loop only hands them the flight state
+static void run_main_loop(void)
+{
+    flight_state_t shown = FLIGHT_STATE_COUNT;
+    while (1)
+    {
+        flight_state_t state = bean_flight_get_state();
+        if (state != shown)
+        {
+            shown = state;
+            play_state_beeps(state);
+            if (state == FLIGHT_STATE_LANDED)
+            {
+                ESP_LOGI(TAG, "Landed: starting recovery beacon, max altitude %.0f m", bean_flight_get_max_altitude());
+                show_landed_beacon();
+            }
+        }
+        vTaskDelay(200 / portTICK_PERIOD_MS);
+    }
+}
+
+// No melody, no MSC check and no ready LED, the acquisition comes up first and the console after it. The boot time is
+// checked against the budget of bean_power.standby, the bootloader is not part of it.
+static esp_err_t wake_from_standby(uint32_t slept_s)
+{
+    ESP_LOGI(TAG, "Woke up from standby after %lu s", slept_s);
+    ESP_RETURN_ON_ERROR(bean_init(), TAG, "Init failed");
+    start_led_task();
+
+    bean_context->is_not_usb_msc = true;
+    ESP_RETURN_ON_ERROR(BOOT_STAGE("flight_start", bean_flight_start()), TAG, "Failed to start flight acquisition");
+    uint32_t boot_ms   = (uint32_t)(esp_timer_get_time() / 1000);
+    uint32_t budget_ms = (uint32_t)bean_config_get()->bean_power.standby.wake_budget_ms;
+    if (boot_ms > budget_ms)
+        ESP_LOGW(TAG, "Acquisition up after %lu ms, over the budget of %lu ms", boot_ms, budget_ms);
+    report_boot_profile();
+    bean_context_log_event(bean_context,
+                           EVENT_ID_STANDBY_WAKE,
+                           "slept_s=%lu;boot_ms=%lu;budget_ms=%lu;in_budget=%d",
+                           slept_s,
+                           boot_ms,
+                           budget_ms,
+                           boot_ms <= budget_ms);
+
+    if (BOOT_STAGE("console", bean_console_init()) != ESP_OK)
+        ESP_LOGW(TAG, "Console not available");
+    return ESP_OK;
+}
+
+// No melody, no MSC check and no console: the acquisition is back within tens of ms
+static esp_err_t resume_flight(void)
+{
+    ESP_LOGW(TAG, "Warm reset in %s, resuming the flight", flight_state_name(resume_checkpoint->state));
+    ESP_RETURN_ON_ERROR(
+      run_init_steps(resume_steps, sizeof(resume_steps) / sizeof(resume_steps[0])), TAG, "Resume init failed");
+
+    start_led_task();
+
+    // The logger takes events from here on, the USB check is not done in flight
+    bean_context->is_not_usb_msc = true;
+    ESP_RETURN_ON_ERROR(bean_flight_resume(resume_checkpoint), TAG, "Failed to restore the flight");
+    ESP_RETURN_ON_ERROR(BOOT_STAGE("flight_start", bean_flight_start()), TAG, "Failed to start flight acquisition");
+    report_boot_profile();
     return ESP_OK;
 }
 
 void app_main()
 {
+    boot_profile_init(&boot_profile, esp_timer_get_time());
+    bean_trace_init();
     ESP_LOGI(TAG, "Starting up...");
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     ESP_ERROR_CHECK(nvs_flash_init());
 
+    resume_checkpoint = bean_flight_checkpoint();
+    if (resume_checkpoint != NULL)
+    {
+        if (resume_flight() == ESP_OK)
+            run_main_loop();
+
+        // Half brought up, only a clean boot gets out of this
+        ESP_LOGE(TAG, "Flight resume failed, restarting");
+        bean_flight_discard_checkpoint();
+        esp_restart();
+    }
+
+    uint32_t slept_s = 0;
+    if (bean_power_woke_from_standby(&slept_s))
+    {
+        if (wake_from_standby(slept_s) == ESP_OK)
+            run_main_loop();
+
+        ESP_LOGE(TAG, "Wake from standby failed");
+        show_error_led();
+        return;
+    }
+
     if (bean_init() != ESP_OK)
     {
         ESP_LOGE(TAG, "Bean Init failed");
-        bean_led_set_color(LED_BOTH, (led_color_rgb_t){ 255, 0, 0 });
+        show_error_led();
         return;
     }
+    start_led_task();
 
-    bean_beep_sound(NOTE_C6, 100);
-    bean_beep_sound(NOTE_E4, 100);
-    bean_beep_sound(NOTE_G4, 100);
-    bean_beep_sound(NOTE_C5, 100);
-    bean_beep_sound(NOTE_E5, 100);
+    play_startup_melody();
 
     // If powered by USB and not in development mode
     if (bean_battery_is_usb_powered() && !usb_serial_jtag_ll_txfifo_writable())
@@ -64,13 +364,11 @@ void app_main()
         storage_enable_usb_msc();
         // Prevent it from continuing in the code
         // The device should now only work as an USB MSC device
+        // Display slow flashing soft white LED
+        bean_led_show(LED_BOTH, (led_color_rgb_t){ 50, 50, 50 }, LED_PATTERN_SLOW_BLINK, 0);
         while (1)
         {
-            // Display slow flashing soft white LED
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            bean_led_set_color(LED_BOTH, (led_color_rgb_t){ 50, 50, 50 });
-            vTaskDelay(1000 / portTICK_PERIOD_MS);
-            bean_led_set_color(LED_BOTH, (led_color_rgb_t){ 0, 0, 0 });
+            vTaskDelay(portMAX_DELAY);
         }
     }
     else
@@ -78,52 +376,25 @@ void app_main()
         bean_context->is_not_usb_msc = true;
     }
 
-    bean_led_set_color(LED_BOTH, (led_color_rgb_t){ 255, 255, 255 });
-    vTaskDelay(3000 / portTICK_PERIOD_MS);
-    bean_led_set_color(LED_BOTH, (led_color_rgb_t){ 0, 0, 0 });
+    // Not fatal, the flight computer works without it
+    if (BOOT_STAGE("console", bean_console_init()) != ESP_OK)
+        ESP_LOGW(TAG, "Console not available");
 
-    while (1)
-    {
+    show_ready_led();
+#if !CONFIG_BEAN_FAST_BOOT
+    // The acquisition only starts once the ready LED is over
+    int64_t led_start_us = esp_timer_get_time();
+    vTaskDelay(pdMS_TO_TICKS(READY_LED_MS));
+    boot_profile_add(&boot_profile, "ready_led", led_start_us, esp_timer_get_time(), true);
+#endif
 
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
-        bean_led_set_color(LED_L1, (led_color_rgb_t){ 0, 50, 0 });
-        vTaskDelay(5000 / portTICK_PERIOD_MS);
-        bean_led_set_color(LED_L1, (led_color_rgb_t){ 0, 0, 0 });
-
-        if (bean_altimeter_update() == ESP_OK)
-        {
-            ESP_LOGI(TAG,
-                     "Pressure: %.2f Pa, Temperature: %.2f C",
-                     bean_altimeter_get_pressure(),
-                     bean_altimeter_get_temperature());
-        }
-        else
-        {
-            ESP_LOGE(TAG, "Failed to read from altimeter");
-        }
-        if (bean_imu_update_accel() == ESP_OK)
-        {
-            ESP_LOGI(TAG,
-                     "Accel X: %.2f m/s^2, Y: %.2f m/s^2, Z: %.2f m/s^2",
-                     get_x_accel_data(),
-                     get_y_accel_data(),
-                     get_z_accel_data());
-        }
-        else
-        {
-            ESP_LOGE(TAG, "Failed to update accelerometer data");
-        }
-        if (bean_imu_update_gyro() == ESP_OK)
-        {
-            ESP_LOGI(TAG,
-                     "Gyro X: %.2f rad/s, Y: %.2f rad/s, Z: %.2f rad/s",
-                     get_x_gyro_data(),
-                     get_y_gyro_data(),
-                     get_z_gyro_data());
-        }
-        else
-        {
-            ESP_LOGE(TAG, "Failed to update gyroscope data");
-        }
+    if (BOOT_STAGE("flight_start", bean_flight_start()) != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to start flight acquisition");
+        show_error_led();
+        return;
     }
+    report_boot_profile();
+
+    run_main_loop();
 }
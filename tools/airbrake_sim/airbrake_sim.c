@@ -0,0 +1,169 @@
+/*
+Description: Host simulation loop of the airbrake controller, used to tune the gains.
+
+Simulates a vertical flight with a constant thrust motor, quadratic drag and airbrakes that add drag area. The
+controller sees the flight through the same estimator as the flight computer (noisy accelerometer and baro) and drives
+the brakes through the same slew limiter as the servo driver.
+
+Usage: airbrake_sim [target_m] [kp] [ki]
+       airbrake_sim sweep [target_m]   prints the apogee error over a grid of gains
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "airbrake.h"
+#include "flight_estimator.h"
+#include "servo_slew.h"
+
+#define GRAVITY_EARTH (9.80665f)
+#define TICK_MS       10
+#define AIR_DENSITY   1.2f
+
+typedef struct rocket
+{
+    float mass_kg;
+    float thrust_n;
+    float burn_time_s;
+    float drag_area_m2; // Cd * A of the body
+    float brake_area_m2; // Extra Cd * A with the brakes fully deployed
+    float servo_rate_dps;
+    float servo_range_deg; // Deflection of fully deployed brakes
+} rocket_t;
+
+static const rocket_t default_rocket = {
+    .mass_kg         = 0.6f,
+    .thrust_n        = 60.0f,
+    .burn_time_s     = 1.6f,
+    .drag_area_m2    = 0.0012f,
+    .brake_area_m2   = 0.0030f,
+    .servo_rate_dps  = 300.0f,
+    .servo_range_deg = 90.0f,
+};
+
+static float noise(float amplitude)
+{
+    return amplitude * ((float)rand() / (float)RAND_MAX * 2.0f - 1.0f);
+}
+
+// Flies one flight and returns the apogee, trace prints a line every 100 ms
+static float simulate(const rocket_t *rocket, const airbrake_config_t *brake_config, int trace)
+{
+    flight_estimator_config_t est_config = {
+        .vertical_axis     = 2,
+        .vertical_sign     = 1.0f,
+        .accel_noise_ms2   = 0.5f,
+        .baro_noise_m      = 0.5f,
+        .lockout_mode      = FLIGHT_ESTIMATOR_LOCKOUT_OFF,
+        .rate_tolerance_ms = 30.0f,
+        .rate_window_ms    = 100,
+        .sample_period_ms  = TICK_MS,
+    };
+    flight_estimator_t estimator;
+    flight_estimator_init(&estimator, &est_config);
+    airbrake_t brake;
+    airbrake_init(&brake, brake_config);
+    servo_slew_t servo;
+    servo_slew_init(&servo, 0.0f, rocket->servo_rate_dps, 0.0f, rocket->servo_range_deg);
+
+    float altitude = 0.0f, velocity = 0.0f, apogee = 0.0f;
+    float dt = TICK_MS / 1000.0f;
+    srand(1);
+
+    for (uint32_t t_ms = 0; t_ms < 120000; t_ms += TICK_MS)
+    {
+        float t         = t_ms / 1000.0f;
+        bool on_pad     = t < 1.0f;
+        bool burning    = !on_pad && t < 1.0f + rocket->burn_time_s;
+        float extension = servo_slew_step(&servo, dt) / rocket->servo_range_deg;
+
+        float thrust = burning ? rocket->thrust_n : 0.0f;
+        float area   = rocket->drag_area_m2 + extension * rocket->brake_area_m2;
+        float drag   = 0.5f * AIR_DENSITY * area * velocity * fabsf(velocity);
+        float accel  = on_pad ? 0.0f : (thrust - drag) / rocket->mass_kg - GRAVITY_EARTH;
+
+        velocity += accel * dt;
+        altitude += velocity * dt;
+        if (altitude > apogee)
+            apogee = altitude;
+        if (!on_pad && velocity < 0.0f)
+            break;
+
+        // The accelerometer measures the specific force, gravity is not part of it
+        float sensed[3] = { noise(0.1f), noise(0.1f), accel + GRAVITY_EARTH + noise(0.2f) };
+        float baro      = altitude + noise(0.5f);
+        if (!on_pad && !estimator.gravity_frozen)
+            flight_estimator_freeze_gravity(&estimator);
+        flight_estimator_update(&estimator, t_ms, sensed, &baro);
+
+        bool coasting    = !on_pad && !burning && estimator.accel_ms2 < 0.0f;
+        float deflection = airbrake_update(
+          &brake, estimator.altitude_m, estimator.velocity_ms, estimator.accel_ms2, dt, coasting);
+        servo_slew_set_target(&servo, deflection * rocket->servo_range_deg);
+
+        if (trace && t_ms % 100 == 0)
+            printf("%6.2f s  h %7.1f m  v %6.1f m/s  est %7.1f m %6.1f m/s  pred %7.1f m  brake %.2f\n",
+                   t,
+                   altitude,
+                   velocity,
+                   estimator.altitude_m,
+                   estimator.velocity_ms,
+                   brake.predicted_apogee_m,
+                   extension);
+    }
+    return apogee;
+}
+
+int main(int argc, char **argv)
+{
+    airbrake_config_t config = {
+        .target_apogee_m   = 450.0f,
+        .kp                = 0.02f,
+        .ki                = 0.02f,
+        .min_velocity_ms   = 10.0f,
+        .drag_filter_alpha = 0.05f,
+    };
+
+    if (argc > 1 && strcmp(argv[1], "sweep") == 0)
+    {
+        if (argc > 2)
+            config.target_apogee_m = strtof(argv[2], NULL);
+        config.kp      = 0.0f;
+        config.ki      = 0.0f;
+        float unbraked = simulate(&default_rocket, &config, 0);
+        printf("Target %.0f m, apogee without brakes %.1f m\n", config.target_apogee_m, unbraked);
+        printf("  kp \\ ki ");
+        const float gains_kp[] = { 0.005f, 0.01f, 0.02f, 0.05f, 0.1f };
+        const float gains_ki[] = { 0.0f, 0.005f, 0.01f, 0.02f, 0.05f };
+        for (size_t j = 0; j < sizeof(gains_ki) / sizeof(gains_ki[0]); j++)
+            printf("%8.3f", gains_ki[j]);
+        printf("\n");
+        for (size_t i = 0; i < sizeof(gains_kp) / sizeof(gains_kp[0]); i++)
+        {
+            printf("  %7.3f ", gains_kp[i]);
+            for (size_t j = 0; j < sizeof(gains_ki) / sizeof(gains_ki[0]); j++)
+            {
+                config.kp = gains_kp[i];
+                config.ki = gains_ki[j];
+                printf("%8.1f", simulate(&default_rocket, &config, 0) - config.target_apogee_m);
+            }
+            printf("\n");
+        }
+        return 0;
+    }
+
+    if (argc > 1)
+        config.target_apogee_m = strtof(argv[1], NULL);
+    if (argc > 2)
+        config.kp = strtof(argv[2], NULL);
+    if (argc > 3)
+        config.ki = strtof(argv[3], NULL);
+
+    float apogee = simulate(&default_rocket, &config, 1);
+    printf("Apogee %.1f m, target %.1f m, error %.1f m\n",
+           apogee,
+           config.target_apogee_m,
+           apogee - config.target_apogee_m);
+    return 0;
+}
@@ -0,0 +1,140 @@
+/*
+Description: Host report of the heap usage of the config load, with and without the config arena.
+
+Replays what bean_storage does at boot (parse default.json, parse conf.json, print the merged file) once on the heap,
+the way it was done before the arena, and once in the arena of bean_context. For the heap run it reports the number of
+allocations, the peak and what is still allocated at the end (the stored tree used to be leaked). For the arena run it
+reports the peak of the arena and the overflow to the heap.
+
+Usage: config_heap_report <default.json> [conf.json]
+Built against the cJSON of ESP-IDF, see the config-heap-report recipe of the justfile.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "cJSON.h"
+#include "config_arena.h"
+
+#define ARENA_SIZE  (64 * 1024) // BEAN_CONTEXT_CONFIG_ARENA_SIZE
+#define HEADER_SIZE 16 // Keeps the payload aligned
+
+static size_t heap_live, heap_peak, heap_blocks, heap_allocations;
+static config_arena_t arena;
+
+static void *counting_malloc(size_t size)
+{
+    uint8_t *block = malloc(size + HEADER_SIZE);
+    if (!block)
+        return NULL;
+    memcpy(block, &size, sizeof(size));
+    heap_live += size;
+    heap_blocks++;
+    heap_allocations++;
+    if (heap_live > heap_peak)
+        heap_peak = heap_live;
+    return block + HEADER_SIZE;
+}
+
+static void counting_free(void *ptr)
+{
+    if (!ptr)
+        return;
+    uint8_t *block = (uint8_t *)ptr - HEADER_SIZE;
+    size_t size;
+    memcpy(&size, block, sizeof(size));
+    heap_live -= size;
+    heap_blocks--;
+    free(block);
+}
+
+static void *arena_malloc(size_t size)
+{
+    void *ptr = config_arena_alloc(&arena, size);
+    return ptr ? ptr : counting_malloc(size);
+}
+
+static void arena_free(void *ptr)
+{
+    if (ptr && !config_arena_owns(&arena, ptr))
+        counting_free(ptr);
+}
+
+static char *read_file(const char *filename)
+{
+    FILE *f = fopen(filename, "rb");
+    if (!f)
+    {
+        perror(filename);
+        exit(1);
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    char *buffer = malloc(size + 1);
+    if (!buffer || fread(buffer, 1, size, f) != (size_t)size)
+    {
+        fprintf(stderr, "Failed to read %s\n", filename);
+        exit(1);
+    }
+    buffer[size] = '\0';
+    fclose(f);
+    return buffer;
+}
+
+// The load as bean_storage does it, leak_stored keeps the stored tree like the code before the arena
+static void load(const char *default_json, const char *conf_json, int leak_stored)
+{
+    cJSON *defaults = cJSON_Parse(default_json);
+    cJSON *stored   = cJSON_Parse(conf_json);
+    if (!defaults || !stored)
+    {
+        fprintf(stderr, "Failed to parse the config\n");
+        exit(1);
+    }
+    char *printed = cJSON_Print(defaults);
+    cJSON_free(printed);
+    if (!leak_stored)
+        cJSON_Delete(stored);
+    cJSON_Delete(defaults);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s <default.json> [conf.json]\n", argv[0]);
+        return 1;
+    }
+    char *default_json = read_file(argv[1]);
+    char *conf_json    = argc > 2 ? read_file(argv[2]) : default_json;
+
+    cJSON_Hooks heap_hooks = { .malloc_fn = counting_malloc, .free_fn = counting_free };
+    cJSON_InitHooks(&heap_hooks);
+    load(default_json, conf_json, 1);
+    printf("Heap:  %zu allocations, peak %zu bytes, %zu bytes in %zu blocks left allocated\n",
+           heap_allocations,
+           heap_peak,
+           heap_live,
+           heap_blocks);
+
+    heap_live = heap_peak = heap_blocks = heap_allocations = 0;
+
+    void *buffer = malloc(ARENA_SIZE);
+    config_arena_init(&arena, buffer, ARENA_SIZE);
+    cJSON_Hooks arena_hooks = { .malloc_fn = arena_malloc, .free_fn = arena_free };
+    cJSON_InitHooks(&arena_hooks);
+    load(default_json, conf_json, 0);
+    printf("Arena: %u allocations, peak %zu of %zu bytes, %u overflowed to the heap (%zu bytes), "
+           "%zu bytes left allocated on the heap\n",
+           arena.allocations,
+           arena.peak,
+           arena.size,
+           arena.overflows,
+           arena.overflow_bytes,
+           heap_live);
+    printf("The arena is a single %u byte block, freed at once after the load\n", ARENA_SIZE);
+
+    free(buffer);
+    return 0;
+}
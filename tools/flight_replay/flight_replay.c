@@ -0,0 +1,498 @@
+/*
+Description: Replays a recorded data log (log_dNNN.csv) through the flight logic built for the host, on the virtual
+clock of the POSIX backend of bean_hal.
+
+The rows of a sample (acceleration, rate of turn, pressure, temperature under one timestamp) are put back together
+into the flight_sample_t the acquisition task made of them and go where it sends them:
+- the data log queue, in the format of bean_flight.c, so the loggers of bean_storage write the log again
+- the state machine with the estimator and the detectors, then the airbrake controller, with the settings of
+  default.json and an optional conf.json
+- flight_actions, the deployments and the events of bean_flight.c, on the pyro scheduler and the event log
+
+The clock follows the timestamps of the log, nothing waits for real time, so a flight of minutes replays in
+milliseconds. The hardware high-g and no-motion features are not in the data log, the launch and the landing come
+from the samples alone.
+
+Written to stdout, the same for the same log and settings, to diff against a golden run:
+- the events: state changes, launch, cross-check, apogee, pyro fires, baro lockouts and the flight summary
+Written to the output directory:
+- log_dNNN.csv and log_eNNN.csv, the data log as written again and the event log
+- estimator.csv, the estimate at every sample: altitude, velocity, acceleration, baro altitude, lockout, airbrake
+
+Usage: flight_replay <log_dNNN.csv> [-c conf.json] [-o directory]
+Built by the host build, see host/CMakeLists.txt.
+*/
+
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "airbrake.h"
+#include "bean_context.h"
+#include "bean_hal_posix.h"
+#include "bean_storage.h"
+#include "bean_storage_logger.h"
+#include "flight_actions.h"
+#include "flight_config.h"
+#include "flight_sm.h"
+#include "pyro_sched.h"
+
+#define LINE_LENGTH     256
+#define CLOSE_WAIT_MS   10000 // Virtual time for the loggers to close, the data log needs one idle sync interval
+#define ESTIMATOR_TRACE "estimator.csv"
+
+typedef struct
+{
+    flight_sample_t *samples;
+    size_t count;
+    size_t capacity;
+    uint32_t skipped_rows; // Not a number where one was expected
+} recording_t;
+
+typedef struct
+{
+    bean_context_t *ctx;
+    flight_sm_t sm;
+    airbrake_t airbrake;
+    float airbrake_deflection;
+    float sample_period_s;
+    bool log_imu;
+    bool log_baro;
+    flight_actions_t actions; // With the dropped samples
+    pyro_sched_t pyro;
+    int64_t pyro_service_us; // When the scheduler wants pyro_sched_service(), -1 for never
+    int64_t sample_time_us;
+    FILE *trace;
+} replay_t;
+
+static const char *event_names[] = {
+    [EVENT_ID_BOOT]              = "BOOT",
+    [EVENT_ID_STATE_CHANGE]      = "STATE_CHANGE",
+    [EVENT_ID_LAUNCH]            = "LAUNCH",
+    [EVENT_ID_LANDED]            = "LANDED",
+    [EVENT_ID_FLIGHT_SUMMARY]    = "FLIGHT_SUMMARY",
+    [EVENT_ID_LOG_CLOSE]         = "LOG_CLOSE",
+    [EVENT_ID_LAUNCH_CROSSCHECK] = "LAUNCH_CROSSCHECK",
+    [EVENT_ID_APOGEE]            = "APOGEE",
+    [EVENT_ID_BARO_LOCKOUT]      = "BARO_LOCKOUT",
+    [EVENT_ID_PYRO_FIRE]         = "PYRO_FIRE",
+};
+
+static flight_sample_t *add_sample(recording_t *rec, uint32_t timestamp_ms)
+{
+    if (rec->count == rec->capacity)
+    {
+        size_t capacity          = rec->capacity ? rec->capacity * 2 : 4096;
+        flight_sample_t *samples = realloc(rec->samples, capacity * sizeof(*samples));
+        if (!samples)
+            return NULL;
+        rec->samples  = samples;
+        rec->capacity = capacity;
+    }
+    flight_sample_t *sample = &rec->samples[rec->count++];
+    *sample                 = (flight_sample_t){ .timestamp_ms = timestamp_ms };
+    return sample;
+}
+
+// Three values split by ';', or by ',' as the first logs had them
+static bool parse_vector(const char *text, float out[3])
+{
+    char *end;
+    for (int i = 0; i < 3; i++)
+    {
+        out[i] = strtof(text, &end);
+        if (end == text)
+            return false;
+        text = end + (*end == ';' || *end == ',');
+    }
+    return true;
+}
+
+static bool parse_value(const char *text, float *out)
+{
+    char *end;
+    *out = strtof(text, &end);
+    return end != text;
+}
+
+// The rows of one sample share its timestamp, a new timestamp starts the next sample
+static int load_recording(const char *path, recording_t *rec)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        return 1;
+    }
+
+    char line[LINE_LENGTH];
+    flight_sample_t *sample = NULL;
+    while (fgets(line, sizeof(line), file))
+    {
+        // The header, written again by a resumed log, and the battery rows are not part of a sample
+        char *end;
+        unsigned long timestamp = strtoul(line, &end, 10);
+        if (end == line || *end != ',')
+            continue;
+        char *type_text = end + 1;
+        long type       = strtol(type_text, &end, 10);
+        if (end == type_text || *end != ',')
+            continue;
+        const char *value = end + 1;
+        if (type != MEASUREMENT_TYPE_ACCELERATION && type != MEASUREMENT_TYPE_GYROSCOPE &&
+            type != MEASUREMENT_TYPE_PRESSURE && type != MEASUREMENT_TYPE_TEMPERATURE)
+            continue;
+
+        if (!sample || sample->timestamp_ms != (uint32_t)timestamp)
+        {
+            sample = add_sample(rec, (uint32_t)timestamp);
+            if (!sample)
+            {
+                fclose(file);
+                fprintf(stderr, "Out of memory after %zu samples\n", rec->count);
+                return 1;
+            }
+        }
+
+        bool parsed = false;
+        if (type == MEASUREMENT_TYPE_ACCELERATION)
+            parsed = sample->accel_valid = parse_vector(value, sample->accel);
+        else if (type == MEASUREMENT_TYPE_GYROSCOPE)
+            parsed = sample->gyro_valid = parse_vector(value, sample->gyro);
+        else if (type == MEASUREMENT_TYPE_PRESSURE)
+            parsed = sample->baro_valid = parse_value(value, &sample->pressure_pa);
+        else
+            parsed = parse_value(value, &sample->temperature_c);
+        if (!parsed)
+            rec->skipped_rows++;
+    }
+    fclose(file);
+    return 0;
+}
+
+// Merges conf.json into default.json like the boot does, with default.json alone when there is none
+static int load_config(const char *path)
+{
+    if (!path)
+        return 0;
+    FILE *file = fopen(path, "r");
+    if (!file)
+    {
+        perror(path);
+        return 1;
+    }
+    fseek(file, 0, SEEK_END);
+    long length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    char *text = malloc((size_t)length + 1);
+    size_t got = text ? fread(text, 1, (size_t)length, file) : 0;
+    fclose(file);
+    if (!text)
+        return 1;
+    text[got] = '\0';
+
+    bean_context_config_begin();
+    cJSON *stored = cJSON_Parse(text);
+    if (!stored)
+    {
+        bean_context_config_end();
+        free(text);
+        fprintf(stderr, "%s is not valid JSON\n", path);
+        return 1;
+    }
+    config_merge_result_t result = bean_context_initialize_config(stored);
+    cJSON_Delete(stored);
+    bean_context_config_end();
+    free(text);
+    fprintf(stderr,
+            "%s: %d settings taken, %d ignored, %d type mismatches\n",
+            path,
+            result.items_updated,
+            result.items_ignored,
+            result.type_mismatches);
+    return 0;
+}
+
+// The events of flight_actions go to stdout and to the event log, under the time of the sample
+static void actions_log_event(void *ctx, event_id_t id, const char *data)
+{
+    replay_t *replay = ctx;
+    printf("%10" PRIu32 "  %-17s %s\n", bean_hal_time_ms(), event_names[id], data);
+    bean_context_log_event(replay->ctx, id, "%s", data);
+}
+
+static void enqueue_measurement(replay_t *replay, measurement_type_t type, uint32_t timestamp, const char *fmt, ...)
+  __attribute__((format(printf, 4, 5)));
+
+// The acquisition task drops a sample the logger has no room for, the replay waits for it: its clock is not the one
+// of the flight
+static void enqueue_measurement(replay_t *replay, measurement_type_t type, uint32_t timestamp, const char *fmt, ...)
+{
+    log_data_t log_data = { .measurement_type = type, .timestamp = timestamp };
+
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(log_data.measurement_value, sizeof(log_data.measurement_value), fmt, args);
+    va_end(args);
+
+    if (!bean_hal_queue_send(replay->ctx->data_log_queue, &log_data, BEAN_HAL_WAIT_FOREVER))
+        replay->actions.dropped_samples++;
+}
+
+static void log_sample(replay_t *replay, const flight_sample_t *sample)
+{
+    if (replay->log_imu && sample->accel_valid)
+        enqueue_measurement(replay,
+                            MEASUREMENT_TYPE_ACCELERATION,
+                            sample->timestamp_ms,
+                            "%.2f;%.2f;%.2f",
+                            sample->accel[0],
+                            sample->accel[1],
+                            sample->accel[2]);
+    if (replay->log_imu && sample->gyro_valid)
+        enqueue_measurement(replay,
+                            MEASUREMENT_TYPE_GYROSCOPE,
+                            sample->timestamp_ms,
+                            "%.2f;%.2f;%.2f",
+                            sample->gyro[0],
+                            sample->gyro[1],
+                            sample->gyro[2]);
+    if (replay->log_baro && sample->baro_valid)
+    {
+        enqueue_measurement(replay, MEASUREMENT_TYPE_PRESSURE, sample->timestamp_ms, "%.2f", sample->pressure_pa);
+        enqueue_measurement(replay, MEASUREMENT_TYPE_TEMPERATURE, sample->timestamp_ms, "%.2f", sample->temperature_c);
+    }
+}
+
+// The pyro scheduler on the virtual clock: the outputs are not wired, the hold timer is a deadline checked per sample
+static void pyro_set_output(void *ctx, uint8_t channel, bool on) {}
+
+static int64_t pyro_now_us(void *ctx)
+{
+    return bean_hal_time_us();
+}
+
+static void pyro_schedule(void *ctx, int64_t delay_us)
+{
+    replay_t *replay        = ctx;
+    replay->pyro_service_us = delay_us < 0 ? -1 : bean_hal_time_us() + delay_us;
+}
+
+// The outputs of flight_actions: the pyro scheduler, the servos and the battery are not simulated
+static bool actions_arm_pyro(void *ctx, uint8_t channel)
+{
+    replay_t *replay = ctx;
+    return pyro_sched_arm(&replay->pyro, channel) == PYRO_OK;
+}
+
+static const char *actions_fire_pyro(void *ctx, uint8_t channel, pyro_fire_record_t *record)
+{
+    replay_t *replay     = ctx;
+    pyro_result_t result = pyro_sched_fire(&replay->pyro, channel, replay->sample_time_us, record);
+    return result == PYRO_OK ? NULL : pyro_result_name(result);
+}
+
+static void actions_landed(void *ctx)
+{
+    replay_t *replay = ctx;
+    for (uint8_t ch = 0; ch < PYRO_SCHED_CHANNELS; ch++)
+        pyro_sched_disarm(&replay->pyro, ch);
+}
+
+static void step(replay_t *replay, flight_sample_t *sample)
+{
+    flight_sm_t *sm = &replay->sm;
+    log_sample(replay, sample);
+
+    flight_state_t previous = sm->state;
+    if (flight_sm_step(sm, sample))
+        flight_actions_transition(&replay->actions, sm, previous);
+    if (replay->actions.airbrake_enabled && sm->state == FLIGHT_STATE_ASCENDING)
+    {
+        const flight_estimator_t *est = &sm->estimator;
+        bool coasting                 = est->velocity_ms > 0.0f && est->accel_ms2 < 0.0f;
+        replay->airbrake_deflection   = airbrake_update(&replay->airbrake,
+                                                      est->altitude_m,
+                                                      est->velocity_ms,
+                                                      est->accel_ms2,
+                                                      replay->sample_period_s,
+                                                      coasting);
+    }
+    flight_actions_sample(&replay->actions, sm);
+
+    // The brakes are retracted when the ascent ends
+    if (replay->trace)
+        fprintf(replay->trace,
+                "%" PRIu32 ",%s,%.3f,%.3f,%.3f,%.3f,%d,%.3f\n",
+                sample->timestamp_ms,
+                flight_state_name(sm->state),
+                sm->estimator.altitude_m,
+                sm->estimator.velocity_ms,
+                sm->estimator.accel_ms2,
+                sm->altitude_m,
+                sm->estimator.locked_out,
+                sm->state == FLIGHT_STATE_ASCENDING ? replay->airbrake_deflection : 0.0f);
+}
+
+static void setup(replay_t *replay, bean_context_t *ctx)
+{
+    const bean_config_t *config = bean_config_get();
+
+    flight_sm_config_t sm_config;
+    airbrake_config_t brake_config;
+    flight_config_load(config, &sm_config, &brake_config);
+    sm_config.hw_launch_trigger = false; // The high-g feature is not in the data log
+
+    *replay = (replay_t){
+        .ctx             = ctx,
+        .sample_period_s = flight_config_loop_delay_ms(config) / 1000.0f,
+        .log_imu         = config->bean_core.logging.imu,
+        .log_baro        = config->bean_core.logging.baro,
+        .pyro_service_us = -1,
+    };
+    flight_sm_init(&replay->sm, &sm_config);
+    airbrake_init(&replay->airbrake, &brake_config);
+
+    flight_actions_io_t actions_io = {
+        .arm_pyro  = actions_arm_pyro,
+        .fire_pyro = actions_fire_pyro,
+        .log_event = actions_log_event,
+        .landed    = actions_landed,
+        .ctx       = replay,
+    };
+    flight_actions_init(&replay->actions, &actions_io);
+    flight_actions_load(&replay->actions, config);
+
+    pyro_io_t io = {
+        .set_output = pyro_set_output,
+        .now_us     = pyro_now_us,
+        .schedule   = pyro_schedule,
+        .ctx        = replay,
+    };
+    pyro_sched_init(&replay->pyro,
+                    &io,
+                    (uint32_t)config->bean_pyro.hold_ms * 1000,
+                    (uint32_t)config->bean_pyro.arm_timeout_ms * 1000);
+}
+
+static void usage(void)
+{
+    fprintf(stderr, "Usage: flight_replay <log_dNNN.csv> [-c conf.json] [-o directory]\n");
+}
+
+int main(int argc, char **argv)
+{
+    const char *log_path  = NULL;
+    const char *conf_path = NULL;
+    const char *directory = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+            conf_path = argv[++i];
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+            directory = argv[++i];
+        else if (argv[i][0] != '-' && !log_path)
+            log_path = argv[i];
+        else
+        {
+            usage();
+            return 1;
+        }
+    }
+    if (!log_path)
+    {
+        usage();
+        return 1;
+    }
+
+    recording_t rec = { 0 };
+    if (load_recording(log_path, &rec) != 0)
+        return 1;
+    if (rec.count == 0)
+    {
+        fprintf(stderr, "No samples in %s\n", log_path);
+        return 1;
+    }
+
+    char temporary[] = "/tmp/flight_replay_XXXXXX";
+    if (!directory && !(directory = mkdtemp(temporary)))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    bean_hal_posix_set_log_level(BEAN_HAL_LOG_WARN);
+    bean_hal_posix_set_root(directory);
+    bean_context_t *ctx;
+    if (bean_context_init(&ctx) != ESP_OK || load_config(conf_path) != 0)
+        return 1;
+
+    replay_t replay;
+    setup(&replay, ctx);
+    replay.trace = bean_hal_fopen(ESTIMATOR_TRACE, "w");
+    if (!replay.trace)
+    {
+        perror(ESTIMATOR_TRACE);
+        return 1;
+    }
+    fprintf(replay.trace, "timestamp,state,altitude_m,velocity_ms,accel_ms2,baro_altitude_m,locked_out,airbrake\n");
+
+    // The clock starts at the first sample, the loggers are created on it
+    bean_hal_posix_use_virtual_clock((int64_t)rec.samples[0].timestamp_ms * 1000);
+    ctx->is_not_usb_msc = true;
+    bean_storage_logger_init();
+    bean_hal_task_create(vtask_data_log_handler, "data_log", 0, ctx, 0, NULL);
+    bean_hal_task_create(vtask_event_log_handler, "event_log", 0, ctx, 0, NULL);
+
+    printf("# %s: %zu samples from %" PRIu32 " to %" PRIu32 " ms, %" PRIu32 " rows skipped\n",
+           log_path,
+           rec.count,
+           rec.samples[0].timestamp_ms,
+           rec.samples[rec.count - 1].timestamp_ms,
+           rec.skipped_rows);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t replayed = 0;
+    for (; replayed < rec.count && replay.sm.state != FLIGHT_STATE_LANDED; replayed++)
+    {
+        bean_hal_posix_set_clock((int64_t)rec.samples[replayed].timestamp_ms * 1000);
+        replay.sample_time_us = bean_hal_time_us();
+        if (replay.pyro_service_us >= 0 && replay.sample_time_us >= replay.pyro_service_us)
+            pyro_sched_service(&replay.pyro);
+        step(&replay, &rec.samples[replayed]);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double replay_ms = (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    printf("# ended in %s, max altitude %.1f m, %zu samples after the landing not replayed\n",
+           flight_state_name(replay.sm.state),
+           replay.sm.max_altitude_m,
+           rec.count - replayed);
+    fclose(replay.trace);
+
+    // Closed at the landing by the firmware, the sampling stops there. The loggers look at the virtual clock once per
+    // real millisecond, so each step of it waits one for them to see their receive time out.
+    bean_storage_logger_close(ctx);
+    const struct timespec poll = { .tv_nsec = 1000000 };
+    for (uint32_t waited_ms = 0; waited_ms < CLOSE_WAIT_MS && !bean_storage_logs_closed(); waited_ms += 10)
+    {
+        bean_hal_delay_ms(10);
+        nanosleep(&poll, NULL);
+    }
+
+    uint32_t flight_ms = rec.samples[replayed - 1].timestamp_ms - rec.samples[0].timestamp_ms;
+    fprintf(stderr,
+            "Replayed %.1f s of flight in %.1f ms: %s/%s, %s%s/log_d%03d.csv and log_e%03d.csv\n",
+            flight_ms / 1000.0,
+            replay_ms,
+            directory,
+            ESTIMATOR_TRACE,
+            directory,
+            STORAGE_BASE_PATH,
+            bean_storage_log_number(),
+            bean_storage_log_number());
+    free(rec.samples);
+    return bean_storage_logs_closed() ? 0 : 1;
+}
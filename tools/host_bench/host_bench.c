@@ -0,0 +1,210 @@
+/*
+Description: Host micro-benchmarks of the portable components, built on the POSIX backend of bean_hal.
+
+Times the hot paths that run unchanged on the target, to catch a regression without flashing a board:
+- merge: a config session that merges a conf.json into default.json and decodes the typed config, as at boot
+- flight: the estimator and the state machine per sample over a synthetic flight, with the settings of default.json
+- logger: samples through the data log queue into a log file, with the logger task of bean_storage
+
+The absolute numbers are the ones of the host, only their change between two builds means something.
+
+Usage: host_bench [merge|flight|logger] [iterations]
+Built by the host build, see host/CMakeLists.txt.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bean_context.h"
+#include "bean_hal_posix.h"
+#include "bean_storage.h"
+#include "bean_storage_logger.h"
+#include "flight_config.h"
+
+#define MERGE_ITERATIONS  200
+#define FLIGHT_ITERATIONS 20
+#define LOGGER_SAMPLES    200000
+#define FLIGHT_LENGTH_MS  120000
+#define GRAVITY_EARTH     (9.80665f)
+
+// Embedded by host/CMakeLists.txt, as EMBED_FILES does on the target
+extern const uint8_t _binary_default_json_start[];
+extern const uint8_t _binary_default_json_end[];
+
+static bean_context_t *ctx;
+
+static double elapsed_ms(int64_t start_us)
+{
+    return (bean_hal_time_us() - start_us) / 1000.0;
+}
+
+static void bench_merge(int iterations)
+{
+    // default.json itself as conf.json: every setting is visited and none changes
+    size_t length = (size_t)(_binary_default_json_end - _binary_default_json_start);
+    char *conf    = malloc(length + 1);
+    memcpy(conf, _binary_default_json_start, length);
+    conf[length] = '\0';
+
+    int64_t start_us = bean_hal_time_us();
+    for (int i = 0; i < iterations; i++)
+    {
+        bean_context_config_begin();
+        cJSON *stored = cJSON_Parse(conf);
+        bean_context_initialize_config(stored);
+        cJSON_Delete(stored);
+        bean_context_config_end();
+    }
+    double total_ms = elapsed_ms(start_us);
+    printf("merge   %6d runs  %9.1f us/run\n", iterations, total_ms * 1000.0 / iterations);
+    free(conf);
+}
+
+// Pad, 3 s of boost, a coast with drag to apogee and a descent at 20 m/s, with a little noise on every sensor
+static void synthetic_sample(uint32_t t_ms,
+                             float period_s,
+                             flight_sample_t *sample,
+                             float *altitude_m,
+                             float *velocity_ms)
+{
+    const uint32_t launch_ms  = 10000;
+    const uint32_t burnout_ms = 13000;
+
+    float accel_ms2 = 0.0f;
+    if (t_ms >= launch_ms && t_ms < burnout_ms)
+        accel_ms2 = 60.0f;
+    else if (t_ms >= burnout_ms && *velocity_ms > 0.0f)
+        accel_ms2 = -GRAVITY_EARTH - 0.002f * *velocity_ms * *velocity_ms;
+    else if (t_ms >= burnout_ms && *altitude_m > 0.0f && *velocity_ms > -20.0f)
+        accel_ms2 = -GRAVITY_EARTH;
+
+    *velocity_ms += accel_ms2 * period_s;
+    *altitude_m += *velocity_ms * period_s;
+    if (*altitude_m <= 0.0f)
+    {
+        *altitude_m  = 0.0f;
+        *velocity_ms = 0.0f;
+        accel_ms2    = 0.0f;
+    }
+
+    float noise = ((float)rand() / RAND_MAX - 0.5f) * 0.2f;
+
+    *sample = (flight_sample_t){
+        .timestamp_ms  = t_ms,
+        .accel_valid   = true,
+        .accel         = { 0.0f, 0.0f, accel_ms2 + GRAVITY_EARTH + noise },
+        .gyro_valid    = true,
+        .baro_valid    = true,
+        .pressure_pa   = 101325.0f * powf(1.0f - *altitude_m / 44330.0f, 5.255f) + noise * 10.0f,
+        .temperature_c = 20.0f,
+    };
+}
+
+static void bench_flight(int iterations)
+{
+    flight_sm_config_t sm_config;
+    airbrake_config_t brake_config;
+    flight_config_load(bean_config_get(), &sm_config, &brake_config);
+    sm_config.hw_launch_trigger = false;
+
+    // The samples are made up front, only the state machine is timed
+    uint32_t period_ms       = flight_config_loop_delay_ms(bean_config_get());
+    uint32_t count           = FLIGHT_LENGTH_MS / period_ms;
+    flight_sample_t *samples = malloc(count * sizeof(*samples));
+    float altitude_m         = 0.0f;
+    float velocity_ms        = 0.0f;
+    srand(1);
+    for (uint32_t i = 0; i < count; i++)
+        synthetic_sample(i * period_ms, period_ms / 1000.0f, &samples[i], &altitude_m, &velocity_ms);
+
+    flight_sm_t *sm       = malloc(sizeof(*sm));
+    flight_state_t landed = FLIGHT_STATE_PRE_LAUNCH;
+    int64_t start_us      = bean_hal_time_us();
+    for (int i = 0; i < iterations; i++)
+    {
+        flight_sm_init(sm, &sm_config);
+        for (uint32_t j = 0; j < count; j++)
+            flight_sm_step(sm, &samples[j]);
+        landed = sm->state;
+    }
+    double total_ms = elapsed_ms(start_us);
+    printf("flight  %6lu samples  %9.3f us/sample, ended in %s at %.0f m max\n",
+           (unsigned long)count * iterations,
+           total_ms * 1000.0 / ((double)count * iterations),
+           flight_state_name(landed),
+           sm->max_altitude_m);
+    free(sm);
+    free(samples);
+}
+
+static void bench_logger(int samples)
+{
+    char root[] = "/tmp/bean_host_bench_XXXXXX";
+    if (!mkdtemp(root))
+    {
+        perror("mkdtemp");
+        return;
+    }
+    bean_hal_posix_set_root(root);
+    ctx->is_not_usb_msc = true;
+    bean_storage_logger_init();
+    bean_hal_task_create(vtask_data_log_handler, "data_log", 0, ctx, 0, NULL);
+    bean_hal_task_create(vtask_event_log_handler, "event_log", 0, ctx, 0, NULL);
+
+    log_data_t item  = { .measurement_type = MEASUREMENT_TYPE_ACCELERATION };
+    int64_t start_us = bean_hal_time_us();
+    for (int i = 0; i < samples; i++)
+    {
+        item.timestamp = (uint32_t)i;
+        snprintf(item.measurement_value, sizeof(item.measurement_value), "%.3f,%.3f,%.3f", 0.125, -0.25, 9.81);
+        bean_hal_queue_send(ctx->data_log_queue, &item, BEAN_HAL_WAIT_FOREVER);
+    }
+    while (bean_hal_queue_waiting(ctx->data_log_queue) > 0)
+        bean_hal_delay_ms(1);
+    double total_ms = elapsed_ms(start_us);
+
+    // The data log closes on the first idle flush interval after the close
+    bean_storage_logger_close(ctx);
+    while (!bean_storage_logs_closed())
+        bean_hal_delay_ms(10);
+
+    char path[64];
+    snprintf(path, sizeof(path), "%s/log_d%03d.csv", STORAGE_BASE_PATH, bean_storage_log_number());
+    FILE *file = bean_hal_fopen(path, "r");
+    long size  = 0;
+    if (file)
+    {
+        fseek(file, 0, SEEK_END);
+        size = ftell(file);
+        fclose(file);
+    }
+    printf("logger  %6d samples  %9.3f us/sample, %.1f MB/s, %ld bytes in %s%s\n",
+           samples,
+           total_ms * 1000.0 / samples,
+           size / total_ms / 1000.0,
+           size,
+           root,
+           path);
+}
+
+int main(int argc, char **argv)
+{
+    const char *only = argc > 1 ? argv[1] : NULL;
+    int iterations   = argc > 2 ? atoi(argv[2]) : 0;
+
+    bean_hal_posix_set_log_level(BEAN_HAL_LOG_WARN);
+    if (bean_context_init(&ctx) != ESP_OK)
+    {
+        fprintf(stderr, "bean_context_init failed\n");
+        return 1;
+    }
+
+    if (!only || strcmp(only, "merge") == 0)
+        bench_merge(iterations > 0 ? iterations : MERGE_ITERATIONS);
+    if (!only || strcmp(only, "flight") == 0)
+        bench_flight(iterations > 0 ? iterations : FLIGHT_ITERATIONS);
+    if (!only || strcmp(only, "logger") == 0)
+        bench_logger(iterations > 0 ? iterations : LOGGER_SAMPLES);
+    return 0;
+}
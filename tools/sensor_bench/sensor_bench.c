@@ -0,0 +1,271 @@
+/*
+Description: Driver-level bench of the sensors on the simulated I2C bus of the POSIX backend of bean_hal.
+
+bean_imu.c and the Bosch BMI08X driver run unchanged against the BMI088 register model (sim_bmi088.c), and so do
+bean_altimeter.c and the BMP3 driver against the BMP390 model (sim_bmp390.c) when the BMP3 submodule is checked out.
+The models follow a synthetic flight: 1 s on the pad, 1.5 s of boost at 8 g, then a coast.
+
+What it checks:
+- init: the chip IDs, the soft resets, the upload of the feature engine and the trimming CRC, good and corrupted
+- the sample sequence of bean_flight.c, at 100 Hz: the accelerometer, the gyroscope, the altimeter and the feature
+  status, with the high-g output when it is set
+- what the drivers read back against the source, and when the high-g feature fired after the start of the boost
+
+The bus figures are per sample: the transactions, the bytes and the time on the wire at 400 kHz, the clock of the
+target. Their change between two builds shows what a driver change costs on the bus without a board.
+
+Usage: sensor_bench [seconds]
+Built by the host build, see host/CMakeLists.txt.
+*/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "bean_hal.h"
+#include "bean_hal_posix.h"
+#include "bean_imu.h"
+#include "sim_bmi088.h"
+#include "sim_bmp390.h"
+#ifdef BEAN_HOST_ALTIMETER
+#include "bean_altimeter.h"
+#endif
+
+#define BMP390_ADDRESS    0x76
+#define GRAVITY_EARTH     (9.80665f)
+#define I2C_CLOCK_HZ      400000
+#define SAMPLE_PERIOD_MS  10
+#define DEFAULT_SECONDS   4
+#define LAUNCH_US         1000000
+#define BURNOUT_US        2500000
+#define BOOST_MS2         (8.0f * GRAVITY_EARTH)
+#define COAST_MS2         (-GRAVITY_EARTH - 3.0f)
+#define HIGH_G_THRESHOLD  (5.0f * GRAVITY_EARTH)
+#define HIGH_G_HYSTERESIS (1.0f * GRAVITY_EARTH)
+#define HIGH_G_DURATION   10
+
+typedef struct
+{
+    int64_t start_us;
+} flight_t;
+
+// Height and vertical acceleration of the synthetic flight at a time after its start
+static void flight_at(const flight_t *flight, int64_t time_us, float *altitude_m, float *accel_ms2)
+{
+    float t       = (float)(time_us - flight->start_us - LAUNCH_US) / 1e6f;
+    float burn_s  = (BURNOUT_US - LAUNCH_US) / 1e6f;
+    float burnout = 0.5f * BOOST_MS2 * burn_s * burn_s;
+    if (t < 0.0f)
+    {
+        *altitude_m = 0.0f;
+        *accel_ms2  = 0.0f;
+    }
+    else if (t < burn_s)
+    {
+        *altitude_m = 0.5f * BOOST_MS2 * t * t;
+        *accel_ms2  = BOOST_MS2;
+    }
+    else
+    {
+        float coast_s = t - burn_s;
+        *altitude_m   = burnout + BOOST_MS2 * burn_s * coast_s + 0.5f * COAST_MS2 * coast_s * coast_s;
+        *accel_ms2    = COAST_MS2;
+    }
+}
+
+// The z axis of the sensor points up, the rocket rolls at 30 deg/s under power
+static void imu_source(void *arg, int64_t time_us, float accel_ms2[3], float gyro_dps[3])
+{
+    float altitude_m, accel;
+    flight_at(arg, time_us, &altitude_m, &accel);
+    accel_ms2[0] = 0.0f;
+    accel_ms2[1] = 0.0f;
+    accel_ms2[2] = accel + GRAVITY_EARTH;
+    gyro_dps[0]  = 0.0f;
+    gyro_dps[1]  = 0.0f;
+    gyro_dps[2]  = accel == BOOST_MS2 ? 30.0f : 0.0f;
+}
+
+// Standard atmosphere from a field at sea level and 20 C
+static void baro_source(void *arg, int64_t time_us, float *pressure_pa, float *temperature_c)
+{
+    float altitude_m, accel;
+    flight_at(arg, time_us, &altitude_m, &accel);
+    *pressure_pa   = 101325.0f * powf(1.0f - altitude_m / 44330.0f, 5.255f);
+    *temperature_c = 20.0f - 0.0065f * altitude_m;
+}
+
+static void print_bus(const char *name, uint8_t address, int samples)
+{
+    bean_hal_posix_i2c_stats_t stats;
+    bean_hal_posix_i2c_get_stats(address, &stats);
+    printf("  %-6s 0x%02x  %6.2f transactions  %7.1f bytes  %8.1f us on the bus  %lu failed\n",
+           name,
+           address,
+           (double)stats.transactions / samples,
+           (double)stats.bytes / samples,
+           (double)stats.bus_time_us / samples,
+           (unsigned long)stats.failures);
+}
+
+static int init_sensors(void)
+{
+    bean_hal_posix_i2c_clear_stats();
+    int64_t start_us = bean_hal_time_us();
+    if (bean_imu_init() != ESP_OK)
+    {
+        fprintf(stderr, "bean_imu_init failed\n");
+        return 1;
+    }
+    if (bean_imu_enable_high_g(HIGH_G_THRESHOLD, HIGH_G_HYSTERESIS, HIGH_G_DURATION) != ESP_OK)
+    {
+        fprintf(stderr, "bean_imu_enable_high_g failed\n");
+        return 1;
+    }
+    printf("init IMU        %8.1f ms\n", (bean_hal_time_us() - start_us) / 1000.0);
+    print_bus("accel", BMI088_ACC_I2C_ADDR, 1);
+    print_bus("gyro", BMI088_GYR_I2C_ADDR, 1);
+    return 0;
+}
+
+#ifdef BEAN_HOST_ALTIMETER
+static int init_altimeter(sim_bmp390_t *baro)
+{
+    // A part whose trimming data does not match its CRC has to be refused, then the same part with the CRC back
+    sim_bmp390_corrupt_trimming(baro);
+    if (bean_altimeter_init() == ESP_OK)
+    {
+        fprintf(stderr, "bean_altimeter_init took a corrupted trimming CRC\n");
+        return 1;
+    }
+    sim_bmp390_corrupt_trimming(baro);
+
+    bean_hal_posix_i2c_clear_stats();
+    int64_t start_us = bean_hal_time_us();
+    if (bean_altimeter_init() != ESP_OK)
+    {
+        fprintf(stderr, "bean_altimeter_init failed\n");
+        return 1;
+    }
+    printf("init altimeter  %8.1f ms, a corrupted trimming CRC is refused\n",
+           (bean_hal_time_us() - start_us) / 1000.0);
+    print_bus("baro", BMP390_ADDRESS, 1);
+    return 0;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+    int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+    if (seconds <= 0)
+        seconds = DEFAULT_SECONDS;
+
+    bean_hal_posix_set_log_level(BEAN_HAL_LOG_WARN);
+    bean_hal_i2c_init(-1, -1, I2C_CLOCK_HZ);
+
+    flight_t flight    = { .start_us = bean_hal_time_us() };
+    sim_bmi088_t *imu  = sim_bmi088_create(imu_source, &flight);
+    sim_bmp390_t *baro = sim_bmp390_create(baro_source, &flight);
+    if (!imu || !baro || sim_bmi088_attach(imu, BMI088_ACC_I2C_ADDR, BMI088_GYR_I2C_ADDR, -1, -1) != ESP_OK ||
+        sim_bmp390_attach(baro, BMP390_ADDRESS) != ESP_OK)
+    {
+        fprintf(stderr, "Could not attach the sensor models\n");
+        return 1;
+    }
+
+    if (init_sensors() != 0)
+        return 1;
+#ifdef BEAN_HOST_ALTIMETER
+    if (init_altimeter(baro) != 0)
+        return 1;
+#else
+    printf("init altimeter  skipped, the BMP3 driver is not in this build\n");
+#endif
+
+    // The flight starts with the sampling, init took its own time
+    flight.start_us    = bean_hal_time_us();
+    int samples        = seconds * 1000 / SAMPLE_PERIOD_MS;
+    int64_t high_g_us  = -1;
+    double pad_error   = 0.0;
+    double boost_error = 0.0;
+    double gyro_error  = 0.0;
+    int64_t read_us    = 0;
+#ifdef BEAN_HOST_ALTIMETER
+    double pressure_error = 0.0;
+#endif
+    bean_hal_posix_i2c_clear_stats();
+    for (int i = 0; i < samples; i++)
+    {
+        int64_t now_us = bean_hal_time_us();
+        esp_err_t ret  = bean_imu_update_accel();
+        if (ret == ESP_OK)
+            ret = bean_imu_update_gyro();
+#ifdef BEAN_HOST_ALTIMETER
+        if (ret == ESP_OK)
+            ret = bean_altimeter_update();
+#endif
+        uint8_t status = 0;
+        if (ret == ESP_OK)
+            ret = bean_imu_get_feature_status(&status);
+        struct bmi088_mm_high_g_out high_g;
+        if (ret == ESP_OK && (status & BMI088_MM_ACCEL_HIGH_G_INT))
+        {
+            ret = bean_imu_get_high_g_output(&high_g);
+            if (high_g_us < 0 && high_g.z)
+                high_g_us = now_us - flight.start_us - LAUNCH_US;
+        }
+        read_us += bean_hal_time_us() - now_us;
+        if (ret != ESP_OK)
+        {
+            fprintf(stderr, "Sample %d failed\n", i);
+            return 1;
+        }
+
+        // Away from the steps of the motion the drivers have to read back what the source gives
+        float expected[3], gyro[3];
+        imu_source(&flight, now_us, expected, gyro);
+        int64_t t_us = now_us - flight.start_us;
+        double error = fabs(get_z_accel_data() - expected[2]);
+        if (t_us < LAUNCH_US - 100000 && error > pad_error)
+            pad_error = error;
+        if (t_us > LAUNCH_US + 100000 && t_us < BURNOUT_US - 100000 && error > boost_error)
+            boost_error = error;
+        if (t_us > LAUNCH_US + 100000 && t_us < BURNOUT_US - 100000)
+            gyro_error = fmax(gyro_error, fabs(get_z_gyro_data() - gyro[2]));
+#ifdef BEAN_HOST_ALTIMETER
+        float pressure_pa, temperature_c;
+        baro_source(&flight, now_us, &pressure_pa, &temperature_c);
+        if (t_us < LAUNCH_US - 100000)
+            pressure_error = fmax(pressure_error, fabs(bean_altimeter_get_pressure() - pressure_pa));
+#endif
+
+        int64_t next_us = flight.start_us + (int64_t)(i + 1) * SAMPLE_PERIOD_MS * 1000;
+        int64_t wait_us = next_us - bean_hal_time_us();
+        if (wait_us >= 1000)
+            bean_hal_delay_ms((uint32_t)(wait_us / 1000));
+    }
+
+    printf("%d samples at %d Hz, %.1f us a sample on the host\n",
+           samples,
+           1000 / SAMPLE_PERIOD_MS,
+           (double)read_us / samples);
+    print_bus("accel", BMI088_ACC_I2C_ADDR, samples);
+    print_bus("gyro", BMI088_GYR_I2C_ADDR, samples);
+#ifdef BEAN_HOST_ALTIMETER
+    print_bus("baro", BMP390_ADDRESS, samples);
+#endif
+    printf("accel z off by %.3f m/s^2 on the pad, %.3f m/s^2 under boost, gyro z by %.3f deg/s\n",
+           pad_error,
+           boost_error,
+           gyro_error);
+#ifdef BEAN_HOST_ALTIMETER
+    printf("pressure off by %.2f Pa on the pad\n", pressure_error);
+#endif
+    if (high_g_us < 0)
+        printf("high-g never fired\n");
+    else
+        printf("high-g fired %.1f ms after the start of the boost\n", high_g_us / 1000.0);
+
+    sim_bmp390_destroy(baro);
+    sim_bmi088_destroy(imu);
+    return high_g_us < 0 ? 1 : 0;
+}
@@ -0,0 +1,194 @@
+/*
+Description: Host converter of a bean_trace file (trace.bin, crash_trace.bin) into the Chrome trace event JSON, which
+Perfetto (ui.perfetto.dev) and chrome://tracing open as a timeline.
+
+Every core is a process and every task a thread of it, the records of an interrupt are on an "isr" thread. Spans
+(sample, imu_read, log_write, flash_write, ...) become begin/end events, the others instants with their argument. With
+the task switches recorded, a "running" thread per core shows which task had the core.
+
+Usage: trace_convert <trace.bin> [trace.json]
+See the trace-json recipe of the justfile.
+*/
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "bean_trace_format.h"
+
+#define RUNNING_TID 1000 // Thread of the task switch spans, above every task id
+
+static char task_names[BEAN_TRACE_MAX_TASKS][BEAN_TRACE_TASK_NAME_LENGTH + 1];
+static bool first_event = true;
+
+// JSON has no trailing comma, so the comma goes before every event but the first
+static void next_event(FILE *out)
+{
+    if (!first_event)
+        fprintf(out, ",\n");
+    first_event = false;
+}
+
+static const char *task_name(uint8_t task)
+{
+    if (task == BEAN_TRACE_TASK_ISR)
+        return "isr";
+    if (task >= BEAN_TRACE_MAX_TASKS || task_names[task][0] == '\0')
+        return "unknown";
+    return task_names[task];
+}
+
+// The task names are from the firmware, the ones of FreeRTOS need no escaping but a corrupt file might
+static void print_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\')
+            fputc('\\', out);
+        fputc(*text >= 0x20 ? *text : '?', out);
+    }
+    fputc('"', out);
+}
+
+static void print_metadata(FILE *out, const char *kind, int pid, int tid, const char *name)
+{
+    next_event(out);
+    fprintf(out, "{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", kind, pid, tid);
+    print_string(out, name);
+    fprintf(out, "}}");
+}
+
+// The timestamps are 32 bit us, unwrapped on the way. A small step back is a writer that was preempted between
+// taking its slot and its timestamp, only a big one is a wrap.
+static uint64_t unwrap(uint64_t previous, uint32_t timestamp_us)
+{
+    uint64_t time = (previous & ~0xFFFFFFFFull) | timestamp_us;
+    if (time + 0x80000000ull < previous)
+        time += 0x100000000ull;
+    return time;
+}
+
+static void convert_core(FILE *out, int core, const bean_trace_record_t *records, uint32_t count)
+{
+    bool running       = false;
+    uint8_t running_id = 0;
+    uint64_t since_us  = 0;
+    uint64_t time_us   = count > 0 ? records[0].timestamp_us : 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        const bean_trace_record_t *record = &records[i];
+        bean_trace_event_t event          = (bean_trace_event_t)record->event;
+        time_us                           = unwrap(time_us, record->timestamp_us);
+
+        if (event == BEAN_TRACE_TASK_SWITCH)
+        {
+            if (running)
+            {
+                next_event(out);
+                fprintf(out, "{\"name\":");
+                print_string(out, task_name(running_id));
+                fprintf(out,
+                        ",\"ph\":\"X\",\"ts\":%llu,\"dur\":%llu,\"pid\":%d,\"tid\":%d}",
+                        (unsigned long long)since_us,
+                        (unsigned long long)(time_us - since_us),
+                        core,
+                        RUNNING_TID);
+            }
+            running    = true;
+            running_id = record->task;
+            since_us   = time_us;
+            continue;
+        }
+
+        char phase = bean_trace_event_phase(event);
+        next_event(out);
+        fprintf(out,
+                "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%llu,\"pid\":%d,\"tid\":%d,%s\"args\":{\"arg\":%u}}",
+                bean_trace_event_name(event),
+                phase,
+                (unsigned long long)time_us,
+                core,
+                record->task,
+                phase == 'i' ? "\"s\":\"t\"," : "",
+                record->arg);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <trace.bin> [trace.json]\n", argv[0]);
+        return 2;
+    }
+
+    FILE *in = fopen(argv[1], "rb");
+    if (!in)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+
+    bean_trace_file_header_t header;
+    if (fread(&header, sizeof(header), 1, in) != 1 || header.magic != BEAN_TRACE_FILE_MAGIC ||
+        header.version != BEAN_TRACE_FILE_VERSION || header.cores > BEAN_TRACE_MAX_CORES ||
+        header.task_count > BEAN_TRACE_MAX_TASKS || header.task_name_length != BEAN_TRACE_TASK_NAME_LENGTH)
+    {
+        fprintf(stderr, "%s: not a trace file of this version\n", argv[1]);
+        return 1;
+    }
+    for (int task = 0; task < header.task_count; task++)
+    {
+        if (fread(task_names[task], header.task_name_length, 1, in) != 1)
+        {
+            fprintf(stderr, "%s: truncated task names\n", argv[1]);
+            return 1;
+        }
+    }
+
+    FILE *out = argc > 2 ? fopen(argv[2], "w") : stdout;
+    if (!out)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    fprintf(out, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    for (int core = 0; core < header.cores; core++)
+    {
+        uint32_t count               = header.record_count[core];
+        bean_trace_record_t *records = malloc(count * sizeof(bean_trace_record_t) + 1);
+        if (!records || fread(records, sizeof(bean_trace_record_t), count, in) != count)
+        {
+            fprintf(stderr, "%s: truncated records of core %d\n", argv[1], core);
+            return 1;
+        }
+
+        char name[32];
+        snprintf(name, sizeof(name), "core %d", core);
+        print_metadata(out, "process_name", core, 0, name);
+        print_metadata(out, "thread_name", core, BEAN_TRACE_TASK_ISR, "isr");
+        print_metadata(out, "thread_name", core, RUNNING_TID, "running");
+        for (int task = 1; task < header.task_count; task++)
+        {
+            if (task_names[task][0] != '\0')
+                print_metadata(out, "thread_name", core, task, task_names[task]);
+        }
+
+        convert_core(out, core, records, count);
+        fprintf(stderr,
+                "core %d: %u records, %u older ones overwritten\n",
+                core,
+                (unsigned)count,
+                (unsigned)header.overwritten[core]);
+        free(records);
+    }
+    fprintf(out, "\n],\"otherData\":{\"crashed\":%s}}\n", header.crashed ? "true" : "false");
+
+    if (out != stdout)
+        fclose(out);
+    fclose(in);
+    return 0;
+}